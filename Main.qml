@@ -27,6 +27,18 @@ Window {
         }
     }
 
+    // 逐帧后退/前进，暂停后生效
+    Shortcut {
+        sequence: ","
+        enabled: btnPlay.enabled
+        onActivated: videoPlayer.stepFrame(-1)
+    }
+    Shortcut {
+        sequence: "."
+        enabled: btnPlay.enabled
+        onActivated: videoPlayer.stepFrame(1)
+    }
+
     // 顶部底部栏显示隐藏
     MouseArea {
         anchors.fill: parent
@@ -77,12 +89,11 @@ Window {
         id: fileDialog
         title: "打开视频"
         nameFilters: ["*.mp4", "*.avi", "*.mkv", "*"]
+        // 选择多个文件时按顺序连续播放
+        fileMode: FileDialog.OpenFiles
         onAccepted: {
-            console.log("Selected file: " + fileDialog.file)
-            if (videoPlayer.loadVideo(fileDialog.file, false)) {
-                const time = videoPlayer.getVideoTotleTime()
-                totleTimeText.text = formatTime(time)
-                playBar.to = time
+            console.log("Selected files: " + fileDialog.files)
+            if (videoPlayer.loadPlaylist(fileDialog.files, false)) {
                 // 启动定时器，获取播放时间
                 playTimeTimer.start()
                 btnPlay.enabled = true
@@ -110,6 +121,15 @@ Window {
         id: videoPlayer
         height: parent.height
         width: parent.width
+        // 打开文件时先展示第一帧，音频设备和完整的流参数随后就绪
+        fastStart: true
+
+        // 切换到播放列表的下一项时更新总时长
+        onCurrentIndexChanged: {
+            const time = videoPlayer.getVideoTotleTime()
+            totleTimeText.text = formatTime(time)
+            playBar.to = time
+        }
     }
 
     // 顶部栏
@@ -349,13 +369,86 @@ Window {
                     radius: 6
                 }
 
+                HoverHandler {
+                    id: playBarHover
+                }
+
+                // 悬停时显示预览缩略图
+                Rectangle {
+                    id: thumbnailPreview
+                    // 悬停位置对应的播放时间 单位秒
+                    readonly property real hoverTime: playBar.valueAt(Math.max(0, Math.min(1,
+                        (playBarHover.point.position.x - playBar.leftPadding) / playBar.availableWidth)))
+                    visible: playBar.enabled && playBarHover.hovered && thumbnailImage.status === Image.Ready
+                    width: thumbnailImage.width + 4
+                    height: thumbnailImage.height + thumbnailTime.height + 8
+                    x: Math.max(0, Math.min(playBar.width - width, playBarHover.point.position.x - width / 2))
+                    y: -height - 8
+                    color: "#202020"
+                    radius: 4
+
+                    Image {
+                        id: thumbnailImage
+                        x: 2
+                        y: 2
+                        width: 160
+                        height: 90
+                        fillMode: Image.PreserveAspectFit
+                        asynchronous: true
+                        // 缩略图由播放器自己缓存
+                        cache: false
+                        source: playBar.enabled && playBarHover.hovered ? videoPlayer.thumbnailUrl(Math.round(thumbnailPreview.hoverTime * 1000)) : ""
+                    }
+
+                    Text {
+                        id: thumbnailTime
+                        anchors.top: thumbnailImage.bottom
+                        anchors.topMargin: 2
+                        anchors.horizontalCenter: parent.horizontalCenter
+                        color: "#edeeee"
+                        font.pixelSize: 12
+                        text: formatTime(Math.floor(thumbnailPreview.hoverTime))
+                    }
+                }
+
                 onMoved: {
-                    if (videoPlayer.getPlayTime() === this.value) return
-                    const second = Math.floor(this.valueAt(this.position))
-                    console.log('seekToPosition: ', second)
-                    videoPlayer.seekToPosition(second)
+                    const ms = Math.round(this.valueAt(this.position) * 1000)
+                    // 拖动过程中跳到最近的关键帧，松开后精确跳转
+                    if (pressed) {
+                        videoPlayer.scrubToMs(ms)
+                    } else {
+                        videoPlayer.seekToMs(ms)
+                    }
                     playTimeTimer.start()
                 }
+
+                onPressedChanged: {
+                    if (pressed) return
+                    const ms = Math.round(this.value * 1000)
+                    console.log('seekToMs: ', ms)
+                    videoPlayer.seekToMs(ms)
+                }
+            }
+
+            // 播放速率，点击切换到下一档，右键切换到上一档；负数为倒放
+            Text {
+                id: rateText
+                property var rates: [-32, -16, -8, -4, -2, -1, 1, 2, 4, 8, 16, 32]
+                enabled: btnPlay.enabled
+                text: videoPlayer.playbackRate + 'x'
+                color: enabled ? '#FFFFFF' : '#797a7b'
+                Layout.leftMargin: 8
+
+                MouseArea {
+                    anchors.fill: parent
+                    acceptedButtons: Qt.LeftButton | Qt.RightButton
+                    onClicked: (mouse) => {
+                        const index = rateText.rates.indexOf(videoPlayer.playbackRate)
+                        const step = mouse.button === Qt.RightButton ? -1 : 1
+                        const next = Math.max(0, Math.min(rateText.rates.length - 1, index + step))
+                        videoPlayer.playbackRate = rateText.rates[next]
+                    }
+                }
             }
 
             Slider {
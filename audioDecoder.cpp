@@ -1,14 +1,40 @@
 #include "audiodecoder.h"
 #include <QDebug>
 
-AudioDecoder::AudioDecoder() {}
+extern "C" {
+#include <libavfilter/buffersink.h>
+#include <libavfilter/buffersrc.h>
+}
+
+// 队列最多容纳的packet数，实际缓存量由BufferLimits控制
+#define MAX_AUDIO_SIZE (50 * 120)
+// 音频输出中保持的待播放数据时长，即PCM环形缓冲的容量 单位微秒
+#define AUDIO_BUFFER_AHEAD 200000
+// 输出格式为S16双声道，每个采样4字节
+#define AUDIO_BYTES_PER_SAMPLE 4
+// 主时钟不是音频时，音频与主时钟偏差超过该值才调整采样数 单位微秒
+#define AUDIO_SYNC_THRESHOLD 20000
+// 偏差超过该值不再尝试同步 单位微秒
+#define AUDIO_NOSYNC_THRESHOLD (10 * AV_TIME_BASE)
+// 每帧采样数的最大调整比例 百分比
+#define AUDIO_MAX_COMPENSATION 10
+
+AudioDecoder::AudioDecoder() : DecoderBase(MAX_AUDIO_SIZE) {
+    // 音频设备取走数据后唤醒解码线程
+    m_ring.setSpaceEvent(&m_stateEvent);
+    m_pFrame = av_frame_alloc();
+}
 
 AudioDecoder::~AudioDecoder() {
     if (m_pDecCtx) avcodec_free_context(&m_pDecCtx);
     if (m_pSwrCtx) swr_free(&m_pSwrCtx);
+    av_freep(&m_pConvertBuf);
+    freeTempo();
+    av_frame_free(&m_pTempoFrame);
+    av_frame_free(&m_pFrame);
 }
 
-bool AudioDecoder::init(AVStream* stream) {
+bool AudioDecoder::init(AVStream* stream, const ThreadingConfig& threading) {
     // 保存视频流
     m_pStream = stream;
     // 获取视频流的时间基准
@@ -30,6 +56,9 @@ bool AudioDecoder::init(AVStream* stream) {
         goto end;
     }
 
+    // 设置多线程方式及线程数
+    applyThreading(codec, threading);
+
     // 打开音频解码器上下文
     if (avcodec_open2(m_pDecCtx, codec, nullptr) < 0) {
         qCritical() << "Failed to open audio codec context";
@@ -46,6 +75,13 @@ bool AudioDecoder::init(AVStream* stream) {
         goto end;
     }
 
+    // 按采样率分配PCM环形缓冲
+    {
+        const int bytesPerSecond = m_pDecCtx->sample_rate * AUDIO_BYTES_PER_SAMPLE;
+        const size_t capacity = size_t(qint64(bytesPerSecond) * AUDIO_BUFFER_AHEAD / AV_TIME_BASE) & ~size_t(AUDIO_BYTES_PER_SAMPLE - 1);
+        m_ring.reset(capacity, bytesPerSecond);
+    }
+
     return true;
 
 end:
@@ -55,104 +91,288 @@ end:
 
 void AudioDecoder::run() {
     m_bPlaying = true;
+    runLoop([this]{ return isInterruptionRequested(); });
+}
 
-    AVFrame* frame = av_frame_alloc();
-
-    // 获取当前时间
-    m_nStartTime = av_gettime();
+bool AudioDecoder::decodeStep() {
+    if (m_queue.isAborted()) return false;
 
-    AVPacket* packet = nullptr;
+    // 丢弃落后于时钟的数据
+    const qint64 skipTime = m_nSkipRequest.exchange(AV_NOPTS_VALUE);
+    if (skipTime != AV_NOPTS_VALUE) {
+        applySkip(skipTime);
+        return true;
+    }
 
-    while (1) {
-        // 发生了跳转
-        if (m_bSeekFlag) {
-            // 清除解码器上下文缓存数据
-            avcodec_flush_buffers(m_pDecCtx);
-            // 补偿时间
-            m_nStartTime -= (m_nSeekTime - m_nFrameTime);
-            // 清空跳转时间
-            m_bSeekFlag = false;
+    // 写入环形缓冲，空间不足时等待设备消耗
+    if (m_pPendingData) {
+        // 不按设备速度解码时没有音频输出，发生了跳转时数据已过期，都直接丢弃
+        if (!m_bPaced || seekPending()) {
+            clearPending();
+            if (seekPending()) m_bFiltering = false;
+            return true;
         }
+        return writePending();
+    }
 
-        // 播放暂停控制
-        while (!m_bPlaying) {
-            // 记录暂停的时间
-            qint64 stopTime = av_gettime();
-            std::unique_lock<std::mutex> lock(m_mutex);
-            m_cv.wait(lock, [this]{ return m_bPlaying; });
-            // 将暂停的时间进行补偿
-            m_nStartTime += (av_gettime() - stopTime);
+    // 取出变速滤镜的输出
+    if (m_bFiltering) {
+        if (seekPending()) {
+            m_bFiltering = false;
+        } else {
+            pullTempo();
         }
+        return true;
+    }
 
-        // 从队列中获取一个packet
-        m_mutex.lock();
-        // 无数据
-        if (m_queue.empty()) {
-            m_mutex.unlock();
-            av_usleep(1000);
-            continue;
-        }
-        packet = m_queue.front();
-        m_queue.pop_front();
-        m_mutex.unlock();
-
-        // 发生了跳转
-        if (m_bSeekFlag) {
-            av_packet_unref(packet);
-            av_packet_free(&packet);
-            continue;
+    // 接受已解码数据
+    if (m_bReceiving) {
+        if (seekPending()) {
+            finishPacket();
+        } else {
+            receiveFrame();
         }
+        return true;
+    }
 
-        // 发送一个包到解码器中解码
-        if (avcodec_send_packet(m_pDecCtx, packet) != 0) {
-            qDebug("send AVPacket to decoder failed!\n");
-            av_packet_unref(packet);
-            continue;
-        }
-        // 接受已解码数据
-        while (avcodec_receive_frame(m_pDecCtx, frame) == 0) {
-            // 计算帧的播放时间
-            qint64 pts = frame->best_effort_timestamp;
-            m_nFrameTime = av_rescale_q(pts, m_timeBase, AV_TIME_BASE_Q);
-
-            // 发生了跳转 则跳过关键帧到目的时间的这几帧
-            if (m_nFrameTime < m_nSeekTime) {
-                continue;
-            } else {
-                m_nSeekTime = -1;
-            }
-
-            // 控制播放速度
-            while(1) {
-                // 发生了跳转
-                if (m_bSeekFlag) break;
-                qint64 now = av_gettime() - m_nStartTime;
-                qint64 delay = m_nFrameTime - now;
-                qint64 sleepTime = delay > 5000 ? 5000 : delay;
-                if (sleepTime > 0) {
-                    av_usleep(sleepTime);
-                } else {
-                    break;
-                }
-            }
-            // 发生了跳转
-            if (m_bSeekFlag) break;
-
-            // 音频帧转换
-            uint8_t* out_buf = nullptr;
-            av_samples_alloc(&out_buf, nullptr, 2, frame->nb_samples, AV_SAMPLE_FMT_S16, 0);
-            int frame_count = swr_convert(m_pSwrCtx, &out_buf, frame->nb_samples, (const uint8_t**)frame->data, frame->nb_samples);
-
-            if (frame_count > 0) {
-                int out_buf_size = av_samples_get_buffer_size(nullptr, 2, frame_count, AV_SAMPLE_FMT_S16, 0);
-                QByteArray buffer(reinterpret_cast<char*>(out_buf), out_buf_size);
-                emit frameReady(buffer);
-                emit frameTimeUpdate(m_nFrameTime);
-            }
-            av_freep(&out_buf);
-        }
-        av_packet_unref(packet);
-        av_packet_free(&packet);
+    // 播放暂停控制
+    if (!m_bPlaying && !seekPending()) return false;
+
+    // 从队列中获取一个packet，无数据时等待
+    PacketQueue::Info info;
+    AVPacket* packet = m_queue.pop(&info);
+    if (!packet) return false;
+    recordMetric(MetricStage::AudioQueue, av_gettime_relative() - info.queuedTime);
+
+    // 跳转标记，清除解码器上下文缓存数据；已被更新的跳转取代的标记直接丢弃
+    if (m_queue.isFlushPacket(packet)) {
+        if (!handleFlushPacket(info)) return true;
+        // 变速在跳转时生效，滤镜中缓存的旧数据一并丢弃
+        m_bFiltering = false;
+        initTempo(m_dTempo);
+        // 音频输出丢弃旧序号的数据，音频时钟在新数据开始播放后重新校准
+        m_ring.flush(m_dGraphTempo);
+        m_pClock->audio().invalidate();
+        return true;
     }
-    av_frame_free(&frame);
+
+    // 发生了跳转，丢弃跳转前的旧数据
+    if (seekPending() || !isCurrent(info)) {
+        releasePacket(packet);
+        return true;
+    }
+
+    // 发送一个包到解码器中解码
+    const qint64 decodeStart = av_gettime_relative();
+    const int ret = avcodec_send_packet(m_pDecCtx, packet);
+    releasePacket(packet);
+    if (ret != 0) {
+        qDebug("send AVPacket to decoder failed!\n");
+        return true;
+    }
+    m_nDecodeTime = av_gettime_relative() - decodeStart;
+    m_bReceiving = true;
+    return true;
+}
+
+void AudioDecoder::receiveFrame() {
+    const qint64 decodeStart = av_gettime_relative();
+    const int ret = avcodec_receive_frame(m_pDecCtx, m_pFrame);
+    m_nDecodeTime += av_gettime_relative() - decodeStart;
+    if (ret != 0) {
+        finishPacket();
+        return;
+    }
+
+    // 计算帧的播放时间
+    qint64 pts = m_pFrame->best_effort_timestamp;
+    m_nFrameTime = av_rescale_q(pts, m_timeBase, AV_TIME_BASE_Q);
+
+    // 发生了跳转 则跳过关键帧到目的时间的这几帧
+    if (m_nFrameTime < m_nSkipUntil) {
+        return;
+    } else {
+        m_nSkipUntil = -1;
+    }
+
+    // 音频帧转换，主时钟不是音频时通过增减采样数向主时钟靠拢
+    const int wantedSamples = synchronizeSamples(m_pFrame->nb_samples);
+    if (wantedSamples != m_pFrame->nb_samples) {
+        swr_set_compensation(m_pSwrCtx, wantedSamples - m_pFrame->nb_samples, wantedSamples);
+    }
+    const int outSamples = swr_get_out_samples(m_pSwrCtx, m_pFrame->nb_samples);
+    av_fast_malloc(&m_pConvertBuf, &m_nConvertBufSize, size_t(outSamples) * AUDIO_BYTES_PER_SAMPLE);
+    if (!m_pConvertBuf) {
+        qCritical() << "Failed to allocate audio convert buffer";
+        finishPacket();
+        return;
+    }
+    const int frame_count = swr_convert(m_pSwrCtx, &m_pConvertBuf, outSamples, (const uint8_t**)m_pFrame->data, m_pFrame->nb_samples);
+    // 不按设备速度解码时没有音频输出，转换后直接丢弃
+    if (frame_count <= 0 || !m_bPaced) return;
+
+    // 写入环形缓冲，变速播放时先经过atempo滤镜
+    if (m_pFilterGraph) {
+        if (m_nTempoStartPts == AV_NOPTS_VALUE) m_nTempoStartPts = m_nFrameTime;
+        filterSamples(m_pConvertBuf, frame_count);
+    } else {
+        setPending(m_pConvertBuf, frame_count, m_nFrameTime);
+    }
+}
+
+void AudioDecoder::finishPacket() {
+    m_bReceiving = false;
+    recordMetric(MetricStage::AudioDecode, m_nDecodeTime);
+}
+
+void AudioDecoder::setPending(const uint8_t* data, int samples, qint64 pts) {
+    m_pPendingData = data;
+    m_nPendingBytes = size_t(samples) * AUDIO_BYTES_PER_SAMPLE;
+    m_nPendingWritten = 0;
+    m_nPendingPts = pts;
+}
+
+bool AudioDecoder::writePending() {
+    m_nPendingWritten += m_ring.write(reinterpret_cast<const char*>(m_pPendingData) + m_nPendingWritten, m_nPendingBytes - m_nPendingWritten,
+                                      m_nPendingPts + m_ring.toMediaTime(m_ring.bytesToUs(m_nPendingWritten)));
+    if (m_nPendingWritten < m_nPendingBytes) return false;
+    clearPending();
+    return true;
+}
+
+void AudioDecoder::clearPending() {
+    m_pPendingData = nullptr;
+    // 来自滤镜的输出写完后释放
+    if (m_pTempoFrame) av_frame_unref(m_pTempoFrame);
+}
+
+void AudioDecoder::applySkip(qint64 time) {
+    m_ring.discardBefore(time, AUDIO_BYTES_PER_SAMPLE);
+    // 待写入的数据及变速滤镜中缓存的数据紧接在环形缓冲之后，一并丢弃，之后解码出的帧按时间跳过
+    if (m_pPendingData) clearPending();
+    if (m_pFilterGraph) {
+        m_bFiltering = false;
+        initTempo(m_dGraphTempo);
+    }
+    m_nSkipUntil = qMax(m_nSkipUntil, time);
+    // 音频时钟在保留的数据开始播放后重新校准
+    m_pClock->audio().invalidate();
+}
+
+void AudioDecoder::pullTempo() {
+    // 滤镜输出的时间戳是播放设备上的时间，按已输出的采样数和速率换算回播放时间
+    if (av_buffersink_get_frame(m_pTempoSink, m_pTempoFrame) < 0) {
+        m_bFiltering = false;
+        return;
+    }
+    const qint64 pts = m_nTempoStartPts + qint64(m_nTempoSamples * m_dGraphTempo * AV_TIME_BASE / m_pDecCtx->sample_rate);
+    m_nTempoSamples += m_pTempoFrame->nb_samples;
+    setPending(m_pTempoFrame->data[0], m_pTempoFrame->nb_samples, pts);
+}
+
+bool AudioDecoder::hasWork() {
+    if (m_queue.isAborted() || m_bFiltering || m_bReceiving || m_nSkipRequest != AV_NOPTS_VALUE) return true;
+    if (m_pPendingData) return m_ring.freeSpace() > 0 || !m_bPaced || seekPending();
+    return (m_bPlaying || seekPending()) && m_queue.size() > 0;
+}
+
+qint64 AudioDecoder::outputDeadline() {
+    // 设备播放完环形缓冲中的数据之前需要新数据
+    return av_gettime_relative() + m_ring.bytesToUs(m_ring.size());
+}
+
+bool AudioDecoder::filterSamples(const uint8_t* data, int samples) {
+    // 送入滤镜的帧与重采样输出的格式一致
+    m_pTempoFrame->format = AV_SAMPLE_FMT_S16;
+    m_pTempoFrame->sample_rate = m_pDecCtx->sample_rate;
+    m_pTempoFrame->nb_samples = samples;
+    av_channel_layout_default(&m_pTempoFrame->ch_layout, 2);
+    if (av_frame_get_buffer(m_pTempoFrame, 0) < 0) {
+        av_frame_unref(m_pTempoFrame);
+        return false;
+    }
+    memcpy(m_pTempoFrame->data[0], data, size_t(samples) * AUDIO_BYTES_PER_SAMPLE);
+    if (av_buffersrc_add_frame(m_pTempoSrc, m_pTempoFrame) < 0) {
+        av_frame_unref(m_pTempoFrame);
+        return false;
+    }
+
+    m_bFiltering = true;
+    return true;
+}
+
+bool AudioDecoder::initTempo(double tempo) {
+    const int sampleRate = m_pDecCtx->sample_rate;
+    char args[256];
+    char filters[128];
+    AVFilterInOut* outputs = nullptr;
+    AVFilterInOut* inputs = nullptr;
+
+    freeTempo();
+    m_dGraphTempo = 1.0;
+    m_nTempoStartPts = AV_NOPTS_VALUE;
+    m_nTempoSamples = 0;
+    if (tempo == 1.0) return true;
+
+    if (!m_pTempoFrame) m_pTempoFrame = av_frame_alloc();
+    m_pFilterGraph = avfilter_graph_alloc();
+    snprintf(args, sizeof(args), "sample_rate=%d:sample_fmt=s16:channel_layout=stereo:time_base=1/%d", sampleRate, sampleRate);
+    if (avfilter_graph_create_filter(&m_pTempoSrc, avfilter_get_by_name("abuffer"), "in", args, nullptr, m_pFilterGraph) < 0) {
+        qCritical() << "Failed to create tempo source filter";
+        goto end;
+    }
+    if (avfilter_graph_create_filter(&m_pTempoSink, avfilter_get_by_name("abuffersink"), "out", nullptr, nullptr, m_pFilterGraph) < 0) {
+        qCritical() << "Failed to create tempo sink filter";
+        goto end;
+    }
+
+    // atempo保持音调不变地改变速度，输出仍为S16双声道
+    snprintf(filters, sizeof(filters), "atempo=%.3f,aformat=sample_fmts=s16:channel_layouts=stereo", tempo);
+    outputs = avfilter_inout_alloc();
+    inputs = avfilter_inout_alloc();
+    outputs->name = av_strdup("in");
+    outputs->filter_ctx = m_pTempoSrc;
+    outputs->pad_idx = 0;
+    outputs->next = nullptr;
+    inputs->name = av_strdup("out");
+    inputs->filter_ctx = m_pTempoSink;
+    inputs->pad_idx = 0;
+    inputs->next = nullptr;
+    if (avfilter_graph_parse_ptr(m_pFilterGraph, filters, &inputs, &outputs, nullptr) < 0
+        || avfilter_graph_config(m_pFilterGraph, nullptr) < 0) {
+        qCritical() << "Failed to configure tempo filter:" << filters;
+        goto end;
+    }
+    avfilter_inout_free(&inputs);
+    avfilter_inout_free(&outputs);
+    m_dGraphTempo = tempo;
+    return true;
+
+end:
+    avfilter_inout_free(&inputs);
+    avfilter_inout_free(&outputs);
+    freeTempo();
+    return false;
+}
+
+void AudioDecoder::freeTempo() {
+    if (m_pFilterGraph) avfilter_graph_free(&m_pFilterGraph);
+    m_pTempoSrc = nullptr;
+    m_pTempoSink = nullptr;
+}
+
+int AudioDecoder::synchronizeSamples(int nbSamples) {
+    if (m_pClock->master() == SyncMaster::Audio) return nbSamples;
+
+    Clock& master = m_pClock->masterClock();
+    if (!m_pClock->audio().isValid() || !master.isValid()) return nbSamples;
+
+    // 偏差过小无需调整，过大（如刚发生跳转）时调整采样数也无济于事
+    const qint64 diff = m_pClock->audio().get() - master.get();
+    if (qAbs(diff) < AUDIO_SYNC_THRESHOLD || qAbs(diff) > AUDIO_NOSYNC_THRESHOLD) return nbSamples;
+
+    // 音频超前则多输出采样拉长播放，落后则少输出，每帧最多调整10%
+    int wanted = nbSamples + int(diff * m_pDecCtx->sample_rate / AV_TIME_BASE);
+    const int maxDelta = nbSamples * AUDIO_MAX_COMPENSATION / 100;
+    return qBound(nbSamples - maxDelta, wanted, nbSamples + maxDelta);
 }
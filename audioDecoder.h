@@ -3,9 +3,12 @@
 
 #include <QThread>
 #include "./decoderBase.h"
+#include "clock.h"
+#include "pcmRingBuffer.h"
 
 extern "C" {
 #include <libswresample/swresample.h>
+#include <libavfilter/avfilter.h>
 }
 
 class AudioDecoder: public QThread, public DecoderBase {
@@ -14,20 +17,92 @@ public:
     AudioDecoder();
     ~AudioDecoder();
 
-    bool init(AVStream* stream);
+    bool init(AVStream* stream, const ThreadingConfig& threading = ThreadingConfig());
     inline int getSampleRate() { return m_pDecCtx->sample_rate; }
+    inline void setClock(MediaClock* clock) { m_pClock = clock; }
+    // 是否按音频输出的消耗速度解码，关闭后解码速度不受限制（无音频设备的性能测试）
+    inline void setPaced(bool paced) {
+        m_bPaced = paced;
+        m_stateEvent.notify();
+    }
+
+    // 设置变速播放的速率，保持音调不变；在下一次跳转时生效
+    inline void setTempo(double tempo) { m_dTempo = tempo; }
+
+    // 丢弃播放时间早于time的数据，包括环形缓冲中已有的及之后解码出的，不经过跳转 time单位微秒
+    // 用于快速起播时丢弃音频设备就绪前积压的、落后于外部时钟的数据
+    inline void skipTo(qint64 time) {
+        m_nSkipRequest = time;
+        m_stateEvent.notify();
+    }
+
+    // 解码输出的S16双声道PCM数据，由音频设备直接拉取
+    inline PcmRingBuffer* ring() { return &m_ring; }
+    // 当前的跳转序号，音频输出据此丢弃跳转前的数据
+    inline int serial() { return m_ring.serial(); }
 
 protected:
     void run() override;
+    bool decodeStep() override;
+    bool hasWork() override;
+    qint64 outputDeadline() override;
 
-signals:
-    void frameTimeUpdate(qint64 frameTime);
-    void frameReady(QByteArray buffer);
+private:
+    // 主时钟不是音频时，计算为追赶主时钟本帧应输出的采样数
+    int synchronizeSamples(int nbSamples);
+    // 按速率重建atempo滤镜，速率为1时不使用滤镜
+    bool initTempo(double tempo);
+    void freeTempo();
+    // 接收一帧并重采样，设为待写入的数据或送入变速滤镜；解码器中没有更多的帧时结束当前packet
+    void receiveFrame();
+    // 当前packet的帧已全部接收或因跳转放弃，记录解码耗时
+    void finishPacket();
+    // 将重采样后的数据送入变速滤镜，输出由pullTempo逐帧取出
+    bool filterSamples(const uint8_t* data, int samples);
+    // 从变速滤镜取出一帧设为待写入的数据，滤镜中没有输出时结束
+    void pullTempo();
+    // 设置待写入环形缓冲的数据，pts为第一个采样的播放时间 单位微秒
+    void setPending(const uint8_t* data, int samples, qint64 pts);
+    // 尽量写入待写入的数据，空间不足时返回false，由设备消耗后继续
+    bool writePending();
+    void clearPending();
+    // 执行skipTo的请求
+    void applySkip(qint64 time);
 
 private:
-    // 开始播放的时间 单位微秒
-    qint64 m_nStartTime = 0;
+    MediaClock* m_pClock = nullptr;
     SwrContext* m_pSwrCtx = nullptr;
+    std::atomic<bool> m_bPaced = true;
+    // 尚未执行的skipTo请求，没有时为AV_NOPTS_VALUE
+    std::atomic<qint64> m_nSkipRequest = AV_NOPTS_VALUE;
+    // 音频输出中保持的待播放数据，容量即解码领先播放的时长
+    PcmRingBuffer m_ring;
+    // 重采样输出缓冲，按需增大后重复使用
+    uint8_t* m_pConvertBuf = nullptr;
+    unsigned int m_nConvertBufSize = 0;
+    // 变速播放的速率及atempo滤镜
+    std::atomic<double> m_dTempo = 1.0;
+    double m_dGraphTempo = 1.0;
+    AVFilterGraph* m_pFilterGraph = nullptr;
+    AVFilterContext* m_pTempoSrc = nullptr;
+    AVFilterContext* m_pTempoSink = nullptr;
+    AVFrame* m_pTempoFrame = nullptr;
+    // 本次跳转后送入滤镜的第一个采样的播放时间 单位微秒，及滤镜已输出的采样数
+    qint64 m_nTempoStartPts = AV_NOPTS_VALUE;
+    qint64 m_nTempoSamples = 0;
+    // 以下只在解码线程（或线程池任务）中使用，每次decodeStep推进一步
+    AVFrame* m_pFrame = nullptr;
+    // 已发送packet，正在从解码器接收帧
+    bool m_bReceiving = false;
+    // 变速滤镜中可能还有待取出的输出
+    bool m_bFiltering = false;
+    // 当前packet的解码耗时 单位微秒，只统计send/receive本身，不含等待音频输出消耗的时间
+    qint64 m_nDecodeTime = 0;
+    // 等待写入环形缓冲的数据，指向m_pConvertBuf或m_pTempoFrame，为空表示没有
+    const uint8_t* m_pPendingData = nullptr;
+    size_t m_nPendingBytes = 0;
+    size_t m_nPendingWritten = 0;
+    qint64 m_nPendingPts = 0;
 };
 
 #endif // AUDIODECODER_H
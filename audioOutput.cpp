@@ -0,0 +1,160 @@
+#include "audioOutput.h"
+#include "decoder.h"
+#include <QDebug>
+#include <QMediaDevices>
+#include <cstring>
+
+// 检查跳转及校准时钟的间隔 单位毫秒
+#define AUDIO_CLOCK_INTERVAL 10
+// 输出格式为S16双声道，每个采样4字节
+#define AUDIO_BYTES_PER_SAMPLE 4
+
+PcmDevice::PcmDevice(PcmRingBuffer* ring, QObject* parent) : QIODevice(parent), m_pRing(ring) {}
+
+qint64 PcmDevice::bytesAvailable() const {
+    // 数据不足时以静音补齐，设备总能读到数据
+    return qMax<qint64>(m_pRing->size(), m_pRing->capacity()) + QIODevice::bytesAvailable();
+}
+
+qint64 PcmDevice::readData(char* data, qint64 maxlen) {
+    // 按整个采样读取，保持环形缓冲的读位置对齐
+    maxlen &= ~qint64(AUDIO_BYTES_PER_SAMPLE - 1);
+    qint64 len = 0;
+    if (m_pRing->serial() == m_nSerial) len = m_pRing->read(data, maxlen);
+    // 解码跟不上或刚发生跳转时输出静音，避免设备进入空闲状态
+    if (len < maxlen) memset(data + len, 0, maxlen - len);
+    m_nReadBytes += maxlen;
+    return maxlen;
+}
+
+qint64 PcmDevice::writeData(const char* data, qint64 len) {
+    Q_UNUSED(data);
+    Q_UNUSED(len);
+    return -1;
+}
+
+AudioOutput::AudioOutput(Decoder* decoder) : m_pDecoder(decoder) {
+    // 设备回调和时钟校准都在音频线程中进行
+    moveToThread(&m_thread);
+    m_thread.setObjectName("AudioOutput");
+    m_thread.start(QThread::TimeCriticalPriority);
+}
+
+AudioOutput::~AudioOutput() {
+    stop();
+}
+
+bool AudioOutput::init(int sampleRate, bool paused /* = false */) {
+    bool ok = false;
+    QMetaObject::invokeMethod(this, [this, sampleRate, paused, &ok]{
+        ok = open(sampleRate);
+        if (ok && paused) m_pAudioSink->suspend();
+    }, Qt::BlockingQueuedConnection);
+    return ok;
+}
+
+void AudioOutput::stop() {
+    if (!m_thread.isRunning()) return;
+    QMetaObject::invokeMethod(this, [this]{ close(); }, Qt::BlockingQueuedConnection);
+    m_thread.quit();
+    m_thread.wait();
+}
+
+void AudioOutput::setVolume(int volumn) {
+    QMetaObject::invokeMethod(this, [this, volumn]{
+        if (!m_pAudioSink) return;
+        qreal linearVolume = QAudio::convertVolume(volumn / qreal(100.0), QAudio::LogarithmicVolumeScale, QAudio::LinearVolumeScale);
+        m_pAudioSink->setVolume(linearVolume);
+    });
+}
+
+void AudioOutput::setPaused(bool paused) {
+    QMetaObject::invokeMethod(this, [this, paused]{
+        if (!m_pAudioSink) return;
+        if (paused) {
+            m_pAudioSink->suspend();
+        } else {
+            m_pAudioSink->resume();
+        }
+    });
+}
+
+bool AudioOutput::open(int sampleRate) {
+    QAudioFormat format;
+    // 设置音频格式参数
+    format.setSampleRate(sampleRate);
+    format.setChannelCount(2);
+    // 设置音频样本格式
+    format.setSampleFormat(QAudioFormat::Int16);
+
+    // 创建QAudioSink实例
+    m_pAudioSink = new QAudioSink(QMediaDevices::defaultAudioOutput(), format, this);
+    if (m_pAudioSink->isNull()) {
+        qWarning() << "audio sink is null, cannot play audio.";
+        return false;
+    }
+
+    // 拉取模式，设备需要数据时从环形缓冲读取
+    m_pDevice = new PcmDevice(m_pDecoder->audioBuffer(), this);
+    m_pDevice->open(QIODevice::ReadOnly);
+    m_nSerial = m_pDecoder->audioBuffer()->serial();
+    m_pDevice->setSerial(m_nSerial);
+    m_pAudioSink->start(m_pDevice);
+    if (m_pAudioSink->error() != QAudio::NoError) {
+        qWarning() << "Failed to start audio sink.";
+        return false;
+    }
+
+    m_pTimer = new QTimer(this);
+    m_pTimer->setInterval(AUDIO_CLOCK_INTERVAL);
+    m_pTimer->setTimerType(Qt::PreciseTimer);
+    connect(m_pTimer, &QTimer::timeout, this, &AudioOutput::onTimeout);
+    m_pTimer->start();
+    return true;
+}
+
+void AudioOutput::close() {
+    if (m_pTimer) m_pTimer->stop();
+    if (m_pAudioSink && !m_pAudioSink->isNull()) m_pAudioSink->stop();
+    delete m_pTimer;
+    delete m_pAudioSink;
+    delete m_pDevice;
+    m_pTimer = nullptr;
+    m_pAudioSink = nullptr;
+    m_pDevice = nullptr;
+}
+
+void AudioOutput::onTimeout() {
+    // 解码线程已经跳转，重启设备后再校准
+    const int serial = m_pDecoder->audioBuffer()->serial();
+    if (serial != m_nSerial) {
+        reset(serial);
+        return;
+    }
+    updateClock();
+}
+
+void AudioOutput::reset(int serial) {
+    m_nSerial = serial;
+    // 重启设备丢弃其中缓存的旧数据，已消耗时长从0开始计算
+    const bool suspended = m_pAudioSink->state() == QAudio::SuspendedState;
+    m_pAudioSink->stop();
+    m_pDevice->resetReadBytes();
+    m_pDevice->setSerial(serial);
+    if (!m_pDevice->isOpen()) m_pDevice->open(QIODevice::ReadOnly);
+    m_pAudioSink->start(m_pDevice);
+    if (suspended) m_pAudioSink->suspend();
+}
+
+void AudioOutput::updateClock() {
+    if (m_pAudioSink->state() == QAudio::SuspendedState) return;
+
+    // 环形缓冲中下一个待读字节的播放时间，减去已被设备读走但尚未播放的时长
+    qint64 pts = 0;
+    int serial = 0;
+    PcmRingBuffer* ring = m_pDecoder->audioBuffer();
+    if (!ring->readPosition(&pts, &serial) || serial != m_nSerial) return;
+    // 变速播放时按速率换算成播放时间
+    const qint64 buffered = ring->toMediaTime(ring->bytesToUs(m_pDevice->readBytes()) - m_pAudioSink->processedUSecs());
+    m_pDecoder->clock().audio().set(pts - qMax<qint64>(0, buffered));
+}
@@ -0,0 +1,76 @@
+#ifndef AUDIOOUTPUT_H
+#define AUDIOOUTPUT_H
+
+#include <QObject>
+#include <QAudioSink>
+#include <QIODevice>
+#include <QThread>
+#include <QTimer>
+
+class Decoder;
+class PcmRingBuffer;
+
+// 音频设备以拉取方式读取的数据源，直接从解码线程填充的PCM环形缓冲中读取
+class PcmDevice : public QIODevice {
+    Q_OBJECT
+public:
+    PcmDevice(PcmRingBuffer* ring, QObject* parent = nullptr);
+
+    bool isSequential() const override { return true; }
+    qint64 bytesAvailable() const override;
+
+    // 只读取该序号的数据，序号不一致（刚发生跳转、设备尚未重启）时输出静音
+    inline void setSerial(int serial) { m_nSerial = serial; }
+    // 设备已读取的字节数，包括静音
+    inline qint64 readBytes() const { return m_nReadBytes; }
+    inline void resetReadBytes() { m_nReadBytes = 0; }
+
+protected:
+    qint64 readData(char* data, qint64 maxlen) override;
+    qint64 writeData(const char* data, qint64 len) override;
+
+private:
+    PcmRingBuffer* m_pRing = nullptr;
+    int m_nSerial = -1;
+    qint64 m_nReadBytes = 0;
+};
+
+// 音频输出
+// QAudioSink运行在独立的线程中，以拉取方式从PCM环形缓冲读取数据，不依赖界面线程的事件循环；
+// 按设备实际消耗的数据量校准音频时钟
+class AudioOutput : public QObject {
+    Q_OBJECT
+public:
+    AudioOutput(Decoder* decoder);
+    ~AudioOutput();
+
+    // 以下接口在音频线程之外调用，实际操作在音频线程中进行
+    // paused为true时设备启动后立即暂停，预加载时提前完成设备创建
+    bool init(int sampleRate, bool paused = false);
+    void stop();
+    // 设置音量 0~100
+    void setVolume(int volumn);
+    void setPaused(bool paused);
+
+private slots:
+    // 检查跳转并更新音频时钟
+    void onTimeout();
+
+private:
+    // 在音频线程中创建并启动设备
+    bool open(int sampleRate);
+    void close();
+    // 跳转后重启设备，丢弃其中缓存的旧数据
+    void reset(int serial);
+    void updateClock();
+
+    Decoder* m_pDecoder = nullptr;
+    QThread m_thread;
+    // 以下对象在音频线程中创建和使用
+    QAudioSink* m_pAudioSink = nullptr;
+    PcmDevice* m_pDevice = nullptr;
+    QTimer* m_pTimer = nullptr;
+    int m_nSerial = -1;
+};
+
+#endif // AUDIOOUTPUT_H
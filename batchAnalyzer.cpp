@@ -0,0 +1,422 @@
+#include "batchAnalyzer.h"
+#include <QDebug>
+#include <QDir>
+#include <QImage>
+#include <QThread>
+#include <algorithm>
+#include <memory>
+
+extern "C" {
+#include <libavutil/avutil.h>
+#include <libavutil/time.h>
+}
+
+// 未指定段数时每个线程分到的段数，段越多负载越均衡，但每段开头都要重新跳转
+#define SEGMENTS_PER_THREAD 4
+// 计算亮度和场景分数用的缩小灰度图大小 单位像素
+#define THUMB_WIDTH 64
+#define THUMB_HEIGHT 36
+// 相邻段衔接处的间隔超过前一帧时长的该倍数时认为丢了帧
+#define SEGMENT_GAP_FACTOR 1.5
+
+BatchResult BatchAnalyzer::run(const QString& uri, const BatchOptions& options) {
+    BatchResult result;
+    const qint64 begin = av_gettime_relative();
+    AVFormatContext* fmtCtx = nullptr;
+    AVStream* stream = nullptr;
+    KeyframeIndex keyframeIndex;
+    std::vector<std::unique_ptr<QThread>> workers;
+    int threads = 0;
+    int decodeThreads = 1;
+
+    m_strUri = uri;
+    m_options = options;
+    m_segments.clear();
+    m_nNext = 0;
+    m_nFinished = 0;
+    m_nTotal = 0;
+    m_bCancel = false;
+
+    // 只用于取得视频流及时长，各线程另外打开
+    if (avformat_open_input(&fmtCtx, uri.toUtf8().constData(), nullptr, nullptr) != 0) {
+        result.error = "failed to open input";
+        goto end;
+    }
+    if (avformat_find_stream_info(fmtCtx, nullptr) < 0) {
+        result.error = "failed to retrieve stream info";
+        goto end;
+    }
+    m_nStreamIdx = av_find_best_stream(fmtCtx, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    if (m_nStreamIdx < 0) {
+        result.error = "no video stream";
+        goto end;
+    }
+    stream = fmtCtx->streams[m_nStreamIdx];
+    m_timeBase = stream->time_base;
+    result.duration = stream->duration != AV_NOPTS_VALUE ? av_rescale_q(stream->duration, m_timeBase, AV_TIME_BASE_Q)
+                                                        : qMax<int64_t>(0, fmtCtx->duration);
+
+    // 与播放器跳转共用关键帧索引：容器自带索引时直接读取，否则扫描一遍文件
+    keyframeIndex.build(uri, m_nStreamIdx);
+    keyframeIndex.wait();
+    result.indexTime = av_gettime_relative() - begin;
+    if (m_bCancel) {
+        result.error = "canceled";
+        goto end;
+    }
+
+    threads = options.threads > 0 ? options.threads : qMax(1, QThread::idealThreadCount());
+    planSegments(keyframeIndex.entries(), stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0,
+                 options.segments > 0 ? options.segments : threads * SEGMENTS_PER_THREAD);
+    m_nTotal = int(m_segments.size());
+    threads = qMin(threads, m_nTotal.load());
+    // 段数少于核数时（如短片段）由解码器的多线程补足
+    decodeThreads = qMax(1, QThread::idealThreadCount() / threads);
+    result.threads = threads;
+    avformat_close_input(&fmtCtx);
+
+    for (int i = 0; i < threads; ++i) {
+        workers.emplace_back(QThread::create([this, i, decodeThreads]{ workerLoop(i, decodeThreads); }));
+        workers.back()->start();
+    }
+    for (auto& worker : workers) worker->wait();
+
+    if (m_bCancel) {
+        result.error = "canceled";
+        goto end;
+    }
+    merge(result);
+
+end:
+    if (fmtCtx) avformat_close_input(&fmtCtx);
+    result.elapsed = av_gettime_relative() - begin;
+    if (!result.ok) qCritical() << "Batch analysis failed:" << result.error;
+    return result;
+}
+
+void BatchAnalyzer::planSegments(const std::vector<KeyframeIndex::Entry>& keyframes, int64_t startTimestamp, int count) {
+    // 第一段从文件开头开始，最后一段到文件末尾
+    Segment first;
+    first.timestamp = keyframes.empty() ? startTimestamp : keyframes.front().timestamp;
+    first.info.start = INT64_MIN;
+    first.info.end = INT64_MAX;
+    m_segments.push_back(first);
+    if (keyframes.empty()) return;
+
+    // 每段都从关键帧开始，解码时不需要参考前一段的数据；前一段的终点即这一段关键帧的pts，
+    // 前一段解码到读到pts晚于终点的关键帧为止，开放GOP中显示在关键帧之前的前导帧仍归前一段
+    const qint64 firstTime = keyframes.front().time;
+    const qint64 span = keyframes.back().time - firstTime;
+    size_t last = 0;
+    for (int i = 1; i < count; ++i) {
+        const qint64 target = firstTime + span * i / count;
+        const size_t index = std::lower_bound(keyframes.begin(), keyframes.end(), target,
+            [](const KeyframeIndex::Entry& e, qint64 t) { return e.time < t; }) - keyframes.begin();
+        if (index <= last || index >= keyframes.size()) continue;
+        last = index;
+        m_segments.back().info.end = keyframes[index].time;
+        Segment segment;
+        segment.timestamp = keyframes[index].timestamp;
+        segment.info.start = keyframes[index].time;
+        segment.info.end = INT64_MAX;
+        m_segments.push_back(segment);
+    }
+}
+
+void BatchAnalyzer::workerLoop(int thread, int decodeThreads) {
+    Context ctx;
+    // 打不开时剩下的段由其他线程处理
+    if (openContext(ctx, decodeThreads)) {
+        while (!m_bCancel) {
+            const int index = m_nNext.fetch_add(1);
+            if (index >= int(m_segments.size())) break;
+            processSegment(ctx, m_segments[index], thread);
+            ++m_nFinished;
+        }
+    }
+    closeContext(ctx);
+}
+
+bool BatchAnalyzer::openContext(Context& ctx, int decodeThreads) {
+    const AVCodec* codec = nullptr;
+    const AVCodecParameters* codecpar = nullptr;
+
+    ctx.fmtCtx = avformat_alloc_context();
+    ctx.fmtCtx->interrupt_callback.callback = interruptCallback;
+    ctx.fmtCtx->interrupt_callback.opaque = this;
+    if (avformat_open_input(&ctx.fmtCtx, m_strUri.toUtf8().constData(), nullptr, nullptr) != 0) {
+        qCritical() << "Batch: failed to open input";
+        goto end;
+    }
+    if (avformat_find_stream_info(ctx.fmtCtx, nullptr) < 0 || m_nStreamIdx >= int(ctx.fmtCtx->nb_streams)) {
+        qCritical() << "Batch: failed to retrieve stream info";
+        goto end;
+    }
+    // 只读取视频流
+    for (unsigned int i = 0; i < ctx.fmtCtx->nb_streams; ++i) {
+        if (int(i) != m_nStreamIdx) ctx.fmtCtx->streams[i]->discard = AVDISCARD_ALL;
+    }
+
+    codecpar = ctx.fmtCtx->streams[m_nStreamIdx]->codecpar;
+    codec = avcodec_find_decoder(codecpar->codec_id);
+    if (!codec) {
+        qCritical() << "Batch: video decoder not found";
+        goto end;
+    }
+    ctx.decCtx = avcodec_alloc_context3(codec);
+    if (avcodec_parameters_to_context(ctx.decCtx, codecpar) < 0) {
+        qCritical() << "Batch: failed to copy codec parameters";
+        goto end;
+    }
+    // packet的opaque带上压缩数据大小，随解码传到帧上
+    ctx.decCtx->flags |= AV_CODEC_FLAG_COPY_OPAQUE;
+    ctx.decCtx->thread_count = decodeThreads;
+    if (avcodec_open2(ctx.decCtx, codec, nullptr) < 0) {
+        qCritical() << "Batch: failed to open video codec";
+        goto end;
+    }
+
+    ctx.packet = av_packet_alloc();
+    ctx.frame = av_frame_alloc();
+    ctx.prev = av_frame_alloc();
+    return true;
+
+end:
+    closeContext(ctx);
+    return false;
+}
+
+void BatchAnalyzer::closeContext(Context& ctx) {
+    if (ctx.decCtx) avcodec_free_context(&ctx.decCtx);
+    if (ctx.fmtCtx) avformat_close_input(&ctx.fmtCtx);
+    if (ctx.thumbCtx) {
+        sws_freeContext(ctx.thumbCtx);
+        ctx.thumbCtx = nullptr;
+    }
+    if (ctx.imageCtx) {
+        sws_freeContext(ctx.imageCtx);
+        ctx.imageCtx = nullptr;
+    }
+    av_packet_free(&ctx.packet);
+    av_frame_free(&ctx.frame);
+    av_frame_free(&ctx.prev);
+}
+
+void BatchAnalyzer::processSegment(Context& ctx, Segment& segment, int thread) {
+    const qint64 begin = av_gettime_relative();
+    const qint64 interval = m_options.frameInterval;
+    bool draining = false;
+    bool done = false;
+
+    segment.info.thread = thread;
+    segment.failed = false;
+    segment.firstPts = AV_NOPTS_VALUE;
+    segment.lastPts = AV_NOPTS_VALUE;
+    avcodec_flush_buffers(ctx.decCtx);
+    av_frame_unref(ctx.prev);
+    ctx.hasPrev = false;
+    ctx.prevThumb.clear();
+    // 本段负责的第一个抽帧时间
+    if (interval > 0) {
+        ctx.nextTarget = segment.info.start <= 0 ? 0 : (segment.info.start + interval - 1) / interval * interval;
+    }
+
+    if (av_seek_frame(ctx.fmtCtx, m_nStreamIdx, segment.timestamp, AVSEEK_FLAG_BACKWARD) < 0) {
+        qCritical() << "Batch: seek failed, segment start:" << segment.info.start;
+        segment.failed = true;
+        return;
+    }
+
+    while (!done && !m_bCancel) {
+        if (!draining) {
+            const int ret = av_read_frame(ctx.fmtCtx, ctx.packet);
+            if (ret < 0) {
+                // 读到文件末尾，冲刷解码器
+                draining = true;
+                avcodec_send_packet(ctx.decCtx, nullptr);
+            } else if (ctx.packet->stream_index != m_nStreamIdx) {
+                av_packet_unref(ctx.packet);
+                continue;
+            } else {
+                const int64_t pts = ctx.packet->pts != AV_NOPTS_VALUE ? ctx.packet->pts : ctx.packet->dts;
+                // 已越过下一段起点之后的关键帧，本段的帧（包括参考前一个GOP的前导帧）都已送入解码器
+                if ((ctx.packet->flags & AV_PKT_FLAG_KEY) && pts != AV_NOPTS_VALUE
+                    && av_rescale_q(pts, m_timeBase, AV_TIME_BASE_Q) > segment.info.end) {
+                    draining = true;
+                    avcodec_send_packet(ctx.decCtx, nullptr);
+                } else {
+                    ctx.packet->opaque = reinterpret_cast<void*>(intptr_t(ctx.packet->size));
+                    avcodec_send_packet(ctx.decCtx, ctx.packet);
+                }
+                av_packet_unref(ctx.packet);
+            }
+        }
+
+        // 取出已解码的帧，解码器按显示时间输出，取到下一段的帧时本段结束
+        while (!done && avcodec_receive_frame(ctx.decCtx, ctx.frame) == 0) {
+            ++segment.info.decodedFrames;
+            const qint64 pts = av_rescale_q(ctx.frame->best_effort_timestamp, m_timeBase, AV_TIME_BASE_Q);
+            // 没有时间戳的帧无法确定所属的段
+            if (ctx.frame->best_effort_timestamp == AV_NOPTS_VALUE) {
+                qDebug() << "Batch: frame without timestamp dropped";
+            } else if (pts >= segment.info.end) {
+                done = true;
+            } else if (pts >= segment.info.start) {
+                handleFrame(ctx, segment, pts);
+            }
+            av_frame_unref(ctx.frame);
+        }
+        if (draining) done = true;
+    }
+
+    // 本段剩余的抽帧时间展示的都是最后一帧；最后一段到最后一帧展示完为止
+    if (interval > 0 && ctx.hasPrev) {
+        const qint64 end = segment.info.end != INT64_MAX ? segment.info.end : ctx.prevPts + qMax<qint64>(1, ctx.prevDuration);
+        for (; ctx.nextTarget < end; ctx.nextTarget += interval) {
+            takeSnapshot(ctx, segment, ctx.prev, ctx.prevPts, ctx.nextTarget);
+        }
+    }
+    segment.lastThumb = ctx.prevThumb;
+    if (ctx.hasPrev) {
+        segment.lastPts = ctx.prevPts;
+        segment.lastDuration = ctx.prevDuration;
+    }
+    segment.info.elapsed = av_gettime_relative() - begin;
+}
+
+void BatchAnalyzer::handleFrame(Context& ctx, Segment& segment, qint64 pts) {
+    // 请求的时间展示的是不晚于它的最后一帧，第一帧之前的时间取第一帧
+    const qint64 interval = m_options.frameInterval;
+    if (interval > 0) {
+        for (; ctx.nextTarget < pts && ctx.nextTarget < segment.info.end; ctx.nextTarget += interval) {
+            if (ctx.hasPrev) {
+                takeSnapshot(ctx, segment, ctx.prev, ctx.prevPts, ctx.nextTarget);
+            } else {
+                takeSnapshot(ctx, segment, ctx.frame, pts, ctx.nextTarget);
+            }
+        }
+    }
+
+    const qint64 duration = av_rescale_q(ctx.frame->duration, m_timeBase, AV_TIME_BASE_Q);
+    if (segment.firstPts == AV_NOPTS_VALUE) segment.firstPts = pts;
+    if (m_options.frameStats || m_options.sceneScores) {
+        BatchFrameInfo info;
+        info.pts = pts;
+        info.duration = duration;
+        info.pictType = av_get_picture_type_char(ctx.frame->pict_type);
+        info.keyframe = ctx.frame->flags & AV_FRAME_FLAG_KEY;
+        info.size = int(reinterpret_cast<intptr_t>(ctx.frame->opaque));
+        info.luma = makeThumb(ctx);
+        // 段首帧的分数在合并时用前一段的最后一帧计算
+        if (m_options.sceneScores && !ctx.prevThumb.empty()) info.scene = thumbDiff(ctx.prevThumb, ctx.thumb);
+        if (segment.frames.empty()) segment.firstThumb = ctx.thumb;
+        ctx.prevThumb.swap(ctx.thumb);
+        segment.frames.push_back(info);
+    }
+
+    av_frame_unref(ctx.prev);
+    av_frame_move_ref(ctx.prev, ctx.frame);
+    ctx.hasPrev = true;
+    ctx.prevPts = pts;
+    ctx.prevDuration = duration;
+}
+
+double BatchAnalyzer::makeThumb(Context& ctx) {
+    const AVFrame* frame = ctx.frame;
+    ctx.thumbCtx = sws_getCachedContext(ctx.thumbCtx,
+        frame->width, frame->height, static_cast<AVPixelFormat>(frame->format),
+        THUMB_WIDTH, THUMB_HEIGHT, AV_PIX_FMT_GRAY8,
+        SWS_AREA, nullptr, nullptr, nullptr);
+    ctx.thumb.assign(THUMB_WIDTH * THUMB_HEIGHT, 0);
+    if (!ctx.thumbCtx) return 0;
+
+    uint8_t* dst[4] = { ctx.thumb.data(), nullptr, nullptr, nullptr };
+    int dstStride[4] = { THUMB_WIDTH, 0, 0, 0 };
+    sws_scale(ctx.thumbCtx, frame->data, frame->linesize, 0, frame->height, dst, dstStride);
+    qint64 sum = 0;
+    for (uint8_t value : ctx.thumb) sum += value;
+    return double(sum) / ctx.thumb.size();
+}
+
+void BatchAnalyzer::takeSnapshot(Context& ctx, Segment& segment, const AVFrame* frame, qint64 pts, qint64 time) {
+    BatchSnapshot snapshot;
+    snapshot.time = time;
+    snapshot.pts = pts;
+
+    if (!m_options.frameDir.isEmpty()) {
+        const int width = m_options.frameWidth > 0 ? qMin(m_options.frameWidth, frame->width) : frame->width;
+        const int height = qMax(2, int(qint64(frame->height) * width / frame->width) & ~1);
+        ctx.imageCtx = sws_getCachedContext(ctx.imageCtx,
+            frame->width, frame->height, static_cast<AVPixelFormat>(frame->format),
+            width, height, AV_PIX_FMT_RGBA,
+            SWS_BILINEAR, nullptr, nullptr, nullptr);
+        if (ctx.imageCtx) {
+            QImage image(width, height, QImage::Format_RGBA8888);
+            uint8_t* dst[4] = { image.bits(), nullptr, nullptr, nullptr };
+            int dstStride[4] = { int(image.bytesPerLine()), 0, 0, 0 };
+            sws_scale(ctx.imageCtx, frame->data, frame->linesize, 0, frame->height, dst, dstStride);
+            // 文件名为请求时间 单位毫秒，按名称排序即按时间排序
+            const QString path = QDir(m_options.frameDir).filePath(
+                QString("frame_%1.%2").arg(time / 1000, 9, 10, QChar('0')).arg(m_options.frameFormat));
+            if (image.save(path)) {
+                snapshot.path = path;
+            } else {
+                qWarning() << "Batch: failed to save" << path;
+            }
+        }
+    }
+    segment.snapshots.push_back(snapshot);
+}
+
+void BatchAnalyzer::merge(BatchResult& result) {
+    const std::vector<uint8_t>* lastThumb = nullptr;
+    const Segment* previous = nullptr;
+    for (Segment& segment : m_segments) {
+        if (segment.info.thread == -1) {
+            result.error = "segment not processed";
+            return;
+        }
+        if (segment.failed) {
+            result.error = QString("seek failed for segment at %1 ms").arg(segment.info.start / 1000);
+            return;
+        }
+        // 相邻段的帧时间必须递增且衔接，重叠或间隔超过一帧说明段的边界与解码输出的帧时间不一致
+        if (segment.firstPts != AV_NOPTS_VALUE) {
+            if (previous) {
+                const qint64 gap = segment.firstPts - previous->lastPts;
+                const qint64 maxGap = qint64(previous->lastDuration * SEGMENT_GAP_FACTOR);
+                if (gap <= 0 || (previous->lastDuration > 0 && gap > maxGap)) {
+                    result.error = QString("frames not contiguous at %1 ms: previous frame %2 ms, next frame %3 ms")
+                        .arg(segment.info.start / 1000).arg(previous->lastPts / 1000).arg(segment.firstPts / 1000);
+                    return;
+                }
+            }
+            previous = &segment;
+        }
+        // 段首帧与前一段最后一帧比较
+        if (m_options.sceneScores && !segment.frames.empty() && lastThumb && !lastThumb->empty()) {
+            segment.frames.front().scene = thumbDiff(*lastThumb, segment.firstThumb);
+        }
+        if (!segment.lastThumb.empty()) lastThumb = &segment.lastThumb;
+
+        // 第一段和最后一段的边界以文件首尾表示
+        BatchSegmentInfo info = segment.info;
+        if (info.start == INT64_MIN) info.start = 0;
+        if (info.end == INT64_MAX) info.end = qMax(info.start, result.duration);
+        result.segments.push_back(info);
+        result.frames.insert(result.frames.end(), segment.frames.begin(), segment.frames.end());
+        result.snapshots.insert(result.snapshots.end(), segment.snapshots.begin(), segment.snapshots.end());
+    }
+    result.ok = true;
+}
+
+double BatchAnalyzer::thumbDiff(const std::vector<uint8_t>& a, const std::vector<uint8_t>& b) {
+    if (a.empty() || a.size() != b.size()) return -1;
+    qint64 sum = 0;
+    for (size_t i = 0; i < a.size(); ++i) sum += qAbs(int(a[i]) - int(b[i]));
+    return double(sum) / (255.0 * a.size());
+}
+
+int BatchAnalyzer::interruptCallback(void* opaque) {
+    return static_cast<BatchAnalyzer*>(opaque)->m_bCancel ? 1 : 0;
+}
@@ -0,0 +1,175 @@
+#ifndef BATCHANALYZER_H
+#define BATCHANALYZER_H
+
+#include "keyframeIndex.h"
+#include <QString>
+#include <atomic>
+#include <vector>
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+}
+
+// 批量分析选项
+struct BatchOptions {
+    // 抽帧间隔 单位微秒，为0表示不抽帧
+    qint64 frameInterval = 0;
+    // 抽出的帧保存的目录，为空时只记录时间不保存
+    QString frameDir;
+    // 保存的图片格式 jpg/png
+    QString frameFormat = "jpg";
+    // 保存的图片宽度，为0表示原始宽度，不放大
+    int frameWidth = 0;
+    // 是否记录每帧的信息
+    bool frameStats = false;
+    // 是否计算场景切换分数
+    bool sceneScores = false;
+    // 并行解码的线程数，为0表示CPU核数
+    int threads = 0;
+    // 切分的段数，为0表示线程数的若干倍；段数多于线程数时各线程的负载更均衡
+    int segments = 0;
+};
+
+// 每帧的信息
+struct BatchFrameInfo {
+    // 显示时间及时长 单位微秒
+    qint64 pts = 0;
+    qint64 duration = 0;
+    // 帧类型 I/P/B
+    char pictType = '?';
+    bool keyframe = false;
+    // 压缩数据大小 单位字节
+    int size = 0;
+    // 平均亮度 0~255
+    double luma = 0;
+    // 与前一帧的差异 0~1，第一帧及未计算时为-1
+    double scene = -1;
+};
+
+// 抽出的帧
+struct BatchSnapshot {
+    // 请求的时间，及该时间展示的帧的显示时间 单位微秒
+    qint64 time = 0;
+    qint64 pts = 0;
+    // 保存的文件，未保存时为空
+    QString path;
+};
+
+// 一段的处理情况
+struct BatchSegmentInfo {
+    // 段的起止时间 单位微秒，包含起点不包含终点
+    qint64 start = 0;
+    qint64 end = 0;
+    // 解码的帧数，包含段起点之前被丢弃的帧
+    qint64 decodedFrames = 0;
+    // 处理耗时 单位微秒
+    qint64 elapsed = 0;
+    // 处理该段的线程，未处理时为-1
+    int thread = -1;
+};
+
+struct BatchResult {
+    bool ok = false;
+    QString error;
+    // 视频流的时长 单位微秒
+    qint64 duration = 0;
+    int threads = 0;
+    // 建立关键帧索引的耗时及总耗时 单位微秒
+    qint64 indexTime = 0;
+    qint64 elapsed = 0;
+    std::vector<BatchSegmentInfo> segments;
+    // 以下均按时间排序
+    std::vector<BatchFrameInfo> frames;
+    std::vector<BatchSnapshot> snapshots;
+};
+
+// 无界面的批量抽帧与分析
+// 按关键帧把文件切分为若干段，每段在独立的线程中用独立的解复用和解码上下文解码，
+// 各段的结果按时间顺序合并；段与段之间不共享状态，处理速度随CPU核数近似线性增长
+class BatchAnalyzer {
+public:
+    BatchAnalyzer() {};
+    ~BatchAnalyzer() {};
+
+    // 分析uri中的视频流，阻塞到完成或取消
+    BatchResult run(const QString& uri, const BatchOptions& options);
+    // 取消正在进行的分析，可在任意线程调用
+    inline void cancel() { m_bCancel = true; }
+    // 已处理完的段数及总段数
+    inline int finishedSegments() const { return m_nFinished; }
+    inline int totalSegments() const { return m_nTotal; }
+
+private:
+    // 一段的范围及处理结果
+    struct Segment {
+        // 跳转用的时间戳 单位为流的时间基准
+        int64_t timestamp = 0;
+        BatchSegmentInfo info;
+        // 第一帧、最后一帧的显示时间及最后一帧的时长 单位微秒，合并时检查相邻段是否衔接，没有帧时为AV_NOPTS_VALUE
+        qint64 firstPts = AV_NOPTS_VALUE;
+        qint64 lastPts = AV_NOPTS_VALUE;
+        qint64 lastDuration = 0;
+        // 跳转失败，本段没有解码，合并时整体失败
+        bool failed = false;
+        std::vector<BatchFrameInfo> frames;
+        std::vector<BatchSnapshot> snapshots;
+        // 第一帧和最后一帧缩小后的灰度图，合并时计算段首帧的场景分数
+        std::vector<uint8_t> firstThumb;
+        std::vector<uint8_t> lastThumb;
+    };
+
+    // 每个线程独立的解复用和解码上下文
+    struct Context {
+        AVFormatContext* fmtCtx = nullptr;
+        AVCodecContext* decCtx = nullptr;
+        SwsContext* thumbCtx = nullptr;
+        SwsContext* imageCtx = nullptr;
+        AVPacket* packet = nullptr;
+        AVFrame* frame = nullptr;
+        // 上一帧，请求的时间落在它与下一帧之间时输出它
+        AVFrame* prev = nullptr;
+        bool hasPrev = false;
+        qint64 prevPts = 0;
+        qint64 prevDuration = 0;
+        // 当前帧和上一帧缩小后的灰度图
+        std::vector<uint8_t> thumb;
+        std::vector<uint8_t> prevThumb;
+        // 下一个抽帧时间 单位微秒
+        qint64 nextTarget = 0;
+    };
+
+    // 在关键帧之间按时间平均切分为最多count段，没有关键帧时只有一段；startTimestamp为流的起始时间戳。
+    // 段的边界是关键帧的显示时间（pts），与解码输出的帧时间一致
+    void planSegments(const std::vector<KeyframeIndex::Entry>& keyframes, int64_t startTimestamp, int count);
+    bool openContext(Context& ctx, int decodeThreads);
+    void closeContext(Context& ctx);
+    void workerLoop(int thread, int decodeThreads);
+    void processSegment(Context& ctx, Segment& segment, int thread);
+    // 处理一个在段范围内的帧，帧在ctx.frame中，处理后移入ctx.prev
+    void handleFrame(Context& ctx, Segment& segment, qint64 pts);
+    // 输出请求时间time展示的帧
+    void takeSnapshot(Context& ctx, Segment& segment, const AVFrame* frame, qint64 pts, qint64 time);
+    // 计算ctx.frame缩小后的灰度图，返回平均亮度
+    double makeThumb(Context& ctx);
+    // 按段的顺序合并结果，相邻段的帧不衔接时失败
+    void merge(BatchResult& result);
+
+    static int interruptCallback(void* opaque);
+    // 两张灰度图的平均差异 0~1
+    static double thumbDiff(const std::vector<uint8_t>& a, const std::vector<uint8_t>& b);
+
+    QString m_strUri;
+    BatchOptions m_options;
+    int m_nStreamIdx = -1;
+    AVRational m_timeBase = { 0, 1 };
+    std::vector<Segment> m_segments;
+    // 下一个待处理的段
+    std::atomic<int> m_nNext = 0;
+    std::atomic<int> m_nFinished = 0;
+    std::atomic<int> m_nTotal = 0;
+    std::atomic<bool> m_bCancel = false;
+};
+
+#endif // BATCHANALYZER_H
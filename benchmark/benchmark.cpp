@@ -0,0 +1,352 @@
+// 无界面的解码性能测试
+// 在本地生成测试片段，用真实的Decoder流水线解码，输出JSON格式的性能数据
+
+#include "clipGenerator.h"
+#include "decoder.h"
+#include "keyframeIndex.h"
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QThread>
+#include <algorithm>
+#include <vector>
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+// 读到文件末尾后超过该时间没有新帧展示则认为解码完成 单位毫秒
+#define IDLE_TIMEOUT 300
+// 单个片段的最长测试时间 单位毫秒
+#define CLIP_TIMEOUT (10 * 60 * 1000)
+// 轮询间隔 单位毫秒
+#define POLL_INTERVAL 5
+// 预读缓冲大小 单位字节
+#define READ_AHEAD_BYTES (16 * 1024 * 1024)
+
+// 测试选项
+struct BenchOptions {
+    // 是否按时钟展示，默认以最快速度解码
+    bool realtime = false;
+    bool useHardwareDecoder = false;
+    DecodeThreading threading = DecodeThreading::Auto;
+    // 视频帧输出格式，AV_PIX_FMT_NONE表示可渲染的YUV帧不做转换
+    AVPixelFormat outputFormat = AV_PIX_FMT_RGBA;
+    // 输出大小，为0表示保持原始分辨率
+    int outputWidth = 0;
+    int outputHeight = 0;
+    // 是否经过预读线程读取，及是否把本地文件映射到内存
+    bool readAhead = true;
+    bool useMmap = false;
+    // 是否在共享解码线程池中解码
+    bool sharedDecode = false;
+    // 是否快速起播
+    bool fastStart = false;
+};
+
+// 进程的峰值常驻内存 单位KB
+static qint64 peakRssKb() {
+#if defined(Q_OS_WIN)
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) return 0;
+    return qint64(pmc.PeakWorkingSetSize / 1024);
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#if defined(Q_OS_MACOS)
+    return qint64(usage.ru_maxrss / 1024);
+#else
+    return qint64(usage.ru_maxrss);
+#endif
+#endif
+}
+
+// 已排序样本的百分位数
+static qint64 percentile(const std::vector<qint64>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    const size_t index = std::min(sorted.size() - 1, size_t(p * (sorted.size() - 1) + 0.5));
+    return sorted[index];
+}
+
+static QJsonObject runClip(const QString& path, const BenchOptions& options) {
+    QJsonObject result;
+    Decoder decoder;
+    // 每次都完整探测，测试结果不受上一次运行留下的索引缓存影响
+    decoder.setIndexCacheEnabled(false);
+    decoder.setReadAhead(options.readAhead, READ_AHEAD_BYTES, options.useMmap);
+    decoder.setSharedDecode(options.sharedDecode);
+    decoder.setFastStart(options.fastStart);
+    if (!decoder.init(path, options.useHardwareDecoder, options.threading)) {
+        result["error"] = "decoder init failed";
+        return result;
+    }
+
+    // 没有音频设备，音频解码不限速，视频按外部时钟或不按时钟展示
+    decoder.setSyncMaster(SyncMaster::External);
+    decoder.setAudioPaced(false);
+    decoder.setVideoPaced(options.realtime);
+    decoder.setVideoOutputFormat(options.outputFormat);
+    decoder.setVideoOutputSize(options.outputWidth, options.outputHeight);
+
+    // 直接在展示线程中记录延迟，close()等待线程结束后再读取
+    std::vector<qint64> latencies;
+    QObject::connect(decoder.videoPresenter(), &VideoPresenter::framePresented, decoder.videoPresenter(),
+                     [&latencies](qint64 pts, qint64 latency) { Q_UNUSED(pts); latencies.push_back(latency); },
+                     Qt::DirectConnection);
+
+    QElapsedTimer timer;
+    timer.start();
+    decoder.start();
+
+    qint64 lastPresented = 0;
+    qint64 lastProgressTime = 0;
+    bool timedOut = false;
+    while (true) {
+        // 处理展示线程发出的帧信号，避免帧堆积在事件队列中
+        QCoreApplication::processEvents();
+        QThread::msleep(POLL_INTERVAL);
+
+        const qint64 now = timer.elapsed();
+        const qint64 presented = decoder.getPresentedFrames();
+        if (presented != lastPresented) {
+            lastPresented = presented;
+            lastProgressTime = now;
+        }
+        if (decoder.isDrained() && now - lastProgressTime > IDLE_TIMEOUT) break;
+        if (now > CLIP_TIMEOUT) {
+            timedOut = true;
+            break;
+        }
+    }
+    decoder.close();
+    QCoreApplication::processEvents();
+
+    std::sort(latencies.begin(), latencies.end());
+    const qint64 frames = decoder.getPresentedFrames();
+    const double seconds = lastProgressTime / 1000.0;
+
+    result["decoded_frames"] = decoder.getDecodedFrames();
+    result["presented_frames"] = frames;
+    result["dropped_frames"] = decoder.getDroppedFrames();
+    result["late_frames"] = decoder.getLateFrames();
+    result["decode_threads"] = decoder.getVideoDecodeThreads();
+    result["elapsed_ms"] = lastProgressTime;
+    result["decode_fps"] = seconds > 0 ? frames / seconds : 0.0;
+    result["convert_ms_per_frame"] = frames > 0 ? decoder.getConvertTime() / 1000.0 / frames : 0.0;
+    result["latency_p50_ms"] = percentile(latencies, 0.50) / 1000.0;
+    result["latency_p99_ms"] = percentile(latencies, 0.99) / 1000.0;
+    // 起播耗时：从init开始到打开、探测、打开解码器及第一帧送出展示
+    const StartupTimes startup = decoder.startupTimes();
+    result["open_ms"] = startup.opened / 1000.0;
+    result["probe_ms"] = startup.probed / 1000.0;
+    result["codec_open_ms"] = startup.codecsOpened / 1000.0;
+    result["ttff_ms"] = startup.firstFrame / 1000.0;
+    result["stages"] = decoder.metrics().toJson();
+    const IoStats io = decoder.ioStats();
+    result["io_read_mbps"] = io.readTime > 0 ? io.bytesRead / double(io.readTime) : 0.0;
+    result["io_stalls"] = io.stalls;
+    result["io_stall_ms"] = io.stallTime / 1000.0;
+    // 稳定状态下分配次数只与队列深度有关，不随帧数增长
+    const PoolStats packets = decoder.packetPoolStats();
+    const PoolStats frameShells = decoder.framePoolStats();
+    const PoolStats buffers = decoder.frameBufferStats();
+    result["packet_allocs"] = packets.allocs;
+    result["packet_reuses"] = packets.reuses;
+    result["frame_allocs"] = frameShells.allocs;
+    result["frame_reuses"] = frameShells.reuses;
+    result["frame_buffer_allocs"] = buffers.allocs;
+    result["frame_buffer_reuses"] = buffers.reuses;
+    // 进程级峰值，包含之前测试过的片段
+    result["peak_rss_kb"] = peakRssKb();
+    if (timedOut) result["error"] = "timed out";
+    return result;
+}
+
+// 校验容器自带索引与逐个扫描packet得到的关键帧一致，用于有B帧、索引记录dts的mp4
+static QJsonObject checkIndex(const QString& path) {
+    // 生成的片段中视频总是第一个流
+    KeyframeIndex containerIndex;
+    containerIndex.build(path, 0);
+    containerIndex.wait();
+    KeyframeIndex scannedIndex;
+    scannedIndex.setUseContainerIndex(false);
+    scannedIndex.build(path, 0);
+    scannedIndex.wait();
+
+    const std::vector<KeyframeIndex::Entry> expected = scannedIndex.entries();
+    const std::vector<KeyframeIndex::Entry> actual = containerIndex.entries();
+    const size_t count = std::min(expected.size(), actual.size());
+    int mismatches = int(std::max(expected.size(), actual.size()) - count);
+    for (size_t i = 0; i < count; ++i) {
+        if (expected[i].time != actual[i].time || expected[i].timestamp != actual[i].timestamp) {
+            if (mismatches == 0) {
+                qWarning() << "Index mismatch at keyframe" << i << "container time:" << actual[i].time
+                           << "scanned time:" << expected[i].time;
+            }
+            ++mismatches;
+        }
+    }
+
+    QJsonObject result;
+    result["container_index"] = containerIndex.isFromContainer();
+    result["keyframes"] = int(expected.size());
+    result["mismatches"] = mismatches;
+    result["ok"] = containerIndex.isFromContainer() && !expected.empty() && mismatches == 0;
+    return result;
+}
+
+int main(int argc, char* argv[]) {
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Headless decode benchmark for the videoPlayer pipeline");
+    parser.addHelpOption();
+    QCommandLineOption codecsOption("codecs", "Comma separated video encoders for generated clips.", "list", "h264,hevc");
+    QCommandLineOption sizesOption("sizes", "Comma separated clip resolutions.", "list", "640x360,1280x720,1920x1080,3840x2160");
+    QCommandLineOption durationOption("duration", "Clip duration in seconds.", "seconds", "10");
+    QCommandLineOption fpsOption("fps", "Clip frame rate.", "fps", "30");
+    QCommandLineOption noAudioOption("no-audio", "Generate clips without an audio stream.");
+    QCommandLineOption clipDirOption("clip-dir", "Directory for generated clips (reused between runs).", "dir",
+                                     QDir::temp().filePath("videoPlayerBench"));
+    QCommandLineOption inputOption("input", "Benchmark an existing file instead of generated clips (repeatable).", "file");
+    QCommandLineOption realtimeOption("realtime", "Pace presentation against the clock instead of running flat out.");
+    QCommandLineOption hwOption("hw", "Use the hardware decoder.");
+    QCommandLineOption threadingOption("threading", "Decode threading: auto, frame or slice.", "mode", "auto");
+    QCommandLineOption outputOption("output", "Frame output: rgba (convert every frame) or native (pass renderable YUV through).", "format", "rgba");
+    QCommandLineOption outputSizeOption("output-size", "Scale converted frames to fit WxH.", "size");
+    QCommandLineOption ioOption("io", "Demux I/O: readahead (background read-ahead thread), mmap (read-ahead from a mapped file) or direct.", "mode", "readahead");
+    QCommandLineOption sharedDecodeOption("shared-decode", "Decode on the shared decode thread pool instead of per-stream threads.");
+    QCommandLineOption fastStartOption("fast-start", "Open with a bounded probe and defer the keyframe index until the first frame.");
+    QCommandLineOption checkIndexOption("check-index", "Check that the container keyframe index of a generated MP4 with B-frames matches a packet scan.");
+    QCommandLineOption outOption("out", "Write the JSON report to a file instead of stdout.", "file");
+    parser.addOptions({ codecsOption, sizesOption, durationOption, fpsOption, noAudioOption, clipDirOption, inputOption,
+                        realtimeOption, hwOption, threadingOption, outputOption, outputSizeOption, ioOption, sharedDecodeOption,
+                        fastStartOption, checkIndexOption, outOption });
+    parser.process(app);
+
+    BenchOptions options;
+    options.realtime = parser.isSet(realtimeOption);
+    options.useHardwareDecoder = parser.isSet(hwOption);
+    const QString threading = parser.value(threadingOption);
+    if (threading == "frame") options.threading = DecodeThreading::Frame;
+    if (threading == "slice") options.threading = DecodeThreading::Slice;
+    options.outputFormat = parser.value(outputOption) == "native" ? AV_PIX_FMT_NONE : AV_PIX_FMT_RGBA;
+    options.readAhead = parser.value(ioOption) != "direct";
+    options.useMmap = parser.value(ioOption) == "mmap";
+    options.sharedDecode = parser.isSet(sharedDecodeOption);
+    options.fastStart = parser.isSet(fastStartOption);
+    if (parser.isSet(outputSizeOption)) {
+        const QStringList size = parser.value(outputSizeOption).split("x");
+        if (size.size() == 2) {
+            options.outputWidth = size[0].toInt();
+            options.outputHeight = size[1].toInt();
+        }
+    }
+
+    QJsonArray results;
+
+    // 指定了文件时只测试这些文件
+    const QStringList inputs = parser.values(inputOption);
+    for (const QString& input : inputs) {
+        qInfo() << "benchmarking" << input;
+        QJsonObject result = runClip(QFileInfo(input).absoluteFilePath(), options);
+        result["clip"] = input;
+        results.append(result);
+    }
+
+    if (inputs.isEmpty()) {
+        QDir clipDir(parser.value(clipDirOption));
+        clipDir.mkpath(".");
+
+        for (const QString& codec : parser.value(codecsOption).split(",")) {
+            for (const QString& size : parser.value(sizesOption).split(",")) {
+                const QStringList dims = size.split("x");
+                if (dims.size() != 2) continue;
+
+                ClipSpec spec;
+                spec.codec = codec;
+                spec.width = dims[0].toInt();
+                spec.height = dims[1].toInt();
+                spec.fps = parser.value(fpsOption).toInt();
+                spec.duration = parser.value(durationOption).toInt();
+                spec.audio = !parser.isSet(noAudioOption);
+
+                QJsonObject result;
+                const QString path = clipDir.filePath(ClipGenerator::clipName(spec));
+                if (!QFile::exists(path)) {
+                    qInfo() << "generating" << path;
+                    ClipGenerator generator;
+                    if (!generator.generate(spec, path)) {
+                        result["error"] = "clip generation failed";
+                    }
+                }
+                if (!result.contains("error")) {
+                    qInfo() << "benchmarking" << path;
+                    result = runClip(path, options);
+                }
+                result["clip"] = ClipGenerator::clipName(spec);
+                result["codec"] = codec;
+                result["width"] = spec.width;
+                result["height"] = spec.height;
+                results.append(result);
+            }
+        }
+    }
+
+    // 索引校验使用有B帧的h264片段
+    QJsonObject indexCheck;
+    if (parser.isSet(checkIndexOption)) {
+        QDir clipDir(parser.value(clipDirOption));
+        clipDir.mkpath(".");
+        ClipSpec spec;
+        spec.duration = parser.value(durationOption).toInt();
+        spec.fps = parser.value(fpsOption).toInt();
+        spec.audio = false;
+        spec.container = "mp4";
+        const QString path = clipDir.filePath(ClipGenerator::clipName(spec));
+        ClipGenerator generator;
+        if (!QFile::exists(path) && !generator.generate(spec, path)) {
+            indexCheck["error"] = "clip generation failed";
+            indexCheck["ok"] = false;
+        } else {
+            qInfo() << "checking keyframe index of" << path;
+            indexCheck = checkIndex(path);
+        }
+        indexCheck["clip"] = ClipGenerator::clipName(spec);
+    }
+
+    QJsonObject report;
+    report["realtime"] = options.realtime;
+    report["hardware_decoder"] = options.useHardwareDecoder;
+    report["threading"] = threading;
+    report["output"] = parser.value(outputOption);
+    report["io"] = parser.value(ioOption);
+    report["shared_decode"] = options.sharedDecode;
+    report["fast_start"] = options.fastStart;
+    report["cpu_cores"] = QThread::idealThreadCount();
+    report["peak_rss_kb"] = peakRssKb();
+    report["results"] = results;
+    if (!indexCheck.isEmpty()) report["index_check"] = indexCheck;
+
+    const QByteArray json = QJsonDocument(report).toJson();
+    if (parser.isSet(outOption)) {
+        QFile file(parser.value(outOption));
+        if (!file.open(QIODevice::WriteOnly)) {
+            qCritical() << "Failed to write report to" << parser.value(outOption);
+            return 1;
+        }
+        file.write(json);
+    } else {
+        fwrite(json.constData(), 1, json.size(), stdout);
+    }
+    return indexCheck.isEmpty() || indexCheck["ok"].toBool() ? 0 : 1;
+}
@@ -0,0 +1,256 @@
+#include "clipGenerator.h"
+#include <QDebug>
+#include <QFile>
+
+extern "C" {
+#include <libavdevice/avdevice.h>
+#include <libavutil/opt.h>
+}
+
+// 关键帧间隔 单位秒，与常见的点播码流一致，便于测试跳转
+#define CLIP_GOP_SECONDS 2
+// 测试音频的频率及采样率
+#define CLIP_SINE_FREQUENCY 440
+#define CLIP_SAMPLE_RATE 48000
+
+ClipGenerator::~ClipGenerator() {
+    release();
+}
+
+QString ClipGenerator::clipName(const ClipSpec& spec) {
+    return QString("bench_%1_%2x%3_%4fps_%5s%6.%7")
+        .arg(spec.codec).arg(spec.width).arg(spec.height).arg(spec.fps).arg(spec.duration)
+        .arg(spec.audio ? "" : "_noaudio").arg(spec.container);
+}
+
+bool ClipGenerator::generate(const ClipSpec& spec, const QString& path) {
+    // 先写入临时文件，完成后再改名，避免中断时留下不完整的片段被复用
+    const QString partPath = path + ".part";
+    AVPacket* packet = av_packet_alloc();
+    AVFrame* frame = av_frame_alloc();
+    bool ok = false;
+
+    if (!openInput(spec) || !openOutput(spec, partPath)) goto end;
+
+    while (av_read_frame(m_pInCtx, packet) == 0) {
+        if (packet->stream_index == m_nAudioInIdx && m_nAudioOutIdx != -1) {
+            // 音频为PCM，直接复制
+            AVStream* outStream = m_pOutCtx->streams[m_nAudioOutIdx];
+            av_packet_rescale_ts(packet, m_pInCtx->streams[m_nAudioInIdx]->time_base, outStream->time_base);
+            packet->stream_index = m_nAudioOutIdx;
+            packet->pos = -1;
+            if (av_interleaved_write_frame(m_pOutCtx, packet) < 0) {
+                qCritical() << "Failed to write audio packet";
+                goto end;
+            }
+        } else if (packet->stream_index == m_nVideoInIdx) {
+            if (avcodec_send_packet(m_pDecCtx, packet) < 0) {
+                qCritical() << "Failed to decode test pattern";
+                goto end;
+            }
+            while (avcodec_receive_frame(m_pDecCtx, frame) == 0) {
+                if (!encodeFrame(frame)) goto end;
+            }
+        }
+        av_packet_unref(packet);
+    }
+
+    // 冲刷编码器中缓存的帧
+    if (!encodeFrame(nullptr)) goto end;
+    if (av_write_trailer(m_pOutCtx) < 0) {
+        qCritical() << "Failed to write clip trailer";
+        goto end;
+    }
+    ok = true;
+
+end:
+    av_packet_free(&packet);
+    av_frame_free(&frame);
+    release();
+    if (ok) {
+        QFile::remove(path);
+        ok = QFile::rename(partPath, path);
+    } else {
+        QFile::remove(partPath);
+    }
+    return ok;
+}
+
+bool ClipGenerator::openInput(const ClipSpec& spec) {
+    avdevice_register_all();
+    const AVInputFormat* lavfi = av_find_input_format("lavfi");
+    if (!lavfi) {
+        qCritical() << "lavfi input device not available";
+        return false;
+    }
+
+    // 一个滤镜图同时输出画面和声音
+    QString graph = QString("testsrc2=size=%1x%2:rate=%3:duration=%4[out0]")
+        .arg(spec.width).arg(spec.height).arg(spec.fps).arg(spec.duration);
+    if (spec.audio) {
+        graph += QString(";sine=frequency=%1:sample_rate=%2:duration=%3[out1]")
+            .arg(CLIP_SINE_FREQUENCY).arg(CLIP_SAMPLE_RATE).arg(spec.duration);
+    }
+
+    if (avformat_open_input(&m_pInCtx, graph.toUtf8().constData(), lavfi, nullptr) != 0) {
+        qCritical() << "Failed to open lavfi graph" << graph;
+        return false;
+    }
+    if (avformat_find_stream_info(m_pInCtx, nullptr) < 0) {
+        qCritical() << "Failed to retrieve lavfi stream info";
+        return false;
+    }
+
+    for (unsigned int i = 0; i < m_pInCtx->nb_streams; ++i) {
+        const auto codec_type = m_pInCtx->streams[i]->codecpar->codec_type;
+        if (m_nVideoInIdx == -1 && codec_type == AVMEDIA_TYPE_VIDEO) m_nVideoInIdx = i;
+        if (m_nAudioInIdx == -1 && codec_type == AVMEDIA_TYPE_AUDIO) m_nAudioInIdx = i;
+    }
+    if (m_nVideoInIdx == -1) {
+        qCritical() << "lavfi graph has no video output";
+        return false;
+    }
+
+    // testsrc2输出的是原始画面，用rawvideo解码器取帧
+    const AVCodecParameters* codecpar = m_pInCtx->streams[m_nVideoInIdx]->codecpar;
+    const AVCodec* decoder = avcodec_find_decoder(codecpar->codec_id);
+    m_pDecCtx = avcodec_alloc_context3(decoder);
+    if (!decoder || avcodec_parameters_to_context(m_pDecCtx, codecpar) < 0 || avcodec_open2(m_pDecCtx, decoder, nullptr) < 0) {
+        qCritical() << "Failed to open test pattern decoder";
+        return false;
+    }
+    return true;
+}
+
+bool ClipGenerator::openOutput(const ClipSpec& spec, const QString& path) {
+    // 先按编码器名称查找，再按编码格式名称查找
+    const QByteArray codecName = spec.codec.toUtf8();
+    const AVCodec* encoder = avcodec_find_encoder_by_name(codecName.constData());
+    if (!encoder) {
+        const AVCodecDescriptor* desc = avcodec_descriptor_get_by_name(codecName.constData());
+        if (desc) encoder = avcodec_find_encoder(desc->id);
+    }
+    if (!encoder) {
+        qCritical() << "Video encoder not found:" << spec.codec;
+        return false;
+    }
+
+    const char* formatName = spec.container == "mp4" ? "mp4" : "matroska";
+    if (avformat_alloc_output_context2(&m_pOutCtx, nullptr, formatName, path.toUtf8().constData()) < 0) {
+        qCritical() << "Failed to allocate output context";
+        return false;
+    }
+
+    // 视频编码器，优先使用YUV420P
+    m_pEncCtx = avcodec_alloc_context3(encoder);
+    m_pEncCtx->width = spec.width;
+    m_pEncCtx->height = spec.height;
+    m_pEncCtx->time_base = AVRational{ 1, spec.fps };
+    m_pEncCtx->framerate = AVRational{ spec.fps, 1 };
+    m_pEncCtx->gop_size = spec.fps * CLIP_GOP_SECONDS;
+    m_pEncCtx->pix_fmt = AV_PIX_FMT_YUV420P;
+    if (encoder->pix_fmts) {
+        m_pEncCtx->pix_fmt = encoder->pix_fmts[0];
+        for (const AVPixelFormat* fmt = encoder->pix_fmts; *fmt != AV_PIX_FMT_NONE; ++fmt) {
+            if (*fmt == AV_PIX_FMT_YUV420P) m_pEncCtx->pix_fmt = AV_PIX_FMT_YUV420P;
+        }
+    }
+    if (m_pOutCtx->oformat->flags & AVFMT_GLOBALHEADER) m_pEncCtx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+
+    // 生成片段只求快，编码器不认识的选项会被忽略
+    AVDictionary* options = nullptr;
+    av_dict_set(&options, "preset", "veryfast", 0);
+    av_dict_set(&options, "cpu-used", "8", 0);
+    const int ret = avcodec_open2(m_pEncCtx, encoder, &options);
+    av_dict_free(&options);
+    if (ret < 0) {
+        qCritical() << "Failed to open video encoder:" << spec.codec;
+        return false;
+    }
+
+    AVStream* videoStream = avformat_new_stream(m_pOutCtx, nullptr);
+    avcodec_parameters_from_context(videoStream->codecpar, m_pEncCtx);
+    videoStream->time_base = m_pEncCtx->time_base;
+    m_nVideoOutIdx = videoStream->index;
+
+    if (m_nAudioInIdx != -1) {
+        AVStream* audioStream = avformat_new_stream(m_pOutCtx, nullptr);
+        avcodec_parameters_copy(audioStream->codecpar, m_pInCtx->streams[m_nAudioInIdx]->codecpar);
+        audioStream->codecpar->codec_tag = 0;
+        audioStream->time_base = m_pInCtx->streams[m_nAudioInIdx]->time_base;
+        m_nAudioOutIdx = audioStream->index;
+    }
+
+    if (avio_open(&m_pOutCtx->pb, path.toUtf8().constData(), AVIO_FLAG_WRITE) < 0) {
+        qCritical() << "Failed to open clip for writing:" << path;
+        return false;
+    }
+    if (avformat_write_header(m_pOutCtx, nullptr) < 0) {
+        qCritical() << "Failed to write clip header";
+        return false;
+    }
+
+    m_pEncFrame = av_frame_alloc();
+    m_pEncFrame->format = m_pEncCtx->pix_fmt;
+    m_pEncFrame->width = spec.width;
+    m_pEncFrame->height = spec.height;
+    if (av_frame_get_buffer(m_pEncFrame, 0) < 0) {
+        qCritical() << "Failed to allocate encoder frame";
+        return false;
+    }
+    m_pEncPacket = av_packet_alloc();
+    return true;
+}
+
+bool ClipGenerator::encodeFrame(AVFrame* frame) {
+    AVFrame* encFrame = nullptr;
+    if (frame) {
+        // 编码器可能仍引用上一帧的缓冲
+        if (av_frame_make_writable(m_pEncFrame) < 0) return false;
+        m_pSwsCtx = sws_getCachedContext(m_pSwsCtx,
+            frame->width, frame->height, static_cast<AVPixelFormat>(frame->format),
+            m_pEncCtx->width, m_pEncCtx->height, m_pEncCtx->pix_fmt,
+            SWS_BILINEAR, nullptr, nullptr, nullptr);
+        if (!m_pSwsCtx) {
+            qCritical() << "Failed to initialize the conversion context";
+            return false;
+        }
+        sws_scale(m_pSwsCtx, frame->data, frame->linesize, 0, frame->height, m_pEncFrame->data, m_pEncFrame->linesize);
+        m_pEncFrame->pts = m_nFrameCount++;
+        encFrame = m_pEncFrame;
+    }
+
+    if (avcodec_send_frame(m_pEncCtx, encFrame) < 0) {
+        qCritical() << "Failed to encode frame";
+        return false;
+    }
+    AVStream* outStream = m_pOutCtx->streams[m_nVideoOutIdx];
+    while (avcodec_receive_packet(m_pEncCtx, m_pEncPacket) == 0) {
+        av_packet_rescale_ts(m_pEncPacket, m_pEncCtx->time_base, outStream->time_base);
+        m_pEncPacket->stream_index = m_nVideoOutIdx;
+        if (av_interleaved_write_frame(m_pOutCtx, m_pEncPacket) < 0) {
+            qCritical() << "Failed to write video packet";
+            return false;
+        }
+    }
+    return true;
+}
+
+void ClipGenerator::release() {
+    if (m_pOutCtx) {
+        if (m_pOutCtx->pb) avio_closep(&m_pOutCtx->pb);
+        avformat_free_context(m_pOutCtx);
+        m_pOutCtx = nullptr;
+    }
+    if (m_pInCtx) avformat_close_input(&m_pInCtx);
+    if (m_pDecCtx) avcodec_free_context(&m_pDecCtx);
+    if (m_pEncCtx) avcodec_free_context(&m_pEncCtx);
+    if (m_pSwsCtx) {
+        sws_freeContext(m_pSwsCtx);
+        m_pSwsCtx = nullptr;
+    }
+    av_frame_free(&m_pEncFrame);
+    av_packet_free(&m_pEncPacket);
+    m_nVideoInIdx = m_nAudioInIdx = m_nVideoOutIdx = m_nAudioOutIdx = -1;
+    m_nFrameCount = 0;
+}
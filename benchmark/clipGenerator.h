@@ -0,0 +1,60 @@
+#ifndef CLIPGENERATOR_H
+#define CLIPGENERATOR_H
+
+#include <QString>
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+}
+
+// 测试片段参数
+struct ClipSpec {
+    // 视频编码器名称或编码格式名称，如h264、hevc、mpeg4、libaom-av1
+    QString codec = "h264";
+    int width = 1280;
+    int height = 720;
+    int fps = 30;
+    // 时长 单位秒
+    int duration = 10;
+    // 是否包含音频流
+    bool audio = true;
+    // 封装格式，mkv或mp4；mp4不支持PCM音频，需关闭音频
+    QString container = "mkv";
+};
+
+// 测试片段生成器
+// 用lavfi的testsrc2/sine生成画面和声音，视频按指定格式编码，音频为PCM，默认封装为mkv
+class ClipGenerator {
+public:
+    ClipGenerator() {};
+    ~ClipGenerator();
+
+    // 片段的文件名，相同参数的片段可以复用
+    static QString clipName(const ClipSpec& spec);
+    // 生成片段到path，编码器不可用或生成失败时返回false
+    bool generate(const ClipSpec& spec, const QString& path);
+
+private:
+    bool openInput(const ClipSpec& spec);
+    bool openOutput(const ClipSpec& spec, const QString& path);
+    // 将一帧编码并写入输出，frame为空时冲刷编码器
+    bool encodeFrame(AVFrame* frame);
+    void release();
+
+    AVFormatContext* m_pInCtx = nullptr;
+    AVFormatContext* m_pOutCtx = nullptr;
+    AVCodecContext* m_pDecCtx = nullptr;
+    AVCodecContext* m_pEncCtx = nullptr;
+    SwsContext* m_pSwsCtx = nullptr;
+    AVFrame* m_pEncFrame = nullptr;
+    AVPacket* m_pEncPacket = nullptr;
+    int m_nVideoInIdx = -1;
+    int m_nAudioInIdx = -1;
+    int m_nVideoOutIdx = -1;
+    int m_nAudioOutIdx = -1;
+    qint64 m_nFrameCount = 0;
+};
+
+#endif // CLIPGENERATOR_H
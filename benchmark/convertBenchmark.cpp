@@ -0,0 +1,203 @@
+// 颜色转换的微基准测试
+// 用合成的YUV帧对比sws_scale与YuvToRgb各指令集内核及按行并行转换的耗时，输出JSON格式的结果
+
+#include "decodeExecutor.h"
+#include "yuvToRgb.h"
+#include <QCoreApplication>
+#include <QDebug>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QThread>
+#include <algorithm>
+#include <functional>
+
+extern "C" {
+#include <libavutil/frame.h>
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
+}
+
+// 并行转换时每段的最少行数 单位行，与FrameConverter一致
+#define CONVERT_SLICE_ROWS 64
+
+namespace {
+
+// 生成带渐变和噪声的测试帧，覆盖全部取值范围
+AVFrame* makeSourceFrame(AVPixelFormat format, int width, int height) {
+    AVFrame* frame = av_frame_alloc();
+    frame->format = format;
+    frame->width = width;
+    frame->height = height;
+    frame->colorspace = AVCOL_SPC_BT709;
+    frame->color_range = AVCOL_RANGE_MPEG;
+    if (av_frame_get_buffer(frame, 64) < 0) {
+        av_frame_free(&frame);
+        return nullptr;
+    }
+    unsigned seed = 1;
+    auto noise = [&seed]{
+        seed = seed * 1103515245 + 12345;
+        return int((seed >> 16) & 0x1F);
+    };
+    for (int y = 0; y < height; ++y) {
+        uint8_t* row = frame->data[0] + y * frame->linesize[0];
+        for (int x = 0; x < width; ++x) row[x] = uint8_t(std::clamp(16 + (x * 219) / width + noise() - 16, 0, 255));
+    }
+    const int chromaWidth = (width + 1) / 2;
+    for (int y = 0; y < (height + 1) / 2; ++y) {
+        uint8_t* u = frame->data[1] + y * frame->linesize[1];
+        uint8_t* v = format == AV_PIX_FMT_NV12 ? nullptr : frame->data[2] + y * frame->linesize[2];
+        for (int x = 0; x < chromaWidth; ++x) {
+            const uint8_t cu = uint8_t(16 + (y * 224) / ((height + 1) / 2));
+            const uint8_t cv = uint8_t(16 + (x * 224) / chromaWidth);
+            if (v) {
+                u[x] = cu;
+                v[x] = cv;
+            } else {
+                u[x * 2] = cu;
+                u[x * 2 + 1] = cv;
+            }
+        }
+    }
+    return frame;
+}
+
+// 重复执行fn，返回每次的平均耗时 单位微秒
+double timeIt(int iterations, const std::function<void()>& fn) {
+    fn();
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < iterations; ++i) fn();
+    return double(timer.nsecsElapsed()) / 1000.0 / iterations;
+}
+
+// 两帧RGBA像素的最大差值
+int maxDiff(const AVFrame* a, const AVFrame* b) {
+    int diff = 0;
+    for (int y = 0; y < a->height; ++y) {
+        const uint8_t* rowA = a->data[0] + y * a->linesize[0];
+        const uint8_t* rowB = b->data[0] + y * b->linesize[0];
+        for (int x = 0; x < a->width * 4; ++x) diff = std::max(diff, std::abs(rowA[x] - rowB[x]));
+    }
+    return diff;
+}
+
+QJsonObject runCase(AVPixelFormat srcFormat, AVPixelFormat dstFormat, int width, int height, int iterations) {
+    QJsonObject result;
+    result["input"] = av_get_pix_fmt_name(srcFormat);
+    result["output"] = av_get_pix_fmt_name(dstFormat);
+    result["width"] = width;
+    result["height"] = height;
+
+    AVFrame* src = makeSourceFrame(srcFormat, width, height);
+    AVFrame* reference = av_frame_alloc();
+    AVFrame* dst = av_frame_alloc();
+    SwsContext* swsCtx = nullptr;
+    for (AVFrame* frame : { reference, dst }) {
+        frame->format = dstFormat;
+        frame->width = width;
+        frame->height = height;
+    }
+    if (!src || av_frame_get_buffer(reference, 64) < 0 || av_frame_get_buffer(dst, 64) < 0) {
+        result["error"] = "frame allocation failed";
+        goto end;
+    }
+
+    // 与FrameConverter回退路径相同的参数
+    swsCtx = sws_getContext(width, height, srcFormat, width, height, dstFormat, SWS_BILINEAR, nullptr, nullptr, nullptr);
+    if (!swsCtx) {
+        result["error"] = "sws_getContext failed";
+        goto end;
+    }
+    sws_setColorspaceDetails(swsCtx, sws_getCoefficients(SWS_CS_ITU709), 0, sws_getCoefficients(SWS_CS_ITU709), 1, 0, 1 << 16, 1 << 16);
+    {
+        const double swsUs = timeIt(iterations, [&]{
+            sws_scale(swsCtx, src->data, src->linesize, 0, height, reference->data, reference->linesize);
+        });
+        result["sws_scale_us"] = swsUs;
+
+        const SimdLevel best = YuvToRgb::detect();
+        QJsonObject kernels;
+        for (int level = int(SimdLevel::Scalar); level <= int(best); ++level) {
+            const SimdLevel simd = static_cast<SimdLevel>(level);
+            QJsonObject kernel;
+            kernel["us"] = timeIt(iterations, [&]{ YuvToRgb::convertRows(src, dst, 0, height, simd); });
+            kernel["max_diff_vs_sws"] = maxDiff(reference, dst);
+            kernels[YuvToRgb::levelName(simd)] = kernel;
+        }
+        result["kernels"] = kernels;
+
+        const int slices = qBound(1, height / CONVERT_SLICE_ROWS, QThread::idealThreadCount());
+        const int rowsPerSlice = ((height + slices - 1) / slices + 1) & ~1;
+        const double slicedUs = timeIt(iterations, [&]{
+            DecodeExecutor::instance().parallelFor(slices, [&](int index) {
+                YuvToRgb::convertRows(src, dst, index * rowsPerSlice, (index + 1) * rowsPerSlice, best);
+            });
+        });
+        result["slices"] = slices;
+        result["sliced_us"] = slicedUs;
+        result["sliced_max_diff_vs_sws"] = maxDiff(reference, dst);
+        result["sliced_speedup_vs_sws"] = swsUs / slicedUs;
+    }
+
+end:
+    if (swsCtx) sws_freeContext(swsCtx);
+    av_frame_free(&src);
+    av_frame_free(&reference);
+    av_frame_free(&dst);
+    return result;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Colour conversion micro-benchmark: sws_scale against the SIMD YUV to RGB kernels");
+    parser.addHelpOption();
+    QCommandLineOption sizesOption("sizes", "Comma separated frame sizes.", "list", "1280x720,1920x1080,3840x2160");
+    QCommandLineOption iterationsOption("iterations", "Conversions timed per case.", "count", "50");
+    QCommandLineOption outOption("out", "Write the JSON report to a file instead of stdout.", "file");
+    parser.addOptions({ sizesOption, iterationsOption, outOption });
+    parser.process(app);
+
+    const int iterations = qMax(1, parser.value(iterationsOption).toInt());
+    QJsonArray results;
+    for (const QString& size : parser.value(sizesOption).split(",")) {
+        const QStringList dims = size.split("x");
+        if (dims.size() != 2) continue;
+        const int width = dims[0].toInt();
+        const int height = dims[1].toInt();
+        if (width <= 0 || height <= 0) continue;
+        for (AVPixelFormat srcFormat : { AV_PIX_FMT_YUV420P, AV_PIX_FMT_NV12 }) {
+            for (AVPixelFormat dstFormat : { AV_PIX_FMT_RGBA, AV_PIX_FMT_BGRA }) {
+                qInfo() << "converting" << size << av_get_pix_fmt_name(srcFormat) << "->" << av_get_pix_fmt_name(dstFormat);
+                results.append(runCase(srcFormat, dstFormat, width, height, iterations));
+            }
+        }
+    }
+
+    QJsonObject report;
+    report["simd"] = YuvToRgb::levelName(YuvToRgb::detect());
+    report["cpu_cores"] = QThread::idealThreadCount();
+    report["iterations"] = iterations;
+    report["results"] = results;
+
+    const QByteArray json = QJsonDocument(report).toJson();
+    if (parser.isSet(outOption)) {
+        QFile file(parser.value(outOption));
+        if (!file.open(QIODevice::WriteOnly)) {
+            qCritical() << "Failed to write report to" << parser.value(outOption);
+            return 1;
+        }
+        file.write(json);
+    } else {
+        fwrite(json.constData(), 1, json.size(), stdout);
+    }
+    return 0;
+}
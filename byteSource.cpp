@@ -0,0 +1,128 @@
+#include "byteSource.h"
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+extern "C" {
+#include <libavformat/avio.h>
+#include <libavutil/error.h>
+}
+
+namespace {
+
+// 本地文件，无缓冲读取，缓冲由预读层负责
+class FileSource : public ByteSource {
+public:
+    bool open(const QString& path) {
+        m_file.setFileName(path);
+        return m_file.open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+    }
+
+    int read(uint8_t* buf, int size) override {
+        const qint64 ret = m_file.read(reinterpret_cast<char*>(buf), size);
+        return ret < 0 ? AVERROR(EIO) : int(ret);
+    }
+    bool seek(int64_t pos) override { return m_file.seek(pos); }
+    int64_t size() override { return m_file.size(); }
+    bool isSeekable() override { return true; }
+
+private:
+    QFile m_file;
+};
+
+// 映射到内存的本地文件，读取即拷贝，缺页在预读线程中发生
+class MappedFileSource : public ByteSource {
+public:
+    ~MappedFileSource() {
+        if (m_pData) m_file.unmap(m_pData);
+    }
+
+    bool open(const QString& path) {
+        m_file.setFileName(path);
+        if (!m_file.open(QIODevice::ReadOnly)) return false;
+        m_nSize = m_file.size();
+        if (m_nSize <= 0) return false;
+        m_pData = m_file.map(0, m_nSize);
+        return m_pData != nullptr;
+    }
+
+    int read(uint8_t* buf, int size) override {
+        const int64_t len = std::min<int64_t>(size, m_nSize - m_nPos);
+        if (len <= 0) return 0;
+        memcpy(buf, m_pData + m_nPos, len);
+        m_nPos += len;
+        return int(len);
+    }
+    bool seek(int64_t pos) override {
+        if (pos < 0 || pos > m_nSize) return false;
+        m_nPos = pos;
+        return true;
+    }
+    int64_t size() override { return m_nSize; }
+    bool isSeekable() override { return true; }
+
+private:
+    QFile m_file;
+    uchar* m_pData = nullptr;
+    int64_t m_nSize = 0;
+    int64_t m_nPos = 0;
+};
+
+// FFmpeg协议层，用于管道、http等非本地文件
+class AvioSource : public ByteSource {
+public:
+    ~AvioSource() {
+        if (m_pCtx) avio_closep(&m_pCtx);
+    }
+
+    bool open(const QString& uri) {
+        const AVIOInterruptCB interrupt = { &AvioSource::interruptCallback, this };
+        return avio_open2(&m_pCtx, uri.toUtf8().constData(), AVIO_FLAG_READ, &interrupt, nullptr) >= 0;
+    }
+
+    int read(uint8_t* buf, int size) override {
+        const int ret = avio_read_partial(m_pCtx, buf, size);
+        return ret == AVERROR_EOF ? 0 : ret;
+    }
+    bool seek(int64_t pos) override { return avio_seek(m_pCtx, pos, SEEK_SET) >= 0; }
+    int64_t size() override {
+        const int64_t ret = avio_size(m_pCtx);
+        return ret < 0 ? -1 : ret;
+    }
+    bool isSeekable() override { return m_pCtx->seekable & AVIO_SEEKABLE_NORMAL; }
+    void abort() override { m_bAbort = true; }
+
+private:
+    static int interruptCallback(void* opaque) {
+        return static_cast<AvioSource*>(opaque)->m_bAbort ? 1 : 0;
+    }
+
+    AVIOContext* m_pCtx = nullptr;
+    std::atomic<bool> m_bAbort = false;
+};
+
+}
+
+std::unique_ptr<ByteSource> ByteSource::create(const QString& uri, bool useMmap) {
+    const QFileInfo info(uri);
+    if (info.isFile()) {
+        if (useMmap) {
+            auto source = std::make_unique<MappedFileSource>();
+            if (source->open(uri)) return source;
+            // 映射失败（如32位进程中的大文件）时退回到普通读取
+            qWarning() << "ByteSource: mmap failed, falling back to read";
+        }
+        auto source = std::make_unique<FileSource>();
+        if (source->open(uri)) return source;
+        qWarning() << "ByteSource: failed to open file" << uri;
+        return nullptr;
+    }
+
+    auto source = std::make_unique<AvioSource>();
+    if (source->open(uri)) return source;
+    qWarning() << "ByteSource: failed to open" << uri;
+    return nullptr;
+}
@@ -0,0 +1,29 @@
+#ifndef BYTESOURCE_H
+#define BYTESOURCE_H
+
+#include <QString>
+#include <cstdint>
+#include <memory>
+
+// 字节流数据源，预读线程通过它统一访问本地文件、管道及FFmpeg支持的其他协议（http等）
+// 只在预读线程中调用，abort除外
+class ByteSource {
+public:
+    virtual ~ByteSource() {};
+
+    // 读取最多size字节，返回实际读取的字节数，到达末尾返回0，失败返回负的AVERROR
+    virtual int read(uint8_t* buf, int size) = 0;
+    // 定位到字节位置pos，不支持或失败时返回false
+    virtual bool seek(int64_t pos) = 0;
+    // 总字节数，未知时返回-1
+    virtual int64_t size() = 0;
+    virtual bool isSeekable() = 0;
+    // 中断阻塞中的读取（任意线程调用）
+    virtual void abort() {};
+
+    // 按uri创建数据源：本地文件直接读取，useMmap为true时映射到内存；其他uri交给FFmpeg的协议层（pipe:、http://等）
+    // 打开失败时返回nullptr
+    static std::unique_ptr<ByteSource> create(const QString& uri, bool useMmap);
+};
+
+#endif // BYTESOURCE_H
@@ -0,0 +1,149 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <atomic>
+#include <mutex>
+#include <QtGlobal>
+
+extern "C" {
+#include <libavutil/time.h>
+}
+
+// 播放时钟
+// 记录最近一次校准时的播放时间和系统时间，两次校准之间按系统时间乘以播放速率推算
+class Clock {
+public:
+    Clock() {};
+    ~Clock() {};
+
+    // 校准时钟 pts单位微秒
+    inline void set(qint64 pts) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_nPts = pts;
+        m_nUpdateTime = av_gettime_relative();
+        m_bValid = true;
+    }
+
+    // 当前播放时间 单位微秒，时钟无效时返回最后一次校准的值
+    inline qint64 get() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_bValid || m_bPaused) return m_nPts;
+        return m_nPts + qint64((av_gettime_relative() - m_nUpdateTime) * m_dSpeed);
+    }
+
+    // 设置播放速率，为负表示倒放；从当前时间开始按新速率推算
+    inline void setSpeed(double speed) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const qint64 now = av_gettime_relative();
+        if (m_bValid && !m_bPaused) m_nPts += qint64((now - m_nUpdateTime) * m_dSpeed);
+        m_nUpdateTime = now;
+        m_dSpeed = speed;
+    }
+
+    // 暂停时冻结时钟，恢复后从冻结的时间继续推算
+    inline void setPaused(bool paused) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (paused == m_bPaused) return;
+        const qint64 now = av_gettime_relative();
+        if (paused && m_bValid) m_nPts += qint64((now - m_nUpdateTime) * m_dSpeed);
+        m_nUpdateTime = now;
+        m_bPaused = paused;
+    }
+
+    // 使时钟失效，直到下一次校准，发生跳转时调用
+    inline void invalidate() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_bValid = false;
+    }
+
+    inline bool isValid() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_bValid;
+    }
+
+private:
+    std::mutex m_mutex;
+    qint64 m_nPts = 0;
+    qint64 m_nUpdateTime = 0;
+    double m_dSpeed = 1.0;
+    bool m_bValid = false;
+    bool m_bPaused = false;
+};
+
+// 音视频同步的主时钟来源
+enum class SyncMaster {
+    Audio,
+    Video,
+    External
+};
+
+// 一个播放实例的音频、视频和外部时钟
+class MediaClock {
+public:
+    MediaClock() {};
+    ~MediaClock() {};
+
+    inline Clock& audio() { return m_audioClock; }
+    inline Clock& video() { return m_videoClock; }
+    inline Clock& external() { return m_externalClock; }
+
+    // 设置期望的主时钟，没有对应的流时自动退回到外部时钟
+    inline void setMaster(SyncMaster master) { m_master = master; }
+    inline void setStreams(bool hasAudio, bool hasVideo) {
+        m_bHasAudio = hasAudio;
+        m_bHasVideo = hasVideo;
+    }
+
+    // 实际使用的主时钟
+    inline SyncMaster master() {
+        const SyncMaster master = m_master;
+        if (master == SyncMaster::Audio && !m_bHasAudio) return SyncMaster::External;
+        if (master == SyncMaster::Video && !m_bHasVideo) return SyncMaster::External;
+        return master;
+    }
+
+    inline Clock& masterClock() {
+        switch (master()) {
+        case SyncMaster::Audio: return m_audioClock;
+        case SyncMaster::Video: return m_videoClock;
+        default: return m_externalClock;
+        }
+    }
+
+    inline qint64 masterTime() { return masterClock().get(); }
+
+    // 音视频偏差 单位微秒，为正表示音频超前
+    inline qint64 drift() {
+        if (!m_audioClock.isValid() || !m_videoClock.isValid()) return 0;
+        return m_audioClock.get() - m_videoClock.get();
+    }
+
+    inline void setPaused(bool paused) {
+        m_audioClock.setPaused(paused);
+        m_videoClock.setPaused(paused);
+        m_externalClock.setPaused(paused);
+    }
+
+    // 设置播放速率，为负表示倒放
+    inline void setSpeed(double speed) {
+        m_dSpeed = speed;
+        m_audioClock.setSpeed(speed);
+        m_videoClock.setSpeed(speed);
+        m_externalClock.setSpeed(speed);
+    }
+    inline double speed() { return m_dSpeed; }
+
+    // 播放时间差对应的实际等待时间 单位微秒
+    inline qint64 toWallTime(qint64 mediaTime) { return qint64(mediaTime / m_dSpeed.load()); }
+
+private:
+    Clock m_audioClock;
+    Clock m_videoClock;
+    Clock m_externalClock;
+    std::atomic<SyncMaster> m_master = SyncMaster::Audio;
+    std::atomic<bool> m_bHasAudio = false;
+    std::atomic<bool> m_bHasVideo = false;
+    std::atomic<double> m_dSpeed = 1.0;
+};
+
+#endif // CLOCK_H
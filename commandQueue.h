@@ -0,0 +1,75 @@
+#ifndef COMMANDQUEUE_H
+#define COMMANDQUEUE_H
+
+#include "waitEvent.h"
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <QtGlobal>
+
+// 播放控制命令
+enum class CommandType {
+    Play,
+    Pause,
+    Seek
+};
+
+struct PlayerCommand {
+    CommandType type = CommandType::Play;
+    // 跳转时间 单位微秒
+    qint64 time = 0;
+    // 是否直接跳到最近的关键帧
+    bool fast = false;
+    // 跳转后采用的播放速率
+    double rate = 1.0;
+    // 跳转序号，每次请求跳转递增，序号不是最新的packet和帧已过期
+    int serial = 0;
+};
+
+// 播放控制命令队列
+// 界面线程入队，解复用线程在循环开始时一次取出全部命令按顺序执行；
+// 新的跳转替换队列中尚未执行的跳转，播放和暂停同样只保留最后一个，连续拖动进度条时只执行最后一次跳转
+class CommandQueue {
+public:
+    CommandQueue() {};
+    ~CommandQueue() {};
+
+    inline void push(const PlayerCommand& command) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            const bool seek = command.type == CommandType::Seek;
+            for (auto it = m_commands.begin(); it != m_commands.end();) {
+                if ((it->type == CommandType::Seek) == seek) {
+                    it = m_commands.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            m_commands.push_back(command);
+            m_nSize = m_commands.size();
+        }
+        if (m_pEvent) m_pEvent->notify();
+    }
+
+    // 取出全部命令
+    inline void takeAll(std::vector<PlayerCommand>& commands) {
+        commands.clear();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        commands.swap(m_commands);
+        m_nSize = 0;
+    }
+
+    // 不加锁，用于等待条件
+    inline bool isEmpty() const { return m_nSize.load() == 0; }
+
+    // 入队时通知该事件，解复用线程通过它等待
+    inline void setEvent(WaitEvent* event) { m_pEvent = event; }
+
+private:
+    std::mutex m_mutex;
+    std::vector<PlayerCommand> m_commands;
+    std::atomic<size_t> m_nSize = 0;
+    WaitEvent* m_pEvent = nullptr;
+};
+
+#endif // COMMANDQUEUE_H
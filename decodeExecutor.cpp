@@ -0,0 +1,193 @@
+#include "decodeExecutor.h"
+
+extern "C" {
+#include <libavutil/time.h>
+}
+
+// 当前线程在线程池中的序号，不是工作线程时为-1
+static thread_local int s_nWorkerIndex = -1;
+
+void ExecutorTask::wake() {
+    int state = m_nState.load();
+    while (true) {
+        if (state & Canceled) return;
+        if (state == Idle) {
+            if (m_nState.compare_exchange_weak(state, Queued)) {
+                m_pExecutor->enqueue(shared_from_this());
+                return;
+            }
+        } else if (state == Running) {
+            // 由执行它的工作线程在本次执行结束后重新入队
+            if (m_nState.compare_exchange_weak(state, Rerun)) return;
+        } else {
+            // 已在队列中
+            return;
+        }
+    }
+}
+
+void ExecutorTask::cancel() {
+    m_nState.fetch_or(Canceled);
+    m_pExecutor->m_doneEvent.wait([this]{
+        const int state = m_nState.load() & ~Canceled;
+        return state != Running && state != Rerun;
+    });
+}
+
+DecodeExecutor::DecodeExecutor() {
+
+}
+
+DecodeExecutor::~DecodeExecutor() {
+    stop();
+}
+
+DecodeExecutor& DecodeExecutor::instance() {
+    static DecodeExecutor executor;
+    return executor;
+}
+
+ExecutorTaskPtr DecodeExecutor::createTask(std::function<bool()> slice, int priority /* = 0 */) {
+    start();
+    ExecutorTaskPtr task = std::make_shared<ExecutorTask>(this, std::move(slice));
+    task->setPriority(priority);
+    return task;
+}
+
+void DecodeExecutor::parallelFor(int count, std::function<void(int)> fn, int priority /* = 0 */) {
+    if (count <= 0) return;
+    if (count == 1) {
+        fn(0);
+        return;
+    }
+    start();
+
+    // 由调用线程和辅助任务共同领取，辅助任务可能在全部完成后才被调度，此时领取不到直接结束
+    struct Job {
+        std::function<void(int)> fn;
+        int count = 0;
+        std::atomic<int> next = 0;
+        std::atomic<int> done = 0;
+        WaitEvent doneEvent;
+    };
+    auto job = std::make_shared<Job>();
+    job->fn = std::move(fn);
+    job->count = count;
+    auto work = [job]{
+        int index;
+        while ((index = job->next.fetch_add(1)) < job->count) {
+            job->fn(index);
+            if (job->done.fetch_add(1) + 1 == job->count) job->doneEvent.notify();
+        }
+        return false;
+    };
+
+    const int helpers = qMin(count - 1, threadCount());
+    const qint64 deadline = av_gettime_relative();
+    for (int i = 0; i < helpers; ++i) {
+        ExecutorTaskPtr task = createTask(work, priority);
+        task->setDeadline(deadline);
+        task->wake();
+    }
+    work();
+    job->doneEvent.wait([&job]{ return job->done == job->count; });
+}
+
+void DecodeExecutor::start() {
+    if (m_bStarted) return;
+    std::lock_guard<std::mutex> lock(m_startMutex);
+    if (m_bStarted) return;
+    const int count = qMax(1, QThread::idealThreadCount());
+    for (int i = 0; i < count; ++i) m_workers.push_back(std::make_unique<Worker>());
+    for (int i = 0; i < count; ++i) {
+        m_workers[i]->thread = QThread::create([this, i]{ workerLoop(i); });
+        m_workers[i]->thread->start();
+    }
+    m_bStarted = true;
+}
+
+void DecodeExecutor::stop() {
+    if (!m_bStarted) return;
+    m_bStop = true;
+    m_workEvent.notify();
+    for (const auto& worker : m_workers) {
+        worker->thread->wait();
+        delete worker->thread;
+        worker->queue.clear();
+    }
+    m_workers.clear();
+    m_bStarted = false;
+}
+
+void DecodeExecutor::enqueue(ExecutorTaskPtr task) {
+    if (m_workers.empty()) return;
+    // 工作线程中唤醒的任务留在本线程，数据仍在缓存中；其他线程唤醒的轮流分配
+    int index = s_nWorkerIndex;
+    if (index < 0) index = int(m_nNextWorker.fetch_add(1) % m_workers.size());
+    {
+        Worker& worker = *m_workers[index];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.queue.push_back(std::move(task));
+    }
+    ++m_nQueued;
+    m_workEvent.notify();
+}
+
+ExecutorTaskPtr DecodeExecutor::takeBest(int index) {
+    Worker& worker = *m_workers[index];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if (worker.queue.empty()) return nullptr;
+    auto best = worker.queue.begin();
+    for (auto it = worker.queue.begin() + 1; it != worker.queue.end(); ++it) {
+        const int priority = (*it)->priority();
+        if (priority > (*best)->priority()
+            || (priority == (*best)->priority() && (*it)->deadline() < (*best)->deadline())) {
+            best = it;
+        }
+    }
+    ExecutorTaskPtr task = std::move(*best);
+    worker.queue.erase(best);
+    --m_nQueued;
+    return task;
+}
+
+void DecodeExecutor::workerLoop(int index) {
+    s_nWorkerIndex = index;
+    const int count = int(m_workers.size());
+    while (!m_bStop) {
+        ExecutorTaskPtr task = takeBest(index);
+        // 自己的队列为空，从其他线程的队列中窃取
+        for (int i = 1; !task && i < count; ++i) {
+            task = takeBest((index + i) % count);
+            if (task) ++m_nSteals;
+        }
+        if (!task) {
+            m_workEvent.wait([this]{ return m_nQueued > 0 || m_bStop; });
+            continue;
+        }
+        runTask(task);
+    }
+}
+
+void DecodeExecutor::runTask(const ExecutorTaskPtr& task) {
+    // 入队后被取消的任务不再执行
+    int state = ExecutorTask::Queued;
+    if (!task->m_nState.compare_exchange_strong(state, ExecutorTask::Running)) return;
+
+    const bool more = task->m_fnSlice();
+
+    state = task->m_nState.load();
+    while (true) {
+        if (state & ExecutorTask::Canceled) {
+            task->m_nState = ExecutorTask::Canceled;
+            break;
+        }
+        // 时间片用完或执行期间被唤醒时重新入队，否则等待下一次唤醒
+        const bool requeue = more || state == ExecutorTask::Rerun;
+        if (task->m_nState.compare_exchange_weak(state, requeue ? ExecutorTask::Queued : ExecutorTask::Idle)) {
+            if (requeue) enqueue(task);
+            break;
+        }
+    }
+    m_doneEvent.notify();
+}
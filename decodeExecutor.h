@@ -0,0 +1,111 @@
+#ifndef DECODEEXECUTOR_H
+#define DECODEEXECUTOR_H
+
+#include "waitEvent.h"
+#include <QThread>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class DecodeExecutor;
+
+// 线程池中的一个可重复调度的任务
+// 同一任务不会被两个工作线程同时执行；执行期间被唤醒时，本次执行结束后立即重新入队，不会丢失唤醒
+class ExecutorTask : public std::enable_shared_from_this<ExecutorTask> {
+public:
+    // slice执行一段工作，返回true表示还有工作、只是用完了时间片，返回false表示暂时无事可做，等待wake
+    ExecutorTask(DecodeExecutor* executor, std::function<bool()> slice) : m_pExecutor(executor), m_fnSlice(std::move(slice)) {};
+    ~ExecutorTask() {};
+
+    // 条件发生变化后调用，可在任意线程调用
+    void wake();
+    // 不再调度该任务，正在执行时等待其结束；之后slice不会再被调用，不能在slice中调用
+    void cancel();
+
+    // 优先级，数值大的先执行
+    inline void setPriority(int priority) { m_nPriority = priority; }
+    inline int priority() const { return m_nPriority; }
+    // 截止时间，即输出队列将被取空的系统时间 单位微秒；优先级相同时截止时间早的先执行
+    inline void setDeadline(qint64 deadline) { m_nDeadline = deadline; }
+    inline qint64 deadline() const { return m_nDeadline; }
+
+private:
+    friend class DecodeExecutor;
+
+    // 调度状态，Canceled位与其余状态组合
+    enum State {
+        Idle = 0,
+        Queued = 1,
+        Running = 2,
+        // 执行期间被唤醒
+        Rerun = 3,
+        Canceled = 4
+    };
+
+    DecodeExecutor* m_pExecutor = nullptr;
+    std::function<bool()> m_fnSlice;
+    std::atomic<int> m_nState = Idle;
+    std::atomic<int> m_nPriority = 0;
+    std::atomic<qint64> m_nDeadline = 0;
+};
+
+using ExecutorTaskPtr = std::shared_ptr<ExecutorTask>;
+
+// 所有播放实例共享的解码线程池
+// 线程数按CPU核数确定，与播放实例数无关。每个工作线程有自己的就绪队列，在工作线程中唤醒的任务进入该线程的队列；
+// 自己的队列为空时从其他线程的队列中窃取。每次按优先级、再按截止时间选出最紧急的任务执行一个时间片
+class DecodeExecutor {
+public:
+    ~DecodeExecutor();
+
+    static DecodeExecutor& instance();
+
+    // 创建任务，之后通过wake调度；第一次创建时启动工作线程
+    ExecutorTaskPtr createTask(std::function<bool()> slice, int priority = 0);
+    // 把[0, count)分给工作线程并行执行fn，调用线程也参与执行，全部完成后返回；可在工作线程中调用
+    // 各部分的截止时间为当前时间，优先于同优先级的解码任务执行
+    void parallelFor(int count, std::function<void(int)> fn, int priority = 0);
+    // 工作线程数
+    inline int threadCount() const { return int(m_workers.size()); }
+    // 当前在就绪队列中的任务数
+    inline int queuedTasks() const { return m_nQueued; }
+    // 从其他线程窃取任务的次数
+    inline qint64 steals() const { return m_nSteals; }
+
+private:
+    friend class ExecutorTask;
+
+    struct Worker {
+        QThread* thread = nullptr;
+        std::mutex mutex;
+        std::deque<ExecutorTaskPtr> queue;
+    };
+
+    DecodeExecutor();
+    void start();
+    void stop();
+    void enqueue(ExecutorTaskPtr task);
+    // 从index号线程的队列中取出最紧急的任务
+    ExecutorTaskPtr takeBest(int index);
+    void workerLoop(int index);
+    // 执行一个时间片并按结果更新任务状态
+    void runTask(const ExecutorTaskPtr& task);
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::mutex m_startMutex;
+    std::atomic<bool> m_bStarted = false;
+    std::atomic<bool> m_bStop = false;
+    std::atomic<int> m_nQueued = 0;
+    std::atomic<qint64> m_nSteals = 0;
+    // 不在工作线程中唤醒的任务轮流分配给各工作线程
+    std::atomic<unsigned> m_nNextWorker = 0;
+    // 有任务入队时唤醒空闲的工作线程
+    WaitEvent m_workEvent;
+    // 任务执行结束时通知，cancel据此等待
+    WaitEvent m_doneEvent;
+};
+
+#endif // DECODEEXECUTOR_H
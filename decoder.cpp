@@ -1,37 +1,158 @@
 #include "decoder.h"
 #include <qDebug>
 
-#define MAX_AUDIO_SIZE (50 * 20)
-#define MAX_VIDEO_SIZE (25 * 20)
+// 默认缓存上限
+#define DEFAULT_VIDEO_BUFFER_BYTES (64 * 1024 * 1024)
+#define DEFAULT_VIDEO_BUFFER_DURATION (10 * AV_TIME_BASE)
+#define DEFAULT_AUDIO_BUFFER_BYTES (4 * 1024 * 1024)
+#define DEFAULT_AUDIO_BUFFER_DURATION (10 * AV_TIME_BASE)
+// 视频解码线程数上限，超过后帧多线程的延迟和内存开销增长快于收益
+#define MAX_VIDEO_DECODE_THREADS 16
+// 音频解码线程数上限
+#define MAX_AUDIO_DECODE_THREADS 2
+// 播放速率范围
+#define MIN_PLAYBACK_RATE 0.5
+#define MAX_PLAYBACK_RATE 32.0
+// 不低于该速率（含倒放）时只解复用和解码关键帧，并关闭声音
+#define TRICK_PLAY_MIN_RATE 8.0
+// 快进快退时相邻两个展示的关键帧之间的实际时间间隔，速率越高跳过的关键帧越多 单位微秒
+#define TRICK_FRAME_INTERVAL 100000
+// 快进快退时视频队列最多缓存的关键帧数
+#define TRICK_QUEUE_PACKETS 4
+// 没有关键帧索引时快退向前查找关键帧的最大尝试次数
+#define TRICK_SEEK_RETRIES 8
+// 预读缓冲大小
+#define DEFAULT_READ_AHEAD_BYTES (16 * 1024 * 1024)
+// 逐帧浏览及平滑倒放的GOP缓存上限
+#define DEFAULT_STEP_CACHE_BYTES (256 * 1024 * 1024)
+// 快速起播时探测的数据量上限 单位字节，及探测的时长上限 单位微秒
+#define FAST_START_PROBE_SIZE (512 * 1024)
+#define FAST_START_ANALYZE_DURATION (500 * 1000)
+// 到达预计的结束时间后仍未播完（展示或音频设备稍有落后）时的重试间隔 单位微秒
+#define FINISH_RETRY_TIME 10000
 
-Decoder::Decoder() {}
+std::atomic<int> Decoder::s_nActiveDecoders = 0;
+
+Decoder::Decoder() {
+    // 解码线程取走packet后唤醒解复用线程
+    m_videoDecoder.setSpaceEvent(&m_spaceEvent);
+    m_audioDecoder.setSpaceEvent(&m_spaceEvent);
+    // 界面线程发来命令后唤醒解复用线程
+    m_commands.setEvent(&m_spaceEvent);
+    m_videoDecoder.setPacketPool(&m_packetPool);
+    m_audioDecoder.setPacketPool(&m_packetPool);
+    m_videoDecoder.setBufferLimits({ DEFAULT_VIDEO_BUFFER_BYTES, DEFAULT_VIDEO_BUFFER_DURATION });
+    m_audioDecoder.setBufferLimits({ DEFAULT_AUDIO_BUFFER_BYTES, DEFAULT_AUDIO_BUFFER_DURATION });
+    m_audioDecoder.setClock(&m_clock);
+    m_videoPresenter.setClock(&m_clock);
+    m_videoDecoder.setMetrics(&m_metrics);
+    m_audioDecoder.setMetrics(&m_metrics);
+    m_videoPresenter.setMetrics(&m_metrics);
+    m_videoDecoder.setQualityGovernor(&m_qualityGovernor);
+    m_videoPresenter.setQualityGovernor(&m_qualityGovernor);
+    m_qualityGovernor.setListener([this](QualityLevel level) { emit qualityLevelChanged(int(level)); });
+    m_frameStepper.setCacheLimit(DEFAULT_STEP_CACHE_BYTES);
+    m_nReadAheadBytes = DEFAULT_READ_AHEAD_BYTES;
+    // 关键帧索引建立完成后写入磁盘缓存
+    connect(&m_keyframeIndex, &QThread::finished, this, &Decoder::saveIndexCache);
+    m_keyframeIndex.setProbeCallback([this](const AVFormatContext* fmtCtx) { onStreamsProbed(fmtCtx); });
+}
 
 Decoder::~Decoder() {
-    if (m_audioDecoder.isRunning()) {
-        m_audioDecoder.requestInterruption();
-        m_audioDecoder.wait();
-    }
-    if (m_videoDecoder.isRunning()) {
-        m_videoDecoder.requestInterruption();
-        m_videoDecoder.wait();
-    }
+    close();
     if (m_pFmtCtx) avformat_close_input(&m_pFmtCtx);
+    m_readAhead.close();
 }
 
-bool Decoder::init(const QString& uri, bool useHardwareDecoder /* = false */) {
+void Decoder::close() {
+    requestInterruption();
+    m_audioDecoder.requestInterruption();
+    m_videoDecoder.requestInterruption();
+    m_videoPresenter.requestInterruption();
+    // 唤醒阻塞在队列上的线程
+    m_audioDecoder.abort();
+    m_videoDecoder.abort();
+    m_spaceEvent.notify();
+
+    m_keyframeIndex.stop();
+    m_frameStepper.close();
+    if (isRunning()) wait();
+    if (m_audioDecoder.isRunning()) m_audioDecoder.wait();
+    if (m_videoDecoder.isRunning()) m_videoDecoder.wait();
+    m_audioDecoder.stopTask();
+    m_videoDecoder.stopTask();
+    if (m_videoPresenter.isRunning()) m_videoPresenter.wait();
+
+    if (m_bActive) {
+        m_bActive = false;
+        --s_nActiveDecoders;
+    }
+}
+
+bool Decoder::init(const QString& uri, bool useHardwareDecoder /* = false */, DecodeThreading threading /* = DecodeThreading::Auto */) {
   m_strUri = uri;
+  ThreadingConfig videoThreading;
+  ThreadingConfig audioThreading;
+  bool indexCached = false;
+  AVDictionary* options = nullptr;
+
+  m_nInitTime = av_gettime_relative();
+  m_nOpenedTime = -1;
+  m_nProbedTime = -1;
+  m_nCodecsTime = -1;
+  m_nFirstFrameTime = -1;
+  m_nAudioReadyTime = -1;
+  // 快速起播时音频设备就绪前由外部时钟驱动
+  m_bAudioReady = !m_bFastStart;
+
+  // 计入正在运行的播放实例数，再按实例数分配解码线程
+  if (!m_bActive) {
+    m_bActive = true;
+    ++s_nActiveDecoders;
+  }
+  videoThreading = { threading, videoDecodeThreads() };
+  audioThreading = { threading, qMin(videoThreading.threadCount, MAX_AUDIO_DECODE_THREADS) };
+  m_audioThreading = audioThreading;
+  m_nLateAudioIdx = -1;
+  m_bLateAudioProbed = false;
+
+  // 经过预读线程读取，数据源打不开时退回到FFmpeg直接读取
+  if (m_bReadAhead && m_readAhead.open(m_strUri, m_nReadAheadBytes, m_bReadAheadMmap)) {
+    m_pFmtCtx = avformat_alloc_context();
+    m_pFmtCtx->pb = m_readAhead.context();
+    m_pFmtCtx->flags |= AVFMT_FLAG_CUSTOM_IO;
+  }
+
+  // 快速起播只探测开头少量数据，不足的流参数在开始播放后补全
+  if (m_bFastStart) {
+    av_dict_set_int(&options, "probesize", FAST_START_PROBE_SIZE, 0);
+    av_dict_set_int(&options, "analyzeduration", FAST_START_ANALYZE_DURATION, 0);
+  }
 
   // 打开输入文件
-  if (avformat_open_input(&m_pFmtCtx, m_strUri.toUtf8().constData(), nullptr, nullptr) != 0) {
+  if (avformat_open_input(&m_pFmtCtx, m_strUri.toUtf8().constData(), nullptr, &options) != 0) {
     qCritical() << "Failed to open input file";
     goto end;
   }
+  av_dict_free(&options);
+  m_nOpenedTime = av_gettime_relative() - m_nInitTime;
+
+  // 有上次打开时记录的流参数则直接使用，省去avformat_find_stream_info试解码的耗时
+  m_mediaIndex = MediaIndex();
+  if (m_bIndexCacheEnabled && MediaIndexCache::load(m_strUri, &m_mediaIndex)) {
+    indexCached = MediaIndexCache::applyStreams(m_mediaIndex, m_pFmtCtx);
+    if (!indexCached) m_mediaIndex = MediaIndex();
+  }
 
   // 寻找流信息
-  if (avformat_find_stream_info(m_pFmtCtx, nullptr) < 0) {
-    qCritical() << "Failed to retrieve stream info";
-    goto end;
+  if (!indexCached) {
+    if (avformat_find_stream_info(m_pFmtCtx, nullptr) < 0) {
+      qCritical() << "Failed to retrieve stream info";
+      goto end;
+    }
+    MediaIndexCache::captureStreams(m_pFmtCtx, &m_mediaIndex);
   }
+  m_nProbedTime = av_gettime_relative() - m_nInitTime;
 
   // 查找视频流和音频流
   for (unsigned int i = 0; i < m_pFmtCtx->nb_streams; ++i) {
@@ -48,78 +169,299 @@ bool Decoder::init(const QString& uri, bool useHardwareDecoder /* = false */) {
   // 存在音频流
   if (m_nAudioStreamIdx != -1) {
       // 初始化音频解码线程
-      if (!m_audioDecoder.init(m_pFmtCtx->streams[m_nAudioStreamIdx])) {
+      if (m_audioDecoder.init(m_pFmtCtx->streams[m_nAudioStreamIdx], audioThreading)) {
+        m_nAudioSampleRate = m_audioDecoder.getSampleRate();
+        // 启动音频解码线程，或在共享线程池中解码
+        if (m_bSharedDecode) {
+          m_audioDecoder.startTask(&DecodeExecutor::instance(), m_nDecodePriority);
+        } else {
+          m_audioDecoder.start();
+        }
+      } else if (m_bFastStart && m_nVideoStreamIdx != -1) {
+        // 有限探测可能还没拿到音频参数，快速起播时先只播放视频，完整探测后再打开音频
+        qWarning() << "audioDecoder init failed, playing without audio until the full probe";
+        m_nLateAudioIdx = int(m_nAudioStreamIdx);
+        m_nAudioStreamIdx = -1;
+      } else {
         qCritical() << "audioDecoder init failed";
         goto end;
       }
-      m_nAudioSampleRate = m_audioDecoder.getSampleRate();
-      // 启动音频解码线程
-      m_audioDecoder.start();
-      // 连接信号
-      connect(&m_audioDecoder, &AudioDecoder::frameTimeUpdate, &m_videoDecoder, &VideoDecoder::audioFrameTimeUpdate);
-      connect(&m_audioDecoder, &AudioDecoder::frameReady, this, &Decoder::audioFrameReady);
   }
 
   // 存在视频流
   if (m_nVideoStreamIdx != -1) {
     // 初始化视频解码线程
-    if (!m_videoDecoder.init(m_pFmtCtx->streams[m_nVideoStreamIdx], useHardwareDecoder)) {
+    if (!m_videoDecoder.init(m_pFmtCtx->streams[m_nVideoStreamIdx], useHardwareDecoder, videoThreading)) {
         qCritical() << "videoDecoder init failed";
         goto end;
     }
-    // 启动视频解码线程
-    m_videoDecoder.start();
+    qDebug() << "video decode threads:" << m_videoDecoder.threadCount()
+             << (m_videoDecoder.threadType() & FF_THREAD_FRAME ? "frame" : m_videoDecoder.threadType() & FF_THREAD_SLICE ? "slice" : "none");
+    // 启动视频解码线程（或在共享线程池中解码）及展示线程
+    if (m_bSharedDecode) {
+        m_videoDecoder.startTask(&DecodeExecutor::instance(), m_nDecodePriority);
+    } else {
+        m_videoDecoder.start();
+    }
+    m_videoPresenter.setFrameQueue(m_videoDecoder.frameQueue());
+    m_videoPresenter.start();
     // 连接信号
-    connect(&m_videoDecoder, &VideoDecoder::frameReady, this, &Decoder::videoFrameReady);
+    connect(&m_videoPresenter, &VideoPresenter::frameReady, this, &Decoder::videoFrameReady);
+    connect(&m_videoPresenter, &VideoPresenter::frameDue, this, &Decoder::videoFrameDue);
+    // 按垂直同步展示时帧由渲染线程取走，不经过frameReady
+    connect(&m_videoPresenter, &VideoPresenter::framePresented, this,
+            [this](qint64 pts, qint64 latency) { Q_UNUSED(pts); Q_UNUSED(latency); onFrameReady(av_gettime_relative()); },
+            Qt::DirectConnection);
+    // 逐帧浏览使用独立的解码上下文，第一次逐帧或倒放时才打开文件
+    m_frameStepper.open(m_strUri, m_nVideoStreamIdx, &m_keyframeIndex);
+    connect(&m_frameStepper, &FrameStepper::frameReady, this, &Decoder::videoFrameReady);
   }
 
+  m_nCodecsTime = av_gettime_relative() - m_nInitTime;
+
+  // 没有对应的流时主时钟退回到外部时钟
+  updateClockStreams();
+  m_clock.external().set(0);
   m_nDuration = m_pFmtCtx->duration / AV_TIME_BASE;
+
+  // 后台建立跳转所用流的关键帧索引，缓存中已有时直接使用；快速起播时推迟到第一帧展示后，不与起播争抢I/O
+  if (indexCached && m_mediaIndex.keyframeStream == indexStream() && !m_mediaIndex.keyframes.empty()) {
+    m_keyframeIndex.load(indexStream(), m_mediaIndex.keyframes);
+  } else if (m_bFastStart && m_nVideoStreamIdx != -1) {
+    m_bIndexDeferred = true;
+  } else {
+    buildKeyframeIndex();
+  }
   return true;
 
 end:
+  av_dict_free(&options);
   if (m_pFmtCtx) avformat_close_input(&m_pFmtCtx);
+  m_readAhead.close();
+  if (m_bActive) {
+    m_bActive = false;
+    --s_nActiveDecoders;
+  }
   return false;
 }
 
+void Decoder::buildKeyframeIndex() {
+    m_bIndexDeferred = false;
+    // 已关闭
+    if (isInterruptionRequested() || indexStream() == -1) return;
+    m_keyframeIndex.build(m_strUri, indexStream());
+}
+
+void Decoder::onStreamsProbed(const AVFormatContext* fmtCtx) {
+    if (!m_bFastStart) return;
+    {
+        std::lock_guard<std::mutex> lock(m_probeMutex);
+        m_probedIndex = MediaIndex();
+        MediaIndexCache::captureStreams(fmtCtx, &m_probedIndex);
+    }
+    // 有限探测时部分格式只能按码率估算时长
+    if (fmtCtx->duration > 0) m_nDuration = fmtCtx->duration / AV_TIME_BASE;
+    // 由解复用线程以完整的参数打开音频流
+    if (m_nLateAudioIdx != -1) {
+        m_bLateAudioProbed = true;
+        m_spaceEvent.notify();
+    }
+}
+
+void Decoder::openLateAudio() {
+    m_bLateAudioProbed = false;
+    const int index = m_nLateAudioIdx;
+    m_nLateAudioIdx = -1;
+    AVStream* stream = m_pFmtCtx->streams[index];
+    {
+        std::lock_guard<std::mutex> lock(m_probeMutex);
+        if (index >= int(m_probedIndex.streams.size())) return;
+        const StreamInfo& info = m_probedIndex.streams[index];
+        if (info.codecType != AVMEDIA_TYPE_AUDIO || av_cmp_q(info.timeBase, stream->time_base) != 0) return;
+        MediaIndexCache::applyStream(info, stream);
+    }
+    if (!m_audioDecoder.init(stream, m_audioThreading)) {
+        qWarning() << "audioDecoder init failed after the full probe, playing without audio";
+        return;
+    }
+    m_nAudioSampleRate = m_audioDecoder.getSampleRate();
+    if (m_bSharedDecode) {
+        m_audioDecoder.startTask(&DecodeExecutor::instance(), m_nDecodePriority);
+    } else {
+        m_audioDecoder.start();
+    }
+    // 解码线程启动时处于播放状态，与流水线当前的状态保持一致
+    if (!m_bDemuxPlaying || m_bStepping) m_audioDecoder.stop();
+    m_nAudioStreamIdx = index;
+    // 之前读到的音频packet已被丢弃，从当前播放位置重新读取，使声音与画面对齐
+    if (!m_bStepping && !isTrickRate(m_dActiveRate)) requestSeek(playTime(), false);
+    emit audioStreamOpened();
+}
+
+void Decoder::onFrameReady(qint64 presentTime) {
+    qint64 expected = -1;
+    const qint64 elapsed = presentTime - m_nInitTime;
+    if (!m_nFirstFrameTime.compare_exchange_strong(expected, elapsed)) return;
+    m_metrics.record(MetricStage::FirstFrame, elapsed);
+    qDebug() << "time to first frame:" << elapsed / 1000 << "ms";
+    if (m_bIndexDeferred) QMetaObject::invokeMethod(this, [this]{ buildKeyframeIndex(); }, Qt::QueuedConnection);
+}
+
+void Decoder::setAudioReady() {
+    m_nAudioReadyTime = av_gettime_relative() - m_nInitTime;
+    // 快速起播时环形缓冲从开头开始填充，落后于外部时钟推进的进度；切换到音频时钟前先丢弃落后的数据
+    if (m_bFastStart && !m_bAudioReady && m_nAudioStreamIdx != -1) {
+        m_clock.audio().invalidate();
+        m_audioDecoder.skipTo(m_clock.external().get());
+    }
+    m_bAudioReady = true;
+    updateClockStreams();
+}
+
+void Decoder::dropAudio() {
+    if (m_nAudioStreamIdx == -1) return;
+    // 解复用线程不再读取音频packet，音频解码线程不等待设备，直接丢弃队列中剩余的数据
+    m_nAudioStreamIdx = -1;
+    m_audioDecoder.setPaced(false);
+    updateClockStreams();
+    m_spaceEvent.notify();
+}
+
+void Decoder::updateClockStreams() {
+    const double rate = m_dRate;
+    // 快进快退及倒放时没有声音，音频设备就绪前同样由外部时钟驱动
+    const bool audio = m_nAudioStreamIdx != -1 && m_bAudioReady && !isTrickRate(rate) && !isReverseRate(rate);
+    m_clock.setStreams(audio, m_nVideoStreamIdx != -1);
+}
+
+StartupTimes Decoder::startupTimes() {
+    StartupTimes times;
+    times.opened = m_nOpenedTime;
+    times.probed = m_nProbedTime;
+    times.codecsOpened = m_nCodecsTime;
+    times.firstFrame = m_nFirstFrameTime;
+    times.audioReady = m_nAudioReadyTime;
+    return times;
+}
+
+void Decoder::saveIndexCache() {
+    // 被中止的索引不完整，不写入缓存
+    if (!m_bIndexCacheEnabled || !m_keyframeIndex.isComplete()) return;
+    // 快速起播时以完整探测的流参数代替有限探测的结果
+    if (m_bFastStart) {
+        std::lock_guard<std::mutex> lock(m_probeMutex);
+        if (!m_probedIndex.streams.empty()) {
+            m_mediaIndex.streams = m_probedIndex.streams;
+            m_mediaIndex.duration = m_probedIndex.duration;
+        }
+    }
+    m_mediaIndex.keyframeStream = m_keyframeIndex.streamIndex();
+    m_mediaIndex.keyframes = m_keyframeIndex.entries();
+    // 保留缓存中已有的缩略图
+    MediaIndex cached;
+    if (MediaIndexCache::load(m_strUri, &cached)) m_mediaIndex.thumbnails = cached.thumbnails;
+    MediaIndexCache::save(m_strUri, m_mediaIndex);
+}
+
+PoolStats Decoder::framePoolStats() {
+    const PoolStats decoded = m_videoDecoder.framePool()->frameStats();
+    const PoolStats converted = m_videoPresenter.framePool()->frameStats();
+    return { decoded.allocs + converted.allocs, decoded.reuses + converted.reuses };
+}
+
+PoolStats Decoder::frameBufferStats() {
+    const PoolStats transferred = m_videoDecoder.framePool()->bufferStats();
+    const PoolStats converted = m_videoPresenter.framePool()->bufferStats();
+    return { transferred.allocs + converted.allocs, transferred.reuses + converted.reuses };
+}
+
+void Decoder::setDecodePriority(int priority) {
+    m_nDecodePriority = priority;
+    m_videoDecoder.setTaskPriority(priority);
+    m_audioDecoder.setTaskPriority(priority);
+}
+
+int Decoder::videoDecodeThreads() {
+    // 所有播放实例平分CPU核，每个实例至少一个线程
+    const int cores = qMax(1, QThread::idealThreadCount());
+    const int players = qMax(1, s_nActiveDecoders.load());
+    return qBound(1, cores / players, MAX_VIDEO_DECODE_THREADS);
+}
+
 void Decoder::run() {
-    m_bPlaying = true;
+    m_bDemuxPlaying = true;
 
     AVPacket* packet = av_packet_alloc();
-    while(1) {
-        // 发生了跳转
-        if (m_nSeekTime != -1) {
-            qint64 frameTime = av_rescale_q(m_nSeekTime, AV_TIME_BASE_Q, m_pFmtCtx->streams[m_nVideoStreamIdx]->time_base);
-            if (av_seek_frame(m_pFmtCtx, m_nVideoStreamIdx, frameTime, AVSEEK_FLAG_BACKWARD) < 0) {
-                qCritical() << "seek frame failed, seekTime: " << m_nSeekTime;
-            } else {
-                m_audioDecoder.seekToPosition(m_nSeekTime);
-                m_videoDecoder.seekToPosition(m_nSeekTime);
-            }
-            m_nSeekTime = -1;
+    while (!isInterruptionRequested()) {
+        // 执行播放、暂停及跳转命令
+        if (hasCommand()) {
+            processCommands();
+            continue;
         }
 
-        // 超出缓存限制，则停止读packet
-        if (m_videoDecoder.queueSize() > MAX_VIDEO_SIZE || m_audioDecoder.queueSize() > MAX_AUDIO_SIZE) {
-            av_usleep(10000);
+        // 快速起播时完整探测补全了音频参数
+        if (m_bLateAudioProbed) {
+            openLateAudio();
             continue;
         }
-        // 暂停
-        if (!m_bPlaying) {
-            av_usleep(10000);
+
+        // 暂停，逐帧浏览时画面由逐帧浏览线程负责
+        if (!m_bDemuxPlaying || m_bStepping) {
+            m_spaceEvent.wait([this]{
+                return (m_bDemuxPlaying && !m_bStepping) || hasCommand() || m_bLateAudioProbed || isInterruptionRequested();
+            });
+            continue;
+        }
+
+        // 超出缓存限制，阻塞到解码线程取走packet
+        if (buffersFull()) {
+            m_spaceEvent.wait([this]{ return !buffersFull() || hasCommand() || isInterruptionRequested(); });
+            continue;
+        }
+
+        // 快进快退只读取要展示的关键帧，到达文件首尾后等待跳转
+        if (isTrickRate(m_dActiveRate)) {
+            if (!readTrickFrame(packet)) {
+                m_bEof = true;
+                m_spaceEvent.wait([this]{ return hasCommand() || isInterruptionRequested(); });
+            }
             continue;
         }
 
         // 读packet，加入对应的队列中
-        if (av_read_frame(m_pFmtCtx, packet) < 0)
-        {
-            av_usleep(10000);
+        const qint64 readStart = av_gettime_relative();
+        int ret = av_read_frame(m_pFmtCtx, packet);
+        m_metrics.record(MetricStage::Demux, av_gettime_relative() - readStart);
+        if (ret == AVERROR_EOF) {
+            // 读到文件末尾，等待跳转；播放中按剩余的播放时间定时醒来，播完时通知一次
+            m_bEof = true;
+            const qint64 waitTime = finishWaitTime();
+            if (waitTime == 0) {
+                m_bFinishNotified = true;
+                emit playbackFinished();
+            } else if (waitTime > 0) {
+                m_spaceEvent.waitFor([this]{ return hasCommand() || isInterruptionRequested(); }, waitTime);
+            } else {
+                m_spaceEvent.wait([this]{ return hasCommand() || isInterruptionRequested(); });
+            }
+            continue;
+        } else if (ret < 0) {
+            m_spaceEvent.waitFor([this]{ return hasCommand() || isInterruptionRequested(); }, 10000);
             continue;
         }
 
+        // 记录已读数据的结束时间，用于估计播完的时刻
+        if ((packet->stream_index == m_nVideoStreamIdx || packet->stream_index == m_nAudioStreamIdx)
+            && packet->pts != AV_NOPTS_VALUE) {
+            const AVRational timeBase = m_pFmtCtx->streams[packet->stream_index]->time_base;
+            m_nReadEnd = qMax(m_nReadEnd, av_rescale_q(packet->pts + packet->duration, timeBase, AV_TIME_BASE_Q));
+        }
+
+        // 数据移入池中的packet，不拷贝也不新分配
         if (packet->stream_index == m_nVideoStreamIdx) {
-            m_videoDecoder.addToQueue(av_packet_clone(packet));
+            pushPacket(m_videoDecoder, m_packetPool.take(packet));
         } else if (packet->stream_index == m_nAudioStreamIdx) {
-            m_audioDecoder.addToQueue(av_packet_clone(packet));
+            pushPacket(m_audioDecoder, m_packetPool.take(packet));
         }
 
         av_packet_unref(packet);
@@ -127,8 +469,28 @@ void Decoder::run() {
     av_packet_free(&packet);
 }
 
-void Decoder::setPlayState(bool play) {
-    m_bPlaying = play;
+void Decoder::processCommands() {
+    std::vector<PlayerCommand> commands;
+    m_commands.takeAll(commands);
+    for (const PlayerCommand& command : commands) {
+        switch (command.type) {
+        case CommandType::Play:
+            applyPlayState(true);
+            break;
+        case CommandType::Pause:
+            applyPlayState(false);
+            break;
+        case CommandType::Seek:
+            doSeek(command);
+            break;
+        }
+    }
+}
+
+void Decoder::applyPlayState(bool play) {
+    m_bDemuxPlaying = play;
+    // 逐帧浏览时画面由逐帧浏览线程负责，流水线保持暂停，交还画面时再恢复
+    if (m_bStepping) play = false;
     if (play) {
         m_audioDecoder.play();
         m_videoDecoder.play();
@@ -136,8 +498,389 @@ void Decoder::setPlayState(bool play) {
         m_audioDecoder.stop();
         m_videoDecoder.stop();
     }
+    m_videoPresenter.setPlaying(play);
+    m_clock.setPaused(!play);
+}
+
+bool Decoder::pushPacket(DecoderBase& decoder, AVPacket* packet) {
+    if (!packet) return false;
+    const int serial = m_nDemuxSerial;
+    // 超出缓存限制，等待解码线程取走packet；等待期间照常执行播放暂停命令，否则预加载的流水线无法开始播放
+    while (!decoder.addToQueue(packet, serial)) {
+        m_spaceEvent.wait([&]{
+            return !decoder.queueFull() || hasCommand() || isInterruptionRequested();
+        });
+        if (!isInterruptionRequested() && !seekRequested() && hasCommand()) processCommands();
+        // 执行命令时可能发生了跳转，该packet已过期
+        if (isInterruptionRequested() || seekRequested() || m_nDemuxSerial != serial) {
+            m_packetPool.recycle(packet);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Decoder::pushSeekMarker(DecoderBase& decoder, qint64 seekTime) {
+    // 解码线程正在丢弃旧序号的packet，队列很快会腾出空间
+    while (!decoder.seekToPosition(seekTime, m_nDemuxSerial)) {
+        m_spaceEvent.wait([&]{
+            return !decoder.queueFull() || seekRequested() || isInterruptionRequested();
+        });
+        // 又有新的跳转，该标记已过期
+        if (isInterruptionRequested() || seekRequested()) return false;
+    }
+    return true;
+}
+
+bool Decoder::buffersFull() {
+    // 快进快退时没有音频，视频队列只保留少量关键帧，变速或跳转时能很快响应
+    if (isTrickRate(m_dActiveRate)) return m_videoDecoder.queueSize() >= TRICK_QUEUE_PACKETS;
+
+    bool overLimit = false;
+    bool starving = false;
+    if (m_nVideoStreamIdx != -1) {
+        overLimit |= m_videoDecoder.queueOverLimit();
+        starving |= m_videoDecoder.queueSize() == 0;
+    }
+    if (m_nAudioStreamIdx != -1) {
+        overLimit |= m_audioDecoder.queueOverLimit();
+        starving |= m_audioDecoder.queueSize() == 0;
+    }
+    // 某个流的队列已空时继续读，避免交织不均匀的文件中一个流占满缓存使另一个流饿死
+    return overLimit && !starving;
+}
+
+void Decoder::doSeek(const PlayerCommand& command) {
+    // 已有更新的跳转请求，这次跳转不再执行
+    if (command.serial != m_nSerial) return;
+    // 之后入队的packet属于这次跳转
+    m_nDemuxSerial = command.serial;
+    m_bEof = false;
+    m_nReadEnd = 0;
+    m_bFinishNotified = false;
+    // 变速通过跳转生效
+    m_dActiveRate = command.rate;
+    const bool trick = isTrickRate(m_dActiveRate);
+    // 快进快退本身只展示关键帧，期间不调整画质等级
+    m_qualityGovernor.setHeld(trick);
+    const qint64 seekTime = command.time;
+    // 优先按视频流跳转，没有视频流时按音频流
+    const int streamIdx = int(m_nVideoStreamIdx != -1 ? m_nVideoStreamIdx : m_nAudioStreamIdx.load());
+    if (streamIdx == -1) return;
+    const AVRational timeBase = m_pFmtCtx->streams[streamIdx]->time_base;
+
+    // 解码线程丢弃该时间之前的帧
+    qint64 targetTime = seekTime;
+    qint64 timestamp = av_rescale_q(seekTime, AV_TIME_BASE_Q, timeBase);
+    KeyframeIndex::Entry keyframe;
+    if (m_keyframeIndex.find(seekTime, command.fast, &keyframe)) {
+        // 直接定位到索引中的关键帧，快速跳转时以关键帧时间为目标，不需要追赶
+        timestamp = keyframe.timestamp;
+        if (command.fast) targetTime = keyframe.time;
+    }
+
+    if (av_seek_frame(m_pFmtCtx, streamIdx, timestamp, AVSEEK_FLAG_BACKWARD) < 0) {
+        qCritical() << "seek frame failed, seekTime: " << seekTime;
+        // 解码线程已开始丢弃旧数据，仍需放入跳转标记，从当前读取位置继续
+        targetTime = -1;
+    } else {
+        // 外部时钟直接从跳转时间开始，音频和视频时钟在新数据展示时重新校准
+        m_clock.external().set(targetTime);
+        // 快进快退从跳转位置的关键帧开始
+        if (trick) m_nTrickPos = targetTime - qint64(m_dActiveRate * TRICK_FRAME_INTERVAL);
+    }
+    // 放入跳转标记，解码线程从标记开始解码这次跳转的数据；快进快退时关键帧的时间不一定在目标之后，不丢弃
+    if (m_nAudioStreamIdx != -1) {
+        pushSeekMarker(m_audioDecoder, targetTime);
+    }
+    if (m_nVideoStreamIdx != -1) {
+        pushSeekMarker(m_videoDecoder, trick ? -1 : targetTime);
+    }
+}
+
+void Decoder::requestSeek(qint64 time, bool fast) {
+    // 多个线程同时请求时，序号的分配与通知解码线程的顺序一致
+    std::lock_guard<std::mutex> lock(m_seekMutex);
+    PlayerCommand command;
+    command.type = CommandType::Seek;
+    command.time = qMax<qint64>(0, time);
+    command.fast = fast;
+    command.rate = m_dRate;
+    command.serial = ++m_nSerial;
+    // 解码和展示线程立即开始丢弃旧数据，不等解复用线程执行跳转
+    m_audioDecoder.requestSeek(command.serial);
+    m_videoDecoder.requestSeek(command.serial);
+    m_commands.push(command);
+}
+
+bool Decoder::isTrickRate(double rate) {
+    return qAbs(rate) >= TRICK_PLAY_MIN_RATE;
+}
+
+bool Decoder::isReverseRate(double rate) {
+    return rate < 0 && !isTrickRate(rate);
+}
+
+bool Decoder::readTrickFrame(AVPacket* packet) {
+    AVStream* stream = m_pFmtCtx->streams[m_nVideoStreamIdx];
+    const bool forward = m_dActiveRate > 0;
+    // 按速率跳过关键帧，使每秒解码的关键帧数不随速率增长
+    const qint64 target = m_nTrickPos + qint64(m_dActiveRate * TRICK_FRAME_INTERVAL);
+    qint64 time = AV_NOPTS_VALUE;
+
+    // 从索引中取目标位置的关键帧，它不比上一个展示的关键帧更靠前时取相邻的下一个
+    KeyframeIndex::Entry keyframe;
+    bool found = m_keyframeIndex.find(qMax<qint64>(0, target), false, &keyframe);
+    if (found && (forward ? keyframe.time <= m_nTrickPos : keyframe.time >= m_nTrickPos)) {
+        found = forward ? m_keyframeIndex.next(m_nTrickPos, &keyframe) : m_keyframeIndex.previous(m_nTrickPos, &keyframe);
+        // 索引已完整，说明到达了文件首尾
+        if (!found && m_keyframeIndex.isComplete()) return false;
+    }
+
+    if (found) {
+        if (av_seek_frame(m_pFmtCtx, m_nVideoStreamIdx, keyframe.timestamp, AVSEEK_FLAG_BACKWARD) < 0) return false;
+        time = readKeyframePacket(packet, stream);
+        if (time == AV_NOPTS_VALUE) return false;
+        pushTrickPacket(packet, time);
+        return true;
+    }
+
+    // 索引尚未覆盖：快进时顺序读取，只有到达目标的关键帧才送去解码
+    if (forward) {
+        while ((time = readKeyframePacket(packet, stream)) != AV_NOPTS_VALUE) {
+            if (time >= target) {
+                pushTrickPacket(packet, time);
+                return true;
+            }
+            av_packet_unref(packet);
+        }
+        return false;
+    }
+
+    // 快退时逐步扩大向前跳转的距离，直到落在更早的关键帧上
+    qint64 seekTarget = target;
+    for (int i = 0; i < TRICK_SEEK_RETRIES && m_nTrickPos > 0; ++i) {
+        const qint64 timestamp = av_rescale_q(qMax<qint64>(0, seekTarget), AV_TIME_BASE_Q, stream->time_base);
+        if (av_seek_frame(m_pFmtCtx, m_nVideoStreamIdx, timestamp, AVSEEK_FLAG_BACKWARD) < 0) return false;
+        time = readKeyframePacket(packet, stream);
+        if (time == AV_NOPTS_VALUE) return false;
+        if (time < m_nTrickPos) {
+            pushTrickPacket(packet, time);
+            return true;
+        }
+        av_packet_unref(packet);
+        seekTarget -= qint64(-m_dActiveRate * TRICK_FRAME_INTERVAL) << (i + 1);
+    }
+    // 已在第一个关键帧
+    return false;
+}
+
+qint64 Decoder::readKeyframePacket(AVPacket* packet, AVStream* stream) {
+    while (!isInterruptionRequested() && !seekRequested()) {
+        const qint64 readStart = av_gettime_relative();
+        const int ret = av_read_frame(m_pFmtCtx, packet);
+        m_metrics.record(MetricStage::Demux, av_gettime_relative() - readStart);
+        if (ret < 0) return AV_NOPTS_VALUE;
+
+        // 其他流及非关键帧直接丢弃
+        const int64_t pts = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+        if (packet->stream_index != m_nVideoStreamIdx || !(packet->flags & AV_PKT_FLAG_KEY) || pts == AV_NOPTS_VALUE) {
+            av_packet_unref(packet);
+            continue;
+        }
+        return av_rescale_q(pts, stream->time_base, AV_TIME_BASE_Q);
+    }
+    return AV_NOPTS_VALUE;
+}
+
+void Decoder::pushTrickPacket(AVPacket* packet, qint64 time) {
+    m_nTrickPos = time;
+    pushPacket(m_videoDecoder, m_packetPool.take(packet));
+}
+
+bool Decoder::setPlaybackRate(double rate) {
+    if (qAbs(rate) < MIN_PLAYBACK_RATE || qAbs(rate) > MAX_PLAYBACK_RATE) return false;
+    const bool trick = isTrickRate(rate);
+    // 没有视频时无法快进快退
+    if (trick && m_nVideoStreamIdx == -1) return false;
+    if (rate == m_dRate) return true;
+
+    // 平滑倒放同样需要视频
+    const bool reverse = isReverseRate(rate);
+    if (reverse && m_nVideoStreamIdx == -1) return false;
+
+    const qint64 position = playTime();
+    m_dRate = rate;
+    // 倒放不经过解码流水线，流水线保持正向1倍速
+    m_audioDecoder.setTempo(trick || reverse ? 1.0 : rate);
+    m_clock.setSpeed(reverse ? 1.0 : rate);
+    // 快进快退及倒放时没有声音，主时钟退回到外部时钟
+    updateClockStreams();
+
+    if (reverse) {
+        if (!m_bStepping) enterStepping(m_videoPresenter.lastPresentedPts());
+        m_frameStepper.setReverseRate(-rate);
+        m_frameStepper.setPlaying(m_bPlaying);
+        return true;
+    }
+    // 从当前位置重新开始，丢弃按旧速率缓存的数据
+    if (m_bStepping) {
+        leaveStepping(trick);
+    } else {
+        seekToMs(position / 1000, trick);
+    }
+    return true;
+}
+
+bool Decoder::stepFrame(int direction) {
+    if (m_nVideoStreamIdx == -1 || direction == 0) return false;
+    // 逐帧浏览时暂停，倒放也随之暂停
+    if (m_bPlaying) setPlayState(false);
+    if (!m_bStepping) enterStepping(m_videoPresenter.lastPresentedPts());
+    m_frameStepper.step(direction);
+    return true;
+}
+
+void Decoder::enterStepping(qint64 pts) {
+    m_bStepping = true;
+    // 立即停止展示，解码由解复用线程暂停
+    m_videoPresenter.setPlaying(false);
+    m_clock.setPaused(true);
+    PlayerCommand command;
+    command.type = CommandType::Pause;
+    m_commands.push(command);
+    m_frameStepper.setPlaying(m_bPlaying);
+    m_frameStepper.activate(pts);
+}
+
+void Decoder::leaveStepping(bool fast) {
+    const qint64 position = m_frameStepper.position();
+    m_frameStepper.deactivate();
+    // 先放入跳转请求再恢复播放，从逐帧浏览停留的帧继续
+    requestSeek(position, fast);
+    m_bStepping = false;
+    setPlayState(m_bPlaying);
+}
+
+void Decoder::preroll() {
+    m_videoPresenter.setPlaying(false);
+    m_clock.setPaused(true);
+    start();
+}
+
+bool Decoder::isFinished() {
+    if (!m_bPlaying || !isDrained() || m_bStepping || m_dRate < 0) return false;
+    if (hasAudio() && m_audioDecoder.ring()->size() > 0) return false;
+    if (!hasVideo()) return true;
+    const qint64 elapsed = av_gettime_relative() - m_videoPresenter.lastPresentTime();
+    return elapsed >= m_clock.toWallTime(m_videoPresenter.lastPresentedDuration());
+}
+
+qint64 Decoder::finishWaitTime() {
+    // 暂停、逐帧浏览、倒放时不会播完，等待命令唤醒
+    if (m_bFinishNotified || !m_bPlaying || !m_bDemuxPlaying || m_bStepping || m_dActiveRate < 0) return -1;
+    if (isFinished()) return 0;
+    // 等到已读数据按主时钟播完，之后仍未结束时短暂重试
+    Clock& master = m_clock.masterClock();
+    if (!master.isValid()) return FINISH_RETRY_TIME;
+    return qMax<qint64>(FINISH_RETRY_TIME, m_clock.toWallTime(m_nReadEnd - master.get()));
+}
+
+void Decoder::setPlayState(bool play) {
+    m_bPlaying = play;
+    if (m_bStepping) {
+        // 平滑倒放由逐帧浏览线程继续，否则开始播放时交还画面
+        if (isReverseRate(m_dRate)) {
+            m_frameStepper.setPlaying(play);
+            return;
+        }
+        if (play) leaveStepping(false);
+        return;
+    }
+    // 与跳转按请求的顺序在解复用线程中执行
+    PlayerCommand command;
+    command.type = play ? CommandType::Play : CommandType::Pause;
+    m_commands.push(command);
+}
+
+void Decoder::setVideoBufferLimits(const BufferLimits& limits) {
+    m_videoDecoder.setBufferLimits(limits);
+    m_spaceEvent.notify();
+}
+
+void Decoder::setAudioBufferLimits(const BufferLimits& limits) {
+    m_audioDecoder.setBufferLimits(limits);
+    m_spaceEvent.notify();
 }
 
 void Decoder::seekToPosition(qint64 second) {
-    m_nSeekTime = second * AV_TIME_BASE;
+    seekToMs(second * 1000);
+}
+
+void Decoder::seekToMs(qint64 ms, bool fast /* = false */) {
+    // 逐帧浏览及倒放时直接展示目标位置的帧
+    if (m_bStepping) {
+        m_frameStepper.seekTo(qMax<qint64>(0, ms) * 1000);
+        return;
+    }
+    requestSeek(ms * 1000, fast);
+}
+
+QJsonObject Decoder::statsSnapshot() {
+    QJsonObject counters;
+    counters["decodedFrames"] = getDecodedFrames();
+    counters["presentedFrames"] = getPresentedFrames();
+    counters["droppedFrames"] = getDroppedFrames();
+    counters["lateFrames"] = getLateFrames();
+    counters["qualityLevel"] = QualityGovernor::levelName(getQualityLevel());
+    counters["vsyncRepeats"] = m_videoPresenter.getVsyncRepeats();
+    counters["vsyncSkips"] = m_videoPresenter.getVsyncSkips();
+    counters["videoQueuePackets"] = qint64(m_videoDecoder.queueSize());
+    counters["videoQueueBytes"] = m_videoDecoder.queueBytes();
+    counters["audioQueuePackets"] = qint64(m_audioDecoder.queueSize());
+    counters["audioQueueBytes"] = m_audioDecoder.queueBytes();
+    counters["frameQueueFrames"] = qint64(m_videoDecoder.frameQueue()->size());
+    counters["decodeThreads"] = getVideoDecodeThreads();
+    if (m_bSharedDecode) {
+        counters["executorThreads"] = DecodeExecutor::instance().threadCount();
+        counters["executorQueuedTasks"] = DecodeExecutor::instance().queuedTasks();
+        counters["executorSteals"] = DecodeExecutor::instance().steals();
+    }
+    counters["stepCacheBytes"] = getStepCacheBytes();
+    const PoolStats packets = packetPoolStats();
+    const PoolStats frames = framePoolStats();
+    const PoolStats buffers = frameBufferStats();
+    counters["packetAllocs"] = packets.allocs;
+    counters["packetReuses"] = packets.reuses;
+    counters["frameAllocs"] = frames.allocs;
+    counters["frameReuses"] = frames.reuses;
+    counters["frameBufferAllocs"] = buffers.allocs;
+    counters["frameBufferReuses"] = buffers.reuses;
+    const IoStats io = ioStats();
+    counters["ioBytesRead"] = io.bytesRead;
+    counters["ioReadMBps"] = io.readTime > 0 ? io.bytesRead / double(io.readTime) : 0.0;
+    counters["ioStalls"] = io.stalls;
+    counters["ioStallMs"] = io.stallTime / 1000.0;
+    counters["ioSeeks"] = io.seeks;
+    counters["ioSeekHits"] = io.seekHits;
+    counters["ioBufferedBytes"] = m_readAhead.bufferedBytes();
+    counters["avDriftMs"] = getAvDrift() / 1000.0;
+
+    // 起播各阶段从init开始的耗时，尚未完成时为-1
+    const StartupTimes times = startupTimes();
+    auto toMs = [](qint64 usec) { return usec < 0 ? -1.0 : usec / 1000.0; };
+    QJsonObject startup;
+    startup["fastStart"] = m_bFastStart;
+    startup["openMs"] = toMs(times.opened);
+    startup["probeMs"] = toMs(times.probed);
+    startup["codecOpenMs"] = toMs(times.codecsOpened);
+    startup["firstFrameMs"] = toMs(times.firstFrame);
+    startup["audioReadyMs"] = toMs(times.audioReady);
+
+    QJsonObject snapshot;
+    snapshot["timestampMs"] = av_gettime() / 1000;
+    snapshot["counters"] = counters;
+    snapshot["startup"] = startup;
+    snapshot["stages"] = m_metrics.toJson();
+    return snapshot;
 }
@@ -2,15 +2,42 @@
 #define DECODER_H
 
 #include "videoDecoder.h"
+#include "videoPresenter.h"
 #include "audioDecoder.h"
+#include "clock.h"
+#include "pipelineMetrics.h"
+#include "keyframeIndex.h"
+#include "mediaIndexCache.h"
+#include "frameStepper.h"
+#include "readAheadIO.h"
+#include "commandQueue.h"
+#include "qualityGovernor.h"
+#include <QJsonObject>
 #include <QObject>
 #include <QThread>
 #include <QString>
+#include <atomic>
+#include <mutex>
+#include "waitEvent.h"
 
 extern "C" {
 #include <libavformat/avformat.h>
 }
 
+// 起播各阶段完成的时间，从init开始计 单位微秒，尚未完成时为-1
+struct StartupTimes {
+    // avformat_open_input完成
+    qint64 opened = -1;
+    // 流参数就绪：探测完成或使用了缓存
+    qint64 probed = -1;
+    // 解码器已打开，解码线程已启动
+    qint64 codecsOpened = -1;
+    // 第一帧送出展示，即起播耗时
+    qint64 firstFrame = -1;
+    // 音频设备就绪，开始以音频时钟同步
+    qint64 audioReady = -1;
+};
+
 class Decoder : public QThread
 {
     Q_OBJECT
@@ -18,38 +45,297 @@ public:
     Decoder();
     ~Decoder();
 
-    bool init(const QString& uri, bool useHardwareDecoder = false);
+    // threading为软件解码的多线程方式，线程数按CPU核数和正在运行的播放实例数分配
+    bool init(const QString& uri, bool useHardwareDecoder = false, DecodeThreading threading = DecodeThreading::Auto);
+    // 停止解复用及解码线程
+    void close();
     void setPlayState(bool play);
+    // 代替start()启动：解复用和解码照常进行，展示和时钟保持暂停，第一帧留在帧队列中、音频填满PCM缓冲；
+    // 之后setPlayState(true)立即从第一帧开始播放，用于播放列表无缝切换
+    void preroll();
+    // 正向播放到了结尾：数据已取空，音频已全部交给设备，最后一帧已展示满时长
+    bool isFinished();
     void seekToPosition(qint64 second);
+    // 跳转到某位置 单位毫秒
+    // fast为false时从目标之前的关键帧解码到目标时间；为true时直接跳到最近的关键帧，用于拖动进度条
+    void seekToMs(qint64 ms, bool fast = false);
+    // 设置播放速率，为负表示倒放，通过一次跳转生效
+    // 不低于8倍速时只解复用和解码关键帧，并关闭声音；低于8倍速时音频经atempo变速不变调，倒放逐帧展示GOP缓存中的帧
+    bool setPlaybackRate(double rate);
+    inline double getPlaybackRate() { return m_dRate; }
+    // 逐帧前进（direction为1）或后退（-1），暂停播放并由逐帧浏览线程接管画面，之后播放时从当前帧继续
+    bool stepFrame(int direction);
+    // 是否处于逐帧浏览或平滑倒放状态
+    inline bool isStepping() { return m_bStepping; }
+    // 逐帧浏览缓存的内存上限及当前占用 单位字节
+    inline void setStepCacheLimit(qint64 bytes) { m_frameStepper.setCacheLimit(bytes); }
+    inline qint64 getStepCacheBytes() { return m_frameStepper.cacheBytes(); }
+    // 设置视频/音频解码队列的缓存上限
+    void setVideoBufferLimits(const BufferLimits& limits);
+    void setAudioBufferLimits(const BufferLimits& limits);
+    inline BufferLimits getVideoBufferLimits() { return m_videoDecoder.bufferLimits(); }
+    inline BufferLimits getAudioBufferLimits() { return m_audioDecoder.bufferLimits(); }
+    // 设置视频帧的输出像素格式
+    inline void setVideoOutputFormat(AVPixelFormat format) {
+        m_videoPresenter.setOutputFormat(format);
+        m_frameStepper.converter().setOutputFormat(format);
+    }
+    // 设置视频显示区域大小 单位设备像素
+    inline void setVideoOutputSize(int width, int height) {
+        m_videoPresenter.setOutputSize(width, height);
+        m_frameStepper.converter().setOutputSize(width, height);
+    }
+    // 设置视频缩放算法
+    inline void setVideoScaleFlags(int flags) {
+        m_videoPresenter.setScaleFlags(flags);
+        m_frameStepper.converter().setScaleFlags(flags);
+    }
+    // 视频帧是否由渲染循环按垂直同步取用，见VideoPresenter::pickFrame
+    inline void setVsyncDriven(bool enabled) { m_videoPresenter.setVsyncDriven(enabled); }
+    inline void setVsyncInterval(qint64 interval) { m_videoPresenter.setVsyncInterval(interval); }
+    inline VideoFramePtr pickVideoFrame(qint64 displayTime, qint64 interval, bool* more) {
+        return m_videoPresenter.pickFrame(displayTime, interval, more);
+    }
+    // 因落后被丢弃的视频帧数
+    inline qint64 getDroppedFrames() { return m_videoPresenter.getDroppedFrames(); }
+    // 晚于显示时间展示的视频帧数
+    inline qint64 getLateFrames() { return m_videoPresenter.getLateFrames(); }
+    // 解码跟不上时是否自动降低画质，关闭后从下一帧开始恢复完整画质
+    inline void setAdaptiveQuality(bool enabled) { m_qualityGovernor.setEnabled(enabled); }
+    inline bool isAdaptiveQuality() { return m_qualityGovernor.isEnabled(); }
+    // 当前的画质等级
+    inline QualityLevel getQualityLevel() { return m_qualityGovernor.level(); }
 
     // 获取视频总时长 单位秒
     inline qint64 getTotleTime() { return m_nDuration; }
     // 获取当前播放时间 单位秒
-    inline qint64 getPlayTime() { return m_audioDecoder.getFrameTime() / AV_TIME_BASE; }
+    inline qint64 getPlayTime() { return playTime() / AV_TIME_BASE; }
+    // 获取当前播放时间 单位毫秒
+    inline qint64 getPlayTimeMs() { return playTime() / 1000; }
+    // 关键帧索引是否已建立完成
+    inline bool isKeyframeIndexReady() { return m_keyframeIndex.isComplete(); }
+    // 是否使用媒体索引磁盘缓存，在init之前设置
+    inline void setIndexCacheEnabled(bool enabled) { m_bIndexCacheEnabled = enabled; }
+    // 解复用是否经过预读线程读取 bufferBytes为预读缓冲大小，useMmap为true时本地文件映射到内存，在init之前设置
+    inline void setReadAhead(bool enabled, qint64 bufferBytes, bool useMmap = false) {
+        m_bReadAhead = enabled;
+        m_nReadAheadBytes = bufferBytes;
+        m_bReadAheadMmap = useMmap;
+    }
+    // 快速起播：限制探测的数据量和时长，完整的流参数在开始播放后由关键帧索引线程补全，关键帧索引推迟到第一帧展示后建立；
+    // 音频设备就绪（setAudioReady）前由外部时钟驱动，第一帧不等待音频设备。在init之前设置
+    inline void setFastStart(bool enabled) { m_bFastStart = enabled; }
+    inline bool isFastStart() { return m_bFastStart; }
+    // 音频设备已创建并开始消耗PCM缓冲，之后以音频时钟同步
+    void setAudioReady();
+    // 音频设备创建失败，之后只播放视频，由外部时钟驱动；可在任意线程调用
+    void dropAudio();
+    // 起播各阶段的耗时
+    StartupTimes startupTimes();
+    // 音视频解码是否在所有播放实例共享的解码线程池中进行，关闭时各自使用独立的解码线程，在init之前设置
+    inline void setSharedDecode(bool enabled) { m_bSharedDecode = enabled; }
+    inline bool isSharedDecode() { return m_bSharedDecode; }
+    // 设置在共享解码线程池中的优先级，数值大的先解码，如可见或有焦点的画面
+    void setDecodePriority(int priority);
+    inline int getDecodePriority() { return m_nDecodePriority; }
+    // packet、视频帧结构及像素缓冲的分配统计，稳定播放时allocs不再增长
+    inline PoolStats packetPoolStats() { return m_packetPool.stats(); }
+    PoolStats framePoolStats();
+    PoolStats frameBufferStats();
+    // 预读层的吞吐量、等待及跳转统计，未使用预读时全为0
+    inline IoStats ioStats() { return m_readAhead.stats(); }
+    // 打开时读到的媒体索引，缓存不存在时只有流参数
+    inline const MediaIndex& mediaIndex() { return m_mediaIndex; }
     // 获取音频采样率
     inline int getAudioSampleRate() { return m_nAudioSampleRate; }
+    // 是否按时钟展示视频、按音频输出的消耗速度解码音频，关闭后以最快速度解码（性能测试）
+    inline void setVideoPaced(bool paced) { m_videoPresenter.setPaced(paced); }
+    inline void setAudioPaced(bool paced) { m_audioDecoder.setPaced(paced); }
+    // 已解码、已展示的视频帧数
+    inline qint64 getDecodedFrames() { return m_videoDecoder.getDecodedFrames(); }
+    inline qint64 getPresentedFrames() { return m_videoPresenter.getPresentedFrames(); }
+    // 视频帧格式转换的累计耗时 单位微秒
+    inline qint64 getConvertTime() { return m_videoPresenter.getConvertTime(); }
+    // 视频展示线程，用于直接连接framePresented信号统计延迟
+    inline VideoPresenter* videoPresenter() { return &m_videoPresenter; }
+    // 已读到文件末尾且解码队列已取空
+    inline bool isDrained() {
+        return m_bEof && m_videoDecoder.queueSize() == 0 && m_audioDecoder.queueSize() == 0
+            && m_videoDecoder.frameQueue()->size() == 0;
+    }
+
+    // 流水线各阶段的耗时统计，界面线程和渲染线程也向其中记录
+    inline PipelineMetrics& metrics() { return m_metrics; }
+    // 各阶段耗时及帧数、队列状态等计数的快照
+    QJsonObject statsSnapshot();
+
+    // 视频解码实际使用的线程数及多线程方式 FF_THREAD_FRAME/FF_THREAD_SLICE
+    inline int getVideoDecodeThreads() { return m_videoDecoder.threadCount(); }
+    inline int getVideoThreadType() { return m_videoDecoder.threadType(); }
+    // 是否存在音频流、视频流
+    inline bool hasAudio() { return m_nAudioStreamIdx != -1; }
+    inline bool hasVideo() { return m_nVideoStreamIdx != -1; }
+
+    // 播放时钟，音频输出据此校准音频时钟
+    inline MediaClock& clock() { return m_clock; }
+    // 设置音视频同步的主时钟
+    inline void setSyncMaster(SyncMaster master) { m_clock.setMaster(master); }
+    inline SyncMaster getSyncMaster() { return m_clock.master(); }
+    // 当前音视频偏差 单位微秒，为正表示音频超前
+    inline qint64 getAvDrift() { return m_clock.drift(); }
+    // 解码输出的PCM数据，音频设备直接从中拉取
+    inline PcmRingBuffer* audioBuffer() { return m_audioDecoder.ring(); }
 
 signals:
-    void videoFrameReady(QImage frame);
-    void audioFrameReady(QByteArray buffer);
+    void videoFrameReady(VideoFramePtr frame, qint64 presentTime);
+    // 待显示的视频帧即将到期，需要重绘
+    void videoFrameDue();
+    // 画质等级变化，在展示线程或渲染线程中发出
+    void qualityLevelChanged(int level);
+    // 快速起播时有限探测缺少音频参数，完整探测后补开了音频解码，需要创建音频设备；在解复用线程中发出
+    void audioStreamOpened();
+    // 正向播放到了结尾（同isFinished），每次跳转后至多发出一次；在解复用线程中发出
+    void playbackFinished();
 
 protected:
     void run() override;
 
 private:
+    // 将packet放入解码队列，队列满时阻塞等待，有新的跳转请求或中断时丢弃packet并返回false
+    bool pushPacket(DecoderBase& decoder, AVPacket* packet);
+    // 放入跳转标记，队列满时阻塞等待，有新的跳转请求或中断时放弃
+    bool pushSeekMarker(DecoderBase& decoder, qint64 seekTime);
+    // 在解复用线程中执行界面线程发来的命令
+    void processCommands();
+    // 处理跳转请求
+    void doSeek(const PlayerCommand& command);
+    // 请求跳转，分配新的跳转序号，解码和展示线程立即开始丢弃旧数据 time单位微秒
+    void requestSeek(qint64 time, bool fast);
+    // 设置解码流水线的播放状态，在解复用线程中调用
+    void applyPlayState(bool play);
+    // 有尚未执行的命令
+    inline bool hasCommand() { return !m_commands.isEmpty(); }
+    // 有比正在入队的数据更新的跳转请求
+    inline bool seekRequested() { return m_nSerial.load() != m_nDemuxSerial; }
+    // 缓存是否已满，需要暂停读packet
+    bool buffersFull();
+    // 快进快退时读取下一个要展示的关键帧放入视频队列，到达文件首尾时返回false
+    bool readTrickFrame(AVPacket* packet);
+    // 从当前读取位置读到下一个视频关键帧，返回其时间 单位微秒，读取失败或发生跳转时返回AV_NOPTS_VALUE
+    qint64 readKeyframePacket(AVPacket* packet, AVStream* stream);
+    // 将关键帧放入视频队列并记录其时间
+    void pushTrickPacket(AVPacket* packet, qint64 time);
+    // 该速率是否只展示关键帧
+    static bool isTrickRate(double rate);
+    // 该速率是否由逐帧浏览线程平滑倒放
+    static bool isReverseRate(double rate);
+    // 暂停解码流水线，由逐帧浏览线程从pts处接管画面 单位微秒
+    void enterStepping(qint64 pts);
+    // 交还画面，流水线从逐帧浏览的当前帧继续 fast同seekToMs
+    void leaveStepping(bool fast);
+    // 当前播放时间 单位微秒
+    inline qint64 playTime() { return m_bStepping ? m_frameStepper.position() : m_clock.masterTime(); }
+    // 关键帧索引建立完成后写入磁盘缓存
+    void saveIndexCache();
+    // 跳转所用的流，优先按视频流跳转，没有时为-1
+    inline int indexStream() { return int(m_nVideoStreamIdx != -1 ? m_nVideoStreamIdx : m_nAudioStreamIdx.load()); }
+    // 开始为跳转所用的流建立关键帧索引
+    void buildKeyframeIndex();
+    // 关键帧索引线程完整探测了流参数，在索引线程中调用
+    void onStreamsProbed(const AVFormatContext* fmtCtx);
+    // 以完整探测的参数打开有限探测时未能打开的音频流，在解复用线程中调用
+    void openLateAudio();
+    // 送出一帧，在展示线程或渲染线程中调用 presentTime单位微秒
+    void onFrameReady(qint64 presentTime);
+    // 按音频设备是否就绪及播放速率选择主时钟
+    void updateClockStreams();
+    // 读到文件末尾后距离播放结束的等待时间 单位微秒，已播完返回0，暂停等不会结束的状态返回-1
+    qint64 finishWaitTime();
+    // 按CPU核数和正在运行的播放实例数计算每个实例的视频解码线程数
+    static int videoDecodeThreads();
+
+
     QString m_strUri = "";
     AVFormatContext* m_pFmtCtx = nullptr;
+    // 解复用的自定义I/O，须在m_pFmtCtx关闭之后关闭
+    ReadAheadIO m_readAhead;
+    bool m_bReadAhead = true;
+    bool m_bReadAheadMmap = false;
+    qint64 m_nReadAheadBytes = 0;
+    // 解复用读到的packet移入池中的packet后入队，解码线程用完归还；须在解码器之后析构
+    PacketPool m_packetPool;
     VideoDecoder m_videoDecoder;
+    VideoPresenter m_videoPresenter;
     AudioDecoder m_audioDecoder;
+    // 音频、视频及外部时钟
+    MediaClock m_clock;
+    PipelineMetrics m_metrics;
+    // 按视频落后于主时钟的程度逐级降低解码画质
+    QualityGovernor m_qualityGovernor;
     qint64 m_nVideoStreamIdx = -1;
-    qint64 m_nAudioStreamIdx = -1;
-    // 总播放时长 单位秒
-    qint64 m_nDuration = 0;
-    bool m_bPlaying = false;
-    // 跳转的时间 单位微秒
-    qint64 m_nSeekTime = -1;
+    // 快速起播补开音频流时在解复用线程中修改
+    std::atomic<qint64> m_nAudioStreamIdx = -1;
+    // 总播放时长 单位秒，快速起播时由完整探测的结果更新
+    std::atomic<qint64> m_nDuration = 0;
+    // 界面设置的播放状态，解码流水线按命令顺序在解复用线程中切换
+    std::atomic<bool> m_bPlaying = false;
+    // 解复用线程当前的播放状态，只在解复用线程中使用
+    bool m_bDemuxPlaying = true;
+    // 已读到文件末尾
+    std::atomic<bool> m_bEof = false;
+    // 已读到的数据的结束时间 单位微秒，及这次跳转后是否已发出playbackFinished，只在解复用线程中使用
+    qint64 m_nReadEnd = 0;
+    bool m_bFinishNotified = false;
+    // 播放、暂停及跳转命令
+    CommandQueue m_commands;
+    // 最近一次请求的跳转序号，及解复用线程正在入队的数据所属的跳转序号
+    std::atomic<int> m_nSerial = 0;
+    int m_nDemuxSerial = 0;
+    std::mutex m_seekMutex;
+    // 设置的播放速率，及解复用线程在最近一次跳转时采用的速率
+    std::atomic<double> m_dRate = 1.0;
+    double m_dActiveRate = 1.0;
+    // 快进快退时最近一个入队的关键帧的时间 单位微秒
+    qint64 m_nTrickPos = 0;
+    // 逐帧浏览及平滑倒放，处于该状态时解复用、解码和展示线程暂停
+    FrameStepper m_frameStepper;
+    std::atomic<bool> m_bStepping = false;
+    // 跳转所用的关键帧索引，打开文件后在后台建立
+    KeyframeIndex m_keyframeIndex;
+    // 流参数及关键帧表，读自或写入磁盘缓存
+    MediaIndex m_mediaIndex;
+    bool m_bIndexCacheEnabled = true;
+    // 快速起播，及推迟到第一帧展示后建立的关键帧索引
+    bool m_bFastStart = false;
+    std::atomic<bool> m_bIndexDeferred = false;
+    // 关键帧索引线程完整探测得到的流参数
+    std::mutex m_probeMutex;
+    MediaIndex m_probedIndex;
+    // 有限探测缺少参数、等待完整探测后再打开的音频流，及完整探测是否已完成
+    int m_nLateAudioIdx = -1;
+    std::atomic<bool> m_bLateAudioProbed = false;
+    // 音频解码的多线程配置，补开音频流时使用
+    ThreadingConfig m_audioThreading;
+    // 音频设备是否就绪，就绪前主时钟退回到外部时钟
+    std::atomic<bool> m_bAudioReady = false;
+    // init开始的系统时间 单位微秒，及起播各阶段完成的时间
+    qint64 m_nInitTime = 0;
+    std::atomic<qint64> m_nOpenedTime = -1;
+    std::atomic<qint64> m_nProbedTime = -1;
+    std::atomic<qint64> m_nCodecsTime = -1;
+    std::atomic<qint64> m_nFirstFrameTime = -1;
+    std::atomic<qint64> m_nAudioReadyTime = -1;
+    // 解码队列腾出空间、播放状态变化时通知
+    WaitEvent m_spaceEvent;
+    // 音视频解码是否在共享线程池中进行，及在其中的优先级
+    bool m_bSharedDecode = false;
+    std::atomic<int> m_nDecodePriority = 0;
     // 音频采样率
     int m_nAudioSampleRate = 0;
+    // 是否计入了正在运行的播放实例数
+    bool m_bActive = false;
+    // 正在运行的播放实例数，所有实例平分CPU核
+    static std::atomic<int> s_nActiveDecoders;
 };
 
 #endif // DECODER_H
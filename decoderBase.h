@@ -1,9 +1,13 @@
 #ifndef DECODERBASE_H
 #define DECODERBASE_H
 
-#include <mutex>
-#include <condition_variable>
-#include <QQueue>
+#include <algorithm>
+#include <atomic>
+#include "packetQueue.h"
+#include "waitEvent.h"
+#include "pipelineMetrics.h"
+#include "decodeExecutor.h"
+#include "mediaPool.h"
 
 extern "C" {
 #include <libavformat/avformat.h>
@@ -11,60 +15,245 @@ extern "C" {
 #include <libavutil/time.h>
 }
 
+// 共享线程池中解码任务每个时间片的最长执行时间 单位微秒
+#define DECODE_SLICE_TIME 2000
+
+// 解码队列的缓存上限，为0表示不限制
+struct BufferLimits {
+    // 最大缓存字节数
+    qint64 maxBytes = 0;
+    // 最大缓存时长 单位微秒
+    qint64 maxDuration = 0;
+};
+
+// 软件解码的多线程方式
+enum class DecodeThreading {
+    // 解码器支持帧多线程时使用帧多线程，否则使用片多线程
+    Auto,
+    // 帧多线程，吞吐量高，但会增加与线程数相当的帧延迟
+    Frame,
+    // 片多线程，不增加延迟，加速效果取决于码流的分片数
+    Slice
+};
+
+// 解码线程配置
+struct ThreadingConfig {
+    DecodeThreading mode = DecodeThreading::Auto;
+    // 线程数，为0表示由libavcodec按CPU核数决定
+    int threadCount = 0;
+};
+
 class DecoderBase {
 public:
-    DecoderBase() {};
+    explicit DecoderBase(size_t queueCapacity) : m_queue(queueCapacity) {
+        // 入队、跳转、播放状态变化及输出腾出空间都通知同一个事件
+        m_queue.setDataEvent(&m_stateEvent);
+    };
     virtual ~DecoderBase() {};
 
+    // 在共享解码线程池中开始解码，代替启动独立的解码线程；priority为任务优先级
+    inline void startTask(DecodeExecutor* executor, int priority = 0) {
+        m_bPlaying = true;
+        m_pTask = executor->createTask([this]{ return runSlice(); }, priority);
+        ExecutorTask* task = m_pTask.get();
+        m_stateEvent.setListener([task]{ task->wake(); });
+        task->wake();
+    }
+
+    // 取消线程池中的解码任务，正在执行时等待其结束
+    inline void stopTask() {
+        if (m_pTask) m_pTask->cancel();
+    }
+
+    // 设置线程池中解码任务的优先级，数值大的先执行
+    inline void setTaskPriority(int priority) {
+        if (m_pTask) m_pTask->setPriority(priority);
+    }
+
     inline void play() {
         m_bPlaying = true;
-        m_cv.notify_all();
+        m_stateEvent.notify();
     }
 
     inline void stop() {
        m_bPlaying = false;
     }
 
-    inline void addToQueue(AVPacket* packet) {
-        m_mutex.lock();
-        m_queue.enqueue(packet);
-        m_mutex.unlock();
+    // 中止解码线程的所有等待
+    inline void abort() {
+        m_queue.abort();
+        m_stateEvent.notify();
+    }
+
+    // 入队，serial为packet所属的跳转序号，队列已满时返回false，由调用者等待空间事件后重试
+    inline bool addToQueue(AVPacket* packet, int serial) {
+        return m_queue.push(packet, serial);
     }
 
     inline qsizetype queueSize() {
         return m_queue.size();
     }
 
+    inline bool queueFull() {
+        return m_queue.isFull();
+    }
+
+    // 队列中packet的总字节数
+    inline qint64 queueBytes() {
+        return m_queue.bytes();
+    }
+
+    // 队列中packet的总时长 单位微秒；packet不带时长时总和偏小，取与时间戳跨度中较大的一个
+    inline qint64 queueDuration() {
+        return av_rescale_q(std::max(m_queue.duration(), m_queue.span()), m_timeBase, AV_TIME_BASE_Q);
+    }
+
+    inline void setBufferLimits(const BufferLimits& limits) {
+        m_nMaxBytes = limits.maxBytes;
+        m_nMaxDuration = limits.maxDuration;
+    }
+
+    inline BufferLimits bufferLimits() {
+        return { m_nMaxBytes, m_nMaxDuration };
+    }
+
+    // 缓存量是否达到上限
+    inline bool queueOverLimit() {
+        if (m_queue.isFull()) return true;
+        const qint64 maxBytes = m_nMaxBytes;
+        const qint64 maxDuration = m_nMaxDuration;
+        if (maxBytes > 0 && queueBytes() >= maxBytes) return true;
+        if (maxDuration > 0 && queueDuration() >= maxDuration) return true;
+        return false;
+    }
+
+    // 队列出队时通知该事件
+    inline void setSpaceEvent(WaitEvent* event) {
+        m_queue.setSpaceEvent(event);
+    }
+
     inline qint64 getFrameTime() {
         return m_nFrameTime;
     }
 
-    inline void seekToPosition(qint64 seekTime) {
-        m_mutex.lock();
-        for (auto packet : m_queue) {
-            av_packet_unref(packet);
+    // 请求跳转时立即调用，之后解码线程丢弃序号较旧的packet，直到取到该序号的跳转标记
+    inline void requestSeek(int serial) {
+        m_nSerial = serial;
+        m_stateEvent.notify();
+    }
+
+    // 由解复用线程在跳转后调用，放入跳转标记，队列已满时返回false，由调用者等待空间事件后重试
+    // 解码线程取到标记时清空解码器缓存，丢弃seekTime之前的帧 seekTime单位微秒，为-1表示不丢弃
+    inline bool seekToPosition(qint64 seekTime, int serial) {
+        return m_queue.pushFlush(serial, seekTime);
+    }
+
+    // 用完的packet归还到该池，为空时直接释放
+    inline void setPacketPool(PacketPool* pool) { m_pPacketPool = pool; }
+
+    // 设置统计各阶段耗时的对象，为空时不统计
+    inline void setMetrics(PipelineMetrics* metrics) { m_pMetrics = metrics; }
+
+    // 解码器实际使用的线程数
+    inline int threadCount() { return m_pDecCtx ? m_pDecCtx->thread_count : 0; }
+    // 解码器实际使用的多线程方式 FF_THREAD_FRAME/FF_THREAD_SLICE，为0表示单线程
+    inline int threadType() { return m_pDecCtx ? m_pDecCtx->active_thread_type : 0; }
+
+protected:
+    // 推进一步：处理一个packet、接收一帧或写出一段数据，返回false表示需要等待输入、输出空间或恢复播放
+    virtual bool decodeStep() = 0;
+    // decodeStep能否继续推进，独立解码线程据此等待
+    virtual bool hasWork() = 0;
+    // 已解码数据按当前速度将被取空的系统时间 单位微秒，作为线程池的调度截止时间
+    virtual qint64 outputDeadline() = 0;
+
+    // 独立解码线程的主循环，interrupted()为真时退出
+    template <typename Interrupted>
+    inline void runLoop(Interrupted interrupted) {
+        while (!interrupted()) {
+            if (!decodeStep()) m_stateEvent.wait([&]{ return hasWork() || interrupted(); });
+        }
+    }
+
+    // 线程池中执行一个时间片，用完时间片时返回true
+    inline bool runSlice() {
+        const qint64 sliceEnd = av_gettime_relative() + DECODE_SLICE_TIME;
+        bool more = decodeStep();
+        while (more && av_gettime_relative() < sliceEnd) more = decodeStep();
+        m_pTask->setDeadline(outputDeadline());
+        return more;
+    }
+
+    // 在打开解码器之前设置多线程方式，解码器不支持请求的方式时退回到它支持的方式
+    inline void applyThreading(const AVCodec* codec, const ThreadingConfig& config) {
+        int supported = 0;
+        if (codec->capabilities & AV_CODEC_CAP_FRAME_THREADS) supported |= FF_THREAD_FRAME;
+        if (codec->capabilities & AV_CODEC_CAP_SLICE_THREADS) supported |= FF_THREAD_SLICE;
+
+        int type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+        if (config.mode == DecodeThreading::Frame) type = FF_THREAD_FRAME;
+        if (config.mode == DecodeThreading::Slice) type = FF_THREAD_SLICE;
+        type &= supported;
+        if (!type) type = supported;
+
+        m_pDecCtx->thread_type = type;
+        m_pDecCtx->thread_count = type ? config.threadCount : 1;
+    }
+
+    inline void recordMetric(MetricStage stage, qint64 usec) {
+        if (m_pMetrics) m_pMetrics->record(stage, usec);
+    }
+
+    // 释放用完的packet
+    inline void releasePacket(AVPacket* packet) {
+        if (m_pPacketPool) {
+            m_pPacketPool->recycle(packet);
+        } else {
             av_packet_free(&packet);
         }
-        m_queue.clear();
-        m_bSeekFlag = true;
-        m_nSeekTime = seekTime;
-        m_mutex.unlock();
     }
 
-protected:
+    // 有尚未处理的跳转，正在解码的数据已过期
+    inline bool seekPending() {
+        return m_nDecodeSerial != m_nSerial.load();
+    }
+
+    // packet是否属于正在解码的跳转序号
+    inline bool isCurrent(const PacketQueue::Info& info) {
+        return info.serial == m_nDecodeSerial;
+    }
+
+    // 处理跳转标记，返回false表示标记已被更新的跳转取代，直接丢弃
+    inline bool handleFlushPacket(const PacketQueue::Info& info) {
+        if (info.serial != m_nSerial.load()) return false;
+        avcodec_flush_buffers(m_pDecCtx);
+        m_nDecodeSerial = info.serial;
+        m_nSkipUntil = info.seekTime;
+        return true;
+    }
+
     // 帧时间 单位微秒
     qint64 m_nFrameTime = 0;
-    std::mutex m_mutex;
-    std::condition_variable m_cv;
     AVStream* m_pStream = nullptr;
     AVCodecContext* m_pDecCtx = nullptr;
-    AVRational m_timeBase;
-    bool m_bPlaying = false;
-    QQueue<AVPacket*> m_queue;
-    // 跳转标志
-    bool m_bSeekFlag = false;
-    // 跳转时间 单位微秒
-    qint64 m_nSeekTime = -1;
+    AVRational m_timeBase = { 0, 1 };
+    std::atomic<bool> m_bPlaying = false;
+    PacketQueue m_queue;
+    // 有packet入队、播放状态变化、发生跳转及输出腾出空间时通知
+    WaitEvent m_stateEvent;
+    // 最近一次请求的跳转序号
+    std::atomic<int> m_nSerial = 0;
+    // 正在解码的数据所属的跳转序号，只在解码线程中使用
+    int m_nDecodeSerial = 0;
+    // 解码线程丢弃该时间之前的帧 单位微秒
+    qint64 m_nSkipUntil = -1;
+    // 缓存上限
+    std::atomic<qint64> m_nMaxBytes = 0;
+    std::atomic<qint64> m_nMaxDuration = 0;
+    PipelineMetrics* m_pMetrics = nullptr;
+    PacketPool* m_pPacketPool = nullptr;
+    // 共享线程池中的解码任务，使用独立线程时为空
+    ExecutorTaskPtr m_pTask;
 };
 
 #endif // DECODERBASE_H
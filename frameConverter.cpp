@@ -0,0 +1,136 @@
+#include "frameConverter.h"
+#include "decodeExecutor.h"
+#include <QDebug>
+#include <QThread>
+#include <algorithm>
+
+extern "C" {
+#include <libavutil/pixdesc.h>
+#include <libavutil/time.h>
+}
+
+// 并行转换时每段的最少行数 单位行，过小时线程调度的开销超过转换本身
+#define CONVERT_SLICE_ROWS 64
+// 降低输出分辨率时的缩放比例
+#define REDUCED_SCALE 0.5
+
+FrameConverter::~FrameConverter() {
+    if (m_swsCtx) sws_freeContext(m_swsCtx);
+}
+
+VideoFramePtr FrameConverter::convert(const AVFrame* frame) {
+    AVPixelFormat outFormat = static_cast<AVPixelFormat>(m_nOutputFormat.load());
+    if (outFormat == AV_PIX_FMT_NONE) {
+        // 渲染端可直接上传的格式，以引用方式输出
+        if (isRenderableFormat(frame->format)) return m_pPool->ref(frame);
+        outFormat = AV_PIX_FMT_YUV420P;
+    }
+
+    int outWidth = 0, outHeight = 0;
+    outputSizeForFrame(frame, &outWidth, &outHeight);
+
+    VideoFramePtr out = m_pPool->take();
+    if (!out) return nullptr;
+    AVFrame* outFrame = out.get();
+    outFrame->format = outFormat;
+    outFrame->width = outWidth;
+    outFrame->height = outHeight;
+
+    // 不需要缩放的常见格式直接由SIMD内核并行转换
+    if (outWidth == frame->width && outHeight == frame->height && YuvToRgb::supports(frame->format, outFormat)) {
+        if (!m_pPool->allocBuffer(outFrame)) {
+            qCritical() << "Failed to allocate converted frame";
+            return nullptr;
+        }
+        av_frame_copy_props(outFrame, frame);
+        const qint64 convertStart = av_gettime_relative();
+        convertSliced(frame, outFrame);
+        if (m_pMetrics) m_pMetrics->record(MetricStage::Convert, av_gettime_relative() - convertStart);
+        return out;
+    }
+
+    // 输入输出格式、大小或缩放算法变化时重建SwsContext
+    m_swsCtx = sws_getCachedContext(
+        m_swsCtx,
+        frame->width,             // 输入宽度
+        frame->height,            // 输入高度
+        static_cast<AVPixelFormat>(frame->format), // 输入像素格式
+        outWidth,                 // 输出宽度
+        outHeight,                // 输出高度
+        outFormat,                // 输出像素格式
+        m_bReducedScale ? SWS_FAST_BILINEAR : m_nScaleFlags.load(), // 插值方法
+        nullptr, nullptr, nullptr
+        );
+    if (!m_swsCtx) {
+        qCritical() << "Failed to initialize the conversion context";
+        return nullptr;
+    }
+    applyColorspace(frame, outFormat);
+
+    if (!m_pPool->allocBuffer(outFrame)) {
+        qCritical() << "Failed to allocate converted frame";
+        return nullptr;
+    }
+    av_frame_copy_props(outFrame, frame);
+    const qint64 scaleStart = av_gettime_relative();
+    sws_scale(m_swsCtx, frame->data, frame->linesize, 0, frame->height, outFrame->data, outFrame->linesize);
+    if (m_pMetrics) m_pMetrics->record(MetricStage::Convert, av_gettime_relative() - scaleStart);
+    return out;
+}
+
+void FrameConverter::applyColorspace(const AVFrame* frame, AVPixelFormat outFormat) {
+    // 未标明色彩空间时，高清按BT.709，标清按BT.601，与YuvToRgb一致
+    bool bt709 = frame->colorspace == AVCOL_SPC_BT709;
+    if (frame->colorspace == AVCOL_SPC_UNSPECIFIED) bt709 = frame->height >= 720;
+    int space = bt709 ? SWS_CS_ITU709 : SWS_CS_ITU601;
+    if (frame->colorspace == AVCOL_SPC_BT2020_NCL || frame->colorspace == AVCOL_SPC_BT2020_CL) space = SWS_CS_BT2020;
+    const int* table = sws_getCoefficients(space);
+    const int srcRange = frame->color_range == AVCOL_RANGE_JPEG || frame->format == AV_PIX_FMT_YUVJ420P ? 1 : 0;
+    // 输出RGB时为全范围，输出YUV时保持输入的范围
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(outFormat);
+    const int dstRange = desc && (desc->flags & AV_PIX_FMT_FLAG_RGB) ? 1 : srcRange;
+
+    // 系数未变化时不重复设置，设置会重建转换表
+    int* curInvTable = nullptr;
+    int* curTable = nullptr;
+    int curSrcRange = 0, curDstRange = 0, brightness = 0, contrast = 0, saturation = 0;
+    if (sws_getColorspaceDetails(m_swsCtx, &curInvTable, &curSrcRange, &curTable, &curDstRange,
+                                 &brightness, &contrast, &saturation) >= 0
+        && curSrcRange == srcRange && curDstRange == dstRange
+        && std::equal(table, table + 4, curInvTable) && std::equal(table, table + 4, curTable)) {
+        return;
+    }
+    sws_setColorspaceDetails(m_swsCtx, table, srcRange, table, dstRange, 0, 1 << 16, 1 << 16);
+}
+
+void FrameConverter::convertSliced(const AVFrame* frame, AVFrame* outFrame) {
+    const int slices = qBound(1, frame->height / CONVERT_SLICE_ROWS, QThread::idealThreadCount());
+    // 每段的起始行为偶数，两行亮度共用一行色度
+    const int rowsPerSlice = ((frame->height + slices - 1) / slices + 1) & ~1;
+    const SimdLevel level = m_simdLevel;
+    DecodeExecutor::instance().parallelFor(slices, [frame, outFrame, rowsPerSlice, level](int index) {
+        const int rowStart = index * rowsPerSlice;
+        YuvToRgb::convertRows(frame, outFrame, rowStart, rowStart + rowsPerSlice, level);
+    });
+}
+
+void FrameConverter::outputSizeForFrame(const AVFrame* frame, int* width, int* height) {
+    *width = frame->width;
+    *height = frame->height;
+
+    const int boundWidth = m_nOutputWidth;
+    const int boundHeight = m_nOutputHeight;
+    double scale = 1.0;
+    // 保持宽高比放入显示区域
+    if (boundWidth > 0 && boundHeight > 0) {
+        scale = std::min(double(boundWidth) / frame->width, double(boundHeight) / frame->height);
+    }
+    // 放大由渲染端完成，只在比显示区域大时缩小以减少转换和上传的数据量
+    scale = std::min(scale, 1.0);
+    if (m_bReducedScale) scale *= REDUCED_SCALE;
+    if (scale >= 1.0) return;
+
+    // 宽高取偶数，兼容YUV420的色度平面
+    *width = std::max(2, int(frame->width * scale + 0.5) & ~1);
+    *height = std::max(2, int(frame->height * scale + 0.5) & ~1);
+}
@@ -0,0 +1,63 @@
+#ifndef FRAMECONVERTER_H
+#define FRAMECONVERTER_H
+
+#include "videoFrame.h"
+#include "pipelineMetrics.h"
+#include "mediaPool.h"
+#include "yuvToRgb.h"
+#include <atomic>
+
+extern "C" {
+#include <libswscale/swscale.h>
+}
+
+// 视频帧格式转换
+// 渲染端可直接上传的帧以引用方式输出，其余帧转换为输出格式并缩放到显示区域内；
+// 不需要缩放的YUV420P/NV12转RGBA/BGRA使用SIMD内核，按行切分后在共享线程池中并行转换，其余组合使用swscale；
+// 设置接口可在任意线程调用，convert只在一个线程中调用
+class FrameConverter {
+public:
+    FrameConverter() {};
+    ~FrameConverter();
+
+    // 设置输出像素格式，AV_PIX_FMT_NONE表示可直接渲染的YUV帧以引用方式输出，不做转换
+    inline void setOutputFormat(AVPixelFormat format) { m_nOutputFormat = format; }
+    // 设置显示区域大小（设备像素），需要转换的帧直接缩放到该区域内保持宽高比的大小
+    inline void setOutputSize(int width, int height) {
+        m_nOutputWidth = width;
+        m_nOutputHeight = height;
+    }
+    // 设置缩放算法 SWS_BILINEAR、SWS_BICUBIC等
+    inline void setScaleFlags(int flags) { m_nScaleFlags = flags; }
+    // 降低输出分辨率：需要转换的帧再缩小一半并使用最快的缩放算法，用于解码跟不上时减轻转换和上传的负担
+    inline void setReducedScale(bool reduced) { m_bReducedScale = reduced; }
+    inline void setMetrics(PipelineMetrics* metrics) { m_pMetrics = metrics; }
+
+    // 将解码后的帧转换为输出格式，失败时返回空
+    VideoFramePtr convert(const AVFrame* frame);
+    // 输出帧的回收池，用于统计分配次数
+    inline const FramePoolPtr& framePool() const { return m_pPool; }
+
+private:
+    // 计算转换后的帧大小
+    void outputSizeForFrame(const AVFrame* frame, int* width, int* height);
+    // 按行切分并行转换到outFrame
+    void convertSliced(const AVFrame* frame, AVFrame* outFrame);
+    // 按帧的色彩空间和范围设置swscale的转换系数，与YuvToRgb的选择一致
+    void applyColorspace(const AVFrame* frame, AVPixelFormat outFormat);
+
+    SwsContext* m_swsCtx = nullptr;
+    // CPU支持的最高指令集
+    const SimdLevel m_simdLevel = YuvToRgb::detect();
+    // 输出帧及像素缓冲从池中分配，渲染端释放后回收
+    FramePoolPtr m_pPool = FramePool::create();
+    PipelineMetrics* m_pMetrics = nullptr;
+    std::atomic<int> m_nOutputFormat = AV_PIX_FMT_NONE;
+    // 显示区域大小，为0表示保持原始分辨率
+    std::atomic<int> m_nOutputWidth = 0;
+    std::atomic<int> m_nOutputHeight = 0;
+    std::atomic<int> m_nScaleFlags = SWS_BILINEAR;
+    std::atomic<bool> m_bReducedScale = false;
+};
+
+#endif // FRAMECONVERTER_H
@@ -0,0 +1,99 @@
+#ifndef FRAMEQUEUE_H
+#define FRAMEQUEUE_H
+
+#include "videoFrame.h"
+#include "waitEvent.h"
+#include <atomic>
+#include <vector>
+
+extern "C" {
+#include <libavutil/time.h>
+}
+
+// 单生产者/单消费者的已解码帧队列
+// 生产者为视频解码线程，消费者为展示线程，帧以引用方式保存，不拷贝像素数据
+class FrameQueue {
+public:
+    struct Entry {
+        VideoFramePtr frame;
+        // 显示时间 单位微秒
+        qint64 pts = 0;
+        // 帧时长 单位微秒，未知时为0
+        qint64 duration = 0;
+        // 所属的跳转序号，与队列当前序号不同的帧已过期
+        int serial = 0;
+        // 入队时的系统时间 单位微秒，用于统计解码到展示的延迟
+        qint64 queuedTime = 0;
+    };
+
+    explicit FrameQueue(size_t capacity) : m_ring(capacity), m_nCapacity(capacity) {};
+    ~FrameQueue() {};
+
+    // 入队，serial为帧所属的跳转序号，队列已满时返回false（生产者线程调用）
+    inline bool push(const VideoFramePtr& frame, qint64 pts, qint64 duration, int serial) {
+        const size_t tail = m_nTail.load(std::memory_order_relaxed);
+        if (tail - m_nHead.load(std::memory_order_acquire) >= m_nCapacity) return false;
+        Entry& entry = m_ring[tail % m_nCapacity];
+        entry.frame = frame;
+        entry.pts = pts;
+        entry.duration = duration;
+        entry.serial = serial;
+        entry.queuedTime = av_gettime_relative();
+        m_nTail.store(tail + 1, std::memory_order_release);
+        m_dataEvent.notify();
+        return true;
+    }
+
+    // 查看队首之后第index个帧，不存在时返回nullptr（消费者线程调用）
+    inline Entry* peek(size_t index = 0) {
+        const size_t head = m_nHead.load(std::memory_order_relaxed);
+        if (m_nTail.load(std::memory_order_acquire) - head <= index) return nullptr;
+        return &m_ring[(head + index) % m_nCapacity];
+    }
+
+    // 移除队首的帧并返回（消费者线程调用）
+    inline VideoFramePtr pop() {
+        const size_t head = m_nHead.load(std::memory_order_relaxed);
+        if (head == m_nTail.load(std::memory_order_acquire)) return nullptr;
+        VideoFramePtr frame = std::move(m_ring[head % m_nCapacity].frame);
+        m_nHead.store(head + 1, std::memory_order_release);
+        if (m_pSpaceEvent) m_pSpaceEvent->notify();
+        return frame;
+    }
+
+    // 使序号不同的帧过期，请求跳转时调用，过期的帧由消费者取出时丢弃
+    inline void setSerial(int serial) {
+        m_nSerial = serial;
+        m_dataEvent.notify();
+    }
+
+    // 中止队列，唤醒所有等待者
+    inline void abort() {
+        m_bAbort = true;
+        m_dataEvent.notify();
+        if (m_pSpaceEvent) m_pSpaceEvent->notify();
+    }
+
+    inline int serial() const { return m_nSerial; }
+    inline bool isAborted() const { return m_bAbort; }
+    inline size_t size() const { return m_nTail.load(std::memory_order_acquire) - m_nHead.load(std::memory_order_acquire); }
+    inline bool isFull() const { return size() >= m_nCapacity; }
+
+    // 入队、跳转及中止时通知，展示线程通过它等待
+    inline WaitEvent& dataEvent() { return m_dataEvent; }
+    // 出队时通知的事件，解码线程通过它等待队列腾出空间
+    inline void setSpaceEvent(WaitEvent* event) { m_pSpaceEvent = event; }
+
+private:
+    std::vector<Entry> m_ring;
+    const size_t m_nCapacity;
+    // 读写位置单调递增，取模得到下标
+    std::atomic<size_t> m_nHead = 0;
+    std::atomic<size_t> m_nTail = 0;
+    std::atomic<int> m_nSerial = 0;
+    std::atomic<bool> m_bAbort = false;
+    WaitEvent m_dataEvent;
+    WaitEvent* m_pSpaceEvent = nullptr;
+};
+
+#endif // FRAMEQUEUE_H
@@ -0,0 +1,421 @@
+#include "frameStepper.h"
+#include <QDebug>
+#include <limits>
+
+extern "C" {
+#include <libavutil/time.h>
+}
+
+// 单个GOP最多占用的缓存比例，保证缓存中至少能同时放下当前GOP和相邻的GOP
+#define GOP_CACHE_SHARE 3
+// 倒放时两帧的展示间隔上限 单位微秒
+#define MAX_REVERSE_INTERVAL 200000
+// 倒放落后超过该时间时不再追赶，从当前时间重新计时 单位微秒
+#define MAX_REVERSE_LATE 100000
+
+FrameStepper::FrameStepper() {
+
+}
+
+FrameStepper::~FrameStepper() {
+    close();
+}
+
+void FrameStepper::open(const QString& uri, int streamIndex, KeyframeIndex* keyframes) {
+    close();
+    m_strUri = uri;
+    m_nStreamIdx = streamIndex;
+    m_pKeyframes = keyframes;
+    m_bInputFailed = false;
+    m_bStop = false;
+    m_nFirstTime = AV_NOPTS_VALUE;
+    m_nEofTime = AV_NOPTS_VALUE;
+    start();
+}
+
+void FrameStepper::close() {
+    if (!isRunning()) return;
+    m_bStop = true;
+    m_requestEvent.notify();
+    wait();
+}
+
+void FrameStepper::activate(qint64 pts) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_nPendingSteps = 0;
+        m_nSeekTarget = pts;
+    }
+    m_nPosition = pts;
+    m_bActive = true;
+    m_requestEvent.notify();
+}
+
+void FrameStepper::deactivate() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_nPendingSteps = 0;
+        m_nSeekTarget = AV_NOPTS_VALUE;
+    }
+    m_dReverseRate = 0;
+    m_bActive = false;
+    m_requestEvent.notify();
+}
+
+void FrameStepper::step(int direction) {
+    if (direction == 0) return;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_nPendingSteps += direction > 0 ? 1 : -1;
+    }
+    m_requestEvent.notify();
+}
+
+void FrameStepper::seekTo(qint64 pts) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_nPendingSteps = 0;
+        m_nSeekTarget = pts;
+    }
+    m_requestEvent.notify();
+}
+
+void FrameStepper::setReverseRate(double rate) {
+    m_dReverseRate = qMax(0.0, rate);
+    m_requestEvent.notify();
+}
+
+void FrameStepper::setPlaying(bool playing) {
+    m_bPlaying = playing;
+    m_requestEvent.notify();
+}
+
+bool FrameStepper::hasRequest() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_nPendingSteps != 0 || m_nSeekTarget != AV_NOPTS_VALUE;
+}
+
+void FrameStepper::run() {
+    m_pPacket = av_packet_alloc();
+    m_pFrame = av_frame_alloc();
+
+    while (!m_bStop) {
+        if (!m_bActive) {
+            m_job = GopJob();
+            m_nDeadline = 0;
+            m_requestEvent.wait([this] { return m_bStop || m_bActive; });
+            continue;
+        }
+        if (!m_pFmtCtx && !m_bInputFailed && !openInput()) {
+            closeInput();
+            m_bInputFailed = true;
+        }
+        if (m_bInputFailed) {
+            m_requestEvent.wait([this] { return m_bStop || !m_bActive; });
+            continue;
+        }
+        m_cache.setMaxBytes(m_nCacheLimit);
+
+        qint64 seekTarget = AV_NOPTS_VALUE;
+        int direction = 0;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            seekTarget = m_nSeekTarget;
+            m_nSeekTarget = AV_NOPTS_VALUE;
+            if (seekTarget == AV_NOPTS_VALUE && m_nPendingSteps != 0) {
+                direction = m_nPendingSteps > 0 ? 1 : -1;
+                m_nPendingSteps -= direction;
+            }
+        }
+
+        if (seekTarget != AV_NOPTS_VALUE) {
+            const CachedGop* gop = ensureGop(seekTarget);
+            if (gop && !gop->frames.empty()) {
+                const auto& frame = gop->frames[qMax(0, gop->indexAt(seekTarget))];
+                present(frame.first, frame.second);
+            }
+            m_nDeadline = 0;
+            continue;
+        }
+        if (direction != 0) {
+            doStep(direction);
+            continue;
+        }
+        const double rate = m_dReverseRate;
+        if (rate > 0 && m_bPlaying) {
+            reverseTick(rate);
+            continue;
+        }
+        m_nDeadline = 0;
+        m_requestEvent.wait([this] {
+            return m_bStop || !m_bActive || hasRequest() || (m_dReverseRate > 0 && m_bPlaying);
+        });
+    }
+
+    m_job = GopJob();
+    m_cache.clear();
+    closeInput();
+    av_frame_free(&m_pFrame);
+    av_packet_free(&m_pPacket);
+}
+
+bool FrameStepper::openInput() {
+    if (avformat_open_input(&m_pFmtCtx, m_strUri.toUtf8().constData(), nullptr, nullptr) != 0) {
+        qWarning() << "FrameStepper: failed to open input";
+        return false;
+    }
+    if (avformat_find_stream_info(m_pFmtCtx, nullptr) < 0) {
+        qWarning() << "FrameStepper: failed to retrieve stream info";
+        return false;
+    }
+    if (m_nStreamIdx < 0 || m_nStreamIdx >= int(m_pFmtCtx->nb_streams)) return false;
+    // 只读取视频流
+    for (unsigned int i = 0; i < m_pFmtCtx->nb_streams; ++i) {
+        if (int(i) != m_nStreamIdx) m_pFmtCtx->streams[i]->discard = AVDISCARD_ALL;
+    }
+
+    const AVCodecParameters* codecpar = m_pFmtCtx->streams[m_nStreamIdx]->codecpar;
+    const AVCodec* codec = avcodec_find_decoder(codecpar->codec_id);
+    if (!codec) {
+        qWarning() << "FrameStepper: video decoder not found";
+        return false;
+    }
+    m_pDecCtx = avcodec_alloc_context3(codec);
+    if (avcodec_parameters_to_context(m_pDecCtx, codecpar) < 0) {
+        qWarning() << "FrameStepper: failed to copy codec parameters";
+        return false;
+    }
+    m_pDecCtx->thread_count = 0;
+    if (avcodec_open2(m_pDecCtx, codec, nullptr) < 0) {
+        qWarning() << "FrameStepper: failed to open video codec";
+        return false;
+    }
+    return true;
+}
+
+void FrameStepper::closeInput() {
+    if (m_pDecCtx) avcodec_free_context(&m_pDecCtx);
+    if (m_pFmtCtx) avformat_close_input(&m_pFmtCtx);
+}
+
+void FrameStepper::doStep(int direction) {
+    const qint64 position = m_nPosition;
+    const CachedGop* gop = ensureGop(position);
+    if (!gop) return;
+    const int index = gop->indexAt(position) + direction;
+    if (index >= 0 && index < int(gop->frames.size())) {
+        present(gop->frames[index].first, gop->frames[index].second);
+        return;
+    }
+
+    // 跨越GOP边界，取相邻GOP的第一帧或最后一帧
+    const qint64 neighbour = direction > 0 ? gop->end : gop->start - 1;
+    gop = ensureGop(neighbour);
+    if (!gop || gop->frames.empty()) return;
+    const auto& frame = direction > 0 ? gop->frames.front() : gop->frames.back();
+    // 已经到达开头或结尾
+    if ((frame.first - position) * direction <= 0) return;
+    present(frame.first, frame.second);
+}
+
+void FrameStepper::reverseTick(double rate) {
+    const qint64 position = m_nPosition;
+    const CachedGop* gop = m_cache.find(position);
+    if (!gop) gop = ensureGop(position);
+    if (!gop) {
+        m_requestEvent.wait([this] { return m_bStop || !m_bActive || hasRequest() || !m_bPlaying; });
+        return;
+    }
+    const int index = gop->indexAt(position);
+    const qint64 previousTime = gop->start - 1;
+    const bool reachedStart = previousTime < 0 || (m_nFirstTime != AV_NOPTS_VALUE && previousTime < m_nFirstTime);
+    const CachedGop* previous = reachedStart ? nullptr : m_cache.find(previousTime);
+
+    const qint64 now = av_gettime_relative();
+    if (m_nDeadline == 0 || now - m_nDeadline > MAX_REVERSE_LATE) m_nDeadline = now;
+    if (now >= m_nDeadline) {
+        const std::pair<qint64, VideoFramePtr>* frame = nullptr;
+        if (index > 0) frame = &gop->frames[index - 1];
+        else if (previous && !previous->frames.empty()) frame = &previous->frames.back();
+
+        if (frame) {
+            const qint64 interval = qBound<qint64>(0, qint64((position - frame->first) / rate), MAX_REVERSE_INTERVAL);
+            present(frame->first, frame->second);
+            m_nDeadline += interval;
+            return;
+        }
+        if (reachedStart) {
+            // 已经倒放到开头，停在第一帧
+            m_requestEvent.wait([this] { return m_bStop || !m_bActive || hasRequest() || !m_bPlaying || m_dReverseRate == 0; });
+            return;
+        }
+        // 前一个GOP还没解码完，画面停顿，继续解码
+    } else if (reachedStart || previous) {
+        // 前一个GOP已就绪，等待下一帧的展示时间
+        m_requestEvent.waitFor([this] { return m_bStop || !m_bActive || hasRequest() || !m_bPlaying; }, m_nDeadline - now);
+        return;
+    }
+
+    // 利用展示间隙逐个packet地解码前一个GOP
+    if (!m_job.active || m_job.target != previousTime) startJob(previousTime);
+    decodeStep();
+}
+
+const CachedGop* FrameStepper::ensureGop(qint64 time) {
+    if (m_nEofTime != AV_NOPTS_VALUE && time >= m_nEofTime) return nullptr;
+    if (m_nFirstTime != AV_NOPTS_VALUE && time < m_nFirstTime) time = m_nFirstTime;
+    const CachedGop* gop = m_cache.find(time);
+    if (gop) return gop;
+
+    if (!m_job.active || m_job.target != time) startJob(time);
+    while (!m_bStop && m_bActive) {
+        if (!decodeStep()) continue;
+        if (m_nFirstTime != AV_NOPTS_VALUE) time = qMax(time, m_nFirstTime);
+        gop = m_cache.find(time);
+        if (gop) return gop;
+        // 落在两个GOP之间（如开放GOP的前导帧被丢弃）时取之后的GOP
+        const qint64 after = m_cache.startAfter(time);
+        return after != AV_NOPTS_VALUE ? m_cache.find(after) : nullptr;
+    }
+    return nullptr;
+}
+
+void FrameStepper::startJob(qint64 time) {
+    m_job = GopJob();
+    m_job.active = true;
+    m_job.target = time;
+
+    AVStream* stream = m_pFmtCtx->streams[m_nStreamIdx];
+    qint64 timestamp = av_rescale_q(qMax<qint64>(0, time), AV_TIME_BASE_Q, stream->time_base);
+    KeyframeIndex::Entry keyframe;
+    if (m_pKeyframes && m_pKeyframes->find(time, false, &keyframe)) {
+        timestamp = keyframe.timestamp;
+        KeyframeIndex::Entry next;
+        if (m_pKeyframes->next(keyframe.time, &next)) m_job.expectedEnd = next.time;
+    }
+
+    // 与已缓存的相邻GOP衔接，已缓存的部分不再保存
+    m_job.from = m_cache.endBefore(time);
+    m_job.to = m_cache.startAfter(time);
+
+    if (av_seek_frame(m_pFmtCtx, m_nStreamIdx, timestamp, AVSEEK_FLAG_BACKWARD) < 0) {
+        qWarning() << "FrameStepper: seek failed";
+    }
+    avcodec_flush_buffers(m_pDecCtx);
+}
+
+qint64 FrameStepper::jobStart() const {
+    if (m_job.keyTime == AV_NOPTS_VALUE) return m_job.from;
+    if (m_job.from == AV_NOPTS_VALUE) return m_job.keyTime;
+    return qMax(m_job.keyTime, m_job.from);
+}
+
+bool FrameStepper::decodeStep() {
+    if (!m_job.active) return true;
+    AVStream* stream = m_pFmtCtx->streams[m_nStreamIdx];
+
+    if (!m_job.draining) {
+        if (av_read_frame(m_pFmtCtx, m_pPacket) < 0) {
+            avcodec_send_packet(m_pDecCtx, nullptr);
+            m_job.draining = true;
+        } else {
+            if (m_pPacket->stream_index == m_nStreamIdx) {
+                const int64_t pts = m_pPacket->pts != AV_NOPTS_VALUE ? m_pPacket->pts : m_pPacket->dts;
+                if ((m_pPacket->flags & AV_PKT_FLAG_KEY) && pts != AV_NOPTS_VALUE) {
+                    // 第一个关键帧是GOP的起点，下一个关键帧是终点；以packet的pts为准，相邻GOP的边界正好衔接。
+                    // 跳转落在已缓存部分之前时，以不晚于from的最后一个关键帧为起点
+                    const qint64 time = av_rescale_q(pts, stream->time_base, AV_TIME_BASE_Q);
+                    if (m_job.keyTime == AV_NOPTS_VALUE || (m_job.from != AV_NOPTS_VALUE && time <= m_job.from)) {
+                        m_job.keyTime = time;
+                        m_job.fromStart = isFirstKeyframe(time);
+                    } else if (time > m_job.keyTime && (m_job.to == AV_NOPTS_VALUE || time < m_job.to)) m_job.to = time;
+                }
+                avcodec_send_packet(m_pDecCtx, m_pPacket);
+            }
+            av_packet_unref(m_pPacket);
+        }
+    }
+
+    const qint64 maxBytes = m_cache.maxBytes() / GOP_CACHE_SHARE;
+    while (true) {
+        const int ret = avcodec_receive_frame(m_pDecCtx, m_pFrame);
+        if (ret == AVERROR_EOF) {
+            const auto& frames = m_job.gop.frames;
+            finishJob(frames.empty() ? qMax<qint64>(0, jobStart()) : frames.back().first + 1);
+            return true;
+        }
+        if (ret < 0) break;
+
+        const qint64 time = av_rescale_q(m_pFrame->best_effort_timestamp, stream->time_base, AV_TIME_BASE_Q);
+        if (m_job.to != AV_NOPTS_VALUE && time >= m_job.to) {
+            av_frame_unref(m_pFrame);
+            finishJob(m_job.to);
+            return true;
+        }
+        const qint64 start = jobStart();
+        if (start != AV_NOPTS_VALUE && time < start) {
+            av_frame_unref(m_pFrame);
+            continue;
+        }
+
+        VideoFramePtr frame = m_pFramePool->take();
+        if (!frame) {
+            av_frame_unref(m_pFrame);
+            continue;
+        }
+        av_frame_move_ref(frame.get(), m_pFrame);
+        CachedGop& gop = m_job.gop;
+        gop.bytes += GopCache::frameBytes(frame.get());
+        gop.frames.emplace_back(time, std::move(frame));
+        if (maxBytes <= 0 || gop.bytes <= maxBytes) continue;
+
+        // 超出单个GOP的上限：请求的时间靠近终点时丢弃最早的帧，否则保留已解码的部分提前结束
+        const qint64 end = m_job.to != AV_NOPTS_VALUE ? m_job.to : m_job.expectedEnd;
+        const bool keepLatest = end != AV_NOPTS_VALUE && end - m_job.target <= m_job.target - start;
+        if (!keepLatest) {
+            finishJob(time + 1);
+            return true;
+        }
+        while (gop.frames.size() > 1 && gop.bytes > maxBytes) {
+            gop.bytes -= GopCache::frameBytes(gop.frames.front().second.get());
+            gop.frames.erase(gop.frames.begin());
+        }
+        m_job.dropped = true;
+    }
+    return false;
+}
+
+bool FrameStepper::isFirstKeyframe(qint64 time) {
+    // 索引已有条目时第一条即流的第一个关键帧（扫描从头开始），否则与流的起始时间比较
+    KeyframeIndex::Entry first;
+    if (m_pKeyframes && m_pKeyframes->next(std::numeric_limits<qint64>::min(), &first) && time <= first.time) return true;
+    const AVStream* stream = m_pFmtCtx->streams[m_nStreamIdx];
+    return stream->start_time != AV_NOPTS_VALUE && time <= av_rescale_q(stream->start_time, stream->time_base, AV_TIME_BASE_Q);
+}
+
+void FrameStepper::finishJob(qint64 end) {
+    CachedGop& gop = m_job.gop;
+    if (m_job.draining) m_nEofTime = end;
+    const qint64 first = gop.frames.empty() ? end : gop.frames.front().first;
+    // 索引尚未覆盖目标时按时间戳向前跳转，有B帧时找到的关键帧可能晚于目标，
+    // 只有确实从流的第一个关键帧开始解码时才能推断第一帧的时间
+    if (m_nFirstTime == AV_NOPTS_VALUE && m_job.fromStart) {
+        // 从文件开头解码仍没有不晚于目标的帧，目标在第一帧之前
+        if (m_job.from == AV_NOPTS_VALUE && !m_job.dropped && m_job.target < first) m_nFirstTime = first;
+        // 第一个关键帧已晚于目标且没有可保留的帧，避免倒放反复解码同一段
+        else if (gop.frames.empty() && m_job.target < m_job.keyTime) m_nFirstTime = m_job.keyTime;
+    }
+    if (!gop.frames.empty()) {
+        const qint64 start = jobStart();
+        gop.start = m_job.dropped || start == AV_NOPTS_VALUE ? first : qMin(start, first);
+        gop.end = qMax(end, gop.frames.back().first + 1);
+        m_cache.insert(std::move(gop), m_nPosition);
+    }
+    m_job = GopJob();
+}
+
+void FrameStepper::present(qint64 pts, const VideoFramePtr& frame) {
+    m_nPosition = pts;
+    VideoFramePtr output = m_converter.convert(frame.get());
+    if (output) emit frameReady(output, av_gettime_relative());
+}
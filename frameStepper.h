@@ -0,0 +1,135 @@
+#ifndef FRAMESTEPPER_H
+#define FRAMESTEPPER_H
+
+#include "frameConverter.h"
+#include "gopCache.h"
+#include "keyframeIndex.h"
+#include "waitEvent.h"
+#include <QString>
+#include <QThread>
+#include <atomic>
+#include <mutex>
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+}
+
+// 逐帧浏览及平滑倒放
+// 使用独立的解复用和解码上下文，每个GOP只正向解码一次，解码出的帧以YUV格式放入GopCache，
+// 后退和倒放直接从缓存中取帧，不需要每次都从上一个关键帧重新解码；
+// 倒放时在两帧的展示间隙中逐个packet地预先解码前一个GOP
+class FrameStepper : public QThread {
+    Q_OBJECT
+public:
+    FrameStepper();
+    ~FrameStepper();
+
+    // 设置文件及视频流，keyframes为播放器的关键帧索引，用于确定GOP边界；输入在第一次使用时才打开
+    void open(const QString& uri, int streamIndex, KeyframeIndex* keyframes);
+    void close();
+
+    // 从显示时间为pts的帧开始接管画面，清空未执行的请求 pts单位微秒
+    void activate(qint64 pts);
+    // 交还画面，停止倒放
+    void deactivate();
+    inline bool isActive() { return m_bActive; }
+    // 逐帧前进（direction为1）或后退（-1），连续调用时请求依次执行
+    void step(int direction);
+    // 展示时间不晚于pts的帧 pts单位微秒
+    void seekTo(qint64 pts);
+    // 倒放速率，为正数，0表示不倒放
+    void setReverseRate(double rate);
+    void setPlaying(bool playing);
+    // 当前展示的帧的显示时间 单位微秒
+    inline qint64 position() { return m_nPosition; }
+
+    // 帧缓存的内存上限及当前占用 单位字节
+    inline void setCacheLimit(qint64 bytes) { m_nCacheLimit = bytes; }
+    inline qint64 cacheBytes() { return m_cache.bytes(); }
+    inline FrameConverter& converter() { return m_converter; }
+
+signals:
+    // presentTime为发出时的系统时间 单位微秒
+    void frameReady(VideoFramePtr frame, qint64 presentTime);
+
+protected:
+    void run() override;
+
+private:
+    // 正在解码的GOP
+    struct GopJob {
+        bool active = false;
+        // 请求的时间，解码包含该时间的GOP
+        qint64 target = 0;
+        // 起始关键帧的显示时间，读到第一个关键帧packet前为AV_NOPTS_VALUE
+        qint64 keyTime = AV_NOPTS_VALUE;
+        // 保留的时间范围[from, to)，from之前、to之后的帧已在缓存中，未知时为AV_NOPTS_VALUE；
+        // to在读到下一个关键帧packet时取其显示时间，与下一个GOP的起点一致
+        qint64 from = AV_NOPTS_VALUE;
+        qint64 to = AV_NOPTS_VALUE;
+        // 按关键帧索引估计的GOP终点，只用于决定超出内存上限时保留哪一端
+        qint64 expectedEnd = AV_NOPTS_VALUE;
+        // 起始关键帧是流的第一个关键帧，只有这时才能由结果推断第一帧的时间
+        bool fromStart = false;
+        // 超出内存上限时已丢弃最早的帧
+        bool dropped = false;
+        bool draining = false;
+        CachedGop gop;
+    };
+
+    bool openInput();
+    void closeInput();
+    // 执行一次逐帧请求
+    void doStep(int direction);
+    // 倒放时展示下一帧或利用间隙预先解码
+    void reverseTick(double rate);
+    // 包含time的GOP，不在缓存中时解码，time落在GOP之间的空隙时返回之后的GOP，失败时返回nullptr
+    const CachedGop* ensureGop(qint64 time);
+    // 开始解码包含time的GOP
+    void startJob(qint64 time);
+    // 解码一个packet，GOP解码完成时放入缓存并返回true
+    bool decodeStep();
+    // 显示时间为time（单位微秒）的关键帧是否为流的第一个关键帧
+    bool isFirstKeyframe(qint64 time);
+    void finishJob(qint64 end);
+    void present(qint64 pts, const VideoFramePtr& frame);
+    // 保留范围的起点
+    qint64 jobStart() const;
+    // 有新的请求，需要中断等待
+    bool hasRequest();
+
+    QString m_strUri;
+    int m_nStreamIdx = -1;
+    KeyframeIndex* m_pKeyframes = nullptr;
+    AVFormatContext* m_pFmtCtx = nullptr;
+    AVCodecContext* m_pDecCtx = nullptr;
+    AVPacket* m_pPacket = nullptr;
+    AVFrame* m_pFrame = nullptr;
+    // 缓存的帧结构从池中取出，GOP被淘汰后归还
+    FramePoolPtr m_pFramePool = FramePool::create();
+    bool m_bInputFailed = false;
+
+    GopCache m_cache;
+    GopJob m_job;
+    FrameConverter m_converter;
+
+    std::mutex m_mutex;
+    WaitEvent m_requestEvent;
+    std::atomic<bool> m_bStop = false;
+    std::atomic<bool> m_bActive = false;
+    std::atomic<bool> m_bPlaying = false;
+    std::atomic<double> m_dReverseRate = 0;
+    // 尚未执行的逐帧请求，为正表示前进
+    int m_nPendingSteps = 0;
+    qint64 m_nSeekTarget = AV_NOPTS_VALUE;
+    std::atomic<qint64> m_nPosition = 0;
+    std::atomic<qint64> m_nCacheLimit = 0;
+    // 第一帧的显示时间及最后一帧之后的时间，之外没有可展示的帧，未知时为AV_NOPTS_VALUE
+    qint64 m_nFirstTime = AV_NOPTS_VALUE;
+    qint64 m_nEofTime = AV_NOPTS_VALUE;
+    // 倒放时下一帧的展示时间 系统时间 单位微秒，为0表示立即展示
+    qint64 m_nDeadline = 0;
+};
+
+#endif // FRAMESTEPPER_H
@@ -0,0 +1,79 @@
+#include "gopCache.h"
+#include <algorithm>
+
+extern "C" {
+#include <libavutil/avutil.h>
+#include <libavutil/imgutils.h>
+}
+
+int CachedGop::indexAt(qint64 time) const {
+    auto after = std::upper_bound(frames.begin(), frames.end(), time,
+                                  [](qint64 t, const std::pair<qint64, VideoFramePtr>& f) { return t < f.first; });
+    return int(after - frames.begin()) - 1;
+}
+
+void GopCache::clear() {
+    m_gops.clear();
+    m_nBytes = 0;
+}
+
+void GopCache::insert(CachedGop gop, qint64 position) {
+    if (gop.frames.empty()) return;
+    // 移除与新GOP范围重叠的GOP
+    for (auto it = m_gops.begin(); it != m_gops.end();) {
+        if (it->second.start < gop.end && gop.start < it->second.end) {
+            m_nBytes -= it->second.bytes;
+            it = m_gops.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    const qint64 start = gop.start;
+    m_nBytes += gop.bytes;
+    m_gops.emplace(start, std::move(gop));
+    evict(position, start);
+}
+
+const CachedGop* GopCache::find(qint64 time) const {
+    auto it = m_gops.upper_bound(time);
+    if (it == m_gops.begin()) return nullptr;
+    --it;
+    return time < it->second.end ? &it->second : nullptr;
+}
+
+qint64 GopCache::endBefore(qint64 time) const {
+    auto it = m_gops.upper_bound(time);
+    if (it == m_gops.begin()) return AV_NOPTS_VALUE;
+    --it;
+    return it->second.end <= time ? it->second.end : AV_NOPTS_VALUE;
+}
+
+qint64 GopCache::startAfter(qint64 time) const {
+    auto it = m_gops.upper_bound(time);
+    return it != m_gops.end() ? it->first : AV_NOPTS_VALUE;
+}
+
+qint64 GopCache::frameBytes(const AVFrame* frame) {
+    const int size = av_image_get_buffer_size(static_cast<AVPixelFormat>(frame->format), frame->width, frame->height, 1);
+    return qMax(0, size);
+}
+
+void GopCache::evict(qint64 position, qint64 keepStart) {
+    while (m_nMaxBytes > 0 && m_nBytes > m_nMaxBytes && m_gops.size() > 1) {
+        // 离当前位置最远的GOP
+        auto farthest = m_gops.end();
+        qint64 farthestDistance = -1;
+        for (auto it = m_gops.begin(); it != m_gops.end(); ++it) {
+            const CachedGop& gop = it->second;
+            if (gop.start == keepStart || (gop.start <= position && position < gop.end)) continue;
+            const qint64 distance = position < gop.start ? gop.start - position : position - gop.end;
+            if (distance > farthestDistance) {
+                farthestDistance = distance;
+                farthest = it;
+            }
+        }
+        if (farthest == m_gops.end()) break;
+        m_nBytes -= farthest->second.bytes;
+        m_gops.erase(farthest);
+    }
+}
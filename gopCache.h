@@ -0,0 +1,58 @@
+#ifndef GOPCACHE_H
+#define GOPCACHE_H
+
+#include "videoFrame.h"
+#include <QtGlobal>
+#include <atomic>
+#include <map>
+#include <utility>
+#include <vector>
+
+// 一个GOP（或其中一段）解码出的帧，按显示时间排序
+struct CachedGop {
+    // 覆盖的时间范围[start, end) 单位微秒
+    qint64 start = 0;
+    qint64 end = 0;
+    // 显示时间及帧，保持解码器输出的YUV格式
+    std::vector<std::pair<qint64, VideoFramePtr>> frames;
+    // 像素数据的字节数
+    qint64 bytes = 0;
+
+    // 时间不晚于time的最后一帧，没有时返回-1
+    int indexAt(qint64 time) const;
+};
+
+// 已解码GOP的缓存，按时间范围查找，超出内存上限时淘汰离当前位置最远的GOP
+// 只在逐帧浏览线程中使用，bytes可在任意线程读取
+class GopCache {
+public:
+    GopCache() {};
+    ~GopCache() {};
+
+    inline void setMaxBytes(qint64 bytes) { m_nMaxBytes = bytes; }
+    inline qint64 maxBytes() const { return m_nMaxBytes; }
+    inline qint64 bytes() const { return m_nBytes; }
+    inline size_t size() const { return m_gops.size(); }
+
+    void clear();
+    // 插入GOP，替换与它范围重叠的GOP；超出上限时淘汰离position最远的GOP，不淘汰包含position的GOP及新插入的GOP
+    void insert(CachedGop gop, qint64 position);
+    // 包含time的GOP，没有时返回nullptr
+    const CachedGop* find(qint64 time) const;
+    // time之前最近的GOP的结束时间、之后最近的GOP的开始时间，没有时返回AV_NOPTS_VALUE
+    qint64 endBefore(qint64 time) const;
+    qint64 startAfter(qint64 time) const;
+
+    // 帧的像素数据字节数
+    static qint64 frameBytes(const AVFrame* frame);
+
+private:
+    void evict(qint64 position, qint64 keepStart);
+
+    // 按开始时间排序
+    std::map<qint64, CachedGop> m_gops;
+    std::atomic<qint64> m_nBytes = 0;
+    qint64 m_nMaxBytes = 0;
+};
+
+#endif // GOPCACHE_H
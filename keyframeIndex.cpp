@@ -0,0 +1,202 @@
+#include "keyframeIndex.h"
+#include <QDebug>
+#include <algorithm>
+
+// 扫描时每积累这么多个关键帧合并一次索引
+#define KEYFRAME_PUBLISH_BATCH 64
+// 读取第一个关键帧时最多读取的packet数
+#define KEYFRAME_OFFSET_PACKETS 1000
+
+KeyframeIndex::KeyframeIndex() {}
+
+KeyframeIndex::~KeyframeIndex() {
+    stop();
+}
+
+void KeyframeIndex::build(const QString& uri, int streamIndex) {
+    stop();
+    m_strUri = uri;
+    m_nStreamIdx = streamIndex;
+    m_bComplete = false;
+    m_bFromContainer = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_entries.clear();
+    }
+    // 与播放争用磁盘和CPU时让出
+    start(QThread::LowPriority);
+}
+
+void KeyframeIndex::stop() {
+    requestInterruption();
+    if (isRunning()) wait();
+}
+
+void KeyframeIndex::load(int streamIndex, const std::vector<Entry>& entries) {
+    stop();
+    m_nStreamIdx = streamIndex;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_entries = entries;
+    }
+    m_bComplete = true;
+}
+
+bool KeyframeIndex::find(qint64 target, bool nearest, Entry* entry) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_entries.empty()) return false;
+    // 索引尚未覆盖目标位置，之后可能还有更近的关键帧
+    if (!m_bComplete && target > m_entries.back().time) return false;
+
+    // 第一个晚于目标的关键帧
+    auto after = std::upper_bound(m_entries.begin(), m_entries.end(), target,
+                                  [](qint64 time, const Entry& e) { return time < e.time; });
+    if (after == m_entries.begin()) {
+        *entry = m_entries.front();
+        return true;
+    }
+    auto before = after - 1;
+    if (nearest && after != m_entries.end() && after->time - target < target - before->time) {
+        *entry = *after;
+    } else {
+        *entry = *before;
+    }
+    return true;
+}
+
+bool KeyframeIndex::next(qint64 time, Entry* entry) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto after = std::upper_bound(m_entries.begin(), m_entries.end(), time,
+                                  [](qint64 t, const Entry& e) { return t < e.time; });
+    if (after == m_entries.end()) return false;
+    *entry = *after;
+    return true;
+}
+
+bool KeyframeIndex::previous(qint64 time, Entry* entry) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    // 索引尚未覆盖该位置时，之后补入的关键帧可能更近
+    if (m_entries.empty() || (!m_bComplete && time > m_entries.back().time)) return false;
+    auto before = std::lower_bound(m_entries.begin(), m_entries.end(), time,
+                                   [](const Entry& e, qint64 t) { return e.time < t; });
+    if (before == m_entries.begin()) return false;
+    *entry = *(before - 1);
+    return true;
+}
+
+void KeyframeIndex::run() {
+    AVFormatContext* fmtCtx = avformat_alloc_context();
+    AVStream* stream = nullptr;
+    fmtCtx->interrupt_callback.callback = interruptCallback;
+    fmtCtx->interrupt_callback.opaque = this;
+
+    // 使用独立的解复用上下文，不影响播放线程的读取位置
+    if (avformat_open_input(&fmtCtx, m_strUri.toUtf8().constData(), nullptr, nullptr) != 0) {
+        qWarning() << "Keyframe index: failed to open input";
+        goto end;
+    }
+    if (avformat_find_stream_info(fmtCtx, nullptr) < 0 || m_nStreamIdx < 0 || m_nStreamIdx >= int(fmtCtx->nb_streams)) {
+        qWarning() << "Keyframe index: stream not found";
+        goto end;
+    }
+    stream = fmtCtx->streams[m_nStreamIdx];
+    if (m_fnProbed) m_fnProbed(fmtCtx);
+
+    m_bFromContainer = m_bUseContainerIndex && readContainerIndex(fmtCtx, stream);
+    if (!m_bFromContainer) {
+        scanPackets(fmtCtx, stream);
+    }
+    if (!isInterruptionRequested()) {
+        m_bComplete = true;
+        qDebug() << "Keyframe index built:" << size() << "keyframes";
+    }
+
+end:
+    avformat_close_input(&fmtCtx);
+}
+
+bool KeyframeIndex::readContainerIndex(AVFormatContext* fmtCtx, AVStream* stream) {
+    const int count = avformat_index_get_entries_count(stream);
+    std::vector<Entry> batch;
+    for (int i = 0; i < count; ++i) {
+        const AVIndexEntry* indexEntry = avformat_index_get_entry(stream, i);
+        if (!indexEntry || !(indexEntry->flags & AVINDEX_KEYFRAME)) continue;
+        Entry entry;
+        entry.timestamp = indexEntry->timestamp;
+        entry.pos = indexEntry->pos;
+        batch.push_back(entry);
+    }
+    // 只有一个关键帧的索引多半只是读取头部时记录的，不可信
+    if (batch.size() < 2) return false;
+
+    // mp4、mov的索引记录的是dts，有B帧时关键帧的显示时间晚于dts，与扫描得到的pts不一致。
+    // 编码器的重排延迟固定，各关键帧的偏移相同，读取第一个关键帧得到偏移后补到所有关键帧上；mkv等记录pts的容器偏移为0
+    const int64_t offset = compositionOffset(fmtCtx, batch.front().timestamp);
+    for (Entry& entry : batch) {
+        entry.time = av_rescale_q(entry.timestamp + offset, stream->time_base, AV_TIME_BASE_Q);
+    }
+    publish(batch);
+    return true;
+}
+
+int64_t KeyframeIndex::compositionOffset(AVFormatContext* fmtCtx, int64_t timestamp) {
+    // 其他流的packet直接丢弃
+    for (unsigned int i = 0; i < fmtCtx->nb_streams; ++i) {
+        if (int(i) != m_nStreamIdx) fmtCtx->streams[i]->discard = AVDISCARD_ALL;
+    }
+
+    AVPacket* packet = av_packet_alloc();
+    int64_t offset = 0;
+    for (int i = 0; i < KEYFRAME_OFFSET_PACKETS && !isInterruptionRequested() && av_read_frame(fmtCtx, packet) == 0; ++i) {
+        const bool keyframe = packet->stream_index == m_nStreamIdx && (packet->flags & AV_PKT_FLAG_KEY);
+        // 与索引对不上时不做调整
+        if (keyframe && packet->pts != AV_NOPTS_VALUE && packet->dts == timestamp) offset = packet->pts - packet->dts;
+        av_packet_unref(packet);
+        if (keyframe) break;
+    }
+    av_packet_free(&packet);
+    return offset;
+}
+
+void KeyframeIndex::scanPackets(AVFormatContext* fmtCtx, AVStream* stream) {
+    // 其他流的packet直接丢弃
+    for (unsigned int i = 0; i < fmtCtx->nb_streams; ++i) {
+        if (int(i) != m_nStreamIdx) fmtCtx->streams[i]->discard = AVDISCARD_ALL;
+    }
+
+    AVPacket* packet = av_packet_alloc();
+    std::vector<Entry> batch;
+    while (!isInterruptionRequested() && av_read_frame(fmtCtx, packet) == 0) {
+        if (packet->stream_index == m_nStreamIdx && (packet->flags & AV_PKT_FLAG_KEY)) {
+            const int64_t pts = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+            if (pts != AV_NOPTS_VALUE) {
+                Entry entry;
+                entry.time = av_rescale_q(pts, stream->time_base, AV_TIME_BASE_Q);
+                // 大多数容器按dts跳转
+                entry.timestamp = packet->dts != AV_NOPTS_VALUE ? packet->dts : pts;
+                entry.pos = packet->pos;
+                batch.push_back(entry);
+            }
+        }
+        av_packet_unref(packet);
+        if (batch.size() >= KEYFRAME_PUBLISH_BATCH) publish(batch);
+    }
+    publish(batch);
+    av_packet_free(&packet);
+}
+
+void KeyframeIndex::publish(std::vector<Entry>& batch) {
+    if (batch.empty()) return;
+    auto byTime = [](const Entry& a, const Entry& b) { return a.time < b.time; };
+    std::sort(batch.begin(), batch.end(), byTime);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const size_t middle = m_entries.size();
+    m_entries.insert(m_entries.end(), batch.begin(), batch.end());
+    std::inplace_merge(m_entries.begin(), m_entries.begin() + middle, m_entries.end(), byTime);
+    batch.clear();
+}
+
+int KeyframeIndex::interruptCallback(void* opaque) {
+    return static_cast<KeyframeIndex*>(opaque)->isInterruptionRequested() ? 1 : 0;
+}
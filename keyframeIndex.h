@@ -0,0 +1,92 @@
+#ifndef KEYFRAMEINDEX_H
+#define KEYFRAMEINDEX_H
+
+#include <QThread>
+#include <QString>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+// 关键帧索引
+// 打开文件后在后台线程中建立：容器自带索引（mp4、mkv等）时直接读取，否则只解复用不解码地扫描一遍文件。
+// 扫描过程中已覆盖的部分即可用于跳转
+class KeyframeIndex : public QThread {
+    Q_OBJECT
+public:
+    struct Entry {
+        // 显示时间 单位微秒
+        int64_t time = 0;
+        // 跳转用的时间戳 单位为流的时间基准
+        int64_t timestamp = 0;
+        // 在文件中的字节位置，未知时为-1
+        int64_t pos = -1;
+    };
+
+    KeyframeIndex();
+    ~KeyframeIndex();
+
+    // 开始为uri中的第streamIndex个流建立索引
+    void build(const QString& uri, int streamIndex);
+    // 停止建立索引
+    void stop();
+    // 直接使用已有的索引（如磁盘缓存），不再扫描
+    void load(int streamIndex, const std::vector<Entry>& entries);
+    // 索引线程完整探测流参数后调用，用于补全快速起播时有限探测的结果；在build之前设置
+    inline void setProbeCallback(std::function<void(const AVFormatContext*)> callback) { m_fnProbed = std::move(callback); }
+    // 是否读取容器自带的索引，关闭时总是扫描文件，用于校验两种来源的结果一致；在build之前设置
+    inline void setUseContainerIndex(bool use) { m_bUseContainerIndex = use; }
+
+    // 查找目标时间对应的关键帧 target单位微秒
+    // nearest为false时返回不晚于目标的最后一个关键帧（精确跳转从这里开始解码），
+    // 为true时返回离目标最近的关键帧；目标超出已建立索引的范围时返回false
+    bool find(qint64 target, bool nearest, Entry* entry);
+    // 时间严格晚于/早于time的第一个关键帧，用于快进快退逐个定位关键帧；超出索引范围时返回false
+    bool next(qint64 time, Entry* entry);
+    bool previous(qint64 time, Entry* entry);
+
+    inline bool isComplete() const { return m_bComplete; }
+    // 索引是否来自容器自带的索引
+    inline bool isFromContainer() const { return m_bFromContainer; }
+    inline int streamIndex() const { return m_nStreamIdx; }
+    // 当前索引的副本
+    inline std::vector<Entry> entries() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_entries;
+    }
+    inline size_t size() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_entries.size();
+    }
+
+protected:
+    void run() override;
+
+private:
+    // 读取容器自带的索引，没有时返回false
+    bool readContainerIndex(AVFormatContext* fmtCtx, AVStream* stream);
+    // 读取时间戳为timestamp的第一个关键帧，返回其pts与dts的差值 单位为流的时间基准
+    int64_t compositionOffset(AVFormatContext* fmtCtx, int64_t timestamp);
+    // 扫描文件中的所有关键帧
+    void scanPackets(AVFormatContext* fmtCtx, AVStream* stream);
+    // 将一批按时间排序的关键帧合并到索引中
+    void publish(std::vector<Entry>& batch);
+
+    static int interruptCallback(void* opaque);
+
+    QString m_strUri;
+    int m_nStreamIdx = -1;
+    std::mutex m_mutex;
+    // 按显示时间排序
+    std::vector<Entry> m_entries;
+    std::atomic<bool> m_bComplete = false;
+    bool m_bUseContainerIndex = true;
+    std::atomic<bool> m_bFromContainer = false;
+    std::function<void(const AVFormatContext*)> m_fnProbed;
+};
+
+#endif // KEYFRAMEINDEX_H
@@ -1,6 +1,7 @@
 #include <QGuiApplication>
 #include <QQmlApplicationEngine>
 #include "videoplayer.h"
+#include "thumbnailProvider.h"
 #include <QIcon>
 
 int main(int argc, char *argv[])
@@ -17,6 +18,8 @@ int main(int argc, char *argv[])
         Qt::QueuedConnection);
 
     qmlRegisterType<VideoPlayer>("VideoPlayer", 1, 0, "VideoPlayer");
+    // 进度条预览缩略图
+    engine.addImageProvider("thumbnail", new ThumbnailProvider());
 
     engine.loadFromModule("videoPlayer", "Main");
 
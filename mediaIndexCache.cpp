@@ -0,0 +1,447 @@
+#include "mediaIndexCache.h"
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <cstring>
+
+extern "C" {
+#include <libavutil/mem.h>
+}
+
+// 缓存文件标识及格式版本，格式或内容的含义变化时递增版本使旧缓存失效
+// 版本2：mp4等容器的关键帧时间由dts改为pts
+#define INDEX_CACHE_MAGIC 0x58495056 // "VPIX"
+#define INDEX_CACHE_VERSION 2
+// 缓存目录名
+#define INDEX_CACHE_DIR "mediaIndex"
+
+namespace {
+
+// 缓存文件头，之后依次为路径、流参数、关键帧表、缩略图，每段按8字节对齐
+struct FileHeader {
+    uint32_t magic;
+    uint32_t version;
+    int64_t fileSize;
+    int64_t modifiedTime;
+    int64_t duration;
+    int32_t streamCount;
+    int32_t keyframeStream;
+    int64_t keyframeCount;
+    int32_t thumbnailCount;
+    int32_t pathLength;
+};
+
+// 流参数，所有字段统一为64位，之后紧跟extradata
+struct StreamRecord {
+    int64_t codecType;
+    int64_t codecId;
+    int64_t codecTag;
+    int64_t format;
+    int64_t bitRate;
+    int64_t profile;
+    int64_t level;
+    int64_t width;
+    int64_t height;
+    int64_t sarNum;
+    int64_t sarDen;
+    int64_t fieldOrder;
+    int64_t colorRange;
+    int64_t colorPrimaries;
+    int64_t colorTrc;
+    int64_t colorSpace;
+    int64_t chromaLocation;
+    int64_t videoDelay;
+    int64_t sampleRate;
+    int64_t channels;
+    int64_t channelOrder;
+    int64_t channelMask;
+    int64_t frameSize;
+    int64_t timeBaseNum;
+    int64_t timeBaseDen;
+    int64_t avgFrameRateNum;
+    int64_t avgFrameRateDen;
+    int64_t realFrameRateNum;
+    int64_t realFrameRateDen;
+    int64_t startTime;
+    int64_t duration;
+    int64_t extradataSize;
+};
+
+struct KeyframeRecord {
+    int64_t time;
+    int64_t timestamp;
+    int64_t pos;
+};
+
+// 缩略图头，之后紧跟RGBA像素数据
+struct ThumbnailRecord {
+    int64_t key;
+    int32_t width;
+    int32_t height;
+    int32_t bytesPerLine;
+    int32_t reserved;
+};
+
+inline qint64 align8(qint64 size) { return (size + 7) & ~qint64(7); }
+
+// 写缓存文件
+class Writer {
+public:
+    inline void append(const void* data, qint64 size) {
+        m_buffer.append(static_cast<const char*>(data), size);
+        m_buffer.append(QByteArray(align8(size) - size, '\0'));
+    }
+    template <typename T>
+    inline void append(const T& value) { append(&value, sizeof(T)); }
+    inline const QByteArray& buffer() const { return m_buffer; }
+
+private:
+    QByteArray m_buffer;
+};
+
+// 解析内存映射的缓存文件，越界时返回nullptr
+class Reader {
+public:
+    Reader(const uchar* data, qint64 size) : m_pData(data), m_nSize(size) {};
+
+    inline const uchar* read(qint64 size) {
+        // 先与剩余长度比较，避免文件中的异常长度在对齐时溢出
+        if (size < 0 || size > remaining() || m_nOffset + align8(size) > m_nSize) return nullptr;
+        const uchar* data = m_pData + m_nOffset;
+        m_nOffset += align8(size);
+        return data;
+    }
+    template <typename T>
+    inline bool read(T* value) {
+        const uchar* data = read(sizeof(T));
+        if (!data) return false;
+        memcpy(value, data, sizeof(T));
+        return true;
+    }
+    // 尚未读取的字节数
+    inline qint64 remaining() const { return m_nSize - m_nOffset; }
+
+private:
+    const uchar* m_pData;
+    qint64 m_nSize;
+    qint64 m_nOffset = 0;
+};
+
+// 媒体文件的大小和修改时间，用于判断缓存是否过期
+bool mediaFileStamp(const QString& mediaPath, int64_t* size, int64_t* modifiedTime) {
+    QFileInfo info(mediaPath);
+    if (!info.exists()) return false;
+    *size = info.size();
+    *modifiedTime = info.lastModified().toMSecsSinceEpoch();
+    return true;
+}
+
+StreamRecord toRecord(const StreamInfo& info) {
+    StreamRecord record;
+    memset(&record, 0, sizeof(record));
+    record.codecType = info.codecType;
+    record.codecId = info.codecId;
+    record.codecTag = info.codecTag;
+    record.format = info.format;
+    record.bitRate = info.bitRate;
+    record.profile = info.profile;
+    record.level = info.level;
+    record.width = info.width;
+    record.height = info.height;
+    record.sarNum = info.sampleAspectRatio.num;
+    record.sarDen = info.sampleAspectRatio.den;
+    record.fieldOrder = info.fieldOrder;
+    record.colorRange = info.colorRange;
+    record.colorPrimaries = info.colorPrimaries;
+    record.colorTrc = info.colorTrc;
+    record.colorSpace = info.colorSpace;
+    record.chromaLocation = info.chromaLocation;
+    record.videoDelay = info.videoDelay;
+    record.sampleRate = info.sampleRate;
+    record.channels = info.channels;
+    record.channelOrder = info.channelOrder;
+    record.channelMask = int64_t(info.channelMask);
+    record.frameSize = info.frameSize;
+    record.timeBaseNum = info.timeBase.num;
+    record.timeBaseDen = info.timeBase.den;
+    record.avgFrameRateNum = info.avgFrameRate.num;
+    record.avgFrameRateDen = info.avgFrameRate.den;
+    record.realFrameRateNum = info.realFrameRate.num;
+    record.realFrameRateDen = info.realFrameRate.den;
+    record.startTime = info.startTime;
+    record.duration = info.duration;
+    record.extradataSize = info.extradata.size();
+    return record;
+}
+
+StreamInfo fromRecord(const StreamRecord& record) {
+    StreamInfo info;
+    info.codecType = int(record.codecType);
+    info.codecId = int(record.codecId);
+    info.codecTag = uint32_t(record.codecTag);
+    info.format = int(record.format);
+    info.bitRate = record.bitRate;
+    info.profile = int(record.profile);
+    info.level = int(record.level);
+    info.width = int(record.width);
+    info.height = int(record.height);
+    info.sampleAspectRatio = { int(record.sarNum), int(record.sarDen) };
+    info.fieldOrder = int(record.fieldOrder);
+    info.colorRange = int(record.colorRange);
+    info.colorPrimaries = int(record.colorPrimaries);
+    info.colorTrc = int(record.colorTrc);
+    info.colorSpace = int(record.colorSpace);
+    info.chromaLocation = int(record.chromaLocation);
+    info.videoDelay = int(record.videoDelay);
+    info.sampleRate = int(record.sampleRate);
+    info.channels = int(record.channels);
+    info.channelOrder = int(record.channelOrder);
+    info.channelMask = uint64_t(record.channelMask);
+    info.frameSize = int(record.frameSize);
+    info.timeBase = { int(record.timeBaseNum), int(record.timeBaseDen) };
+    info.avgFrameRate = { int(record.avgFrameRateNum), int(record.avgFrameRateDen) };
+    info.realFrameRate = { int(record.realFrameRateNum), int(record.realFrameRateDen) };
+    info.startTime = record.startTime;
+    info.duration = record.duration;
+    return info;
+}
+
+} // namespace
+
+QString MediaIndexCache::cachePath(const QString& mediaPath) {
+    const QString dir = QDir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation)).filePath(INDEX_CACHE_DIR);
+    const QByteArray hash = QCryptographicHash::hash(QFileInfo(mediaPath).absoluteFilePath().toUtf8(), QCryptographicHash::Sha1).toHex();
+    return QDir(dir).filePath(QString::fromLatin1(hash) + ".idx");
+}
+
+bool MediaIndexCache::load(const QString& mediaPath, MediaIndex* index) {
+    int64_t fileSize = 0, modifiedTime = 0;
+    if (!mediaFileStamp(mediaPath, &fileSize, &modifiedTime)) return false;
+
+    QFile file(cachePath(mediaPath));
+    if (!file.exists() || !file.open(QIODevice::ReadOnly)) return false;
+    const qint64 size = file.size();
+    const uchar* data = file.map(0, size);
+    if (!data) return false;
+
+    Reader reader(data, size);
+    MediaIndex result;
+    FileHeader header;
+    bool ok = false;
+    const uchar* path = nullptr;
+    const QByteArray absolutePath = QFileInfo(mediaPath).absoluteFilePath().toUtf8();
+
+    if (!reader.read(&header)) goto end;
+    if (header.magic != INDEX_CACHE_MAGIC || header.version != INDEX_CACHE_VERSION) goto end;
+    if (header.fileSize != fileSize || header.modifiedTime != modifiedTime) goto end;
+    // 各项数量来自文件，为负时按缓存损坏处理
+    if (header.streamCount < 0 || header.keyframeCount < 0 || header.thumbnailCount < 0) goto end;
+    // 文件名哈希冲突时路径不一致
+    path = reader.read(header.pathLength);
+    if (!path || QByteArray::fromRawData(reinterpret_cast<const char*>(path), header.pathLength) != absolutePath) goto end;
+
+    result.duration = header.duration;
+    result.keyframeStream = header.keyframeStream;
+    for (int i = 0; i < header.streamCount; ++i) {
+        StreamRecord record;
+        if (!reader.read(&record)) goto end;
+        StreamInfo info = fromRecord(record);
+        const uchar* extradata = reader.read(record.extradataSize);
+        if (!extradata) goto end;
+        info.extradata = QByteArray(reinterpret_cast<const char*>(extradata), record.extradataSize);
+        result.streams.push_back(info);
+    }
+
+    // 关键帧表是连续的定长记录，一次取出
+    {
+        // 先按剩余长度检查数量，避免相乘溢出后按错误的数量分配
+        if (header.keyframeCount > reader.remaining() / qint64(sizeof(KeyframeRecord))) goto end;
+        const uchar* keyframes = reader.read(header.keyframeCount * qint64(sizeof(KeyframeRecord)));
+        if (!keyframes) goto end;
+        result.keyframes.resize(header.keyframeCount);
+        for (int64_t i = 0; i < header.keyframeCount; ++i) {
+            KeyframeRecord record;
+            memcpy(&record, keyframes + i * sizeof(KeyframeRecord), sizeof(record));
+            result.keyframes[i] = { record.time, record.timestamp, record.pos };
+        }
+    }
+
+    for (int i = 0; i < header.thumbnailCount; ++i) {
+        ThumbnailRecord record;
+        if (!reader.read(&record)) goto end;
+        // 尺寸或行长度异常的记录按缓存损坏处理，避免按错误的大小读取像素
+        if (record.width <= 0 || record.height <= 0 || record.bytesPerLine < qint64(record.width) * 4) goto end;
+        const uchar* pixels = reader.read(qint64(record.bytesPerLine) * record.height);
+        if (!pixels) goto end;
+        // 映射的内存在函数返回时解除，需要拷贝
+        QImage image(pixels, record.width, record.height, record.bytesPerLine, QImage::Format_RGBA8888);
+        result.thumbnails.emplace_back(record.key, image.copy());
+    }
+
+    *index = std::move(result);
+    ok = true;
+
+end:
+    file.unmap(const_cast<uchar*>(data));
+    return ok;
+}
+
+bool MediaIndexCache::save(const QString& mediaPath, const MediaIndex& index) {
+    int64_t fileSize = 0, modifiedTime = 0;
+    if (!mediaFileStamp(mediaPath, &fileSize, &modifiedTime)) return false;
+    const QByteArray absolutePath = QFileInfo(mediaPath).absoluteFilePath().toUtf8();
+
+    FileHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = INDEX_CACHE_MAGIC;
+    header.version = INDEX_CACHE_VERSION;
+    header.fileSize = fileSize;
+    header.modifiedTime = modifiedTime;
+    header.duration = index.duration;
+    header.streamCount = int32_t(index.streams.size());
+    header.keyframeStream = index.keyframeStream;
+    header.keyframeCount = int64_t(index.keyframes.size());
+    header.thumbnailCount = int32_t(index.thumbnails.size());
+    header.pathLength = int32_t(absolutePath.size());
+
+    Writer writer;
+    writer.append(header);
+    writer.append(absolutePath.constData(), absolutePath.size());
+    for (const StreamInfo& info : index.streams) {
+        writer.append(toRecord(info));
+        writer.append(info.extradata.constData(), info.extradata.size());
+    }
+    std::vector<KeyframeRecord> keyframes;
+    keyframes.reserve(index.keyframes.size());
+    for (const KeyframeIndex::Entry& entry : index.keyframes) {
+        keyframes.push_back({ entry.time, entry.timestamp, entry.pos });
+    }
+    writer.append(keyframes.data(), qint64(keyframes.size() * sizeof(KeyframeRecord)));
+    for (const auto& thumbnail : index.thumbnails) {
+        const QImage image = thumbnail.second.convertToFormat(QImage::Format_RGBA8888);
+        ThumbnailRecord record = { thumbnail.first, image.width(), image.height(), int32_t(image.bytesPerLine()), 0 };
+        writer.append(record);
+        writer.append(image.constBits(), image.sizeInBytes());
+    }
+
+    const QString path = cachePath(mediaPath);
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    // 整体替换，读取方不会映射到写了一半的文件
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Failed to write media index cache" << path;
+        return false;
+    }
+    file.write(writer.buffer());
+    return file.commit();
+}
+
+bool MediaIndexCache::saveThumbnails(const QString& mediaPath, const std::vector<std::pair<qint64, QImage>>& thumbnails) {
+    MediaIndex index;
+    if (!load(mediaPath, &index)) return false;
+    index.thumbnails = thumbnails;
+    return save(mediaPath, index);
+}
+
+void MediaIndexCache::captureStreams(const AVFormatContext* fmtCtx, MediaIndex* index) {
+    index->duration = fmtCtx->duration;
+    index->streams.clear();
+    for (unsigned int i = 0; i < fmtCtx->nb_streams; ++i) {
+        const AVStream* stream = fmtCtx->streams[i];
+        const AVCodecParameters* par = stream->codecpar;
+        StreamInfo info;
+        info.codecType = par->codec_type;
+        info.codecId = par->codec_id;
+        info.codecTag = par->codec_tag;
+        info.format = par->format;
+        info.bitRate = par->bit_rate;
+        info.profile = par->profile;
+        info.level = par->level;
+        info.width = par->width;
+        info.height = par->height;
+        info.sampleAspectRatio = par->sample_aspect_ratio;
+        info.fieldOrder = par->field_order;
+        info.colorRange = par->color_range;
+        info.colorPrimaries = par->color_primaries;
+        info.colorTrc = par->color_trc;
+        info.colorSpace = par->color_space;
+        info.chromaLocation = par->chroma_location;
+        info.videoDelay = par->video_delay;
+        info.sampleRate = par->sample_rate;
+        info.channels = par->ch_layout.nb_channels;
+        info.channelOrder = par->ch_layout.order;
+        info.channelMask = par->ch_layout.order == AV_CHANNEL_ORDER_NATIVE ? par->ch_layout.u.mask : 0;
+        info.frameSize = par->frame_size;
+        info.timeBase = stream->time_base;
+        info.avgFrameRate = stream->avg_frame_rate;
+        info.realFrameRate = stream->r_frame_rate;
+        info.startTime = stream->start_time;
+        info.duration = stream->duration;
+        if (par->extradata && par->extradata_size > 0) {
+            info.extradata = QByteArray(reinterpret_cast<const char*>(par->extradata), par->extradata_size);
+        }
+        index->streams.push_back(info);
+    }
+}
+
+bool MediaIndexCache::applyStreams(const MediaIndex& index, AVFormatContext* fmtCtx) {
+    // 需要探测才能发现流的格式（如ts）在打开时流的数量不一致
+    if (index.streams.size() != fmtCtx->nb_streams) return false;
+    for (unsigned int i = 0; i < fmtCtx->nb_streams; ++i) {
+        const StreamInfo& info = index.streams[i];
+        const AVStream* stream = fmtCtx->streams[i];
+        if (stream->codecpar->codec_type != info.codecType) return false;
+        if (av_cmp_q(stream->time_base, info.timeBase) != 0) return false;
+    }
+
+    for (unsigned int i = 0; i < fmtCtx->nb_streams; ++i) {
+        applyStream(index.streams[i], fmtCtx->streams[i]);
+    }
+    fmtCtx->duration = index.duration;
+    return true;
+}
+
+void MediaIndexCache::applyStream(const StreamInfo& info, AVStream* stream) {
+    AVCodecParameters* par = stream->codecpar;
+    par->codec_id = static_cast<AVCodecID>(info.codecId);
+    par->codec_tag = info.codecTag;
+    par->format = info.format;
+    par->bit_rate = info.bitRate;
+    par->profile = info.profile;
+    par->level = info.level;
+    par->width = info.width;
+    par->height = info.height;
+    par->sample_aspect_ratio = info.sampleAspectRatio;
+    par->field_order = static_cast<AVFieldOrder>(info.fieldOrder);
+    par->color_range = static_cast<AVColorRange>(info.colorRange);
+    par->color_primaries = static_cast<AVColorPrimaries>(info.colorPrimaries);
+    par->color_trc = static_cast<AVColorTransferCharacteristic>(info.colorTrc);
+    par->color_space = static_cast<AVColorSpace>(info.colorSpace);
+    par->chroma_location = static_cast<AVChromaLocation>(info.chromaLocation);
+    par->video_delay = info.videoDelay;
+    par->sample_rate = info.sampleRate;
+    par->frame_size = info.frameSize;
+    if (info.codecType == AVMEDIA_TYPE_AUDIO && info.channels > 0) {
+        av_channel_layout_uninit(&par->ch_layout);
+        if (info.channelOrder == AV_CHANNEL_ORDER_NATIVE) {
+            av_channel_layout_from_mask(&par->ch_layout, info.channelMask);
+        } else {
+            av_channel_layout_default(&par->ch_layout, info.channels);
+        }
+    }
+    if (!info.extradata.isEmpty()) {
+        av_freep(&par->extradata);
+        par->extradata = static_cast<uint8_t*>(av_mallocz(info.extradata.size() + AV_INPUT_BUFFER_PADDING_SIZE));
+        memcpy(par->extradata, info.extradata.constData(), info.extradata.size());
+        par->extradata_size = int(info.extradata.size());
+    }
+    stream->avg_frame_rate = info.avgFrameRate;
+    stream->r_frame_rate = info.realFrameRate;
+    stream->start_time = info.startTime;
+    stream->duration = info.duration;
+}
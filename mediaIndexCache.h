@@ -0,0 +1,80 @@
+#ifndef MEDIAINDEXCACHE_H
+#define MEDIAINDEXCACHE_H
+
+#include "keyframeIndex.h"
+#include <QByteArray>
+#include <QImage>
+#include <QString>
+#include <utility>
+#include <vector>
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+// 探测得到的流参数，重新打开时代替avformat_find_stream_info
+struct StreamInfo {
+    int codecType = AVMEDIA_TYPE_UNKNOWN;
+    int codecId = AV_CODEC_ID_NONE;
+    uint32_t codecTag = 0;
+    int format = -1;
+    int64_t bitRate = 0;
+    int profile = 0;
+    int level = 0;
+    int width = 0;
+    int height = 0;
+    AVRational sampleAspectRatio = { 0, 1 };
+    int fieldOrder = 0;
+    int colorRange = 0;
+    int colorPrimaries = 0;
+    int colorTrc = 0;
+    int colorSpace = 0;
+    int chromaLocation = 0;
+    int videoDelay = 0;
+    int sampleRate = 0;
+    int channels = 0;
+    int channelOrder = 0;
+    uint64_t channelMask = 0;
+    int frameSize = 0;
+    AVRational timeBase = { 0, 1 };
+    AVRational avgFrameRate = { 0, 1 };
+    AVRational realFrameRate = { 0, 1 };
+    int64_t startTime = AV_NOPTS_VALUE;
+    int64_t duration = AV_NOPTS_VALUE;
+    QByteArray extradata;
+};
+
+// 一个媒体文件的索引：流参数、时长、关键帧表及预览缩略图
+struct MediaIndex {
+    // 总时长 单位微秒
+    int64_t duration = AV_NOPTS_VALUE;
+    std::vector<StreamInfo> streams;
+    // 关键帧表所属的流，-1表示没有关键帧表
+    int keyframeStream = -1;
+    std::vector<KeyframeIndex::Entry> keyframes;
+    // 缩略图，键为时间 单位毫秒
+    std::vector<std::pair<qint64, QImage>> thumbnails;
+};
+
+// 媒体索引磁盘缓存
+// 每个媒体文件一个二进制缓存文件，以路径、大小和修改时间为键，读取时以内存映射方式解析
+class MediaIndexCache {
+public:
+    // 缓存文件路径
+    static QString cachePath(const QString& mediaPath);
+    // 读取缓存，不存在、格式不符或媒体文件已变化时返回false
+    static bool load(const QString& mediaPath, MediaIndex* index);
+    // 写入缓存
+    static bool save(const QString& mediaPath, const MediaIndex& index);
+    // 只替换缓存中的缩略图，缓存不存在时不写入
+    static bool saveThumbnails(const QString& mediaPath, const std::vector<std::pair<qint64, QImage>>& thumbnails);
+
+    // 从已探测的上下文中记录流参数和时长
+    static void captureStreams(const AVFormatContext* fmtCtx, MediaIndex* index);
+    // 将缓存的流参数填入刚打开、尚未探测的上下文，流的数量、类型或时间基准不一致时返回false
+    static bool applyStreams(const MediaIndex& index, AVFormatContext* fmtCtx);
+    // 将一个流的参数填入stream，调用方保证类型和时间基准一致
+    static void applyStream(const StreamInfo& info, AVStream* stream);
+};
+
+#endif // MEDIAINDEXCACHE_H
@@ -0,0 +1,194 @@
+#include "mediaLoader.h"
+#include <QDebug>
+#include <algorithm>
+
+MediaLoader::MediaLoader() {
+
+}
+
+MediaLoader::~MediaLoader() {
+    stop();
+}
+
+void MediaLoader::load(MediaItem* item) {
+    addJob(item, Load);
+}
+
+void MediaLoader::attachAudio(MediaItem* item) {
+    if (!item || m_bStop) return;
+    addJob(item, AttachAudio);
+}
+
+std::vector<MediaItem*> MediaLoader::takeLoaded() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<MediaItem*> items;
+    items.swap(m_loaded);
+    return items;
+}
+
+std::vector<MediaItem*> MediaLoader::takeAudioAttached() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<MediaItem*> items;
+    items.swap(m_audioAttached);
+    return items;
+}
+
+void MediaLoader::release(MediaItem* item) {
+    if (!item) return;
+    // 已停止时直接释放
+    if (m_bStop) {
+        close(item);
+        return;
+    }
+    addJob(item, Release);
+}
+
+void MediaLoader::saveThumbnails(const QString& mediaPath, std::vector<std::pair<qint64, QImage>> thumbnails) {
+    // 已停止时直接写入
+    if (m_bStop) {
+        MediaIndexCache::saveThumbnails(mediaPath, thumbnails);
+        return;
+    }
+    Job job;
+    job.type = SaveThumbnails;
+    job.mediaPath = mediaPath;
+    job.thumbnails = std::move(thumbnails);
+    addJob(std::move(job));
+}
+
+void MediaLoader::addJob(MediaItem* item, JobType type) {
+    Job job;
+    job.item = item;
+    job.type = type;
+    addJob(std::move(job));
+}
+
+void MediaLoader::addJob(Job job) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_jobs.push_back(std::move(job));
+    }
+    if (!isRunning()) start();
+    m_jobEvent.notify();
+}
+
+void MediaLoader::stop() {
+    m_bStop = true;
+    m_jobEvent.notify();
+    if (isRunning()) wait();
+    // 未开始的加载和未取走的项都不会再交给调用方
+    std::lock_guard<std::mutex> lock(m_mutex);
+    // 创建音频设备的项仍归调用方所有，不在这里释放
+    for (const Job& job : m_jobs) {
+        if (job.type == SaveThumbnails) {
+            MediaIndexCache::saveThumbnails(job.mediaPath, job.thumbnails);
+        } else if (job.type != AttachAudio) {
+            close(job.item);
+        }
+    }
+    for (MediaItem* item : m_loaded) close(item);
+    m_jobs.clear();
+    m_loaded.clear();
+    m_audioAttached.clear();
+}
+
+void MediaLoader::run() {
+    while (true) {
+        m_jobEvent.wait([this]{
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_bStop || !m_jobs.empty();
+        });
+        Job job;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_jobs.empty()) break;
+            job = std::move(m_jobs.front());
+            m_jobs.pop_front();
+        }
+        if (job.type == SaveThumbnails) {
+            MediaIndexCache::saveThumbnails(job.mediaPath, job.thumbnails);
+            continue;
+        }
+        if (job.type == Release) {
+            {
+                // 已创建音频设备但调用方尚未取走
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_audioAttached.erase(std::remove(m_audioAttached.begin(), m_audioAttached.end(), job.item), m_audioAttached.end());
+            }
+            close(job.item);
+            continue;
+        }
+        if (job.type == AttachAudio) {
+            if (m_bStop) continue;
+            if (!openAudio(job.item)) {
+                qCritical() << "audio output init failed, playing without audio:" << job.item->localPath;
+                job.item->decoder->dropAudio();
+            }
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_audioAttached.push_back(job.item);
+            }
+            emit audioAttached();
+            continue;
+        }
+        // 停止时不再加载，由stop释放
+        if (m_bStop) {
+            close(job.item);
+            continue;
+        }
+        open(job.item);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_loaded.push_back(job.item);
+        }
+        emit loaded();
+    }
+}
+
+bool MediaLoader::open(MediaItem* item) {
+    Decoder* decoder = item->decoder;
+    if (!decoder->init(item->localPath, item->useHardwareDecoder, item->threading)) {
+        qCritical() << "decoder init failed:" << item->localPath;
+        return false;
+    }
+
+    // 快速起播时先开始解码，音频设备在开始播放后创建，第一帧不等待音频设备
+    if (!item->fastStart) {
+        if (!openAudio(item)) return false;
+        decoder->setAudioReady();
+    }
+
+    decoder->preroll();
+    item->ok = true;
+    return true;
+}
+
+bool MediaLoader::openAudio(MediaItem* item) {
+    Decoder* decoder = item->decoder;
+    if (!decoder->hasAudio()) return true;
+    // 音频输出驱动音频时钟；设备先暂停，切换到这一项时再恢复
+    item->audioOutput = new AudioOutput(decoder);
+    if (!item->audioOutput->init(decoder->getAudioSampleRate(), true)) {
+        qWarning() << "audio output init failed";
+        delete item->audioOutput;
+        item->audioOutput = nullptr;
+        return false;
+    }
+    return true;
+}
+
+void MediaLoader::close(MediaItem* item) {
+    if (!item) return;
+    // 音频输出读取解码器中的PCM缓冲，先于解码器停止
+    delete item->audioOutput;
+    if (item->decoder) {
+        item->decoder->close();
+        // 解码器属于界面线程，不在其他线程中直接析构
+        if (item->decoder->thread() == QThread::currentThread()) {
+            delete item->decoder;
+        } else {
+            item->decoder->deleteLater();
+        }
+    }
+    delete item;
+}
@@ -0,0 +1,97 @@
+#ifndef MEDIALOADER_H
+#define MEDIALOADER_H
+
+#include "decoder.h"
+#include "audioOutput.h"
+#include <QString>
+#include <QThread>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// 播放列表中的一项：解码器、音频输出及打开结果
+struct MediaItem {
+    // 在播放列表中的位置
+    int index = -1;
+    QString localPath;
+    bool useHardwareDecoder = false;
+    DecodeThreading threading = DecodeThreading::Auto;
+    // 快速起播：open不创建音频设备，开始播放后由attachAudio在加载线程中创建
+    bool fastStart = false;
+    // 在界面线程创建，打开后由播放器接管，不再使用时交回MediaLoader释放
+    Decoder* decoder = nullptr;
+    // 没有音频流时为空
+    AudioOutput* audioOutput = nullptr;
+    bool ok = false;
+};
+
+// 播放列表的后台加载线程
+// 在工作线程中打开文件、创建音频设备并预先解码（Decoder::preroll），切换时只需开始播放；
+// 不再使用的项也在这里关闭，等待解码线程退出不阻塞界面线程；缩略图写入媒体索引缓存同样在这里进行
+class MediaLoader : public QThread {
+    Q_OBJECT
+public:
+    MediaLoader();
+    ~MediaLoader();
+
+    // 在工作线程中打开item，完成后发出loaded信号，之后由takeLoaded取走
+    void load(MediaItem* item);
+    // 已打开、尚未取走的项，取走后归调用方所有
+    std::vector<MediaItem*> takeLoaded();
+    // 在工作线程中为快速起播的item创建音频设备，完成后发出audioAttached信号，之后由takeAudioAttached取走；
+    // 创建失败时解码器放弃音频流，item的audioOutput为空
+    void attachAudio(MediaItem* item);
+    // 已创建音频设备、尚未取走的项，item仍归调用方所有；被释放的项不会出现在其中
+    std::vector<MediaItem*> takeAudioAttached();
+    // 在工作线程中关闭并释放item
+    void release(MediaItem* item);
+    // 在工作线程中将缩略图写入mediaPath的媒体索引缓存，stop时未写入的也会写完
+    void saveThumbnails(const QString& mediaPath, std::vector<std::pair<qint64, QImage>> thumbnails);
+    // 结束线程，释放所有未处理及未取走的项
+    void stop();
+
+    // 打开item：初始化解码器、以暂停状态创建音频设备并开始预先解码，可在任意线程调用
+    // 快速起播时不创建音频设备
+    static bool open(MediaItem* item);
+    // 以暂停状态创建音频设备，没有音频流时直接返回true，可在任意线程调用
+    static bool openAudio(MediaItem* item);
+    // 关闭并释放item，可在任意线程调用
+    static void close(MediaItem* item);
+
+signals:
+    void loaded();
+    void audioAttached();
+
+protected:
+    void run() override;
+
+private:
+    enum JobType {
+        Load,
+        AttachAudio,
+        Release,
+        SaveThumbnails
+    };
+
+    struct Job {
+        MediaItem* item = nullptr;
+        JobType type = Load;
+        // SaveThumbnails的媒体路径及缩略图
+        QString mediaPath;
+        std::vector<std::pair<qint64, QImage>> thumbnails;
+    };
+
+    void addJob(MediaItem* item, JobType type);
+    void addJob(Job job);
+
+    std::mutex m_mutex;
+    std::deque<Job> m_jobs;
+    std::vector<MediaItem*> m_loaded;
+    std::vector<MediaItem*> m_audioAttached;
+    WaitEvent m_jobEvent;
+    std::atomic<bool> m_bStop = false;
+};
+
+#endif // MEDIALOADER_H
@@ -0,0 +1,162 @@
+#include "mediaPool.h"
+#include <QDebug>
+
+extern "C" {
+#include <libavutil/imgutils.h>
+#include <libavutil/mem.h>
+}
+
+// 池中最多保留的空闲packet数，解码队列满时在途的packet可达数千个
+#define PACKET_POOL_CAPACITY 4096
+// 池中最多保留的空闲帧结构数
+#define FRAME_POOL_CAPACITY 64
+// 像素缓冲的行对齐 单位字节，满足SIMD读写要求
+#define FRAME_BUFFER_ALIGN 64
+// 像素缓冲末尾的填充 单位字节，SIMD按块读取时可能越过最后一行
+#define FRAME_BUFFER_PADDING 64
+
+PacketPool::~PacketPool() {
+    for (AVPacket* packet : m_free) av_packet_free(&packet);
+}
+
+AVPacket* PacketPool::take(AVPacket* src) {
+    AVPacket* packet = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_free.empty()) {
+            packet = m_free.back();
+            m_free.pop_back();
+        }
+    }
+    if (packet) {
+        ++m_nReuses;
+    } else {
+        packet = av_packet_alloc();
+        if (!packet) return nullptr;
+        ++m_nAllocs;
+    }
+    av_packet_move_ref(packet, src);
+    return packet;
+}
+
+void PacketPool::recycle(AVPacket* packet) {
+    if (!packet) return;
+    av_packet_unref(packet);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_free.size() < PACKET_POOL_CAPACITY) {
+            m_free.push_back(packet);
+            return;
+        }
+    }
+    av_packet_free(&packet);
+}
+
+PoolStats PacketPool::stats() const {
+    return { m_nAllocs.load(), m_nReuses.load() };
+}
+
+FramePool::~FramePool() {
+    for (AVFrame* frame : m_free) av_frame_free(&frame);
+    // 仍被引用的缓冲在最后一个引用释放后才真正释放
+    av_buffer_pool_uninit(&m_pBufferPool);
+}
+
+std::shared_ptr<FramePool> FramePool::create() {
+    return std::shared_ptr<FramePool>(new FramePool());
+}
+
+VideoFramePtr FramePool::take() {
+    AVFrame* frame = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_free.empty()) {
+            frame = m_free.back();
+            m_free.pop_back();
+        }
+    }
+    if (frame) {
+        ++m_nFrameReuses;
+    } else {
+        frame = av_frame_alloc();
+        if (!frame) return nullptr;
+        ++m_nFrameAllocs;
+    }
+    // 帧释放时归还，池由所有在外的帧共同持有
+    std::shared_ptr<FramePool> self = shared_from_this();
+    return VideoFramePtr(frame, [self](AVFrame* released) { self->recycle(released); });
+}
+
+VideoFramePtr FramePool::ref(const AVFrame* src) {
+    VideoFramePtr frame = take();
+    if (!frame || av_frame_ref(frame.get(), src) < 0) return nullptr;
+    return frame;
+}
+
+bool FramePool::allocBuffer(AVFrame* frame) {
+    const AVPixelFormat format = static_cast<AVPixelFormat>(frame->format);
+    int linesizes[4] = { 0 };
+    if (av_image_fill_linesizes(linesizes, format, FFALIGN(frame->width, FRAME_BUFFER_ALIGN)) < 0) return false;
+    ptrdiff_t strides[4] = { 0 };
+    for (int i = 0; i < 4; ++i) {
+        linesizes[i] = FFALIGN(linesizes[i], FRAME_BUFFER_ALIGN);
+        strides[i] = linesizes[i];
+    }
+    size_t planeSizes[4] = { 0 };
+    if (av_image_fill_plane_sizes(planeSizes, format, frame->height, strides) < 0) return false;
+    size_t size = FRAME_BUFFER_PADDING;
+    for (size_t planeSize : planeSizes) size += planeSize;
+
+    // 格式或大小变化，旧缓冲池在其中的缓冲全部归还后释放
+    if (size != m_nBufferSize || !m_pBufferPool) {
+        av_buffer_pool_uninit(&m_pBufferPool);
+        m_pBufferPool = av_buffer_pool_init2(size, this, &FramePool::allocPoolBuffer, nullptr);
+        m_nBufferSize = m_pBufferPool ? size : 0;
+        if (!m_pBufferPool) return false;
+    }
+    AVBufferRef* buffer = av_buffer_pool_get(m_pBufferPool);
+    if (!buffer) {
+        qCritical() << "Failed to allocate frame buffer";
+        return false;
+    }
+    ++m_nBufferGets;
+
+    // 所有平面放在同一块缓冲中，与av_frame_get_buffer的布局一致
+    frame->buf[0] = buffer;
+    uint8_t* data = buffer->data;
+    for (int i = 0; i < 4 && planeSizes[i] > 0; ++i) {
+        frame->data[i] = data;
+        frame->linesize[i] = linesizes[i];
+        data += planeSizes[i];
+    }
+    frame->extended_data = frame->data;
+    return true;
+}
+
+PoolStats FramePool::frameStats() const {
+    return { m_nFrameAllocs.load(), m_nFrameReuses.load() };
+}
+
+PoolStats FramePool::bufferStats() const {
+    const qint64 allocs = m_nBufferAllocs.load();
+    return { allocs, m_nBufferGets.load() - allocs };
+}
+
+void FramePool::recycle(AVFrame* frame) {
+    // 释放像素缓冲的引用，缓冲回到缓冲池
+    av_frame_unref(frame);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_free.size() < FRAME_POOL_CAPACITY) {
+            m_free.push_back(frame);
+            return;
+        }
+    }
+    av_frame_free(&frame);
+}
+
+AVBufferRef* FramePool::allocPoolBuffer(void* opaque, size_t size) {
+    // 只在缓冲池中没有空闲缓冲时调用
+    ++static_cast<FramePool*>(opaque)->m_nBufferAllocs;
+    return av_buffer_alloc(size);
+}
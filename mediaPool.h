@@ -0,0 +1,82 @@
+#ifndef MEDIAPOOL_H
+#define MEDIAPOOL_H
+
+#include "videoFrame.h"
+#include <QtGlobal>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+extern "C" {
+#include <libavcodec/packet.h>
+#include <libavutil/buffer.h>
+}
+
+// 内存池统计：新分配的次数及从池中复用的次数，稳定播放时分配次数不再增长
+struct PoolStats {
+    qint64 allocs = 0;
+    qint64 reuses = 0;
+};
+
+// AVPacket结构的回收池
+// 解复用线程用av_packet_move_ref把读到的数据移入池中取出的packet，不再每个packet都av_packet_clone；
+// 解码线程用完后归还，只释放数据的引用，packet结构留在池中复用
+class PacketPool {
+public:
+    PacketPool() {};
+    ~PacketPool();
+
+    // 取一个packet并移入src的数据，src变为空packet，可在任意线程调用
+    AVPacket* take(AVPacket* src);
+    // 归还packet，可在任意线程调用
+    void recycle(AVPacket* packet);
+    PoolStats stats() const;
+
+private:
+    std::mutex m_mutex;
+    std::vector<AVPacket*> m_free;
+    std::atomic<qint64> m_nAllocs = 0;
+    std::atomic<qint64> m_nReuses = 0;
+};
+
+// 视频帧的回收池
+// 帧结构用完后归还到池中；像素缓冲从AVBufferPool中分配，渲染端释放最后一个引用时回到缓冲池，
+// 分辨率和格式不变时不再分配内存。帧可能比创建它的对象存活得更久，池由帧共同持有
+class FramePool : public std::enable_shared_from_this<FramePool> {
+public:
+    ~FramePool();
+
+    static std::shared_ptr<FramePool> create();
+
+    // 取一个空帧，释放时归还到池中，可在任意线程调用
+    VideoFramePtr take();
+    // 创建一个引用src像素数据的帧，失败时返回空
+    VideoFramePtr ref(const AVFrame* src);
+    // 按frame已设置的format、width、height从缓冲池中分配像素缓冲
+    // 只在一个线程中调用，格式或大小变化时重建缓冲池
+    bool allocBuffer(AVFrame* frame);
+
+    // 帧结构及像素缓冲的分配统计
+    PoolStats frameStats() const;
+    PoolStats bufferStats() const;
+
+private:
+    FramePool() {};
+    void recycle(AVFrame* frame);
+    static AVBufferRef* allocPoolBuffer(void* opaque, size_t size);
+
+    std::mutex m_mutex;
+    std::vector<AVFrame*> m_free;
+    std::atomic<qint64> m_nFrameAllocs = 0;
+    std::atomic<qint64> m_nFrameReuses = 0;
+    // 以下只在调用allocBuffer的线程中使用
+    AVBufferPool* m_pBufferPool = nullptr;
+    size_t m_nBufferSize = 0;
+    std::atomic<qint64> m_nBufferGets = 0;
+    std::atomic<qint64> m_nBufferAllocs = 0;
+};
+
+using FramePoolPtr = std::shared_ptr<FramePool>;
+
+#endif // MEDIAPOOL_H
@@ -0,0 +1,155 @@
+#ifndef PACKETQUEUE_H
+#define PACKETQUEUE_H
+
+#include "waitEvent.h"
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+extern "C" {
+#include <libavcodec/packet.h>
+#include <libavutil/avutil.h>
+#include <libavutil/time.h>
+}
+
+// 单生产者/单消费者无锁环形packet队列
+// 生产者为解复用线程，消费者为解码线程；容量在构造时确定，之后入队出队都不再分配内存。
+// 每个packet带有入队时的跳转序号，跳转时不清空队列，由消费者按序号丢弃过期的packet
+class PacketQueue {
+public:
+    explicit PacketQueue(size_t capacity) : m_ring(capacity), m_nCapacity(capacity) {
+        m_pFlushPacket = av_packet_alloc();
+    };
+
+    ~PacketQueue() {
+        clear();
+        av_packet_free(&m_pFlushPacket);
+    };
+
+    // 出队时取得的packet附带信息
+    struct Info {
+        // 入队时的系统时间 单位微秒
+        int64_t queuedTime = 0;
+        // 入队时的跳转序号
+        int serial = 0;
+        // 跳转标记的跳转时间 单位微秒
+        int64_t seekTime = -1;
+    };
+
+    // 入队，serial为packet所属的跳转序号，队列已满时返回false（生产者线程调用）
+    inline bool push(AVPacket* packet, int serial) {
+        return pushSlot(packet, serial, -1);
+    }
+
+    // 放入跳转标记，消费者据此清空解码器缓存并丢弃seekTime之前的帧（生产者线程调用）
+    inline bool pushFlush(int serial, int64_t seekTime) {
+        // 之后入队的packet与队列中的旧packet时间不连续，时间跨度从下一个packet重新开始
+        m_nFirstTime = AV_NOPTS_VALUE;
+        return pushSlot(m_pFlushPacket, serial, seekTime);
+    }
+
+    // 出队，队列为空时返回nullptr（消费者线程调用）
+    inline AVPacket* pop(Info* info = nullptr) {
+        const size_t head = m_nHead.load(std::memory_order_relaxed);
+        if (head == m_nTail.load(std::memory_order_acquire)) return nullptr;
+        const Slot& slot = m_ring[head % m_nCapacity];
+        AVPacket* packet = slot.packet;
+        if (info) *info = slot.info;
+        m_nBytes.fetch_sub(packet->size);
+        m_nDuration.fetch_sub(packet->duration);
+        const int64_t time = timeOf(packet);
+        if (time != AV_NOPTS_VALUE) m_nPoppedTime = time;
+        m_nHead.store(head + 1, std::memory_order_release);
+        if (m_pSpaceEvent) m_pSpaceEvent->notify();
+        return packet;
+    }
+
+    // 释放队列中剩余的packet（仅在消费者线程已停止时调用）
+    inline void clear() {
+        AVPacket* packet = nullptr;
+        while ((packet = pop())) {
+            if (packet != m_pFlushPacket) av_packet_free(&packet);
+        }
+    }
+
+    // 中止队列，唤醒所有等待者
+    inline void abort() {
+        m_bAbort = true;
+        if (m_pDataEvent) m_pDataEvent->notify();
+        if (m_pSpaceEvent) m_pSpaceEvent->notify();
+    }
+
+    inline bool isAborted() const { return m_bAbort; }
+    inline size_t size() const { return m_nTail.load(std::memory_order_acquire) - m_nHead.load(std::memory_order_acquire); }
+    inline bool isFull() const { return size() >= m_nCapacity; }
+    // 队列中packet的总字节数
+    inline int64_t bytes() const { return m_nBytes.load(); }
+    // 队列中packet的总时长 单位为流的时间基准
+    inline int64_t duration() const { return m_nDuration.load(); }
+    // 队列中packet的时间跨度 单位为流的时间基准，即最后入队的与最后出队的（或跳转后第一个入队的）packet的时间戳之差；
+    // 用于packet不带时长（裸H.264/HEVC、部分TS/MKV）时估计缓存的时长
+    inline int64_t span() const {
+        const int64_t last = m_nLastTime.load();
+        // AV_NOPTS_VALUE为最小值，取较大者即取已知的那个
+        const int64_t first = std::max(m_nFirstTime.load(), m_nPoppedTime.load());
+        if (last == AV_NOPTS_VALUE || first == AV_NOPTS_VALUE) return 0;
+        return std::max<int64_t>(0, last - first);
+    }
+
+    // 入队及中止时通知的事件，解码线程通过它等待数据
+    inline void setDataEvent(WaitEvent* event) { m_pDataEvent = event; }
+    // 出队时通知的事件，解复用线程通过它等待队列腾出空间
+    inline void setSpaceEvent(WaitEvent* event) { m_pSpaceEvent = event; }
+
+    // 是否为跳转标记
+    inline bool isFlushPacket(const AVPacket* packet) const { return packet == m_pFlushPacket; }
+
+private:
+    struct Slot {
+        AVPacket* packet = nullptr;
+        Info info;
+    };
+
+    inline bool pushSlot(AVPacket* packet, int serial, int64_t seekTime) {
+        const size_t tail = m_nTail.load(std::memory_order_relaxed);
+        if (tail - m_nHead.load(std::memory_order_acquire) >= m_nCapacity) return false;
+        Slot& slot = m_ring[tail % m_nCapacity];
+        slot.packet = packet;
+        slot.info.queuedTime = av_gettime_relative();
+        slot.info.serial = serial;
+        slot.info.seekTime = seekTime;
+        m_nBytes.fetch_add(packet->size);
+        m_nDuration.fetch_add(packet->duration);
+        const int64_t time = timeOf(packet);
+        if (time != AV_NOPTS_VALUE) {
+            if (m_nFirstTime.load() == AV_NOPTS_VALUE) m_nFirstTime = time;
+            m_nLastTime = time;
+        }
+        m_nTail.store(tail + 1, std::memory_order_release);
+        if (m_pDataEvent) m_pDataEvent->notify();
+        return true;
+    }
+
+    // 解码时间戳，没有时取显示时间戳
+    static inline int64_t timeOf(const AVPacket* packet) {
+        return packet->dts != AV_NOPTS_VALUE ? packet->dts : packet->pts;
+    }
+
+    std::vector<Slot> m_ring;
+    const size_t m_nCapacity;
+    // 读写位置单调递增，取模得到下标
+    std::atomic<size_t> m_nHead = 0;
+    std::atomic<size_t> m_nTail = 0;
+    std::atomic<bool> m_bAbort = false;
+    std::atomic<int64_t> m_nBytes = 0;
+    std::atomic<int64_t> m_nDuration = 0;
+    // 最近一次跳转后第一个入队、最后入队及最后出队的packet的时间戳 单位为流的时间基准
+    std::atomic<int64_t> m_nFirstTime = AV_NOPTS_VALUE;
+    std::atomic<int64_t> m_nLastTime = AV_NOPTS_VALUE;
+    std::atomic<int64_t> m_nPoppedTime = AV_NOPTS_VALUE;
+    WaitEvent* m_pDataEvent = nullptr;
+    WaitEvent* m_pSpaceEvent = nullptr;
+    AVPacket* m_pFlushPacket = nullptr;
+};
+
+#endif // PACKETQUEUE_H
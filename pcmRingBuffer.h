@@ -0,0 +1,176 @@
+#ifndef PCMRINGBUFFER_H
+#define PCMRINGBUFFER_H
+
+#include "waitEvent.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <vector>
+#include <QtGlobal>
+
+extern "C" {
+#include <libavutil/avutil.h>
+}
+
+// 单生产者/单消费者无锁PCM环形缓冲
+// 生产者为音频解码线程，消费者为音频设备的拉取线程；容量在reset时确定，之后读写都不再分配内存。
+// 同时记录已写入数据末尾的播放时间，消费者据此算出下一个待读字节的播放时间
+class PcmRingBuffer {
+public:
+    PcmRingBuffer() {};
+    ~PcmRingBuffer() {};
+
+    // 分配容量并清空，只在生产者和消费者都未运行时调用
+    inline void reset(size_t capacity, int bytesPerSecond) {
+        m_buffer.assign(capacity, 0);
+        m_nCapacity = capacity;
+        m_nBytesPerSecond = bytesPerSecond;
+        m_nHead = 0;
+        m_nTail = 0;
+        m_nFlushTo = 0;
+        m_nEndPts = AV_NOPTS_VALUE;
+        m_nSerial = 0;
+        m_dSpeed = 1.0;
+    }
+
+    // 写入数据，返回实际写入的字节数，空间不足时只写入一部分（生产者线程调用）
+    // pts为data第一个字节的播放时间 单位微秒
+    inline size_t write(const char* data, size_t len, qint64 pts) {
+        const size_t tail = m_nTail.load(std::memory_order_relaxed);
+        len = std::min(len, freeSpace());
+        if (len == 0) return 0;
+        const size_t offset = tail % m_nCapacity;
+        const size_t first = std::min(len, m_nCapacity - offset);
+        memcpy(m_buffer.data() + offset, data, first);
+        memcpy(m_buffer.data(), data + first, len - first);
+
+        beginUpdate();
+        m_nEndPts = pts + toMediaTime(bytesToUs(len));
+        m_nTail.store(tail + len, std::memory_order_release);
+        endUpdate();
+        return len;
+    }
+
+    // 丢弃所有未读数据并递增序号，发生跳转或变速时调用（生产者线程调用）
+    // speed为之后写入的数据的播放速率，变速播放时一段数据对应的播放时间是其时长乘以速率
+    inline void flush(double speed = 1.0) {
+        beginUpdate();
+        m_dSpeed = speed;
+        m_nFlushTo = m_nTail.load(std::memory_order_relaxed);
+        m_nEndPts = AV_NOPTS_VALUE;
+        ++m_nSerial;
+        endUpdate();
+        if (m_pSpaceEvent) m_pSpaceEvent->notify();
+    }
+
+    // 丢弃播放时间早于pts的未读数据并递增序号，之后的数据保留（生产者线程调用）
+    // 用于追赶已经前进的时钟，音频输出据序号重启设备，丢弃设备中缓存的旧数据；align为每个采样的字节数
+    inline void discardBefore(qint64 pts, size_t align) {
+        const size_t tail = m_nTail.load(std::memory_order_relaxed);
+        const size_t head = std::max(m_nHead.load(std::memory_order_acquire), m_nFlushTo.load(std::memory_order_relaxed));
+        const qint64 endPts = m_nEndPts.load(std::memory_order_relaxed);
+        size_t discard = tail - head;
+        if (endPts != AV_NOPTS_VALUE && pts < endPts && m_nBytesPerSecond > 0) {
+            // 从末尾往前保留pts之后的数据，按采样对齐
+            const qint64 keepUs = qint64((endPts - pts) / m_dSpeed.load());
+            const size_t keep = size_t(keepUs * m_nBytesPerSecond / AV_TIME_BASE) / align * align;
+            discard = keep < discard ? discard - keep : 0;
+        }
+        beginUpdate();
+        m_nFlushTo = head + discard;
+        ++m_nSerial;
+        endUpdate();
+        if (m_pSpaceEvent) m_pSpaceEvent->notify();
+    }
+
+    // 可写入的字节数（生产者线程调用）
+    // 已被flush丢弃的区域可以直接覆盖，消费者此时读到的内容属于旧序号，会随设备缓存一起丢弃
+    inline size_t freeSpace() const {
+        const size_t head = std::max(m_nHead.load(std::memory_order_acquire), m_nFlushTo.load(std::memory_order_relaxed));
+        return m_nCapacity - (m_nTail.load(std::memory_order_relaxed) - head);
+    }
+
+    // 读出最多len字节，返回实际读出的字节数（消费者线程调用）
+    inline size_t read(char* out, size_t len) {
+        size_t head = readHead();
+        len = std::min(len, size_t(m_nTail.load(std::memory_order_acquire) - head));
+        if (len == 0) {
+            m_nHead.store(head, std::memory_order_release);
+            return 0;
+        }
+        const size_t offset = head % m_nCapacity;
+        const size_t first = std::min(len, m_nCapacity - offset);
+        memcpy(out, m_buffer.data() + offset, first);
+        memcpy(out + first, m_buffer.data(), len - first);
+        m_nHead.store(head + len, std::memory_order_release);
+        if (m_pSpaceEvent) m_pSpaceEvent->notify();
+        return len;
+    }
+
+    // 下一个待读字节的播放时间 单位微秒及其序号，跳转后尚无数据时返回false（消费者线程调用）
+    inline bool readPosition(qint64* pts, int* serial) {
+        size_t tail = 0;
+        qint64 endPts = AV_NOPTS_VALUE;
+        int currentSerial = 0;
+        unsigned seq = 0;
+        do {
+            seq = m_nSeq.load(std::memory_order_acquire);
+            tail = m_nTail.load(std::memory_order_acquire);
+            endPts = m_nEndPts.load(std::memory_order_acquire);
+            currentSerial = m_nSerial.load(std::memory_order_acquire);
+        } while ((seq & 1) || seq != m_nSeq.load(std::memory_order_acquire));
+
+        *serial = currentSerial;
+        if (endPts == AV_NOPTS_VALUE) return false;
+        const size_t head = std::max(m_nHead.load(std::memory_order_relaxed), m_nFlushTo.load(std::memory_order_acquire));
+        *pts = endPts - toMediaTime(bytesToUs(tail - head));
+        return true;
+    }
+
+    // 未读数据的字节数
+    inline size_t size() const {
+        const size_t head = std::max(m_nHead.load(std::memory_order_acquire), m_nFlushTo.load(std::memory_order_acquire));
+        return m_nTail.load(std::memory_order_acquire) - head;
+    }
+    inline size_t capacity() const { return m_nCapacity; }
+    // 当前序号，每次flush递增
+    inline int serial() const { return m_nSerial; }
+
+    // 消费者读出数据或发生跳转时通知该事件
+    inline void setSpaceEvent(WaitEvent* event) { m_pSpaceEvent = event; }
+
+    // 字节数对应的播放时长 单位微秒
+    inline qint64 bytesToUs(qint64 bytes) const {
+        return m_nBytesPerSecond > 0 ? bytes * AV_TIME_BASE / m_nBytesPerSecond : 0;
+    }
+
+    // 设备播放时长对应的播放时间 单位微秒
+    inline qint64 toMediaTime(qint64 usec) const { return qint64(usec * m_dSpeed.load()); }
+
+private:
+    // 跳过已被flush丢弃的数据
+    inline size_t readHead() {
+        return std::max(m_nHead.load(std::memory_order_relaxed), m_nFlushTo.load(std::memory_order_acquire));
+    }
+
+    // 写端位置、末尾时间和序号的更新以序列号包围，读端读到奇数或前后不一致时重读
+    inline void beginUpdate() { m_nSeq.fetch_add(1, std::memory_order_acq_rel); }
+    inline void endUpdate() { m_nSeq.fetch_add(1, std::memory_order_acq_rel); }
+
+    std::vector<char> m_buffer;
+    size_t m_nCapacity = 0;
+    int m_nBytesPerSecond = 0;
+    // 读写位置单调递增，取模得到在缓冲中的偏移
+    std::atomic<size_t> m_nHead = 0;
+    std::atomic<size_t> m_nTail = 0;
+    // 该位置之前的数据已被flush丢弃
+    std::atomic<size_t> m_nFlushTo = 0;
+    // 已写入数据末尾的播放时间 单位微秒
+    std::atomic<qint64> m_nEndPts = AV_NOPTS_VALUE;
+    std::atomic<int> m_nSerial = 0;
+    std::atomic<double> m_dSpeed = 1.0;
+    std::atomic<unsigned> m_nSeq = 0;
+    WaitEvent* m_pSpaceEvent = nullptr;
+};
+
+#endif // PCMRINGBUFFER_H
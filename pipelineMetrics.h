@@ -0,0 +1,141 @@
+#ifndef PIPELINEMETRICS_H
+#define PIPELINEMETRICS_H
+
+#include <QJsonObject>
+#include <QtGlobal>
+#include <array>
+#include <atomic>
+
+// 流水线各阶段
+enum class MetricStage {
+    // 解复用线程av_read_frame
+    Demux,
+    // packet在视频/音频解码队列中的等待时间
+    VideoQueue,
+    AudioQueue,
+    // 每个packet的avcodec_send_packet及随后的avcodec_receive_frame
+    VideoDecode,
+    AudioDecode,
+    // 硬件帧下载到内存av_hwframe_transfer_data
+    HwTransfer,
+    // 帧格式转换及缩放sws_scale
+    Convert,
+    // 展示线程发出帧到界面线程收到的时间
+    Delivery,
+    // 渲染线程同步帧到场景图updatePaintNode
+    Render,
+    // 打开文件到第一帧送出展示，每次打开记录一次
+    FirstFrame,
+    // 按垂直同步取帧时，帧的实际显示时刻与显示时间之差的绝对值
+    PresentError,
+    Count
+};
+
+// 延迟直方图
+// 桶按2的幂划分（第i个桶为[2^(i-1), 2^i)微秒），记录时只有几次原子加法，可在任意线程调用
+class LatencyHistogram {
+public:
+    static constexpr int BUCKET_COUNT = 32;
+
+    LatencyHistogram() { reset(); };
+    ~LatencyHistogram() {};
+
+    // 记录一次耗时 单位微秒
+    inline void record(qint64 usec) {
+        if (usec < 0) usec = 0;
+        int bucket = 0;
+        while (bucket < BUCKET_COUNT - 1 && (qint64(1) << bucket) <= usec) ++bucket;
+        m_buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+        m_nCount.fetch_add(1, std::memory_order_relaxed);
+        m_nSum.fetch_add(usec, std::memory_order_relaxed);
+        qint64 max = m_nMax.load(std::memory_order_relaxed);
+        while (usec > max && !m_nMax.compare_exchange_weak(max, usec, std::memory_order_relaxed)) {}
+    }
+
+    inline qint64 count() const { return m_nCount.load(std::memory_order_relaxed); }
+    inline qint64 sum() const { return m_nSum.load(std::memory_order_relaxed); }
+    inline qint64 max() const { return m_nMax.load(std::memory_order_relaxed); }
+    inline qint64 mean() const { return count() > 0 ? sum() / count() : 0; }
+
+    // 百分位数 单位微秒，返回所在桶的上界，与实际值相差不超过2倍
+    inline qint64 percentile(double p) const {
+        const qint64 total = count();
+        if (total == 0) return 0;
+        const qint64 rank = qMax<qint64>(1, qint64(p * total + 0.5));
+        qint64 seen = 0;
+        for (int i = 0; i < BUCKET_COUNT; ++i) {
+            seen += m_buckets[i].load(std::memory_order_relaxed);
+            if (seen >= rank) return qMin(qint64(1) << i, max());
+        }
+        return max();
+    }
+
+    inline void reset() {
+        for (auto& bucket : m_buckets) bucket.store(0, std::memory_order_relaxed);
+        m_nCount = 0;
+        m_nSum = 0;
+        m_nMax = 0;
+    }
+
+private:
+    std::array<std::atomic<qint64>, BUCKET_COUNT> m_buckets;
+    std::atomic<qint64> m_nCount = 0;
+    std::atomic<qint64> m_nSum = 0;
+    std::atomic<qint64> m_nMax = 0;
+};
+
+// 一个播放实例的流水线统计，每个阶段一个直方图
+class PipelineMetrics {
+public:
+    PipelineMetrics() {};
+    ~PipelineMetrics() {};
+
+    inline void record(MetricStage stage, qint64 usec) {
+        m_histograms[int(stage)].record(usec);
+    }
+
+    inline LatencyHistogram& histogram(MetricStage stage) { return m_histograms[int(stage)]; }
+
+    inline void reset() {
+        for (auto& histogram : m_histograms) histogram.reset();
+    }
+
+    static inline const char* stageName(MetricStage stage) {
+        switch (stage) {
+        case MetricStage::Demux: return "demux";
+        case MetricStage::VideoQueue: return "videoQueue";
+        case MetricStage::AudioQueue: return "audioQueue";
+        case MetricStage::VideoDecode: return "videoDecode";
+        case MetricStage::AudioDecode: return "audioDecode";
+        case MetricStage::HwTransfer: return "hwTransfer";
+        case MetricStage::Convert: return "convert";
+        case MetricStage::Delivery: return "delivery";
+        case MetricStage::Render: return "render";
+        case MetricStage::FirstFrame: return "firstFrame";
+        case MetricStage::PresentError: return "presentError";
+        default: return "unknown";
+        }
+    }
+
+    // 各阶段的次数、平均值、p50、p99及最大值，时间单位毫秒
+    inline QJsonObject toJson() const {
+        QJsonObject stages;
+        for (int i = 0; i < int(MetricStage::Count); ++i) {
+            const LatencyHistogram& histogram = m_histograms[i];
+            QJsonObject stage;
+            stage["count"] = histogram.count();
+            stage["totalMs"] = histogram.sum() / 1000.0;
+            stage["meanMs"] = histogram.mean() / 1000.0;
+            stage["p50Ms"] = histogram.percentile(0.50) / 1000.0;
+            stage["p99Ms"] = histogram.percentile(0.99) / 1000.0;
+            stage["maxMs"] = histogram.max() / 1000.0;
+            stages[stageName(MetricStage(i))] = stage;
+        }
+        return stages;
+    }
+
+private:
+    std::array<LatencyHistogram, int(MetricStage::Count)> m_histograms;
+};
+
+#endif // PIPELINEMETRICS_H
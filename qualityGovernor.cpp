@@ -0,0 +1,106 @@
+#include "qualityGovernor.h"
+#include <QDebug>
+#include <algorithm>
+
+extern "C" {
+#include <libavutil/time.h>
+}
+
+// 统计窗口的时长 单位微秒，及窗口内至少需要的帧数
+#define GOVERNOR_WINDOW 500000
+#define GOVERNOR_MIN_FRAMES 3
+// 窗口内平均落后超过该值，或丢帧超过十分之一时降级 单位微秒
+#define DEGRADE_LATENESS 20000
+#define DEGRADE_DROP_DIVISOR 10
+// 两次降级的最短间隔，等待已解码帧队列中降级前的帧展示完 单位微秒
+#define DEGRADE_HOLD 1000000
+// 窗口内平均落后低于该值且没有丢帧时认为跟上了 单位微秒
+#define RECOVER_LATENESS 5000
+// 恢复一级前需要连续跟上的时间，及反复切换时加倍的上限 单位微秒
+#define RECOVER_HOLD 3000000
+#define MAX_RECOVER_HOLD 60000000
+
+void QualityGovernor::record(qint64 lateness, bool dropped) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    // 关闭后恢复完整画质
+    if (!m_bEnabled) {
+        if (m_level != QualityLevel::Full) changeLevel(QualityLevel::Full, 0);
+        restartWindow();
+        m_nHealthySince = -1;
+        return;
+    }
+    if (m_bHeld) {
+        restartWindow();
+        m_nHealthySince = -1;
+        return;
+    }
+
+    const qint64 now = av_gettime_relative();
+    if (m_nWindowStart < 0) m_nWindowStart = now;
+    ++m_nWindowFrames;
+    if (dropped) ++m_nWindowDropped;
+    m_nWindowLateness += qMax<qint64>(0, lateness);
+    if (now - m_nWindowStart < GOVERNOR_WINDOW || m_nWindowFrames < GOVERNOR_MIN_FRAMES) return;
+
+    evaluate(now);
+    restartWindow();
+}
+
+void QualityGovernor::restart() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    restartWindow();
+    m_nHealthySince = -1;
+}
+
+void QualityGovernor::evaluate(qint64 now) {
+    if (m_nRecoverHold == 0) m_nRecoverHold = RECOVER_HOLD;
+    const qint64 meanLateness = m_nWindowLateness / m_nWindowFrames;
+    const QualityLevel level = m_level;
+
+    const bool behind = meanLateness > DEGRADE_LATENESS || m_nWindowDropped * DEGRADE_DROP_DIVISOR > m_nWindowFrames;
+    if (behind) {
+        m_nHealthySince = -1;
+        if (level == QualityLevel::KeyframesOnly || now - m_nLastChange < DEGRADE_HOLD) return;
+        // 恢复后很快又落后，说明上一级仍然跟不上，加倍下次恢复前的观察时间；隔了很久才落后则是新的负载
+        if (m_bLastRecovered) {
+            m_nRecoverHold = now - m_nLastChange < m_nRecoverHold ? std::min<qint64>(m_nRecoverHold * 2, MAX_RECOVER_HOLD)
+                                                                  : RECOVER_HOLD;
+        }
+        m_bLastRecovered = false;
+        m_nLastChange = now;
+        changeLevel(QualityLevel(int(level) + 1), meanLateness);
+        return;
+    }
+
+    // 介于两个阈值之间时保持当前等级
+    if (meanLateness >= RECOVER_LATENESS || m_nWindowDropped > 0) {
+        m_nHealthySince = -1;
+        return;
+    }
+    if (m_nHealthySince < 0) m_nHealthySince = m_nWindowStart;
+    if (level == QualityLevel::Full || now - m_nHealthySince < m_nRecoverHold) return;
+    // 每恢复一级重新观察
+    m_nHealthySince = now;
+    m_bLastRecovered = true;
+    m_nLastChange = now;
+    changeLevel(QualityLevel(int(level) - 1), meanLateness);
+}
+
+void QualityGovernor::changeLevel(QualityLevel level, qint64 meanLateness) {
+    const QualityLevel old = m_level.exchange(level);
+    if (old == level) return;
+    qDebug() << "Quality level" << levelName(old) << "->" << levelName(level)
+             << "mean lateness(ms):" << meanLateness / 1000.0 << "recover hold(ms):" << m_nRecoverHold / 1000;
+    if (m_fnListener) m_fnListener(level);
+}
+
+const char* QualityGovernor::levelName(QualityLevel level) {
+    switch (level) {
+    case QualityLevel::Full: return "full";
+    case QualityLevel::SkipLoopFilter: return "skipLoopFilter";
+    case QualityLevel::SkipNonRef: return "skipNonRef";
+    case QualityLevel::ReducedScale: return "reducedScale";
+    case QualityLevel::KeyframesOnly: return "keyframesOnly";
+    default: return "unknown";
+    }
+}
@@ -0,0 +1,78 @@
+#ifndef QUALITYGOVERNOR_H
+#define QUALITYGOVERNOR_H
+
+#include <QtGlobal>
+#include <atomic>
+#include <functional>
+#include <mutex>
+
+// 解码降级的等级，每一级都包含前一级的措施
+enum class QualityLevel {
+    // 完整画质
+    Full,
+    // 跳过环路滤波（去块效应滤波）
+    SkipLoopFilter,
+    // 丢弃非参考帧
+    SkipNonRef,
+    // 需要转换的帧以一半的分辨率输出
+    ReducedScale,
+    // 只解码关键帧
+    KeyframesOnly
+};
+
+// 解码画质调控
+// 展示线程记录每帧相对主时钟的落后时间，按窗口统计：持续落后时逐级降级，
+// 持续跟上一段时间后逐级恢复；恢复后很快又落后时加倍下次恢复前的观察时间，避免在两级之间反复切换。
+// record、restart在展示线程或渲染线程（按垂直同步取帧时）中调用，level可在任意线程读取
+class QualityGovernor {
+public:
+    QualityGovernor() {};
+    ~QualityGovernor() {};
+
+    // 是否自动降级，关闭后从下一帧开始恢复完整画质
+    inline void setEnabled(bool enabled) { m_bEnabled = enabled; }
+    inline bool isEnabled() const { return m_bEnabled; }
+    // 暂停调控并保持当前等级，用于快进快退等本身只展示关键帧的状态
+    inline void setHeld(bool held) { m_bHeld = held; }
+    inline QualityLevel level() const { return m_level; }
+    // 等级变化时在记录的线程中调用
+    inline void setListener(std::function<void(QualityLevel)> listener) { m_fnListener = std::move(listener); }
+
+    // 记录一帧 lateness为展示时落后于显示时间的时长 单位微秒，dropped表示该帧因落后被丢弃
+    void record(qint64 lateness, bool dropped);
+    // 暂停、跳转后重新开始观察，期间的时间不计入恢复所需的时间，不改变当前等级
+    void restart();
+
+    static const char* levelName(QualityLevel level);
+
+private:
+    void evaluate(qint64 now);
+    void changeLevel(QualityLevel level, qint64 meanLateness);
+    inline void restartWindow() {
+        m_nWindowStart = -1;
+        m_nWindowFrames = 0;
+        m_nWindowDropped = 0;
+        m_nWindowLateness = 0;
+    }
+
+    std::atomic<bool> m_bEnabled = true;
+    std::atomic<bool> m_bHeld = false;
+    std::atomic<QualityLevel> m_level = QualityLevel::Full;
+    std::function<void(QualityLevel)> m_fnListener;
+    // 保护以下统计
+    std::mutex m_mutex;
+    // 当前窗口的开始时间及其中的帧数、丢帧数和累计落后时间 单位微秒
+    qint64 m_nWindowStart = -1;
+    qint64 m_nWindowFrames = 0;
+    qint64 m_nWindowDropped = 0;
+    qint64 m_nWindowLateness = 0;
+    // 连续跟上的开始时间，未跟上时为-1
+    qint64 m_nHealthySince = -1;
+    // 最近一次切换等级的时间，及该次是否为恢复
+    qint64 m_nLastChange = 0;
+    bool m_bLastRecovered = false;
+    // 恢复一级前需要连续跟上的时间 单位微秒
+    qint64 m_nRecoverHold = 0;
+};
+
+#endif // QUALITYGOVERNOR_H
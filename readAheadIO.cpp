@@ -0,0 +1,238 @@
+#include "readAheadIO.h"
+#include <QDebug>
+#include <algorithm>
+#include <cstring>
+
+extern "C" {
+#include <libavutil/error.h>
+#include <libavutil/mem.h>
+#include <libavutil/time.h>
+}
+
+// AVIOContext自身的缓冲大小 单位字节
+#define AVIO_BUFFER_SIZE (64 * 1024)
+// 预读线程单次从数据源读取的上限 单位字节
+#define READ_CHUNK_SIZE (256 * 1024)
+// 读位置之前最多保留缓冲的1/KEEP_BACK_DIVISOR，供小范围的后向跳转使用
+#define KEEP_BACK_DIVISOR 4
+
+ReadAheadIO::ReadAheadIO() {
+
+}
+
+ReadAheadIO::~ReadAheadIO() {
+    close();
+}
+
+bool ReadAheadIO::open(const QString& uri, qint64 bufferSize, bool useMmap /* = false */) {
+    close();
+    m_pSource = ByteSource::create(uri, useMmap);
+    if (!m_pSource) return false;
+    m_nSize = m_pSource->size();
+    m_bSeekable = m_pSource->isSeekable();
+
+    // av_malloc按CPU的SIMD要求对齐
+    m_nCapacity = qMax<qint64>(bufferSize, READ_CHUNK_SIZE * 2);
+    m_pBuffer = static_cast<uint8_t*>(av_malloc(m_nCapacity));
+    uint8_t* avioBuffer = static_cast<uint8_t*>(av_malloc(AVIO_BUFFER_SIZE));
+    if (!m_pBuffer || !avioBuffer) {
+        qWarning() << "ReadAheadIO: failed to allocate buffer";
+        av_free(avioBuffer);
+        close();
+        return false;
+    }
+    m_pAvioCtx = avio_alloc_context(avioBuffer, AVIO_BUFFER_SIZE, 0, this, &ReadAheadIO::readPacket, nullptr, &ReadAheadIO::seekPacket);
+    if (!m_pAvioCtx) {
+        av_free(avioBuffer);
+        close();
+        return false;
+    }
+    // 管道等不能定位的数据源只支持缓冲范围内的跳转
+    if (!m_bSeekable) m_pAvioCtx->seekable = 0;
+
+    m_nStart = 0;
+    m_nEnd = 0;
+    m_nPos = 0;
+    m_bEof = false;
+    m_nError = 0;
+    m_nSeekRequest = -1;
+    m_nGeneration = 0;
+    m_stats = IoStats();
+    m_bStop = false;
+    start();
+    return true;
+}
+
+void ReadAheadIO::close() {
+    if (isRunning()) {
+        m_bStop = true;
+        if (m_pSource) m_pSource->abort();
+        m_spaceEvent.notify();
+        m_dataEvent.notify();
+        wait();
+    }
+    if (m_pAvioCtx) {
+        // FFmpeg可能替换过缓冲，以上下文中的为准
+        av_freep(&m_pAvioCtx->buffer);
+        avio_context_free(&m_pAvioCtx);
+    }
+    av_freep(&m_pBuffer);
+    m_nCapacity = 0;
+    m_pSource.reset();
+}
+
+IoStats ReadAheadIO::stats() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+qint64 ReadAheadIO::bufferedBytes() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_nEnd - m_nPos;
+}
+
+void ReadAheadIO::run() {
+    while (!m_bStop) {
+        qint64 seekTarget = -1;
+        qint64 writePos = 0;
+        qint64 len = 0;
+        int generation = 0;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            seekTarget = m_nSeekRequest;
+            m_nSeekRequest = -1;
+            generation = m_nGeneration;
+            if (seekTarget == -1 && !m_bEof && m_nError == 0) {
+                // 可覆盖的空间：读位置之前超出保留范围的数据
+                const qint64 keepFrom = qMax(m_nStart, m_nPos - m_nCapacity / KEEP_BACK_DIVISOR);
+                const qint64 space = m_nCapacity - (m_nEnd - keepFrom);
+                len = std::min({ space, qint64(READ_CHUNK_SIZE), m_nCapacity - m_nEnd % m_nCapacity });
+                if (len > 0) {
+                    // 先让出即将覆盖的区域，读取期间后向跳转不会落在这里
+                    m_nStart = qMax(m_nStart, m_nEnd + len - m_nCapacity);
+                    writePos = m_nEnd;
+                }
+            }
+        }
+
+        // 跳转到缓冲范围之外，从目标位置重新预读
+        if (seekTarget != -1) {
+            if (!m_pSource->seek(seekTarget)) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (generation == m_nGeneration) m_nError = AVERROR(EIO);
+            }
+            m_dataEvent.notify();
+            continue;
+        }
+
+        // 缓冲已满或已读完，等待读出数据或跳转
+        if (len <= 0) {
+            m_spaceEvent.wait([this] {
+                if (m_bStop) return true;
+                std::lock_guard<std::mutex> lock(m_mutex);
+                const qint64 keepFrom = qMax(m_nStart, m_nPos - m_nCapacity / KEEP_BACK_DIVISOR);
+                return m_nSeekRequest != -1 || (!m_bEof && m_nError == 0 && m_nEnd - keepFrom < m_nCapacity);
+            });
+            continue;
+        }
+
+        // 不持锁读取，慢速存储只阻塞预读线程
+        const qint64 readStart = av_gettime_relative();
+        const int ret = m_pSource->read(m_pBuffer + writePos % m_nCapacity, int(len));
+        const qint64 readTime = av_gettime_relative() - readStart;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            // 读取期间发生了跳转，数据已过期
+            if (generation != m_nGeneration) continue;
+            m_stats.readTime += readTime;
+            if (ret > 0) {
+                m_nEnd += ret;
+                m_stats.bytesRead += ret;
+            } else if (ret == 0) {
+                m_bEof = true;
+            } else {
+                m_nError = ret;
+            }
+        }
+        m_dataEvent.notify();
+    }
+}
+
+int ReadAheadIO::readPacket(void* opaque, uint8_t* buf, int size) {
+    return static_cast<ReadAheadIO*>(opaque)->read(buf, size);
+}
+
+int64_t ReadAheadIO::seekPacket(void* opaque, int64_t offset, int whence) {
+    return static_cast<ReadAheadIO*>(opaque)->seek(offset, whence);
+}
+
+int ReadAheadIO::read(uint8_t* buf, int size) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_nPos >= m_nEnd && !m_bEof && m_nError == 0) {
+        // 缓冲已取空，解复用线程等待预读
+        ++m_stats.stalls;
+        const qint64 stallStart = av_gettime_relative();
+        lock.unlock();
+        m_dataEvent.wait([this] {
+            if (m_bStop) return true;
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_nPos < m_nEnd || m_bEof || m_nError != 0;
+        });
+        lock.lock();
+        m_stats.stallTime += av_gettime_relative() - stallStart;
+    }
+    if (m_bStop) return AVERROR_EXIT;
+
+    if (m_nPos < m_nEnd) {
+        const qint64 len = qMin<qint64>(size, m_nEnd - m_nPos);
+        const qint64 offset = m_nPos % m_nCapacity;
+        const qint64 first = qMin(len, m_nCapacity - offset);
+        memcpy(buf, m_pBuffer + offset, first);
+        memcpy(buf + first, m_pBuffer, len - first);
+        m_nPos += len;
+        lock.unlock();
+        m_spaceEvent.notify();
+        return int(len);
+    }
+    return m_nError != 0 ? m_nError : AVERROR_EOF;
+}
+
+int64_t ReadAheadIO::seek(int64_t offset, int whence) {
+    if (whence & AVSEEK_SIZE) return m_nSize >= 0 ? m_nSize : AVERROR(ENOSYS);
+    whence &= ~AVSEEK_FORCE;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    qint64 target = offset;
+    if (whence == SEEK_CUR) {
+        target = m_nPos + offset;
+    } else if (whence == SEEK_END) {
+        if (m_nSize < 0) return AVERROR(ENOSYS);
+        target = m_nSize + offset;
+    } else if (whence != SEEK_SET) {
+        return AVERROR(EINVAL);
+    }
+    if (target < 0) return AVERROR(EINVAL);
+    ++m_stats.seeks;
+
+    // 目标已在缓冲中，只移动读位置，预读继续
+    if (target >= m_nStart && target <= m_nEnd) {
+        m_nPos = target;
+        ++m_stats.seekHits;
+        lock.unlock();
+        m_spaceEvent.notify();
+        return target;
+    }
+    if (!m_bSeekable) return AVERROR(ENOSYS);
+
+    // 清空缓冲，预读线程从目标处重新开始
+    m_nSeekRequest = target;
+    ++m_nGeneration;
+    m_nStart = target;
+    m_nEnd = target;
+    m_nPos = target;
+    m_bEof = false;
+    m_nError = 0;
+    lock.unlock();
+    m_spaceEvent.notify();
+    return target;
+}
@@ -0,0 +1,87 @@
+#ifndef READAHEADIO_H
+#define READAHEADIO_H
+
+#include "byteSource.h"
+#include "waitEvent.h"
+#include <QString>
+#include <QThread>
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+extern "C" {
+#include <libavformat/avio.h>
+}
+
+// I/O统计，时间单位微秒
+struct IoStats {
+    // 预读线程从数据源读取的字节数及耗时
+    qint64 bytesRead = 0;
+    qint64 readTime = 0;
+    // 解复用线程因缓冲为空而等待的次数及总时长
+    qint64 stalls = 0;
+    qint64 stallTime = 0;
+    // 跳转次数，及目标已在缓冲中、不需要重新读取的次数
+    qint64 seeks = 0;
+    qint64 seekHits = 0;
+};
+
+// 带预读线程的自定义AVIOContext
+// 预读线程持续从数据源读入一块大的环形缓冲，解复用线程的av_read_frame只从内存中拷贝，慢速存储的读取延迟不再阻塞解复用。
+// 跳转目标在缓冲范围内时直接移动读位置，缓冲中保留读位置之前的一段数据供小范围的后向跳转使用；否则从目标处重新预读
+class ReadAheadIO : public QThread {
+    Q_OBJECT
+public:
+    ReadAheadIO();
+    ~ReadAheadIO();
+
+    // 打开uri并开始预读，bufferSize为预读缓冲大小 单位字节，useMmap为true时本地文件映射到内存读取
+    bool open(const QString& uri, qint64 bufferSize, bool useMmap = false);
+    // 停止预读线程并释放AVIOContext，须在avformat_close_input之后调用
+    void close();
+    // 交给AVFormatContext::pb使用，open失败时为nullptr
+    inline AVIOContext* context() { return m_pAvioCtx; }
+
+    IoStats stats();
+    // 已缓冲、尚未被读取的字节数
+    qint64 bufferedBytes();
+
+protected:
+    void run() override;
+
+private:
+    static int readPacket(void* opaque, uint8_t* buf, int size);
+    static int64_t seekPacket(void* opaque, int64_t offset, int whence);
+    int read(uint8_t* buf, int size);
+    int64_t seek(int64_t offset, int whence);
+
+    std::unique_ptr<ByteSource> m_pSource;
+    AVIOContext* m_pAvioCtx = nullptr;
+    int64_t m_nSize = -1;
+    bool m_bSeekable = false;
+
+    // 环形缓冲，文件中的字节位置pos存放在pos % m_nCapacity处
+    uint8_t* m_pBuffer = nullptr;
+    qint64 m_nCapacity = 0;
+    // 以下由m_mutex保护
+    std::mutex m_mutex;
+    // 缓冲中数据的范围[m_nStart, m_nEnd)及解复用线程的读位置 单位字节
+    qint64 m_nStart = 0;
+    qint64 m_nEnd = 0;
+    qint64 m_nPos = 0;
+    // 数据源已读完，或读取出错时的错误码
+    bool m_bEof = false;
+    int m_nError = 0;
+    // 需要预读线程重新定位数据源的位置，-1表示没有
+    qint64 m_nSeekRequest = -1;
+    // 每次重新定位时递增，预读线程据此丢弃读取期间已过期的数据
+    int m_nGeneration = 0;
+    IoStats m_stats;
+
+    // 读出数据、跳转时唤醒预读线程；读入数据时唤醒解复用线程
+    WaitEvent m_spaceEvent;
+    WaitEvent m_dataEvent;
+    std::atomic<bool> m_bStop = false;
+};
+
+#endif // READAHEADIO_H
@@ -0,0 +1,27 @@
+#version 440
+
+layout(location = 0) in vec2 texCoord;
+layout(location = 0) out vec4 fragColor;
+
+layout(std140, binding = 0) uniform buf {
+    mat4 qt_Matrix;
+    mat4 colorMatrix;
+    float qt_Opacity;
+    // 0: Y/U/V三个平面  1: Y平面 + UV交错平面(NV12)
+    int planeLayout;
+};
+
+layout(binding = 1) uniform sampler2D plane1;
+layout(binding = 2) uniform sampler2D plane2;
+layout(binding = 3) uniform sampler2D plane3;
+
+void main() {
+    float y = texture(plane1, texCoord).r;
+    vec2 uv;
+    if (planeLayout == 1) {
+        uv = texture(plane2, texCoord).rg;
+    } else {
+        uv = vec2(texture(plane2, texCoord).r, texture(plane3, texCoord).r);
+    }
+    fragColor = colorMatrix * vec4(y, uv, 1.0) * qt_Opacity;
+}
@@ -0,0 +1,241 @@
+#include "thumbnailEngine.h"
+#include <algorithm>
+#include <QDebug>
+
+// 缩略图宽度 单位像素
+#define THUMBNAIL_WIDTH 192
+// 相近的请求共用一张缩略图的时间间隔 单位毫秒
+#define THUMBNAIL_STEP 1000
+// 缩略图缓存上限 单位字节
+#define THUMBNAIL_CACHE_BYTES (32 * 1024 * 1024)
+// 最多保留的待处理请求数，拖动时较早的请求直接丢弃
+#define MAX_PENDING_REQUESTS 4
+// 跳转后最多读取的packet数，找不到关键帧时放弃
+#define MAX_SEEK_PACKETS 1000
+
+ThumbnailEngine::ThumbnailEngine() {
+    m_cache.setMaxCost(THUMBNAIL_CACHE_BYTES);
+}
+
+ThumbnailEngine::~ThumbnailEngine() {
+    close();
+}
+
+void ThumbnailEngine::open(const QString& uri) {
+    close();
+    m_strUri = uri;
+    m_bStop = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_cache.clear();
+        m_nGenerated = 0;
+    }
+    start(QThread::LowestPriority);
+}
+
+void ThumbnailEngine::close() {
+    m_bStop = true;
+    m_requestEvent.notify();
+    if (isRunning()) wait();
+
+    // 结束所有等待中的请求
+    std::deque<qint64> requests;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        requests.swap(m_requests);
+    }
+    for (qint64 key : requests) emit thumbnailReady(key, QImage());
+}
+
+qint64 ThumbnailEngine::cacheKey(qint64 ms) {
+    return qMax<qint64>(0, ms) / THUMBNAIL_STEP * THUMBNAIL_STEP;
+}
+
+bool ThumbnailEngine::cached(qint64 key, QImage* image) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    QImage* found = m_cache.object(key);
+    if (!found) return false;
+    *image = *found;
+    return true;
+}
+
+void ThumbnailEngine::preload(const std::vector<std::pair<qint64, QImage>>& thumbnails) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const auto& thumbnail : thumbnails) {
+        if (thumbnail.second.isNull()) continue;
+        m_cache.insert(thumbnail.first, new QImage(thumbnail.second), thumbnail.second.sizeInBytes());
+    }
+}
+
+std::vector<std::pair<qint64, QImage>> ThumbnailEngine::thumbnails(int maxCount) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    QList<qint64> keys = m_cache.keys();
+    std::sort(keys.begin(), keys.end());
+    std::vector<std::pair<qint64, QImage>> result;
+    for (qint64 key : keys) {
+        if (int(result.size()) >= maxCount) break;
+        result.emplace_back(key, *m_cache.object(key));
+    }
+    return result;
+}
+
+bool ThumbnailEngine::hasGenerated() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_nGenerated > 0;
+}
+
+void ThumbnailEngine::request(qint64 key) {
+    std::deque<qint64> dropped;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_requests.push_back(key);
+        while (m_requests.size() > MAX_PENDING_REQUESTS) {
+            dropped.push_back(m_requests.front());
+            m_requests.pop_front();
+        }
+    }
+    for (qint64 droppedKey : dropped) emit thumbnailReady(droppedKey, QImage());
+    m_requestEvent.notify();
+}
+
+void ThumbnailEngine::run() {
+    if (!openInput()) {
+        closeInput();
+        return;
+    }
+
+    while (!m_bStop) {
+        m_requestEvent.wait([this]{
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return !m_requests.empty() || m_bStop;
+        });
+        if (m_bStop) break;
+
+        qint64 key = 0;
+        QImage image;
+        bool hit = false;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_requests.empty()) continue;
+            key = m_requests.back();
+            m_requests.pop_back();
+            // 排队期间可能已经由相同的请求生成
+            QImage* found = m_cache.object(key);
+            if (found) {
+                image = *found;
+                hit = true;
+            }
+        }
+
+        if (!hit) {
+            image = decodeAt(key);
+            if (!image.isNull()) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_cache.insert(key, new QImage(image), image.sizeInBytes());
+                ++m_nGenerated;
+            }
+        }
+        emit thumbnailReady(key, image);
+    }
+    closeInput();
+}
+
+bool ThumbnailEngine::openInput() {
+    if (avformat_open_input(&m_pFmtCtx, m_strUri.toUtf8().constData(), nullptr, nullptr) != 0) {
+        qWarning() << "Thumbnail: failed to open input";
+        return false;
+    }
+    if (avformat_find_stream_info(m_pFmtCtx, nullptr) < 0) {
+        qWarning() << "Thumbnail: failed to retrieve stream info";
+        return false;
+    }
+
+    m_nVideoStreamIdx = av_find_best_stream(m_pFmtCtx, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    if (m_nVideoStreamIdx < 0) return false;
+    // 只读取视频流
+    for (unsigned int i = 0; i < m_pFmtCtx->nb_streams; ++i) {
+        if (int(i) != m_nVideoStreamIdx) m_pFmtCtx->streams[i]->discard = AVDISCARD_ALL;
+    }
+
+    const AVCodecParameters* codecpar = m_pFmtCtx->streams[m_nVideoStreamIdx]->codecpar;
+    const AVCodec* codec = avcodec_find_decoder(codecpar->codec_id);
+    if (!codec) {
+        qWarning() << "Thumbnail: video decoder not found";
+        return false;
+    }
+    m_pDecCtx = avcodec_alloc_context3(codec);
+    if (avcodec_parameters_to_context(m_pDecCtx, codecpar) < 0) {
+        qWarning() << "Thumbnail: failed to copy codec parameters";
+        return false;
+    }
+    // 只解码关键帧，单线程，解码器支持时直接以低分辨率解码
+    m_pDecCtx->skip_frame = AVDISCARD_NONKEY;
+    m_pDecCtx->thread_count = 1;
+    m_pDecCtx->lowres = qMin<int>(codec->max_lowres, 2);
+    if (avcodec_open2(m_pDecCtx, codec, nullptr) < 0) {
+        qWarning() << "Thumbnail: failed to open video codec";
+        return false;
+    }
+    return true;
+}
+
+void ThumbnailEngine::closeInput() {
+    if (m_pDecCtx) avcodec_free_context(&m_pDecCtx);
+    if (m_pFmtCtx) avformat_close_input(&m_pFmtCtx);
+    if (m_pSwsCtx) {
+        sws_freeContext(m_pSwsCtx);
+        m_pSwsCtx = nullptr;
+    }
+    m_nVideoStreamIdx = -1;
+}
+
+QImage ThumbnailEngine::decodeAt(qint64 key) {
+    AVStream* stream = m_pFmtCtx->streams[m_nVideoStreamIdx];
+    const qint64 timestamp = av_rescale_q(key * 1000, AV_TIME_BASE_Q, stream->time_base);
+    if (av_seek_frame(m_pFmtCtx, m_nVideoStreamIdx, timestamp, AVSEEK_FLAG_BACKWARD) < 0) {
+        return QImage();
+    }
+    avcodec_flush_buffers(m_pDecCtx);
+
+    AVPacket* packet = av_packet_alloc();
+    AVFrame* frame = av_frame_alloc();
+    QImage image;
+    for (int i = 0; i < MAX_SEEK_PACKETS && !m_bStop && image.isNull(); ++i) {
+        int ret = av_read_frame(m_pFmtCtx, packet);
+        // 读到文件末尾时冲刷解码器
+        if (ret == 0 && packet->stream_index != m_nVideoStreamIdx) {
+            av_packet_unref(packet);
+            continue;
+        }
+        if (ret == 0 && !(packet->flags & AV_PKT_FLAG_KEY)) {
+            av_packet_unref(packet);
+            continue;
+        }
+        avcodec_send_packet(m_pDecCtx, ret == 0 ? packet : nullptr);
+        av_packet_unref(packet);
+        if (avcodec_receive_frame(m_pDecCtx, frame) == 0) {
+            image = scaleFrame(frame);
+            av_frame_unref(frame);
+        }
+        if (ret < 0) break;
+    }
+    av_packet_free(&packet);
+    av_frame_free(&frame);
+    return image;
+}
+
+QImage ThumbnailEngine::scaleFrame(const AVFrame* frame) {
+    const int width = qMin(THUMBNAIL_WIDTH, frame->width);
+    const int height = qMax(2, int(qint64(frame->height) * width / frame->width) & ~1);
+    m_pSwsCtx = sws_getCachedContext(m_pSwsCtx,
+        frame->width, frame->height, static_cast<AVPixelFormat>(frame->format),
+        width, height, AV_PIX_FMT_RGBA,
+        SWS_BILINEAR, nullptr, nullptr, nullptr);
+    if (!m_pSwsCtx) return QImage();
+
+    QImage image(width, height, QImage::Format_RGBA8888);
+    uint8_t* dst[4] = { image.bits(), nullptr, nullptr, nullptr };
+    int dstStride[4] = { int(image.bytesPerLine()), 0, 0, 0 };
+    sws_scale(m_pSwsCtx, frame->data, frame->linesize, 0, frame->height, dst, dstStride);
+    return image;
+}
@@ -0,0 +1,78 @@
+#ifndef THUMBNAILENGINE_H
+#define THUMBNAILENGINE_H
+
+#include "waitEvent.h"
+#include <QCache>
+#include <QImage>
+#include <QString>
+#include <QThread>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+}
+
+// 进度条预览缩略图引擎
+// 使用独立的解复用和解码上下文，只解码关键帧并缩小输出，结果按时间放入LRU缓存；
+// 线程以最低优先级运行，不与播放线程争抢CPU
+class ThumbnailEngine : public QThread {
+    Q_OBJECT
+public:
+    ThumbnailEngine();
+    ~ThumbnailEngine();
+
+    // 打开文件并启动线程，实际的打开操作在线程中进行
+    void open(const QString& uri);
+    void close();
+
+    // 请求时间对应的缓存键，相近的请求共用一张缩略图 ms单位毫秒
+    static qint64 cacheKey(qint64 ms);
+    // 取缓存的缩略图，没有时返回false
+    bool cached(qint64 key, QImage* image);
+    // 放入已有的缩略图（如磁盘缓存），在open之后调用
+    void preload(const std::vector<std::pair<qint64, QImage>>& thumbnails);
+    // 缓存中按时间排序的缩略图，最多maxCount张
+    std::vector<std::pair<qint64, QImage>> thumbnails(int maxCount);
+    // open之后是否生成过新的缩略图，preload放入的不算
+    bool hasGenerated();
+    // 请求生成缩略图，完成后发出thumbnailReady
+    void request(qint64 key);
+
+signals:
+    // 缩略图生成完成，失败或请求被丢弃时image为空
+    void thumbnailReady(qint64 key, QImage image);
+
+protected:
+    void run() override;
+
+private:
+    bool openInput();
+    void closeInput();
+    // 解码key之前最近的关键帧
+    QImage decodeAt(qint64 key);
+    // 将帧缩小为缩略图
+    QImage scaleFrame(const AVFrame* frame);
+
+    QString m_strUri;
+    AVFormatContext* m_pFmtCtx = nullptr;
+    AVCodecContext* m_pDecCtx = nullptr;
+    SwsContext* m_pSwsCtx = nullptr;
+    int m_nVideoStreamIdx = -1;
+
+    std::mutex m_mutex;
+    // 待处理的请求，最新的在队尾，优先处理
+    std::deque<qint64> m_requests;
+    QCache<qint64, QImage> m_cache;
+    // open之后生成的缩略图数
+    int m_nGenerated = 0;
+    WaitEvent m_requestEvent;
+    std::atomic<bool> m_bStop = false;
+};
+
+#endif // THUMBNAILENGINE_H
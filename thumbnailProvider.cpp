@@ -0,0 +1,66 @@
+#include "thumbnailProvider.h"
+
+QMutex ThumbnailProvider::s_mutex;
+QMap<QString, ThumbnailEngine*> ThumbnailProvider::s_engines;
+
+ThumbnailResponse::ThumbnailResponse(ThumbnailEngine* engine, qint64 key, const QSize& requestedSize)
+    : m_nKey(key), m_requestedSize(requestedSize) {
+    if (!engine) {
+        finish(QImage());
+        return;
+    }
+    // 先连接再查缓存，避免错过在两者之间完成的结果；
+    // 结果经由图片加载线程的事件循环送达，请求被取消销毁后不会再被调用
+    m_connection = connect(engine, &ThumbnailEngine::thumbnailReady, this, &ThumbnailResponse::onThumbnailReady);
+    QImage image;
+    if (engine->cached(key, &image)) {
+        finish(image);
+    } else {
+        engine->request(key);
+    }
+}
+
+QQuickTextureFactory* ThumbnailResponse::textureFactory() const {
+    QMutexLocker locker(&m_mutex);
+    return QQuickTextureFactory::textureFactoryForImage(m_image);
+}
+
+void ThumbnailResponse::onThumbnailReady(qint64 key, QImage image) {
+    if (key == m_nKey) finish(image);
+}
+
+void ThumbnailResponse::finish(const QImage& image) {
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_bFinished) return;
+        m_bFinished = true;
+        m_image = image;
+        if (m_requestedSize.isValid() && !image.isNull()) {
+            m_image = image.scaled(m_requestedSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+        }
+    }
+    // 结果已保存，不再需要引擎的通知
+    disconnect(m_connection);
+    // 在构造函数中完成时，等图片加载器连接信号后再发出
+    QMetaObject::invokeMethod(this, &ThumbnailResponse::finished, Qt::QueuedConnection);
+}
+
+QQuickImageResponse* ThumbnailProvider::requestImageResponse(const QString& id, const QSize& requestedSize) {
+    const qsizetype slash = id.lastIndexOf('/');
+    const QString playerId = id.left(slash);
+    const qint64 ms = id.mid(slash + 1).toLongLong();
+
+    QMutexLocker locker(&s_mutex);
+    ThumbnailEngine* engine = s_engines.value(playerId, nullptr);
+    return new ThumbnailResponse(engine, ThumbnailEngine::cacheKey(ms), requestedSize);
+}
+
+void ThumbnailProvider::registerEngine(const QString& playerId, ThumbnailEngine* engine) {
+    QMutexLocker locker(&s_mutex);
+    s_engines.insert(playerId, engine);
+}
+
+void ThumbnailProvider::unregisterEngine(const QString& playerId) {
+    QMutexLocker locker(&s_mutex);
+    s_engines.remove(playerId);
+}
@@ -0,0 +1,49 @@
+#ifndef THUMBNAILPROVIDER_H
+#define THUMBNAILPROVIDER_H
+
+#include "thumbnailEngine.h"
+#include <QMap>
+#include <QMutex>
+#include <QQuickAsyncImageProvider>
+
+// 缩略图请求，缓存命中时立即完成，否则等待缩略图引擎生成
+class ThumbnailResponse : public QQuickImageResponse {
+    Q_OBJECT
+public:
+    ThumbnailResponse(ThumbnailEngine* engine, qint64 key, const QSize& requestedSize);
+    ~ThumbnailResponse() {};
+
+    QQuickTextureFactory* textureFactory() const override;
+
+private slots:
+    void onThumbnailReady(qint64 key, QImage image);
+
+private:
+    void finish(const QImage& image);
+
+    qint64 m_nKey = 0;
+    QSize m_requestedSize;
+    QImage m_image;
+    QMetaObject::Connection m_connection;
+    mutable QMutex m_mutex;
+    bool m_bFinished = false;
+};
+
+// 进度条预览缩略图的QML图片提供者
+// 地址为image://thumbnail/<播放器id>/<毫秒>，每个播放器的缩略图引擎按id注册
+class ThumbnailProvider : public QQuickAsyncImageProvider {
+public:
+    ThumbnailProvider() {};
+    ~ThumbnailProvider() {};
+
+    QQuickImageResponse* requestImageResponse(const QString& id, const QSize& requestedSize) override;
+
+    static void registerEngine(const QString& playerId, ThumbnailEngine* engine);
+    static void unregisterEngine(const QString& playerId);
+
+private:
+    static QMutex s_mutex;
+    static QMap<QString, ThumbnailEngine*> s_engines;
+};
+
+#endif // THUMBNAILPROVIDER_H
@@ -0,0 +1,143 @@
+// 无界面的批量抽帧与分析
+// 按关键帧把文件切分为若干段并行解码，按间隔抽帧保存为图片，可选输出每帧信息及场景切换分数，结果以JSON格式输出
+
+#include "batchAnalyzer.h"
+#include <QCoreApplication>
+#include <QDebug>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QThread>
+
+int main(int argc, char* argv[]) {
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Headless batch frame extraction and analysis on keyframe-aligned parallel segments");
+    parser.addHelpOption();
+    parser.addPositionalArgument("input", "Media file or URL to analyse.");
+    QCommandLineOption intervalOption("interval", "Extract one frame every N seconds, 0 disables extraction.", "seconds", "0");
+    QCommandLineOption framesDirOption("frames-dir", "Save extracted frames into this directory.", "dir");
+    QCommandLineOption frameWidthOption("frame-width", "Width of the saved frames, 0 keeps the source width.", "pixels", "0");
+    QCommandLineOption frameFormatOption("frame-format", "Image format of the saved frames: jpg or png.", "format", "jpg");
+    QCommandLineOption statsOption("stats", "Report type, size and mean luma of every frame.");
+    QCommandLineOption sceneOption("scene", "Report a scene change score for every frame.");
+    QCommandLineOption sceneThresholdOption("scene-threshold", "Score above which a frame is listed as a scene cut.", "score", "0.3");
+    QCommandLineOption threadsOption("threads", "Segments decoded in parallel, 0 uses every core.", "count", "0");
+    QCommandLineOption segmentsOption("segments", "Number of segments, 0 picks a multiple of the thread count.", "count", "0");
+    QCommandLineOption outOption("out", "Write the JSON report to a file instead of stdout.", "file");
+    parser.addOptions({ intervalOption, framesDirOption, frameWidthOption, frameFormatOption, statsOption, sceneOption,
+                        sceneThresholdOption, threadsOption, segmentsOption, outOption });
+    parser.process(app);
+
+    if (parser.positionalArguments().isEmpty()) {
+        qCritical() << "No input given";
+        parser.showHelp(1);
+    }
+    const QString input = parser.positionalArguments().first();
+
+    BatchOptions options;
+    options.frameInterval = qint64(qMax(0.0, parser.value(intervalOption).toDouble()) * 1000000);
+    options.frameWidth = qMax(0, parser.value(frameWidthOption).toInt());
+    options.frameFormat = parser.value(frameFormatOption).toLower();
+    options.frameStats = parser.isSet(statsOption);
+    options.sceneScores = parser.isSet(sceneOption);
+    options.threads = qMax(0, parser.value(threadsOption).toInt());
+    options.segments = qMax(0, parser.value(segmentsOption).toInt());
+    if (options.frameFormat != "jpg" && options.frameFormat != "png") {
+        qCritical() << "Unsupported frame format" << options.frameFormat;
+        return 1;
+    }
+    if (parser.isSet(framesDirOption)) {
+        options.frameDir = parser.value(framesDirOption);
+        if (!QDir().mkpath(options.frameDir)) {
+            qCritical() << "Failed to create" << options.frameDir;
+            return 1;
+        }
+    }
+    const double sceneThreshold = parser.value(sceneThresholdOption).toDouble();
+
+    qInfo() << "analysing" << input;
+    BatchAnalyzer analyzer;
+    const BatchResult result = analyzer.run(input, options);
+    if (!result.ok) return 1;
+
+    QJsonObject report;
+    report["input"] = input;
+    report["cpu_cores"] = QThread::idealThreadCount();
+    report["duration_ms"] = double(result.duration) / 1000.0;
+    report["threads"] = result.threads;
+    report["index_ms"] = double(result.indexTime) / 1000.0;
+    report["elapsed_ms"] = double(result.elapsed) / 1000.0;
+
+    qint64 decodedFrames = 0;
+    QJsonArray segments;
+    for (const BatchSegmentInfo& info : result.segments) {
+        QJsonObject segment;
+        segment["start_ms"] = double(info.start) / 1000.0;
+        segment["end_ms"] = double(info.end) / 1000.0;
+        segment["decoded_frames"] = info.decodedFrames;
+        segment["elapsed_ms"] = double(info.elapsed) / 1000.0;
+        segment["thread"] = info.thread;
+        segments.append(segment);
+        decodedFrames += info.decodedFrames;
+    }
+    const double seconds = double(qMax<qint64>(1, result.elapsed)) / 1000000.0;
+    report["segment_count"] = int(result.segments.size());
+    report["decoded_frames"] = decodedFrames;
+    report["fps"] = double(decodedFrames) / seconds;
+    // 处理速度相对实时播放的倍数
+    report["realtime_factor"] = double(result.duration) / 1000000.0 / seconds;
+    report["segments"] = segments;
+
+    if (options.frameInterval > 0) {
+        QJsonArray snapshots;
+        for (const BatchSnapshot& snapshot : result.snapshots) {
+            QJsonObject item;
+            item["time_ms"] = double(snapshot.time) / 1000.0;
+            item["pts_ms"] = double(snapshot.pts) / 1000.0;
+            if (!snapshot.path.isEmpty()) item["path"] = snapshot.path;
+            snapshots.append(item);
+        }
+        report["snapshots"] = snapshots;
+    }
+
+    if (options.frameStats || options.sceneScores) {
+        QJsonArray frames;
+        QJsonArray sceneCuts;
+        for (const BatchFrameInfo& frame : result.frames) {
+            QJsonObject item;
+            item["pts_ms"] = double(frame.pts) / 1000.0;
+            if (options.frameStats) {
+                item["duration_ms"] = double(frame.duration) / 1000.0;
+                item["type"] = QString(QChar(frame.pictType));
+                item["key"] = frame.keyframe;
+                item["size"] = frame.size;
+                item["luma"] = frame.luma;
+            }
+            if (options.sceneScores) {
+                item["scene"] = frame.scene;
+                if (frame.scene >= sceneThreshold) sceneCuts.append(double(frame.pts) / 1000.0);
+            }
+            frames.append(item);
+        }
+        report["frames"] = frames;
+        if (options.sceneScores) report["scene_cuts_ms"] = sceneCuts;
+    }
+
+    const QByteArray json = QJsonDocument(report).toJson();
+    if (parser.isSet(outOption)) {
+        QFile file(parser.value(outOption));
+        if (!file.open(QIODevice::WriteOnly)) {
+            qCritical() << "Failed to write report to" << parser.value(outOption);
+            return 1;
+        }
+        file.write(json);
+    } else {
+        fwrite(json.constData(), 1, json.size(), stdout);
+    }
+    return 0;
+}
@@ -1,14 +1,26 @@
 #include "videoDecoder.h"
 #include <QDebug>
-
-VideoDecoder::VideoDecoder() {}
+#include <algorithm>
+
+// 队列最多容纳的packet数，实际缓存量由BufferLimits控制
+#define MAX_VIDEO_SIZE (60 * 60)
+// 已解码帧队列的容量
+#define FRAME_QUEUE_SIZE 8
+
+VideoDecoder::VideoDecoder() : DecoderBase(MAX_VIDEO_SIZE), m_frameQueue(FRAME_QUEUE_SIZE) {
+    // 展示线程取走帧后唤醒解码线程
+    m_frameQueue.setSpaceEvent(&m_stateEvent);
+    m_pFrame = av_frame_alloc();
+    m_pHwFrame = av_frame_alloc();
+}
 
 VideoDecoder::~VideoDecoder() {
     if (m_pDecCtx) avcodec_free_context(&m_pDecCtx);
-    if (m_swsCtx) sws_freeContext(m_swsCtx);
+    av_frame_free(&m_pFrame);
+    av_frame_free(&m_pHwFrame);
 }
 
-bool VideoDecoder::init(AVStream* stream, bool useHardwareDecoder) {
+bool VideoDecoder::init(AVStream* stream, bool useHardwareDecoder, const ThreadingConfig& threading) {
     // 保存视频流
     m_pStream = stream;
     // 获取视频流的时间基准
@@ -32,6 +44,9 @@ bool VideoDecoder::init(AVStream* stream, bool useHardwareDecoder) {
         goto end;
     }
 
+    // 设置软件解码的多线程方式及线程数
+    applyThreading(codec, threading);
+
     // 打开视频解码器上下文
     if (avcodec_open2(m_pDecCtx, codec, nullptr) < 0) {
         qCritical() << "Failed to open video codec context";
@@ -49,23 +64,6 @@ bool VideoDecoder::init(AVStream* stream, bool useHardwareDecoder) {
         m_pDecCtx->hw_device_ctx = av_buffer_ref(hw_device_ctx);
     }
 
-    // 创建并初始化SwsContext
-    m_swsCtx = sws_getCachedContext(
-        nullptr,                  // 可以传入已有的SwsContext指针，这里我们创建新的
-        m_pDecCtx->width,           // 输入宽度
-        m_pDecCtx->height,          // 输入高度
-        useHardwareDecoder ? m_pDecCtx->sw_pix_fmt : m_pDecCtx->pix_fmt,         // 输入像素格式
-        m_pDecCtx->width,           // 输出宽度（此处保持与输入相同，也可以调整）
-        m_pDecCtx->height,          // 输出高度（同上）
-        AV_PIX_FMT_RGBA,          // 输出像素格式（这里选择RGBA以便Qt快速渲染）
-        SWS_BILINEAR,             // 插值方法，可以选择其他如SWS_BICUBIC等
-        nullptr, nullptr, nullptr  // 其他高级选项可以留空
-        );
-    if (!m_swsCtx) {
-        qCritical() << "Failed to initialize the conversion context";
-        goto end;
-    }
-
     return true;
 
 end:
@@ -75,109 +73,153 @@ end:
 
 void VideoDecoder::run() {
     m_bPlaying = true;
+    runLoop([this]{ return isInterruptionRequested(); });
+}
 
-    AVFrame* frame = av_frame_alloc();
-    // 分配一个AVFrame用于存储转换硬件解码后的数据
-    AVFrame* hw_transfer_frame = av_frame_alloc();
-    AVPacket* packet = nullptr;
-
-    while (1) {
-        // 发生了跳转
-        if (m_bSeekFlag) {
-            // 清除解码器上下文缓存数据
-            avcodec_flush_buffers(m_pDecCtx);
-            // 清空跳转标志
-            m_bSeekFlag = false;
-        }
+bool VideoDecoder::decodeStep() {
+    if (m_queue.isAborted()) return false;
 
-        // 播放暂停控制
-        while (!m_bPlaying) {
-            std::unique_lock<std::mutex> lock(m_mutex);
-            m_cv.wait(lock, [this]{ return m_bPlaying; });
+    // 放入已解码帧队列，由展示线程按显示时间取走；队列满时等待
+    if (m_pendingFrame) {
+        // 发生了跳转，丢弃该帧及当前packet剩余的帧
+        if (seekPending()) {
+            m_pendingFrame = nullptr;
+            finishPacket();
+            return true;
         }
+        if (!m_frameQueue.push(m_pendingFrame, m_nPendingPts, m_nPendingDuration, m_nDecodeSerial)) return false;
+        m_pendingFrame = nullptr;
+        return true;
+    }
 
-        // 从队列中获取一个packet
-        m_mutex.lock();
-        // 无数据
-        if (m_queue.empty()) {
-            m_mutex.unlock();
-            av_usleep(1000);
-            continue;
-        }
-        packet = m_queue.front();
-        m_queue.pop_front();
-        m_mutex.unlock();
-
-        // 发生了跳转
-        if (m_bSeekFlag) {
-            av_packet_unref(packet);
-            av_packet_free(&packet);
-            continue;
+    // 接受已解码数据
+    if (m_bReceiving) {
+        if (seekPending()) {
+            finishPacket();
+        } else {
+            receiveFrame();
         }
+        return true;
+    }
 
-        // 发送一个包到解码器中解码
-        if (avcodec_send_packet(m_pDecCtx, packet) != 0) {
-            qDebug("send AVPacket to decoder failed!\n");
-            av_packet_unref(packet);
-            continue;
-        }
-        // 接受已解码数据
-        while (avcodec_receive_frame(m_pDecCtx, frame) == 0) {
-            // 计算帧的显示时间
-            qint64 pts = frame->best_effort_timestamp;
-            m_nFrameTime = av_rescale_q(pts, m_timeBase, AV_TIME_BASE_Q);
-
-            // 发生了跳转 则跳过关键帧到目的时间的这几帧
-            if (m_nFrameTime < m_nSeekTime) {
-                continue;
-            } else {
-                m_nSeekTime = -1;
-            }
-
-            // 根据音频进行播放同步
-            while (1) {
-                // 发生了跳转
-                if (m_bSeekFlag) break;
-                qint64 delay = m_nFrameTime - audioFrameTime;
-                qint64 sleepTime = delay > 5000 ? 5000 : delay;
-                if (sleepTime > 0) {
-                    av_usleep(sleepTime);
-                } else {
-                    break;
-                }
-            }
-            // 发生了跳转
-            if (m_bSeekFlag) break;
-
-            AVFrame* destFrame = frame;
-            if (frame->hw_frames_ctx) { // 硬件解码则需要做转换
-                hw_transfer_frame->width = frame->width;
-                hw_transfer_frame->height = frame->height;
-
-                if (av_hwframe_transfer_data(hw_transfer_frame, frame, 0) == 0) {
-                    destFrame = hw_transfer_frame;
-                }
-            }
-
-            // 帧格式转换为rgba格式的QImage，并发送到界面渲染
-            AVFrame* frameRGBA = av_frame_alloc();
-            int numBytes = av_image_get_buffer_size(AV_PIX_FMT_RGBA, m_pDecCtx->width, m_pDecCtx->height, 1);
-            uint8_t* buffer = (uint8_t*)av_malloc(numBytes * sizeof(uint8_t));
-            av_image_fill_arrays(frameRGBA->data, frameRGBA->linesize, buffer, AV_PIX_FMT_RGBA, m_pDecCtx->width, m_pDecCtx->height, 1);
-            sws_scale(m_swsCtx, destFrame->data, destFrame->linesize, 0, m_pDecCtx->height, frameRGBA->data, frameRGBA->linesize);
-            QImage img((uchar*)buffer, m_pDecCtx->width, m_pDecCtx->height, QImage::Format_RGBA8888, [](void* ptr) { av_free(ptr); }, buffer);
-            emit frameReady(img.copy());
-            av_frame_free(&frameRGBA);
+    // 播放暂停控制
+    if (!m_bPlaying && !seekPending()) return false;
+
+    // 从队列中获取一个packet，无数据时等待
+    PacketQueue::Info info;
+    AVPacket* packet = m_queue.pop(&info);
+    if (!packet) return false;
+    recordMetric(MetricStage::VideoQueue, av_gettime_relative() - info.queuedTime);
+
+    // 跳转标记，清除解码器上下文缓存数据；已被更新的跳转取代的标记直接丢弃
+    if (m_queue.isFlushPacket(packet)) {
+        handleFlushPacket(info);
+        return true;
+    }
+
+    // 发生了跳转，丢弃跳转前的旧数据
+    if (seekPending() || !isCurrent(info)) {
+        releasePacket(packet);
+        return true;
+    }
+
+    applyDiscard(packet);
+
+    // 发送一个包到解码器中解码
+    const qint64 decodeStart = av_gettime_relative();
+    const int ret = avcodec_send_packet(m_pDecCtx, packet);
+    releasePacket(packet);
+    if (ret != 0) {
+        qDebug("send AVPacket to decoder failed!\n");
+        return true;
+    }
+    m_nDecodeTime = av_gettime_relative() - decodeStart;
+    m_bReceiving = true;
+    return true;
+}
+
+void VideoDecoder::receiveFrame() {
+    const qint64 decodeStart = av_gettime_relative();
+    const int ret = avcodec_receive_frame(m_pDecCtx, m_pFrame);
+    m_nDecodeTime += av_gettime_relative() - decodeStart;
+    if (ret != 0) {
+        finishPacket();
+        return;
+    }
+
+    ++m_nDecodedFrames;
+    // 计算帧的显示时间
+    qint64 pts = m_pFrame->best_effort_timestamp;
+    m_nFrameTime = av_rescale_q(pts, m_timeBase, AV_TIME_BASE_Q);
+
+    // 发生了跳转 则跳过关键帧到目的时间的这几帧
+    if (m_nFrameTime < m_nSkipUntil) {
+        return;
+    } else {
+        m_nSkipUntil = -1;
+    }
+
+    AVFrame* destFrame = m_pFrame;
+    if (m_pFrame->hw_frames_ctx) { // 硬件解码则需要做转换
+        // 上一帧的数据可能仍被渲染端引用，传输前先解除引用，再从缓冲池取一块新缓冲；
+        // 取不到时由av_hwframe_transfer_data自行分配
+        av_frame_unref(m_pHwFrame);
+        m_pHwFrame->format = reinterpret_cast<const AVHWFramesContext*>(m_pFrame->hw_frames_ctx->data)->sw_format;
+        m_pHwFrame->width = m_pFrame->width;
+        m_pHwFrame->height = m_pFrame->height;
+        if (!m_pFramePool->allocBuffer(m_pHwFrame)) av_frame_unref(m_pHwFrame);
+        const qint64 transferStart = av_gettime_relative();
+        const int transferRet = av_hwframe_transfer_data(m_pHwFrame, m_pFrame, 0);
+        recordMetric(MetricStage::HwTransfer, av_gettime_relative() - transferStart);
+        if (transferRet == 0) {
+            av_frame_copy_props(m_pHwFrame, m_pFrame);
+            destFrame = m_pHwFrame;
         }
-        av_packet_unref(packet);
-        av_packet_free(&packet);
     }
 
-    // 释放资源
-    av_frame_free(&frame);
-    av_frame_free(&hw_transfer_frame);
+    // 由下一步放入已解码帧队列
+    m_pendingFrame = m_pFramePool->ref(destFrame);
+    if (!m_pendingFrame) return;
+    m_nPendingPts = m_nFrameTime;
+    m_nPendingDuration = av_rescale_q(m_pFrame->duration, m_timeBase, AV_TIME_BASE_Q);
+    if (m_nPendingDuration > 0) m_nLastDuration = m_nPendingDuration;
+}
+
+void VideoDecoder::applyDiscard(const AVPacket* packet) {
+    // 追赶跳转目标时，显示时间在目标之前的非参考帧不会被展示，也不被其他帧参考，直接跳过解码
+    const bool catchingUp = m_nSkipUntil > 0 && packet->pts != AV_NOPTS_VALUE
+        && av_rescale_q(packet->pts + packet->duration, m_timeBase, AV_TIME_BASE_Q) <= m_nSkipUntil;
+    AVDiscard skipFrame = catchingUp ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+    AVDiscard skipLoopFilter = catchingUp ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+
+    // 画质调控的等级逐级叠加
+    const QualityLevel level = m_pGovernor ? m_pGovernor->level() : QualityLevel::Full;
+    if (level >= QualityLevel::SkipLoopFilter) skipLoopFilter = AVDISCARD_ALL;
+    if (level >= QualityLevel::SkipNonRef) skipFrame = std::max(skipFrame, AVDISCARD_NONREF);
+    const bool keyframe = packet->flags & AV_PKT_FLAG_KEY;
+    if (level >= QualityLevel::KeyframesOnly) {
+        m_bKeyframesOnly = true;
+    } else if (m_bKeyframesOnly && keyframe) {
+        m_bKeyframesOnly = false;
+    }
+    if (m_bKeyframesOnly) skipFrame = AVDISCARD_NONKEY;
+
+    m_pDecCtx->skip_frame = skipFrame;
+    m_pDecCtx->skip_loop_filter = skipLoopFilter;
+}
+
+void VideoDecoder::finishPacket() {
+    m_bReceiving = false;
+    recordMetric(MetricStage::VideoDecode, m_nDecodeTime);
+}
+
+bool VideoDecoder::hasWork() {
+    if (m_queue.isAborted() || m_bReceiving) return true;
+    if (m_pendingFrame) return !m_frameQueue.isFull() || seekPending();
+    return (m_bPlaying || seekPending()) && m_queue.size() > 0;
 }
 
-void VideoDecoder::audioFrameTimeUpdate(qint64 frameTime) {
-    audioFrameTime = frameTime;
+qint64 VideoDecoder::outputDeadline() {
+    // 队列中的帧展示完之前需要下一帧
+    return av_gettime_relative() + qint64(m_frameQueue.size()) * m_nLastDuration;
 }
@@ -2,12 +2,12 @@
 #define VIDEODECODER_H
 
 #include "decoderBase.h"
+#include "frameQueue.h"
+#include "qualityGovernor.h"
 #include <QThread>
-#include <QImage>
 
 extern "C" {
-#include <libswscale/swscale.h>
-#include <libavutil/imgutils.h>
+#include <libavutil/hwcontext.h>
 }
 
 class VideoDecoder : public QThread, public DecoderBase {
@@ -16,20 +16,61 @@ public:
     VideoDecoder();
     ~VideoDecoder();
 
-    bool init(AVStream* stream, bool useHardwareDecoder);
+    bool init(AVStream* stream, bool useHardwareDecoder, const ThreadingConfig& threading = ThreadingConfig());
+    // 中止解码线程及已解码帧队列的所有等待
+    inline void abort() {
+        DecoderBase::abort();
+        m_frameQueue.abort();
+    }
+    // 请求跳转时立即调用，已解码帧队列中的旧帧随之过期，展示线程不再展示
+    inline void requestSeek(int serial) {
+        DecoderBase::requestSeek(serial);
+        m_frameQueue.setSerial(serial);
+    }
+    // 已解码帧队列，由展示线程消费
+    inline FrameQueue* frameQueue() { return &m_frameQueue; }
+    // 已解码的帧数
+    inline qint64 getDecodedFrames() { return m_nDecodedFrames; }
+    // 输出帧的回收池，用于统计分配次数
+    inline const FramePoolPtr& framePool() const { return m_pFramePool; }
+    // 画质调控，解码每个packet前按其等级设置跳过环路滤波及丢帧
+    inline void setQualityGovernor(QualityGovernor* governor) { m_pGovernor = governor; }
 
 protected:
     void run() override;
-
-signals:
-    void frameReady(QImage frame);
-
-public slots:
-    void audioFrameTimeUpdate(qint64 frameTime);
+    bool decodeStep() override;
+    bool hasWork() override;
+    qint64 outputDeadline() override;
 
 private:
-    qint64 audioFrameTime = 0;
-    SwsContext* m_swsCtx = nullptr;
+    // 接收一帧，放入待入队的帧；解码器中没有更多的帧时结束当前packet
+    void receiveFrame();
+    // 当前packet的帧已全部接收或因跳转放弃，记录解码耗时
+    void finishPacket();
+    // 按追赶跳转目标及画质调控的等级设置解码器跳过的内容
+    void applyDiscard(const AVPacket* packet);
+
+    FrameQueue m_frameQueue;
+    std::atomic<qint64> m_nDecodedFrames = 0;
+    // 以下只在解码线程（或线程池任务）中使用，每次decodeStep推进一步
+    AVFrame* m_pFrame = nullptr;
+    // 存储转换硬件解码后的数据
+    AVFrame* m_pHwFrame = nullptr;
+    // 放入已解码帧队列的帧结构及硬件帧传输的缓冲从池中分配
+    FramePoolPtr m_pFramePool = FramePool::create();
+    // 已发送packet，正在从解码器接收帧
+    bool m_bReceiving = false;
+    // 当前packet的解码耗时 单位微秒，只统计send/receive本身，不含等待已解码帧队列的时间
+    qint64 m_nDecodeTime = 0;
+    // 已解码帧队列满时等待入队的帧
+    VideoFramePtr m_pendingFrame;
+    qint64 m_nPendingPts = 0;
+    qint64 m_nPendingDuration = 0;
+    // 最近一帧的时长 单位微秒，用于估计截止时间
+    qint64 m_nLastDuration = 0;
+    QualityGovernor* m_pGovernor = nullptr;
+    // 上一个packet是否只解码关键帧；退出该等级后等到下一个关键帧再解码其他帧，避免参考帧缺失造成花屏
+    bool m_bKeyframesOnly = false;
 };
 
 #endif // VIDEODECODER_H
@@ -0,0 +1,38 @@
+#ifndef VIDEOFRAME_H
+#define VIDEOFRAME_H
+
+#include <memory>
+#include <QMetaType>
+
+extern "C" {
+#include <libavutil/frame.h>
+#include <libavutil/pixfmt.h>
+}
+
+// 解码后的视频帧，以引用计数的方式在解码线程和渲染线程之间传递，不拷贝像素数据
+using VideoFramePtr = std::shared_ptr<AVFrame>;
+
+inline void freeVideoFrame(AVFrame* frame) {
+    av_frame_free(&frame);
+}
+
+// 创建一个引用src像素数据的新帧
+inline VideoFramePtr makeVideoFrame(const AVFrame* src) {
+    AVFrame* frame = av_frame_alloc();
+    if (!frame || av_frame_ref(frame, src) < 0) {
+        av_frame_free(&frame);
+        return nullptr;
+    }
+    return VideoFramePtr(frame, freeVideoFrame);
+}
+
+// 渲染端可以直接按平面上传为纹理的像素格式
+inline bool isRenderableFormat(int format) {
+    return format == AV_PIX_FMT_YUV420P
+        || format == AV_PIX_FMT_YUVJ420P
+        || format == AV_PIX_FMT_NV12;
+}
+
+Q_DECLARE_METATYPE(VideoFramePtr)
+
+#endif // VIDEOFRAME_H
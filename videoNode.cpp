@@ -0,0 +1,182 @@
+#include "videoNode.h"
+#include <QSGMaterialShader>
+#include <QDebug>
+
+VideoPlaneTexture::VideoPlaneTexture() {
+    setFiltering(QSGTexture::Linear);
+}
+
+VideoPlaneTexture::~VideoPlaneTexture() {
+    if (m_pTexture) m_pTexture->deleteLater();
+}
+
+qint64 VideoPlaneTexture::comparisonKey() const {
+    return qint64(reinterpret_cast<quintptr>(m_pTexture ? static_cast<const void*>(m_pTexture) : this));
+}
+
+QRhiTexture* VideoPlaneTexture::rhiTexture() const {
+    return m_pTexture;
+}
+
+QSize VideoPlaneTexture::textureSize() const {
+    return m_size;
+}
+
+void VideoPlaneTexture::setPlane(const VideoFramePtr& frame, int plane, QRhiTexture::Format format, const QSize& size) {
+    // 占位纹理只需上传一次
+    if (!frame && !m_frame && m_pTexture && m_size == QSize(1, 1)) return;
+    m_frame = frame;
+    m_nPlane = plane;
+    m_format = frame ? format : QRhiTexture::R8;
+    m_size = frame ? size : QSize(1, 1);
+    m_bDirty = true;
+}
+
+void VideoPlaneTexture::commitTextureOperations(QRhi* rhi, QRhiResourceUpdateBatch* resourceUpdates) {
+    if (!m_bDirty) return;
+
+    // 尺寸或格式变化时重建纹理
+    if (!m_pTexture || m_pTexture->pixelSize() != m_size || m_pTexture->format() != m_format) {
+        if (m_pTexture) m_pTexture->deleteLater();
+        m_pTexture = rhi->newTexture(m_format, m_size, 1, {});
+        if (!m_pTexture->create()) {
+            qCritical() << "Failed to create video plane texture" << m_size;
+            delete m_pTexture;
+            m_pTexture = nullptr;
+            return;
+        }
+    }
+
+    QRhiTextureSubresourceUploadDescription desc;
+    if (m_frame) {
+        // 直接引用AVFrame的平面数据，按行跨度上传，不做拷贝
+        const int stride = m_frame->linesize[m_nPlane];
+        desc.setData(QByteArray::fromRawData(reinterpret_cast<const char*>(m_frame->data[m_nPlane]), stride * m_size.height()));
+        desc.setDataStride(stride);
+    } else {
+        static const char placeholder[4] = { 0 };
+        desc.setData(QByteArray::fromRawData(placeholder, 1));
+    }
+    resourceUpdates->uploadTexture(m_pTexture, QRhiTextureUploadEntry(0, 0, desc));
+    m_bDirty = false;
+}
+
+// 根据帧的色彩空间和取值范围计算YUV到RGB的转换矩阵
+static QMatrix4x4 colorMatrixForFrame(const AVFrame* frame) {
+    float kr = 0.299f, kb = 0.114f;
+    AVColorSpace colorSpace = frame->colorspace;
+    if (colorSpace == AVCOL_SPC_UNSPECIFIED) {
+        // 未标注时按分辨率推断，高清内容通常为BT.709
+        colorSpace = frame->height >= 720 ? AVCOL_SPC_BT709 : AVCOL_SPC_BT470BG;
+    }
+    if (colorSpace == AVCOL_SPC_BT709) {
+        kr = 0.2126f; kb = 0.0722f;
+    } else if (colorSpace == AVCOL_SPC_BT2020_NCL || colorSpace == AVCOL_SPC_BT2020_CL) {
+        kr = 0.2627f; kb = 0.0593f;
+    }
+    const float kg = 1.0f - kr - kb;
+
+    const bool fullRange = frame->color_range == AVCOL_RANGE_JPEG || frame->format == AV_PIX_FMT_YUVJ420P;
+    const float yScale = fullRange ? 1.0f : 255.0f / 219.0f;
+    const float cScale = fullRange ? 1.0f : 255.0f / 224.0f;
+    const float yOffset = fullRange ? 0.0f : 16.0f / 255.0f;
+
+    const float rv = cScale * 2.0f * (1.0f - kr);
+    const float bu = cScale * 2.0f * (1.0f - kb);
+    const float gu = cScale * 2.0f * kb * (1.0f - kb) / kg;
+    const float gv = cScale * 2.0f * kr * (1.0f - kr) / kg;
+    const float y0 = -yScale * yOffset;
+
+    return QMatrix4x4(
+        yScale, 0.0f,  rv,   y0 - rv * 0.5f,
+        yScale, -gu,   -gv,  y0 + (gu + gv) * 0.5f,
+        yScale, bu,    0.0f, y0 - bu * 0.5f,
+        0.0f,   0.0f,  0.0f, 1.0f);
+}
+
+class VideoMaterialShader : public QSGMaterialShader {
+public:
+    VideoMaterialShader() {
+        setShaderFileName(VertexStage, QLatin1String(":/shaders/video.vert.qsb"));
+        setShaderFileName(FragmentStage, QLatin1String(":/shaders/video.frag.qsb"));
+    }
+
+    bool updateUniformData(RenderState& state, QSGMaterial* newMaterial, QSGMaterial* oldMaterial) override {
+        Q_UNUSED(oldMaterial);
+        // 与着色器中uniform buf的std140布局一致
+        QByteArray* buf = state.uniformData();
+        auto* material = static_cast<VideoMaterial*>(newMaterial);
+        if (state.isMatrixDirty()) {
+            memcpy(buf->data(), state.combinedMatrix().constData(), 64);
+        }
+        memcpy(buf->data() + 64, material->colorMatrix().constData(), 64);
+        if (state.isOpacityDirty()) {
+            const float opacity = state.opacity();
+            memcpy(buf->data() + 128, &opacity, 4);
+        }
+        const int planeLayout = material->planeLayout();
+        memcpy(buf->data() + 132, &planeLayout, 4);
+        return true;
+    }
+
+    void updateSampledImage(RenderState& state, int binding, QSGTexture** texture, QSGMaterial* newMaterial, QSGMaterial* oldMaterial) override {
+        Q_UNUSED(oldMaterial);
+        if (binding < 1 || binding > 3) return;
+        VideoPlaneTexture* plane = static_cast<VideoMaterial*>(newMaterial)->plane(binding - 1);
+        plane->commitTextureOperations(state.rhi(), state.resourceUpdateBatch());
+        *texture = plane;
+    }
+};
+
+VideoMaterial::VideoMaterial() {
+    for (auto& plane : m_planes) plane.reset(new VideoPlaneTexture());
+}
+
+QSGMaterialType* VideoMaterial::type() const {
+    static QSGMaterialType type;
+    return &type;
+}
+
+QSGMaterialShader* VideoMaterial::createShader(QSGRendererInterface::RenderMode renderMode) const {
+    Q_UNUSED(renderMode);
+    return new VideoMaterialShader();
+}
+
+int VideoMaterial::compare(const QSGMaterial* other) const {
+    // 每个节点持有独立的纹理，不与其他节点合批
+    return this == other ? 0 : (this < other ? -1 : 1);
+}
+
+void VideoMaterial::setFrame(const VideoFramePtr& frame) {
+    const QSize size(frame->width, frame->height);
+    const QSize chromaSize((frame->width + 1) / 2, (frame->height + 1) / 2);
+
+    m_planes[0]->setPlane(frame, 0, QRhiTexture::R8, size);
+    if (frame->format == AV_PIX_FMT_NV12) {
+        m_nPlaneLayout = 1;
+        m_planes[1]->setPlane(frame, 1, QRhiTexture::RG8, chromaSize);
+        m_planes[2]->setPlane(nullptr, 0, QRhiTexture::R8, QSize());
+    } else {
+        m_nPlaneLayout = 0;
+        m_planes[1]->setPlane(frame, 1, QRhiTexture::R8, chromaSize);
+        m_planes[2]->setPlane(frame, 2, QRhiTexture::R8, chromaSize);
+    }
+    m_colorMatrix = colorMatrixForFrame(frame.get());
+}
+
+VideoNode::VideoNode() : m_geometry(QSGGeometry::defaultAttributes_TexturedPoint2D(), 4) {
+    setGeometry(&m_geometry);
+    setMaterial(&m_material);
+}
+
+void VideoNode::setFrame(const VideoFramePtr& frame) {
+    m_material.setFrame(frame);
+    markDirty(QSGNode::DirtyMaterial);
+}
+
+void VideoNode::setRect(const QRectF& rect) {
+    if (rect == m_rect) return;
+    m_rect = rect;
+    QSGGeometry::updateTexturedRectGeometry(&m_geometry, rect, QRectF(0, 0, 1, 1));
+    markDirty(QSGNode::DirtyGeometry);
+}
@@ -0,0 +1,71 @@
+#ifndef VIDEONODE_H
+#define VIDEONODE_H
+
+#include "videoFrame.h"
+#include <QSGGeometryNode>
+#include <QSGMaterial>
+#include <QSGTexture>
+#include <QMatrix4x4>
+#include <rhi/qrhi.h>
+
+// 视频帧的一个平面，渲染时直接从AVFrame的数据上传为单通道/双通道纹理
+class VideoPlaneTexture : public QSGTexture {
+public:
+    VideoPlaneTexture();
+    ~VideoPlaneTexture() override;
+
+    qint64 comparisonKey() const override;
+    QRhiTexture* rhiTexture() const override;
+    QSize textureSize() const override;
+    bool hasAlphaChannel() const override { return false; }
+    bool hasMipmaps() const override { return false; }
+    void commitTextureOperations(QRhi* rhi, QRhiResourceUpdateBatch* resourceUpdates) override;
+
+    // 设置待上传的平面，frame为空时上传一个1x1的占位纹理
+    void setPlane(const VideoFramePtr& frame, int plane, QRhiTexture::Format format, const QSize& size);
+
+private:
+    QRhiTexture* m_pTexture = nullptr;
+    QRhiTexture::Format m_format = QRhiTexture::R8;
+    QSize m_size = QSize(1, 1);
+    // 持有帧的引用，保证上传完成前数据有效
+    VideoFramePtr m_frame;
+    int m_nPlane = 0;
+    bool m_bDirty = true;
+};
+
+// YUV转RGB的材质，颜色转换在着色器中完成
+class VideoMaterial : public QSGMaterial {
+public:
+    VideoMaterial();
+
+    QSGMaterialType* type() const override;
+    QSGMaterialShader* createShader(QSGRendererInterface::RenderMode renderMode) const override;
+    int compare(const QSGMaterial* other) const override;
+
+    void setFrame(const VideoFramePtr& frame);
+    inline VideoPlaneTexture* plane(int index) { return m_planes[index].get(); }
+    inline const QMatrix4x4& colorMatrix() const { return m_colorMatrix; }
+    inline int planeLayout() const { return m_nPlaneLayout; }
+
+private:
+    std::unique_ptr<VideoPlaneTexture> m_planes[3];
+    QMatrix4x4 m_colorMatrix;
+    int m_nPlaneLayout = 0;
+};
+
+// 显示一帧YUV视频的场景图节点
+class VideoNode : public QSGGeometryNode {
+public:
+    VideoNode();
+
+    void setFrame(const VideoFramePtr& frame);
+    void setRect(const QRectF& rect);
+
+private:
+    QSGGeometry m_geometry;
+    VideoMaterial m_material;
+    QRectF m_rect;
+};
+
+#endif // VIDEONODE_H
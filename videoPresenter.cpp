@@ -0,0 +1,214 @@
+#include "videoPresenter.h"
+#include <QDebug>
+#include <algorithm>
+
+// 帧时长未知时认为落后超过该值就是晚了 单位微秒
+#define DEFAULT_LATE_THRESHOLD 40000
+// 单次等待的最长时间，避免主时钟跳变时睡过头 单位微秒
+#define MAX_WAIT_TIME 100000
+// 主时钟尚未校准时的重试间隔 单位微秒
+#define CLOCK_RETRY_TIME 10000
+// 渲染线程超过该时间没有取帧时认为渲染循环已停止，退回到按时间直接发送 单位微秒
+#define VSYNC_STALL_TIMEOUT 500000
+// 待显示队列的容量，渲染循环来不及取走时丢弃最早的帧
+#define DISPLAY_QUEUE_SIZE 4
+
+VideoPresenter::VideoPresenter() {}
+
+VideoPresenter::~VideoPresenter() {}
+
+void VideoPresenter::run() {
+    while (!isInterruptionRequested() && !m_pQueue->isAborted()) {
+        FrameQueue::Entry* entry = m_pQueue->peek();
+        const int serial = m_pQueue->serial();
+
+        // 无数据，等待解码线程
+        if (!entry) {
+            m_pQueue->dataEvent().wait([this]{ return m_pQueue->size() > 0 || m_pQueue->isAborted(); });
+            continue;
+        }
+
+        // 跳转之前的旧帧直接丢弃
+        if (entry->serial != serial) {
+            m_pQueue->pop();
+            continue;
+        }
+
+        // 播放暂停控制
+        if (!m_bPlaying) {
+            if (m_pGovernor) m_pGovernor->restart();
+            m_pQueue->dataEvent().wait([this, serial]{
+                return m_bPlaying || m_pQueue->serial() != serial || m_pQueue->isAborted();
+            });
+            continue;
+        }
+
+        // 跳转后的第一帧及不按时钟展示时立即展示
+        const bool vsync = m_bPaced && isVsyncActive();
+        if (serial != m_nLastSerial || !m_bPaced) {
+            m_nLastSerial = serial;
+            if (m_pGovernor) m_pGovernor->restart();
+            vsync ? queueFrame() : presentFrame();
+            continue;
+        }
+
+        // 主时钟尚未校准（音频设备还未开始播放），稍后重试
+        Clock& master = m_pClock->masterClock();
+        if (!master.isValid()) {
+            m_pQueue->dataEvent().waitFor([this, serial]{
+                return !m_bPlaying || m_pQueue->serial() != serial || m_pQueue->isAborted();
+            }, CLOCK_RETRY_TIME);
+            continue;
+        }
+
+        // 等待到帧的显示时间，期间发生跳转或暂停则重新判断；倒放时帧时间递减，按速率换算成实际等待时间。
+        // 按垂直同步展示时提前一个同步周期，留出转换的时间，由渲染线程决定在哪次同步显示
+        qint64 delay = m_pClock->toWallTime(entry->pts - master.get());
+        const qint64 lead = vsync ? m_nVsyncInterval.load() : 0;
+        if (delay > lead) {
+            m_pQueue->dataEvent().waitFor([this, serial]{
+                return !m_bPlaying || m_pQueue->serial() != serial || m_pQueue->isAborted();
+            }, std::min<qint64>(delay - lead, MAX_WAIT_TIME));
+            continue;
+        }
+
+        // 已经落后，下一帧也到了显示时间则丢弃当前帧，不做颜色转换
+        const qint64 lateThreshold = entry->duration > 0 ? entry->duration : DEFAULT_LATE_THRESHOLD;
+        if (-delay > lateThreshold) {
+            FrameQueue::Entry* next = m_pQueue->peek(1);
+            if (next && next->serial == serial && m_pClock->toWallTime(next->pts - master.get()) <= 0) {
+                m_pQueue->pop();
+                ++m_nDroppedFrames;
+                if (m_pGovernor) m_pGovernor->record(-delay, true);
+                continue;
+            }
+            ++m_nLateFrames;
+        }
+
+        // 按垂直同步展示时由渲染线程记录实际显示的误差
+        if (vsync) {
+            queueFrame();
+            continue;
+        }
+        if (m_pGovernor) m_pGovernor->record(-delay, false);
+        presentFrame();
+    }
+}
+
+void VideoPresenter::presentFrame() {
+    FrameQueue::Entry* entry = m_pQueue->peek();
+    const qint64 pts = entry->pts;
+    const qint64 queuedTime = entry->queuedTime;
+    const qint64 duration = entry->duration;
+    VideoFramePtr frame = m_pQueue->pop();
+
+    // 帧格式转换后发送到界面渲染
+    VideoFramePtr output = convertFrame(frame.get());
+    const qint64 now = av_gettime_relative();
+    if (output) {
+        emit frameReady(output, now);
+        ++m_nPresentedFrames;
+        emit framePresented(pts, now - queuedTime);
+    }
+    // 以刚展示的帧校准视频时钟
+    m_nLastPts = pts;
+    m_nLastDuration = qMax<qint64>(0, duration);
+    m_nLastPresentTime = now;
+    m_pClock->video().set(pts);
+}
+
+void VideoPresenter::queueFrame() {
+    FrameQueue::Entry display;
+    const FrameQueue::Entry* entry = m_pQueue->peek();
+    display.pts = entry->pts;
+    display.duration = entry->duration;
+    display.serial = entry->serial;
+    display.queuedTime = entry->queuedTime;
+    VideoFramePtr frame = m_pQueue->pop();
+    display.frame = convertFrame(frame.get());
+    if (!display.frame) return;
+    {
+        std::lock_guard<std::mutex> lock(m_displayMutex);
+        if (m_display.size() >= DISPLAY_QUEUE_SIZE) {
+            m_display.pop_front();
+            ++m_nVsyncSkips;
+        }
+        m_display.push_back(std::move(display));
+    }
+    emit frameDue();
+}
+
+VideoFramePtr VideoPresenter::pickFrame(qint64 displayTime, qint64 interval, bool* more) {
+    *more = false;
+    const qint64 now = av_gettime_relative();
+    m_nLastPickTime = now;
+    std::lock_guard<std::mutex> lock(m_displayMutex);
+    // 跳转之前的旧帧直接丢弃
+    const int serial = m_pQueue ? m_pQueue->serial() : 0;
+    while (!m_display.empty() && m_display.front().serial != serial) m_display.pop_front();
+    if (m_display.empty() || !m_bPlaying) return nullptr;
+
+    // 跳转后的第一帧立即显示，否则选显示时间在该次同步前后半个周期内的最后一帧，更早的帧不再显示
+    const bool first = m_display.front().serial != m_nShownSerial;
+    int chosen = first ? 0 : -1;
+    qint64 due = displayTime;
+    if (!first) {
+        Clock& master = m_pClock->masterClock();
+        if (!master.isValid()) return nullptr;
+        const qint64 masterTime = master.get();
+        for (size_t i = 0; i < m_display.size(); ++i) {
+            const qint64 dueTime = now + m_pClock->toWallTime(m_display[i].pts - masterTime);
+            if (dueTime > displayTime + interval / 2) {
+                *more = dueTime <= displayTime + interval * 3 / 2;
+                break;
+            }
+            chosen = int(i);
+            due = dueTime;
+        }
+        if (chosen < 0) return nullptr;
+    }
+    for (int i = 0; i < chosen; ++i) {
+        m_display.pop_front();
+        ++m_nVsyncSkips;
+        if (m_pGovernor) m_pGovernor->record(displayTime - due, true);
+    }
+    FrameQueue::Entry entry = std::move(m_display.front());
+    m_display.pop_front();
+    if (!*more && !m_display.empty()) *more = true;
+
+    if (first) {
+        m_nShownSerial = entry.serial;
+    } else {
+        // 上一帧停留的同步周期数超过其时长对应的周期数，多出的即为重复显示
+        if (interval > 0 && m_nShownTime > 0) {
+            const qint64 shown = (displayTime - m_nShownTime + interval / 2) / interval;
+            const qint64 expected = qMax<qint64>(1, (m_nShownDuration + interval - 1) / interval);
+            if (shown > expected) m_nVsyncRepeats += shown - expected;
+        }
+        if (m_pMetrics) m_pMetrics->record(MetricStage::PresentError, qAbs(displayTime - due));
+        if (m_pGovernor) m_pGovernor->record(displayTime - due, false);
+    }
+    m_nShownTime = displayTime;
+    m_nShownDuration = m_pClock->toWallTime(qMax<qint64>(0, entry.duration));
+
+    ++m_nPresentedFrames;
+    emit framePresented(entry.pts, now - entry.queuedTime);
+    // 以显示时刻校准视频时钟
+    m_nLastPts = entry.pts;
+    m_nLastDuration = qMax<qint64>(0, entry.duration);
+    m_nLastPresentTime = displayTime;
+    m_pClock->video().set(entry.pts - qint64((displayTime - now) * m_pClock->speed()));
+    return entry.frame;
+}
+
+VideoFramePtr VideoPresenter::convertFrame(const AVFrame* frame) {
+    if (m_pGovernor) m_converter.setReducedScale(m_pGovernor->level() >= QualityLevel::ReducedScale);
+    const qint64 convertStart = av_gettime_relative();
+    VideoFramePtr output = m_converter.convert(frame);
+    m_nConvertTime += av_gettime_relative() - convertStart;
+    return output;
+}
+
+bool VideoPresenter::isVsyncActive() {
+    return m_bVsyncDriven && av_gettime_relative() - m_nLastPickTime < VSYNC_STALL_TIMEOUT;
+}
@@ -0,0 +1,138 @@
+#ifndef VIDEOPRESENTER_H
+#define VIDEOPRESENTER_H
+
+#include "frameQueue.h"
+#include "frameConverter.h"
+#include "clock.h"
+#include "pipelineMetrics.h"
+#include "qualityGovernor.h"
+#include <QThread>
+#include <atomic>
+#include <deque>
+#include <mutex>
+
+extern "C" {
+#include <libavutil/time.h>
+}
+
+// 视频展示线程
+// 从已解码帧队列中按显示时间取帧，在截止时间到达时转换并发送到界面；
+// 已经落后于时钟的帧在颜色转换之前丢弃。
+// 按垂直同步展示时提前一个同步周期转换放入待显示队列并请求重绘，由渲染线程在每次同步时选取最接近显示时刻的帧；
+// 渲染循环停止取帧（窗口最小化等）时退回到按时间直接发送
+class VideoPresenter : public QThread {
+    Q_OBJECT
+public:
+    VideoPresenter();
+    ~VideoPresenter();
+
+    inline void setFrameQueue(FrameQueue* queue) { m_pQueue = queue; }
+    inline void setClock(MediaClock* clock) { m_pClock = clock; }
+    inline void setMetrics(PipelineMetrics* metrics) {
+        m_pMetrics = metrics;
+        m_converter.setMetrics(metrics);
+    }
+    // 画质调控，按时钟展示时向其记录每帧的落后时间，并按其等级降低输出分辨率
+    inline void setQualityGovernor(QualityGovernor* governor) { m_pGovernor = governor; }
+
+    // 是否按时钟展示，关闭后帧解码出来立即展示（性能测试）
+    inline void setPaced(bool paced) {
+        m_bPaced = paced;
+        if (m_pQueue) m_pQueue->dataEvent().notify();
+    }
+
+    inline void setPlaying(bool playing) {
+        m_bPlaying = playing;
+        if (m_pQueue) m_pQueue->dataEvent().notify();
+    }
+
+    // 是否由渲染循环按垂直同步取帧，关闭后帧在显示时间到达时直接发送
+    inline void setVsyncDriven(bool enabled) { m_bVsyncDriven = enabled; }
+    // 垂直同步周期 单位微秒，帧提前这么久放入待显示队列
+    inline void setVsyncInterval(qint64 interval) { m_nVsyncInterval = interval; }
+    // 从待显示队列中取出在displayTime（下一次垂直同步的时刻，单位微秒）应显示的帧，没有新的帧时返回空；
+    // more表示队列中还有在下一个周期到期的帧，需要再渲染一次。在渲染线程中调用
+    VideoFramePtr pickFrame(qint64 displayTime, qint64 interval, bool* more);
+
+    // 设置输出像素格式，AV_PIX_FMT_NONE表示可直接渲染的YUV帧以引用方式输出，不做转换
+    inline void setOutputFormat(AVPixelFormat format) { m_converter.setOutputFormat(format); }
+    // 设置显示区域大小（设备像素），需要转换的帧直接缩放到该区域内保持宽高比的大小
+    inline void setOutputSize(int width, int height) { m_converter.setOutputSize(width, height); }
+    // 设置缩放算法 SWS_BILINEAR、SWS_BICUBIC等
+    inline void setScaleFlags(int flags) { m_converter.setScaleFlags(flags); }
+    // 转换输出帧的回收池，用于统计分配次数
+    inline const FramePoolPtr& framePool() const { return m_converter.framePool(); }
+
+    // 因落后被丢弃的帧数
+    inline qint64 getDroppedFrames() { return m_nDroppedFrames; }
+    // 晚于截止时间展示的帧数
+    inline qint64 getLateFrames() { return m_nLateFrames; }
+    // 已展示的帧数
+    inline qint64 getPresentedFrames() { return m_nPresentedFrames; }
+    // 按垂直同步展示时，帧停留超过其时长所多出的同步周期数，及转换后未被显示就被跳过的帧数
+    inline qint64 getVsyncRepeats() { return m_nVsyncRepeats; }
+    inline qint64 getVsyncSkips() { return m_nVsyncSkips; }
+    // 帧格式转换的累计耗时 单位微秒
+    inline qint64 getConvertTime() { return m_nConvertTime; }
+    // 最近一次展示的帧的显示时间 单位微秒，逐帧浏览从这一帧开始
+    inline qint64 lastPresentedPts() { return m_nLastPts; }
+    // 最近一次展示的帧的时长及展示时的系统时间 单位微秒，用于判断最后一帧是否已展示完
+    inline qint64 lastPresentedDuration() { return m_nLastDuration; }
+    inline qint64 lastPresentTime() { return m_nLastPresentTime; }
+
+protected:
+    void run() override;
+
+private:
+    // 转换并发送队首的帧，更新视频时钟
+    void presentFrame();
+    // 转换队首的帧放入待显示队列，请求渲染线程取帧
+    void queueFrame();
+    // 帧格式转换，按画质等级降低输出分辨率
+    VideoFramePtr convertFrame(const AVFrame* frame);
+    // 渲染循环最近在取帧
+    bool isVsyncActive();
+
+signals:
+    // presentTime为发出时的系统时间 单位微秒，用于统计送达界面线程的延迟
+    void frameReady(VideoFramePtr frame, qint64 presentTime);
+    // 一帧已发送到界面，pts为显示时间，latency为从解码完成到发送的延迟 单位微秒
+    void framePresented(qint64 pts, qint64 latency);
+    // 待显示队列中有帧即将到期，需要重绘
+    void frameDue();
+
+private:
+    FrameQueue* m_pQueue = nullptr;
+    MediaClock* m_pClock = nullptr;
+    PipelineMetrics* m_pMetrics = nullptr;
+    QualityGovernor* m_pGovernor = nullptr;
+    // 线程启动前即可暂停（预加载时第一帧留在队列中）
+    std::atomic<bool> m_bPlaying = true;
+    std::atomic<bool> m_bPaced = true;
+    // 最近一次展示的帧所属的跳转序号
+    int m_nLastSerial = -1;
+    FrameConverter m_converter;
+    std::atomic<qint64> m_nDroppedFrames = 0;
+    std::atomic<qint64> m_nLateFrames = 0;
+    std::atomic<qint64> m_nPresentedFrames = 0;
+    std::atomic<qint64> m_nConvertTime = 0;
+    std::atomic<qint64> m_nLastPts = 0;
+    std::atomic<qint64> m_nLastDuration = 0;
+    std::atomic<qint64> m_nLastPresentTime = 0;
+    // 按垂直同步展示
+    std::atomic<bool> m_bVsyncDriven = false;
+    std::atomic<qint64> m_nVsyncInterval = 0;
+    // 最近一次渲染线程取帧的时间
+    std::atomic<qint64> m_nLastPickTime = 0;
+    // 已转换、等待渲染线程取走的帧
+    std::mutex m_displayMutex;
+    std::deque<FrameQueue::Entry> m_display;
+    // 以下只在渲染线程中使用：最近显示的帧的跳转序号、显示时刻及时长 单位微秒
+    int m_nShownSerial = -1;
+    qint64 m_nShownTime = 0;
+    qint64 m_nShownDuration = 0;
+    std::atomic<qint64> m_nVsyncRepeats = 0;
+    std::atomic<qint64> m_nVsyncSkips = 0;
+};
+
+#endif // VIDEOPRESENTER_H
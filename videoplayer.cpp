@@ -1,91 +1,391 @@
 #include "videoplayer.h"
+#include "videoNode.h"
+#include "thumbnailProvider.h"
 #include <QDebug>
-#include <QPainter>
-#include <QMediaDevices>
+#include <QJsonDocument>
+#include <QSaveFile>
+#include <QQuickWindow>
+#include <QScreen>
+#include <QSGImageNode>
 
-VideoPlayer::VideoPlayer(QQuickItem* parent) : QQuickPaintedItem(parent) {}
+// 写入媒体索引缓存的缩略图数上限
+#define MAX_CACHED_THUMBNAILS 64
+// 有焦点时解码优先级的提高量，不可见时的降低量
+#define FOCUS_PRIORITY_BOOST 1
+#define HIDDEN_PRIORITY_PENALTY 2
+
+VideoPlayer::VideoPlayer(QQuickItem* parent) : QQuickItem(parent) {
+    setFlag(ItemHasContents, true);
+    // 未加载文件时使用空闲的解码器，接口都可以直接调用
+    m_pItem = new MediaItem();
+    m_pItem->decoder = new Decoder();
+    m_pDecoder = m_pItem->decoder;
+    connect(&m_statsTimer, &QTimer::timeout, this, &VideoPlayer::onStatsTimer);
+    connect(this, &VideoPlayer::volumnChanged, this, &VideoPlayer::onVolunmChange);
+    connect(&m_loader, &MediaLoader::loaded, this, &VideoPlayer::onItemLoaded);
+    connect(&m_loader, &MediaLoader::audioAttached, this, &VideoPlayer::onAudioAttached);
+}
 
 VideoPlayer::~VideoPlayer() {
-    if (m_pAudioSink && !m_pAudioSink->isNull()) m_pAudioSink->stop();
-    if (m_decoder.isRunning()) {
-        m_decoder.requestInterruption();
-        m_decoder.wait();
-    }
+    detachThumbnails();
+    // 仍在加载中的项由加载线程释放
+    m_loader.stop();
+    if (m_bNextReady) MediaLoader::close(m_pNextItem);
+    MediaLoader::close(m_pItem);
 }
 
-bool VideoPlayer::loadVideo(const QString& filePath, bool useHw) {
-    QUrl fileUrl(filePath);
-    QString localPath = fileUrl.toLocalFile();
-    qDebug() << "loadVideo path: " << localPath;
+bool VideoPlayer::loadVideo(const QString& filePath, bool useHw, DecodeThreadingMode threading) {
+    return loadPlaylist({ filePath }, useHw, threading);
+}
+
+bool VideoPlayer::loadPlaylist(const QStringList& files, bool useHw, DecodeThreadingMode threading) {
+    cancelPreload();
+    m_playlist = files;
+    m_bUseHardwareDecoder = useHw;
+    m_threading = threading;
+    emit playlistChanged();
+    return !files.isEmpty() && playIndex(0);
+}
 
-    // 设置解码线程的上下文
-    if (!m_decoder.init(localPath, useHw)) {
+bool VideoPlayer::playIndex(int index) {
+    if (index < 0 || index >= m_playlist.size()) return false;
+    // 已预加载完成，直接切换
+    if (m_pNextItem && m_pNextItem->index == index && m_bNextReady) {
+        MediaItem* item = m_pNextItem;
+        m_pNextItem = nullptr;
+        activateItem(item);
+        return true;
+    }
+
+    cancelPreload();
+    MediaItem* item = createItem(index, m_bFastStart);
+    qDebug() << "loadVideo path: " << item->localPath;
+    if (!MediaLoader::open(item)) {
         qCritical() << "decoder thread init failed";
+        m_loader.release(item);
         return false;
     }
+    activateItem(item);
+    // 已开始播放视频，音频设备在加载线程中创建，完成后接管
+    if (item->fastStart && m_pDecoder->hasAudio()) m_loader.attachAudio(item);
+    return true;
+}
 
-    // 初始化音频输出
-    QAudioFormat format;
-    // 设置音频格式参数
-    format.setSampleRate(m_decoder.getAudioSampleRate());
-    format.setChannelCount(2);
-    // 设置音频样本格式
-    format.setSampleFormat(QAudioFormat::Int16);
+void VideoPlayer::setLoopPlaylist(bool loop) {
+    if (loop == m_bLoopPlaylist) return;
+    m_bLoopPlaylist = loop;
+    // 重新决定下一项
+    cancelPreload();
+    if (m_nCurrentIndex >= 0) preloadNext();
+    emit loopPlaylistChanged();
+}
 
-    // 创建QAudioSink实例
-    m_pAudioSink = new QAudioSink(QMediaDevices::defaultAudioOutput(), format, this);
-    if (m_pAudioSink->isNull()) {
-        qWarning() << "audio sink is null, cannot play audio.";
-        return false;
-    }
+void VideoPlayer::setSharedDecode(bool shared) {
+    if (shared == m_bSharedDecode) return;
+    m_bSharedDecode = shared;
+    emit sharedDecodeChanged();
+}
 
-    // 设置初始音量
-    onVolunmChange(m_nVolumn);
+void VideoPlayer::setFastStart(bool fastStart) {
+    if (fastStart == m_bFastStart) return;
+    m_bFastStart = fastStart;
+    emit fastStartChanged();
+}
 
-    // 开始播放，返回可以写入音频数据的 QIODevice
-    m_pAudioDevice = m_pAudioSink->start();
-    if (!m_pAudioDevice) {
-        qWarning() << "Failed to start audio sink.";
-        return false;
+qint64 VideoPlayer::timeToFirstFrame() {
+    const qint64 firstFrame = m_pDecoder->startupTimes().firstFrame;
+    return firstFrame < 0 ? -1 : firstFrame / 1000;
+}
+
+void VideoPlayer::setDecodePriority(int priority) {
+    if (priority == m_nDecodePriority) return;
+    m_nDecodePriority = priority;
+    updateDecodePriority();
+    emit decodePriorityChanged();
+}
+
+int VideoPlayer::effectiveDecodePriority() const {
+    int priority = m_nDecodePriority;
+    if (hasActiveFocus()) priority += FOCUS_PRIORITY_BOOST;
+    if (!isVisible()) priority -= HIDDEN_PRIORITY_PENALTY;
+    return priority;
+}
+
+void VideoPlayer::updateDecodePriority() {
+    // 预加载中的项在切换时更新
+    m_pDecoder->setDecodePriority(effectiveDecodePriority());
+}
+
+int VideoPlayer::nextIndex() const {
+    if (m_nCurrentIndex < 0 || m_playlist.isEmpty()) return -1;
+    if (m_nCurrentIndex + 1 < m_playlist.size()) return m_nCurrentIndex + 1;
+    return m_bLoopPlaylist ? 0 : -1;
+}
+
+MediaItem* VideoPlayer::createItem(int index, bool fastStart /* = false */) {
+    MediaItem* item = new MediaItem();
+    item->index = index;
+    item->localPath = QUrl(m_playlist[index]).toLocalFile();
+    // 不是file:地址时按路径或其他协议直接使用
+    if (item->localPath.isEmpty()) item->localPath = m_playlist[index];
+    item->useHardwareDecoder = m_bUseHardwareDecoder;
+    item->threading = static_cast<DecodeThreading>(m_threading);
+    item->fastStart = fastStart;
+    item->decoder = new Decoder();
+    item->decoder->setFastStart(fastStart);
+    item->decoder->setSharedDecode(m_bSharedDecode);
+    item->decoder->setDecodePriority(effectiveDecodePriority());
+    return item;
+}
+
+void VideoPlayer::preloadNext() {
+    const int index = nextIndex();
+    if (index < 0 || m_pNextItem) return;
+    m_pNextItem = createItem(index);
+    m_bNextReady = false;
+    m_loader.load(m_pNextItem);
+}
+
+void VideoPlayer::cancelPreload() {
+    if (!m_pNextItem) return;
+    // 仍在加载时由onItemLoaded释放
+    if (m_bNextReady) m_loader.release(m_pNextItem);
+    m_pNextItem = nullptr;
+    m_bNextReady = false;
+}
+
+void VideoPlayer::onItemLoaded() {
+    for (MediaItem* item : m_loader.takeLoaded()) {
+        // 已被取消的预加载
+        if (item != m_pNextItem) {
+            m_loader.release(item);
+        } else if (!item->ok) {
+            qWarning() << "preload failed:" << item->localPath;
+            m_pNextItem = nullptr;
+            m_loader.release(item);
+        } else {
+            m_bNextReady = true;
+            // 预加载完成前当前项已播完，直接切换
+            if (m_pDecoder->isFinished()) {
+                m_pNextItem = nullptr;
+                activateItem(item);
+            }
+        }
     }
+}
 
-    connect(&m_decoder, &Decoder::videoFrameReady, this, &VideoPlayer::onVideoFrameReady);
-    connect(&m_decoder, &Decoder::audioFrameReady, this, &VideoPlayer::onAudioFrameReady);
-    connect(this, &VideoPlayer::volumnChanged, this, &VideoPlayer::onVolunmChange);
+void VideoPlayer::onAudioAttached() {
+    for (MediaItem* item : m_loader.takeAudioAttached()) {
+        // 已切换到其他项，该项由加载线程释放
+        if (item != m_pItem || !item->audioOutput) continue;
+        m_pAudioOutput = item->audioOutput;
+        onVolunmChange(m_nVolumn);
+        m_pAudioOutput->setPaused(!m_bPlaying);
+        // 之后以音频时钟同步
+        m_pDecoder->setAudioReady();
+    }
+}
 
-    // 开始线程解码
-    m_decoder.start();
+void VideoPlayer::onAudioStreamOpened() {
+    if (m_pItem->fastStart && !m_pItem->audioOutput) m_loader.attachAudio(m_pItem);
+}
+
+void VideoPlayer::onDecoderFinished() {
+    // 排队中的信号可能来自已切换掉的项
+    if (sender() != m_pDecoder) return;
+    if (!m_pNextItem || !m_bNextReady) return;
+    MediaItem* item = m_pNextItem;
+    m_pNextItem = nullptr;
+    activateItem(item);
+}
+
+void VideoPlayer::activateItem(MediaItem* item) {
+    MediaItem* old = m_pItem;
+    disconnect(old->decoder, nullptr, this, nullptr);
+    detachThumbnails();
+
+    m_pItem = item;
+    m_pDecoder = item->decoder;
+    m_pAudioOutput = item->audioOutput;
+    m_strLocalPath = item->localPath;
+    m_nCurrentIndex = item->index;
+    m_bFirstFrameShown = false;
+    connect(m_pDecoder, &Decoder::videoFrameReady, this, &VideoPlayer::onVideoFrameReady);
+    connect(m_pDecoder, &Decoder::qualityLevelChanged, this, &VideoPlayer::qualityLevelChanged);
+    connect(m_pDecoder, &Decoder::audioStreamOpened, this, &VideoPlayer::onAudioStreamOpened);
+    // 播完时由解复用线程通知，切换到已就绪的下一项
+    connect(m_pDecoder, &Decoder::playbackFinished, this, &VideoPlayer::onDecoderFinished);
+    // 帧即将到期时才请求重绘，由渲染线程在最接近显示时间的垂直同步取帧
+    connect(m_pDecoder, &Decoder::videoFrameDue, this, &QQuickItem::update);
+
+    // 沿用播放器的设置
+    updateOutputSize();
+    m_pDecoder->setVideoScaleFlags(scaleFlags(m_scalingFilter));
+    if (m_bSoftwareRender) m_pDecoder->setVideoOutputFormat(AV_PIX_FMT_RGBA);
+    m_pDecoder->setSyncMaster(static_cast<SyncMaster>(m_syncMode));
+    m_pDecoder->setAdaptiveQuality(m_bAdaptiveQuality);
+    // 同步周期由渲染线程在updatePaintNode中设置
+    m_pDecoder->setVsyncDriven(true);
+    updateDecodePriority();
+    onVolunmChange(m_nVolumn);
+    attachThumbnails();
+    emit qualityLevelChanged();
+
+    // 预先解码的第一帧立即展示，上一项的最后一帧一直保留到这时，中间没有黑屏
+    m_pDecoder->setPlayState(true);
+    if (m_pAudioOutput) m_pAudioOutput->setPaused(false);
+    m_loader.release(old);
+
+    if (m_nStatsInterval > 0) m_statsTimer.start(m_nStatsInterval);
     setPlaying(true);
-    return true;
+    emit currentIndexChanged();
+    emit playbackRateChanged();
+
+    preloadNext();
 }
 
-void VideoPlayer::paint(QPainter* painter) {
-    if (m_image.isNull()) return;
+void VideoPlayer::attachThumbnails() {
+    // 进度条预览缩略图使用独立的解码上下文，每一项使用不同的地址，避免界面沿用上一项的图片
+    if (!m_pDecoder->hasVideo()) return;
+    m_strThumbnailId = QString("%1-%2").arg(reinterpret_cast<quintptr>(this), 0, 16).arg(m_nCurrentIndex);
+    m_thumbnailEngine.open(m_strLocalPath);
+    m_thumbnailEngine.preload(m_pDecoder->mediaIndex().thumbnails);
+    ThumbnailProvider::registerEngine(m_strThumbnailId, &m_thumbnailEngine);
+}
 
-    QImage img = m_image.scaled(this->width(), this->height(), Qt::KeepAspectRatio);
+void VideoPlayer::detachThumbnails() {
+    if (!m_strThumbnailId.isEmpty()) {
+        ThumbnailProvider::unregisterEngine(m_strThumbnailId);
+        // 有新生成的缩略图时在加载线程中写入媒体索引缓存，下次打开时直接可用，不阻塞切换
+        if (m_thumbnailEngine.hasGenerated()) {
+            m_loader.saveThumbnails(m_strLocalPath, m_thumbnailEngine.thumbnails(MAX_CACHED_THUMBNAILS));
+        }
+        m_strThumbnailId.clear();
+    }
+    m_thumbnailEngine.close();
+}
+
+QSGNode* VideoPlayer::updatePaintNode(QSGNode* oldNode, UpdatePaintNodeData* data) {
+    Q_UNUSED(data);
+    // 窗口换到了刷新率不同的屏幕
+    const double refreshRate = m_dRefreshRate.exchange(0);
+    if (refreshRate > 0) m_vsync.setRefreshRate(refreshRate);
+    // 取在这次渲染显示出来的那次垂直同步应显示的帧；下一个周期还有帧到期时再渲染一次，否则等解码器请求
+    const qint64 interval = m_vsync.interval();
+    bool more = false;
+    VideoFramePtr frame = m_pDecoder->pickVideoFrame(m_vsync.nextVsync(av_gettime_relative()), interval, &more);
+    m_pDecoder->setVsyncInterval(interval);
+    if (frame) {
+        m_frame = frame;
+        m_bFrameDirty = true;
+    }
+    if (more) QMetaObject::invokeMethod(this, &QQuickItem::update, Qt::QueuedConnection);
+    if (!m_frame) return oldNode;
 
-    int x = this->width() - img.width();
-    int y = this->height() - img.height();
+    const qint64 renderStart = av_gettime_relative();
+    QSGNode* node = updateVideoNode(oldNode);
+    m_pDecoder->metrics().record(MetricStage::Render, av_gettime_relative() - renderStart);
+    return node;
+}
+
+QSGNode* VideoPlayer::updateVideoNode(QSGNode* oldNode) {
+    // 软件渲染后端不支持自定义着色器，改为由解码线程输出RGBA帧
+    if (!m_bSoftwareRender && window()->rendererInterface()->graphicsApi() == QSGRendererInterface::Software) {
+        m_bSoftwareRender = true;
+        m_pDecoder->setVideoOutputFormat(AV_PIX_FMT_RGBA);
+    }
 
-    x /= 2;
-    y /= 2;
+    const QRectF rect = videoRect(m_frame->width, m_frame->height);
 
-    painter->drawImage(QPoint(x,y), img);
+    if (m_bSoftwareRender) {
+        // 切换输出格式之前解码出的YUV帧直接跳过
+        if (m_frame->format != AV_PIX_FMT_RGBA) return oldNode;
+        QSGImageNode* node = static_cast<QSGImageNode*>(oldNode);
+        if (!node) {
+            node = window()->createImageNode();
+            node->setOwnsTexture(true);
+            node->setFiltering(QSGTexture::Linear);
+        }
+        if (m_bFrameDirty) {
+            // 图像直接引用帧数据，纹理释放时解除引用
+            AVFrame* ref = av_frame_clone(m_frame.get());
+            QImage image(ref->data[0], ref->width, ref->height, ref->linesize[0], QImage::Format_RGBA8888,
+                         [](void* info) { AVFrame* frame = static_cast<AVFrame*>(info); av_frame_free(&frame); }, ref);
+            node->setTexture(window()->createTextureFromImage(image));
+            m_bFrameDirty = false;
+        }
+        node->setRect(rect);
+        return node;
+    }
+
+    VideoNode* node = static_cast<VideoNode*>(oldNode);
+    if (!node) node = new VideoNode();
+    if (m_bFrameDirty && isRenderableFormat(m_frame->format)) {
+        node->setFrame(m_frame);
+        m_bFrameDirty = false;
+    }
+    node->setRect(rect);
+    return node;
 }
 
-void VideoPlayer::onVideoFrameReady(QImage frame) {
-    m_image = frame;
-    // 触发重绘
+void VideoPlayer::geometryChange(const QRectF& newGeometry, const QRectF& oldGeometry) {
+    QQuickItem::geometryChange(newGeometry, oldGeometry);
+    // 窗口缩放或全屏时，解码线程按新的大小重建转换上下文
+    updateOutputSize();
     update();
 }
 
-void VideoPlayer::onAudioFrameReady(QByteArray buffer) {
-    m_pAudioDevice->write(buffer);
+void VideoPlayer::itemChange(ItemChange change, const ItemChangeData& value) {
+    QQuickItem::itemChange(change, value);
+    if (change == ItemSceneChange || change == ItemDevicePixelRatioHasChanged) {
+        updateOutputSize();
+    }
+    if (change == ItemSceneChange) {
+        // 每次交换缓冲时记录垂直同步的时刻，在渲染线程中调用
+        disconnect(m_swapConnection);
+        disconnect(m_screenConnection);
+        if (value.window) {
+            // 刷新率在渲染线程中应用
+            if (value.window->screen()) m_dRefreshRate = value.window->screen()->refreshRate();
+            m_screenConnection = connect(value.window, &QQuickWindow::screenChanged, this, [this](QScreen* screen) {
+                if (screen) m_dRefreshRate = screen->refreshRate();
+                update();
+            });
+            m_swapConnection = connect(value.window, &QQuickWindow::frameSwapped, this,
+                                       [this]{ m_vsync.onSwap(av_gettime_relative()); }, Qt::DirectConnection);
+        }
+    }
+    if (change == ItemVisibleHasChanged || change == ItemActiveFocusHasChanged) {
+        updateDecodePriority();
+    }
+}
+
+void VideoPlayer::updateOutputSize() {
+    const qreal dpr = window() ? window()->effectiveDevicePixelRatio() : 1.0;
+    m_pDecoder->setVideoOutputSize(qRound(width() * dpr), qRound(height() * dpr));
+}
+
+QRectF VideoPlayer::videoRect(int width, int height) const {
+    QSizeF size = QSizeF(width, height).scaled(QSizeF(this->width(), this->height()), Qt::KeepAspectRatio);
+    qreal x = (this->width() - size.width()) / 2;
+    qreal y = (this->height() - size.height()) / 2;
+    return QRectF(x, y, size.width(), size.height());
+}
+
+void VideoPlayer::onVideoFrameReady(VideoFramePtr frame, qint64 presentTime) {
+    m_pDecoder->metrics().record(MetricStage::Delivery, av_gettime_relative() - presentTime);
+    m_frame = frame;
+    m_bFrameDirty = true;
+    if (!m_bFirstFrameShown) {
+        m_bFirstFrameShown = true;
+        emit firstFrameShown();
+    }
+    // 触发重绘
+    update();
 }
 
 void VideoPlayer::onVolunmChange(int volumn) {
-    qreal linearVolume = QAudio::convertVolume(volumn / qreal(100.0), QAudio::LogarithmicVolumeScale, QAudio::LinearVolumeScale);
-    m_pAudioSink->setVolume(linearVolume);
+    if (m_pAudioOutput) m_pAudioOutput->setVolume(volumn);
 }
 
 void VideoPlayer::setPlaying(bool playing) {
@@ -95,8 +395,95 @@ void VideoPlayer::setPlaying(bool playing) {
 }
 
 
+void VideoPlayer::setScalingFilter(ScalingFilter filter) {
+    if (filter == m_scalingFilter) return;
+    m_scalingFilter = filter;
+    m_pDecoder->setVideoScaleFlags(scaleFlags(filter));
+    emit scalingFilterChanged();
+}
+
+int VideoPlayer::scaleFlags(ScalingFilter filter) {
+    switch (filter) {
+    case FastBilinear: return SWS_FAST_BILINEAR;
+    case Bilinear: return SWS_BILINEAR;
+    case Bicubic: return SWS_BICUBIC;
+    case Area: return SWS_AREA;
+    case Lanczos: return SWS_LANCZOS;
+    case Point: return SWS_POINT;
+    }
+    return SWS_BILINEAR;
+}
+
+QString VideoPlayer::thumbnailUrl(qint64 ms) {
+    if (m_strThumbnailId.isEmpty()) return QString();
+    return QString("image://thumbnail/%1/%2").arg(m_strThumbnailId).arg(ThumbnailEngine::cacheKey(ms));
+}
+
+QString VideoPlayer::getDecodeThreadType() {
+    const int type = m_pDecoder->getVideoThreadType();
+    if (type & FF_THREAD_FRAME) return "frame";
+    if (type & FF_THREAD_SLICE) return "slice";
+    return "none";
+}
+
+void VideoPlayer::setSyncMode(SyncMode mode) {
+    if (mode == m_syncMode) return;
+    m_syncMode = mode;
+    m_pDecoder->setSyncMaster(static_cast<SyncMaster>(mode));
+    emit syncModeChanged();
+}
+
+void VideoPlayer::setAdaptiveQuality(bool adaptive) {
+    if (adaptive == m_bAdaptiveQuality) return;
+    m_bAdaptiveQuality = adaptive;
+    m_pDecoder->setAdaptiveQuality(adaptive);
+    emit adaptiveQualityChanged();
+}
+
+void VideoPlayer::setPlaybackRate(double rate) {
+    if (rate == m_pDecoder->getPlaybackRate()) return;
+    if (!m_pDecoder->setPlaybackRate(rate)) {
+        qWarning() << "unsupported playback rate" << rate;
+        return;
+    }
+    emit playbackRateChanged();
+}
+
 void VideoPlayer::setVolumn(int volumn) {
     if (volumn == m_nVolumn) return;
     m_nVolumn = volumn;
     emit volumnChanged(volumn);
 }
+
+void VideoPlayer::setStatsInterval(int interval) {
+    if (interval == m_nStatsInterval) return;
+    m_nStatsInterval = interval;
+    if (interval > 0) {
+        m_statsTimer.start(interval);
+    } else {
+        m_statsTimer.stop();
+    }
+    emit statsIntervalChanged();
+}
+
+QString VideoPlayer::getStatsJson() {
+    return QString::fromUtf8(QJsonDocument(m_pDecoder->statsSnapshot()).toJson(QJsonDocument::Compact));
+}
+
+void VideoPlayer::onStatsTimer() {
+    const QJsonObject snapshot = m_pDecoder->statsSnapshot();
+    m_stats = snapshot.toVariantMap();
+    emit statsChanged();
+
+    const QByteArray json = QJsonDocument(snapshot).toJson(QJsonDocument::Compact);
+    emit statsSnapshot(QString::fromUtf8(json));
+
+    if (!m_strStatsFile.isEmpty()) {
+        // 整体替换文件，读取方不会看到写了一半的快照
+        QSaveFile file(m_strStatsFile);
+        if (file.open(QIODevice::WriteOnly)) {
+            file.write(json);
+            file.commit();
+        }
+    }
+}
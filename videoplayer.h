@@ -1,30 +1,109 @@
 #ifndef VIDEOPLAYER_H
 #define VIDEOPLAYER_H
 
-#include <QQuickPaintedItem>
-#include <QImage>
+#include <QQuickItem>
 #include "decoder.h"
-#include <QAudioSink>
+#include "audioOutput.h"
+#include "mediaLoader.h"
+#include "thumbnailEngine.h"
+#include "vsyncEstimator.h"
+#include <QStringList>
+#include <QTimer>
+#include <QVariantMap>
 
-class VideoPlayer : public QQuickPaintedItem {
+class VideoPlayer : public QQuickItem {
     Q_OBJECT
 public:
     VideoPlayer(QQuickItem* parent = nullptr);
     ~VideoPlayer();
 
-    // 加载视频
-    Q_INVOKABLE bool loadVideo(const QString& filename, bool hw = false);
+    // 软件解码的多线程方式，线程数按CPU核数和正在运行的播放器数分配
+    enum DecodeThreadingMode {
+        ThreadingAuto = int(DecodeThreading::Auto),
+        FrameThreads = int(DecodeThreading::Frame),
+        SliceThreads = int(DecodeThreading::Slice)
+    };
+    Q_ENUM(DecodeThreadingMode)
+
+    // 加载视频，等同于只有一项的播放列表
+    Q_INVOKABLE bool loadVideo(const QString& filename, bool hw = false, DecodeThreadingMode threading = ThreadingAuto);
+    // 加载播放列表并开始播放第一项，之后的每一项都在后台线程中提前打开并预先解码，播完时无缝切换
+    Q_INVOKABLE bool loadPlaylist(const QStringList& files, bool hw = false, DecodeThreadingMode threading = ThreadingAuto);
+    // 切换到播放列表中的某一项，已预加载时立即切换
+    Q_INVOKABLE bool playIndex(int index);
+    Q_INVOKABLE inline bool playNext() { return nextIndex() >= 0 && playIndex(nextIndex()); }
     // 设置暂停/播放
     Q_INVOKABLE inline void setPlayState(bool play) {
-        m_decoder.setPlayState(play);
+        m_pDecoder->setPlayState(play);
+        if (m_pAudioOutput) m_pAudioOutput->setPaused(!play);
         setPlaying(play);
     }
     // 获取视频总时长 单位秒
-    Q_INVOKABLE inline qint64 getVideoTotleTime() { return m_decoder.getTotleTime(); };
+    Q_INVOKABLE inline qint64 getVideoTotleTime() { return m_pDecoder->getTotleTime(); };
     // 获取当前播放时间 单位秒
-    Q_INVOKABLE inline qint64 getPlayTime() { return m_decoder.getPlayTime(); }
+    Q_INVOKABLE inline qint64 getPlayTime() { return m_pDecoder->getPlayTime(); }
     // 跳转到某位置 单位秒
-    Q_INVOKABLE inline void seekToPosition(qint64 second) { m_decoder.seekToPosition(second); }
+    Q_INVOKABLE inline void seekToPosition(qint64 second) { m_pDecoder->seekToPosition(second); }
+    // 精确跳转到某位置 单位毫秒
+    Q_INVOKABLE inline void seekToMs(qint64 ms) { m_pDecoder->seekToMs(ms); }
+    // 跳转到离某位置最近的关键帧 单位毫秒，拖动进度条时使用
+    Q_INVOKABLE inline void scrubToMs(qint64 ms) { m_pDecoder->seekToMs(ms, true); }
+    // 暂停并逐帧前进（direction为1）或后退（-1），后退直接取GOP缓存中的帧
+    Q_INVOKABLE inline void stepFrame(int direction) {
+        if (!m_pDecoder->stepFrame(direction)) return;
+        if (m_pAudioOutput) m_pAudioOutput->setPaused(true);
+        setPlaying(false);
+    }
+    // 进度条预览缩略图的地址 ms单位毫秒，没有视频流时返回空
+    Q_INVOKABLE QString thumbnailUrl(qint64 ms);
+    // 获取当前播放时间 单位毫秒
+    Q_INVOKABLE inline qint64 getPlayTimeMs() { return m_pDecoder->getPlayTimeMs(); }
+    // 关键帧索引是否已建立完成
+    Q_INVOKABLE inline bool isKeyframeIndexReady() { return m_pDecoder->isKeyframeIndexReady(); }
+    // 获取因落后被丢弃的视频帧数
+    Q_INVOKABLE inline qint64 getDroppedFrames() { return m_pDecoder->getDroppedFrames(); }
+    // 获取晚于显示时间展示的视频帧数
+    Q_INVOKABLE inline qint64 getLateFrames() { return m_pDecoder->getLateFrames(); }
+    // 获取视频解码实际使用的线程数
+    Q_INVOKABLE inline int getDecodeThreadCount() { return m_pDecoder->getVideoDecodeThreads(); }
+    // 获取视频解码实际使用的多线程方式 "frame"、"slice"或"none"
+    Q_INVOKABLE QString getDecodeThreadType();
+    // 获取当前音视频偏差 单位毫秒，为正表示音频超前
+    Q_INVOKABLE inline qint64 getAvDrift() { return m_pDecoder->getAvDrift() / 1000; }
+    // 设置视频缓存上限 maxBytes单位字节，maxMs单位毫秒，为0表示不限制
+    Q_INVOKABLE inline void setVideoBufferLimits(qint64 maxBytes, qint64 maxMs) {
+        m_pDecoder->setVideoBufferLimits({ maxBytes, maxMs * 1000 });
+    }
+    // 设置音频缓存上限 maxBytes单位字节，maxMs单位毫秒，为0表示不限制
+    Q_INVOKABLE inline void setAudioBufferLimits(qint64 maxBytes, qint64 maxMs) {
+        m_pDecoder->setAudioBufferLimits({ maxBytes, maxMs * 1000 });
+    }
+
+    // 播放列表，当前项的位置，及播完最后一项后是否从头循环
+    Q_PROPERTY(QStringList playlist READ playlist NOTIFY playlistChanged)
+    Q_PROPERTY(int currentIndex READ currentIndex NOTIFY currentIndexChanged)
+    Q_PROPERTY(bool loopPlaylist MEMBER m_bLoopPlaylist WRITE setLoopPlaylist NOTIFY loopPlaylistChanged)
+
+    inline QStringList playlist() { return m_playlist; }
+    inline int currentIndex() { return m_nCurrentIndex; }
+    void setLoopPlaylist(bool loop);
+
+    // 音视频解码是否在所有播放器共享的解码线程池中进行，多路同时播放时线程数只随CPU核数增长；从下一次加载的文件开始生效
+    Q_PROPERTY(bool sharedDecode MEMBER m_bSharedDecode WRITE setSharedDecode NOTIFY sharedDecodeChanged)
+    // 在共享解码线程池中的优先级，数值大的先解码；有焦点时提高、不可见时降低
+    Q_PROPERTY(int decodePriority MEMBER m_nDecodePriority WRITE setDecodePriority NOTIFY decodePriorityChanged)
+
+    void setSharedDecode(bool shared);
+    void setDecodePriority(int priority);
+
+    // 快速起播：限制探测的数据量，第一帧不等待音频设备创建，关键帧索引和完整的流参数在开始播放后补全；
+    // 从下一次直接打开的文件开始生效，播放列表中预加载的项始终完整打开
+    Q_PROPERTY(bool fastStart MEMBER m_bFastStart WRITE setFastStart NOTIFY fastStartChanged)
+    // 当前项从开始打开到第一帧送出展示的时间 单位毫秒，尚未展示时为-1
+    Q_PROPERTY(qint64 timeToFirstFrame READ timeToFirstFrame NOTIFY firstFrameShown)
+
+    void setFastStart(bool fastStart);
+    qint64 timeToFirstFrame();
 
     Q_PROPERTY(bool playing MEMBER m_bPlaying WRITE setPlaying NOTIFY playingChange)
 
@@ -34,26 +113,185 @@ public:
 
     void setVolumn(int volumn);
 
+    // 需要CPU转换的帧缩放到显示大小时使用的算法
+    enum ScalingFilter {
+        FastBilinear,
+        Bilinear,
+        Bicubic,
+        Area,
+        Lanczos,
+        Point
+    };
+    Q_ENUM(ScalingFilter)
+
+    Q_PROPERTY(ScalingFilter scalingFilter MEMBER m_scalingFilter WRITE setScalingFilter NOTIFY scalingFilterChanged)
+
+    void setScalingFilter(ScalingFilter filter);
+
+    // 音视频同步的主时钟，没有音频流时使用音频主时钟会自动退回到外部时钟
+    enum SyncMode {
+        AudioMaster = int(SyncMaster::Audio),
+        VideoMaster = int(SyncMaster::Video),
+        ExternalMaster = int(SyncMaster::External)
+    };
+    Q_ENUM(SyncMode)
+
+    Q_PROPERTY(SyncMode syncMode MEMBER m_syncMode WRITE setSyncMode NOTIFY syncModeChanged)
+
+    void setSyncMode(SyncMode mode);
+
+    // 解码跟不上时依次跳过环路滤波、丢弃非参考帧、降低输出分辨率、只解码关键帧，跟上后逐级恢复
+    enum QualityLevel {
+        QualityFull = int(::QualityLevel::Full),
+        QualitySkipLoopFilter = int(::QualityLevel::SkipLoopFilter),
+        QualitySkipNonRef = int(::QualityLevel::SkipNonRef),
+        QualityReducedScale = int(::QualityLevel::ReducedScale),
+        QualityKeyframesOnly = int(::QualityLevel::KeyframesOnly)
+    };
+    Q_ENUM(QualityLevel)
+
+    // 是否自动降低画质，关闭后保持完整画质
+    Q_PROPERTY(bool adaptiveQuality MEMBER m_bAdaptiveQuality WRITE setAdaptiveQuality NOTIFY adaptiveQualityChanged)
+    // 当前项的画质等级
+    Q_PROPERTY(QualityLevel qualityLevel READ qualityLevel NOTIFY qualityLevelChanged)
+
+    void setAdaptiveQuality(bool adaptive);
+    inline QualityLevel qualityLevel() { return static_cast<QualityLevel>(m_pDecoder->getQualityLevel()); }
+
+    // 播放速率，为负表示倒放；不低于8倍速时只展示关键帧，倒放逐帧展示，两者都静音
+    Q_PROPERTY(double playbackRate READ getPlaybackRate WRITE setPlaybackRate NOTIFY playbackRateChanged)
+
+    inline double getPlaybackRate() { return m_pDecoder->getPlaybackRate(); }
+    void setPlaybackRate(double rate);
+
+    // 流水线统计：各阶段（demux、videoQueue、videoDecode、convert、delivery、render等）的
+    // count/meanMs/p50Ms/p99Ms/maxMs，以及帧数、队列状态等计数，每statsInterval毫秒更新一次
+    Q_PROPERTY(QVariantMap stats READ stats NOTIFY statsChanged)
+    // 统计更新间隔 单位毫秒，为0表示不更新
+    Q_PROPERTY(int statsInterval MEMBER m_nStatsInterval WRITE setStatsInterval NOTIFY statsIntervalChanged)
+    // 设置后每次更新统计时将JSON快照写入该文件
+    Q_PROPERTY(QString statsFile MEMBER m_strStatsFile NOTIFY statsFileChanged)
+
+    inline QVariantMap stats() { return m_stats; }
+    void setStatsInterval(int interval);
+    // 获取当前统计的JSON快照
+    Q_INVOKABLE QString getStatsJson();
+    // 清空各阶段的耗时统计
+    Q_INVOKABLE inline void resetStats() { m_pDecoder->metrics().reset(); }
+
 signals:
+    void playlistChanged();
+    void currentIndexChanged();
+    void loopPlaylistChanged();
+    void sharedDecodeChanged();
+    void decodePriorityChanged();
+    void fastStartChanged();
+    // 当前项的第一帧已送到界面
+    void firstFrameShown();
     void playingChange();
     void volumnChanged(int volumn);
+    void scalingFilterChanged();
+    void syncModeChanged();
+    void adaptiveQualityChanged();
+    void qualityLevelChanged();
+    void playbackRateChanged();
+    void statsChanged();
+    void statsIntervalChanged();
+    void statsFileChanged();
+    // 每次更新统计时发出，json为统计快照
+    void statsSnapshot(const QString& json);
 
 protected:
-    void paint(QPainter* painter) override;
+    QSGNode* updatePaintNode(QSGNode* oldNode, UpdatePaintNodeData* data) override;
+    void geometryChange(const QRectF& newGeometry, const QRectF& oldGeometry) override;
+    void itemChange(ItemChange change, const ItemChangeData& value) override;
+
+private:
+    // 用当前帧创建或更新视频节点
+    QSGNode* updateVideoNode(QSGNode* oldNode);
+    // 视频在控件中保持宽高比居中显示的区域
+    QRectF videoRect(int width, int height) const;
+    // 将控件的设备像素大小同步给解码线程
+    void updateOutputSize();
+    // 播放列表中的下一项，没有时返回-1
+    int nextIndex() const;
+    // 创建播放列表第index项，解码器在界面线程创建；fastStart为true时快速起播
+    MediaItem* createItem(int index, bool fastStart = false);
+    // 后台预加载下一项
+    void preloadNext();
+    // 放弃预加载的项
+    void cancelPreload();
+    // 切换到已打开的item并开始播放，旧的项交给加载线程释放
+    void activateItem(MediaItem* item);
+    // 进度条缩略图跟随当前项
+    void attachThumbnails();
+    void detachThumbnails();
+    // 按焦点和可见性调整后的解码优先级
+    int effectiveDecodePriority() const;
+    void updateDecodePriority();
+    // 缩放算法对应的SWS_*标志
+    static int scaleFlags(ScalingFilter filter);
 
 private slots:
-    void onVideoFrameReady(QImage frame);
-    void onAudioFrameReady(QByteArray buffer);
+    void onVideoFrameReady(VideoFramePtr frame, qint64 presentTime);
+    void onStatsTimer();
     void onVolunmChange(int volumn);
+    void onItemLoaded();
+    // 快速起播的项创建了音频设备，接管并按播放状态恢复
+    void onAudioAttached();
+    // 快速起播的项在完整探测后才打开了音频流，为其创建音频设备
+    void onAudioStreamOpened();
+    // 当前项播完且下一项已就绪时切换
+    void onDecoderFinished();
 
 private:
-    Decoder m_decoder;
-    QImage m_image;
+    // 当前播放项及其解码器，未加载文件时为空闲的解码器
+    MediaItem* m_pItem = nullptr;
+    Decoder* m_pDecoder = nullptr;
+    // 正在预加载或已就绪的下一项
+    MediaItem* m_pNextItem = nullptr;
+    bool m_bNextReady = false;
+    MediaLoader m_loader;
+    QStringList m_playlist;
+    int m_nCurrentIndex = -1;
+    bool m_bLoopPlaylist = false;
+    bool m_bUseHardwareDecoder = false;
+    DecodeThreadingMode m_threading = ThreadingAuto;
+    bool m_bSharedDecode = false;
+    int m_nDecodePriority = 0;
+    bool m_bFastStart = false;
+    // 当前项的第一帧是否已送到界面
+    bool m_bFirstFrameShown = false;
+    // 当前显示的帧
+    VideoFramePtr m_frame;
+    // 是否有未提交到场景图的新帧
+    bool m_bFrameDirty = false;
+    // 窗口的垂直同步时刻，渲染线程据此从解码器取帧
+    VsyncEstimator m_vsync;
+    QMetaObject::Connection m_swapConnection;
+    // 窗口所在屏幕变化时重新设置刷新率
+    QMetaObject::Connection m_screenConnection;
+    // 界面线程记录的屏幕刷新率 单位赫兹，渲染线程在updatePaintNode中取走并应用到m_vsync，为0表示没有变化
+    std::atomic<double> m_dRefreshRate = 0;
+    // 场景图使用软件渲染后端，此时由解码线程输出RGBA帧
+    bool m_bSoftwareRender = false;
     bool m_bPlaying = false;
-    QAudioSink* m_pAudioSink = nullptr;
-    QIODevice* m_pAudioDevice = nullptr;
+    // 当前项的音频输出，没有音频流时为空
+    AudioOutput* m_pAudioOutput = nullptr;
     // 音量
     int m_nVolumn = 80;
+    ScalingFilter m_scalingFilter = Bilinear;
+    SyncMode m_syncMode = AudioMaster;
+    bool m_bAdaptiveQuality = true;
+    // 进度条预览缩略图，通过ThumbnailProvider按m_strThumbnailId提供给QML
+    ThumbnailEngine m_thumbnailEngine;
+    QString m_strThumbnailId;
+    // 当前播放的本地文件路径，用于写入媒体索引缓存
+    QString m_strLocalPath;
+    QVariantMap m_stats;
+    QTimer m_statsTimer;
+    int m_nStatsInterval = 1000;
+    QString m_strStatsFile;
 };
 
 #endif // VIDEOPLAYER_H
@@ -0,0 +1,58 @@
+#ifndef VSYNCESTIMATOR_H
+#define VSYNCESTIMATOR_H
+
+#include <QtGlobal>
+#include <cmath>
+
+// 垂直同步周期的默认值，屏幕刷新率未知时使用 单位微秒
+#define DEFAULT_VSYNC_INTERVAL 16667
+// 两次交换间隔超过该值时认为渲染循环停过，只更新相位 单位微秒
+#define VSYNC_IDLE_TIME 1000000
+
+// 垂直同步时刻的估计
+// 渲染线程每次交换缓冲（frameSwapped）时记录时间：交换在垂直同步后返回，两次交换的间隔接近周期的整数倍，
+// 由此平滑估计周期，并由最近一次交换推算下一次垂直同步的时刻。只在渲染线程中使用
+class VsyncEstimator {
+public:
+    VsyncEstimator() {};
+    ~VsyncEstimator() {};
+
+    // 设置屏幕刷新率 单位赫兹，作为周期的初始值
+    inline void setRefreshRate(double hz) {
+        if (hz <= 1.0) return;
+        m_nNominal = qint64(1000000.0 / hz);
+        m_dInterval = double(m_nNominal);
+    }
+
+    // 记录一次交换缓冲 now为系统时间 单位微秒
+    inline void onSwap(qint64 now) {
+        const qint64 delta = now - m_nLastSwap;
+        if (m_nLastSwap > 0 && delta < VSYNC_IDLE_TIME) {
+            // 跨过多个周期（没有重绘的周期）时按周期数折算，偏离整数倍太多的不参与估计
+            const double cycles = std::round(delta / m_dInterval);
+            if (cycles >= 1.0) {
+                const double sample = delta / cycles;
+                if (std::abs(sample - m_nNominal) < m_nNominal / 4) m_dInterval += (sample - m_dInterval) / 16.0;
+            }
+        }
+        m_nLastSwap = now;
+    }
+
+    // 周期 单位微秒
+    inline qint64 interval() const { return qint64(m_dInterval); }
+
+    // now之后下一次垂直同步的时刻，即现在开始渲染的帧显示出来的时间 单位微秒
+    inline qint64 nextVsync(qint64 now) const {
+        if (m_nLastSwap <= 0 || now - m_nLastSwap >= VSYNC_IDLE_TIME) return now + interval();
+        const double cycles = std::floor((now - m_nLastSwap) / m_dInterval) + 1.0;
+        return m_nLastSwap + qint64(cycles * m_dInterval);
+    }
+
+private:
+    qint64 m_nNominal = DEFAULT_VSYNC_INTERVAL;
+    double m_dInterval = DEFAULT_VSYNC_INTERVAL;
+    // 最近一次交换缓冲的时间
+    qint64 m_nLastSwap = 0;
+};
+
+#endif // VSYNCESTIMATOR_H
@@ -0,0 +1,60 @@
+#ifndef WAITEVENT_H
+#define WAITEVENT_H
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <QtGlobal>
+
+// 线程等待事件
+// 没有等待者时notify只做一次原子读，不加锁，适合在热路径上频繁调用
+class WaitEvent {
+public:
+    WaitEvent() {};
+    ~WaitEvent() {};
+
+    // 阻塞直到pred()为真
+    template <typename Pred>
+    inline void wait(Pred pred) {
+        if (pred()) return;
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_nWaiters.fetch_add(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        m_cv.wait(lock, pred);
+        m_nWaiters.fetch_sub(1);
+    }
+
+    // 阻塞直到pred()为真或超时，返回pred()的结果
+    template <typename Pred>
+    inline bool waitFor(Pred pred, qint64 usec) {
+        if (pred()) return true;
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_nWaiters.fetch_add(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        bool ret = m_cv.wait_for(lock, std::chrono::microseconds(usec), pred);
+        m_nWaiters.fetch_sub(1);
+        return ret;
+    }
+
+    // 条件发生变化后调用，唤醒所有等待者
+    inline void notify() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_fnListener) m_fnListener();
+        if (m_nWaiters.load() == 0) return;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_cv.notify_all();
+    }
+
+    // 每次notify时额外调用，用于唤醒线程池中等待同一条件的任务；须在开始notify之前设置
+    inline void setListener(std::function<void()> listener) { m_fnListener = std::move(listener); }
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::atomic<int> m_nWaiters = 0;
+    std::function<void()> m_fnListener;
+};
+
+#endif // WAITEVENT_H
@@ -0,0 +1,293 @@
+#include "yuvToRgb.h"
+#include <algorithm>
+#include <cstdint>
+
+extern "C" {
+#include <libavutil/cpu.h>
+#include <libavutil/pixfmt.h>
+}
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define YUV_SIMD_X86 1
+#include <immintrin.h>
+// GCC、Clang按函数开启指令集，不要求整个工程加-mavx2；MSVC可直接使用intrinsics
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_SSE41 __attribute__((target("sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_SSE41
+#define TARGET_AVX2
+#endif
+#endif
+
+namespace {
+
+// 6位定点的YUV转RGB系数
+// R = (Y - yOffset) * yMul + V * rv
+// G = (Y - yOffset) * yMul - U * gu - V * gv
+// B = (Y - yOffset) * yMul + U * bu
+// U、V已减去128，结果右移6位并截断到[0, 255]；中间结果按16位有符号数饱和运算
+struct Coeffs {
+    int16_t yOffset;
+    int16_t yMul;
+    int16_t rv;
+    int16_t gu;
+    int16_t gv;
+    int16_t bu;
+};
+
+const Coeffs BT601_LIMITED = { 16, 75, 102, 25, 52, 129 };
+const Coeffs BT709_LIMITED = { 16, 75, 115, 14, 34, 135 };
+const Coeffs BT601_FULL = { 0, 64, 90, 22, 46, 113 };
+const Coeffs BT709_FULL = { 0, 64, 101, 12, 30, 119 };
+const Coeffs BT2020_LIMITED = { 16, 75, 107, 12, 42, 137 };
+const Coeffs BT2020_FULL = { 0, 64, 94, 11, 37, 120 };
+
+// 右移前的舍入值
+const int16_t ROUND_BIAS = 32;
+
+const Coeffs& coeffsFor(const AVFrame* frame) {
+    const bool full = frame->color_range == AVCOL_RANGE_JPEG || frame->format == AV_PIX_FMT_YUVJ420P;
+    // BT.2020的恒定亮度与非恒定亮度使用相同的矩阵，与GPU渲染一致
+    if (frame->colorspace == AVCOL_SPC_BT2020_NCL || frame->colorspace == AVCOL_SPC_BT2020_CL) {
+        return full ? BT2020_FULL : BT2020_LIMITED;
+    }
+    // 未标明色彩空间时，高清按BT.709，标清按BT.601，与大多数播放器一致
+    bool bt709 = frame->colorspace == AVCOL_SPC_BT709;
+    if (frame->colorspace == AVCOL_SPC_UNSPECIFIED) bt709 = frame->height >= 720;
+    if (bt709) return full ? BT709_FULL : BT709_LIMITED;
+    return full ? BT601_FULL : BT601_LIMITED;
+}
+
+// 一行的输入，NV12时u为交错的UV平面，v不使用
+struct RowPlanes {
+    const uint8_t* y;
+    const uint8_t* u;
+    const uint8_t* v;
+};
+
+inline int saturate16(int value) {
+    return std::clamp(value, -32768, 32767);
+}
+
+inline uint8_t toPixel(int value) {
+    return uint8_t(std::clamp(saturate16(value) >> 6, 0, 255));
+}
+
+// 逐像素转换[x, width)，SIMD内核处理不了的行尾也由它完成
+template <bool NV12, bool BGRA>
+void rowScalar(const RowPlanes& p, uint8_t* dst, int x, int width, const Coeffs& c) {
+    for (; x < width; ++x) {
+        const int cx = x >> 1;
+        const int u = (NV12 ? p.u[cx * 2] : p.u[cx]) - 128;
+        const int v = (NV12 ? p.u[cx * 2 + 1] : p.v[cx]) - 128;
+        const int y = (p.y[x] - c.yOffset) * c.yMul + ROUND_BIAS;
+        const uint8_t r = toPixel(y + v * c.rv);
+        const uint8_t g = toPixel(y - saturate16(u * c.gu + v * c.gv));
+        const uint8_t b = toPixel(y + u * c.bu);
+        uint8_t* out = dst + x * 4;
+        out[0] = BGRA ? b : r;
+        out[1] = g;
+        out[2] = BGRA ? r : b;
+        out[3] = 255;
+    }
+}
+
+#ifdef YUV_SIMD_X86
+
+// 把四个通道各16字节交错写成16个像素
+TARGET_SSE41 inline void storePixelsSse41(uint8_t* dst, __m128i c0, __m128i c1, __m128i c2, __m128i c3) {
+    const __m128i lo01 = _mm_unpacklo_epi8(c0, c1);
+    const __m128i hi01 = _mm_unpackhi_epi8(c0, c1);
+    const __m128i lo23 = _mm_unpacklo_epi8(c2, c3);
+    const __m128i hi23 = _mm_unpackhi_epi8(c2, c3);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_unpacklo_epi16(lo01, lo23));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 16), _mm_unpackhi_epi16(lo01, lo23));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 32), _mm_unpacklo_epi16(hi01, hi23));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 48), _mm_unpackhi_epi16(hi01, hi23));
+}
+
+// 每次16个像素，返回第一个未处理的像素
+template <bool NV12, bool BGRA>
+TARGET_SSE41 int rowSse41(const RowPlanes& p, uint8_t* dst, int x, int width, const Coeffs& c) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i bias = _mm_set1_epi16(128);
+    const __m128i round = _mm_set1_epi16(ROUND_BIAS);
+    const __m128i yOffset = _mm_set1_epi16(c.yOffset);
+    const __m128i yMul = _mm_set1_epi16(c.yMul);
+    const __m128i rv = _mm_set1_epi16(c.rv);
+    const __m128i gu = _mm_set1_epi16(c.gu);
+    const __m128i gv = _mm_set1_epi16(c.gv);
+    const __m128i bu = _mm_set1_epi16(c.bu);
+    const __m128i alpha = _mm_set1_epi8(-1);
+
+    for (; x + 16 <= width; x += 16) {
+        // 8个色度采样，每个对应两个像素
+        __m128i u, v;
+        if (NV12) {
+            const __m128i uv = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p.u + x));
+            u = _mm_and_si128(uv, _mm_set1_epi16(0x00FF));
+            v = _mm_srli_epi16(uv, 8);
+        } else {
+            u = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p.u + x / 2)));
+            v = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p.v + x / 2)));
+        }
+        u = _mm_sub_epi16(u, bias);
+        v = _mm_sub_epi16(v, bias);
+        const __m128i cr = _mm_mullo_epi16(v, rv);
+        const __m128i cg = _mm_adds_epi16(_mm_mullo_epi16(u, gu), _mm_mullo_epi16(v, gv));
+        const __m128i cb = _mm_mullo_epi16(u, bu);
+
+        const __m128i y8 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p.y + x));
+        __m128i yLo = _mm_unpacklo_epi8(y8, zero);
+        __m128i yHi = _mm_unpackhi_epi8(y8, zero);
+        yLo = _mm_add_epi16(_mm_mullo_epi16(_mm_sub_epi16(yLo, yOffset), yMul), round);
+        yHi = _mm_add_epi16(_mm_mullo_epi16(_mm_sub_epi16(yHi, yOffset), yMul), round);
+
+        const __m128i r = _mm_packus_epi16(
+            _mm_srai_epi16(_mm_adds_epi16(yLo, _mm_unpacklo_epi16(cr, cr)), 6),
+            _mm_srai_epi16(_mm_adds_epi16(yHi, _mm_unpackhi_epi16(cr, cr)), 6));
+        const __m128i g = _mm_packus_epi16(
+            _mm_srai_epi16(_mm_subs_epi16(yLo, _mm_unpacklo_epi16(cg, cg)), 6),
+            _mm_srai_epi16(_mm_subs_epi16(yHi, _mm_unpackhi_epi16(cg, cg)), 6));
+        const __m128i b = _mm_packus_epi16(
+            _mm_srai_epi16(_mm_adds_epi16(yLo, _mm_unpacklo_epi16(cb, cb)), 6),
+            _mm_srai_epi16(_mm_adds_epi16(yHi, _mm_unpackhi_epi16(cb, cb)), 6));
+        storePixelsSse41(dst + x * 4, BGRA ? b : r, g, BGRA ? r : b, alpha);
+    }
+    return x;
+}
+
+// 把四个通道各32字节交错写成32个像素
+// 解包指令在两个128位通道内各自进行，最后用permute2x128恢复像素顺序
+TARGET_AVX2 inline void storePixelsAvx2(uint8_t* dst, __m256i c0, __m256i c1, __m256i c2, __m256i c3) {
+    const __m256i lo01 = _mm256_unpacklo_epi8(c0, c1);
+    const __m256i hi01 = _mm256_unpackhi_epi8(c0, c1);
+    const __m256i lo23 = _mm256_unpacklo_epi8(c2, c3);
+    const __m256i hi23 = _mm256_unpackhi_epi8(c2, c3);
+    // 像素0-3|16-19、4-7|20-23、8-11|24-27、12-15|28-31
+    const __m256i q0 = _mm256_unpacklo_epi16(lo01, lo23);
+    const __m256i q1 = _mm256_unpackhi_epi16(lo01, lo23);
+    const __m256i q2 = _mm256_unpacklo_epi16(hi01, hi23);
+    const __m256i q3 = _mm256_unpackhi_epi16(hi01, hi23);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), _mm256_permute2x128_si256(q0, q1, 0x20));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 32), _mm256_permute2x128_si256(q2, q3, 0x20));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 64), _mm256_permute2x128_si256(q0, q1, 0x31));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 96), _mm256_permute2x128_si256(q2, q3, 0x31));
+}
+
+// 每次32个像素，返回第一个未处理的像素
+template <bool NV12, bool BGRA>
+TARGET_AVX2 int rowAvx2(const RowPlanes& p, uint8_t* dst, int x, int width, const Coeffs& c) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i bias = _mm256_set1_epi16(128);
+    const __m256i round = _mm256_set1_epi16(ROUND_BIAS);
+    const __m256i yOffset = _mm256_set1_epi16(c.yOffset);
+    const __m256i yMul = _mm256_set1_epi16(c.yMul);
+    const __m256i rv = _mm256_set1_epi16(c.rv);
+    const __m256i gu = _mm256_set1_epi16(c.gu);
+    const __m256i gv = _mm256_set1_epi16(c.gv);
+    const __m256i bu = _mm256_set1_epi16(c.bu);
+    const __m256i alpha = _mm256_set1_epi8(-1);
+
+    for (; x + 32 <= width; x += 32) {
+        // 16个色度采样，低128位对应像素0-15，高128位对应像素16-31
+        __m256i u, v;
+        if (NV12) {
+            const __m256i uv = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p.u + x));
+            u = _mm256_and_si256(uv, _mm256_set1_epi16(0x00FF));
+            v = _mm256_srli_epi16(uv, 8);
+        } else {
+            u = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p.u + x / 2)));
+            v = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p.v + x / 2)));
+        }
+        u = _mm256_sub_epi16(u, bias);
+        v = _mm256_sub_epi16(v, bias);
+        const __m256i cr = _mm256_mullo_epi16(v, rv);
+        const __m256i cg = _mm256_adds_epi16(_mm256_mullo_epi16(u, gu), _mm256_mullo_epi16(v, gv));
+        const __m256i cb = _mm256_mullo_epi16(u, bu);
+
+        // yLo为像素0-7|16-23，yHi为像素8-15|24-31，与色度按通道解包后的顺序一致
+        const __m256i y8 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p.y + x));
+        __m256i yLo = _mm256_unpacklo_epi8(y8, zero);
+        __m256i yHi = _mm256_unpackhi_epi8(y8, zero);
+        yLo = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_sub_epi16(yLo, yOffset), yMul), round);
+        yHi = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_sub_epi16(yHi, yOffset), yMul), round);
+
+        const __m256i r = _mm256_packus_epi16(
+            _mm256_srai_epi16(_mm256_adds_epi16(yLo, _mm256_unpacklo_epi16(cr, cr)), 6),
+            _mm256_srai_epi16(_mm256_adds_epi16(yHi, _mm256_unpackhi_epi16(cr, cr)), 6));
+        const __m256i g = _mm256_packus_epi16(
+            _mm256_srai_epi16(_mm256_subs_epi16(yLo, _mm256_unpacklo_epi16(cg, cg)), 6),
+            _mm256_srai_epi16(_mm256_subs_epi16(yHi, _mm256_unpackhi_epi16(cg, cg)), 6));
+        const __m256i b = _mm256_packus_epi16(
+            _mm256_srai_epi16(_mm256_adds_epi16(yLo, _mm256_unpacklo_epi16(cb, cb)), 6),
+            _mm256_srai_epi16(_mm256_adds_epi16(yHi, _mm256_unpackhi_epi16(cb, cb)), 6));
+        storePixelsAvx2(dst + x * 4, BGRA ? b : r, g, BGRA ? r : b, alpha);
+    }
+    return x;
+}
+
+#endif // YUV_SIMD_X86
+
+template <bool NV12, bool BGRA>
+void convertRowsT(const AVFrame* src, AVFrame* dst, int rowStart, int rowEnd, SimdLevel level) {
+    const Coeffs& c = coeffsFor(src);
+    const int width = src->width;
+    for (int row = rowStart; row < rowEnd; ++row) {
+        const int chromaRow = row >> 1;
+        RowPlanes p;
+        p.y = src->data[0] + ptrdiff_t(row) * src->linesize[0];
+        p.u = src->data[1] + ptrdiff_t(chromaRow) * src->linesize[1];
+        p.v = NV12 ? nullptr : src->data[2] + ptrdiff_t(chromaRow) * src->linesize[2];
+        uint8_t* out = dst->data[0] + ptrdiff_t(row) * dst->linesize[0];
+
+        int x = 0;
+#ifdef YUV_SIMD_X86
+        if (level >= SimdLevel::AVX2) x = rowAvx2<NV12, BGRA>(p, out, x, width, c);
+        if (level >= SimdLevel::SSE41) x = rowSse41<NV12, BGRA>(p, out, x, width, c);
+#else
+        (void)level;
+#endif
+        rowScalar<NV12, BGRA>(p, out, x, width, c);
+    }
+}
+
+} // namespace
+
+bool YuvToRgb::supports(int srcFormat, int dstFormat) {
+    const bool srcSupported = srcFormat == AV_PIX_FMT_YUV420P
+        || srcFormat == AV_PIX_FMT_YUVJ420P
+        || srcFormat == AV_PIX_FMT_NV12;
+    return srcSupported && (dstFormat == AV_PIX_FMT_RGBA || dstFormat == AV_PIX_FMT_BGRA);
+}
+
+SimdLevel YuvToRgb::detect() {
+#ifdef YUV_SIMD_X86
+    const int flags = av_get_cpu_flags();
+    if (flags & AV_CPU_FLAG_AVX2) return SimdLevel::AVX2;
+    if (flags & AV_CPU_FLAG_SSE4) return SimdLevel::SSE41;
+#endif
+    return SimdLevel::Scalar;
+}
+
+const char* YuvToRgb::levelName(SimdLevel level) {
+    switch (level) {
+    case SimdLevel::AVX2: return "avx2";
+    case SimdLevel::SSE41: return "sse4.1";
+    default: return "scalar";
+    }
+}
+
+void YuvToRgb::convertRows(const AVFrame* src, AVFrame* dst, int rowStart, int rowEnd, SimdLevel level) {
+    const bool nv12 = src->format == AV_PIX_FMT_NV12;
+    const bool bgra = dst->format == AV_PIX_FMT_BGRA;
+    rowEnd = std::min(rowEnd, src->height);
+    if (nv12) {
+        if (bgra) convertRowsT<true, true>(src, dst, rowStart, rowEnd, level);
+        else convertRowsT<true, false>(src, dst, rowStart, rowEnd, level);
+    } else {
+        if (bgra) convertRowsT<false, true>(src, dst, rowStart, rowEnd, level);
+        else convertRowsT<false, false>(src, dst, rowStart, rowEnd, level);
+    }
+}
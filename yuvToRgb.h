@@ -0,0 +1,30 @@
+#ifndef YUVTORGB_H
+#define YUVTORGB_H
+
+extern "C" {
+#include <libavutil/frame.h>
+}
+
+// 转换使用的指令集
+enum class SimdLevel {
+    Scalar = 0,
+    SSE41,
+    AVX2
+};
+
+// 不缩放的YUV420P/NV12转RGBA/BGRA
+// 每种输入输出格式组合在编译期展开为独立的内核，运行时按CPU支持的指令集选择；
+// 按行区间转换，不同区间可在多个线程中同时转换。系数为6位定点，各指令集的结果完全一致
+class YuvToRgb {
+public:
+    // 是否支持该输入输出格式组合，不支持的由swscale转换
+    static bool supports(int srcFormat, int dstFormat);
+    // CPU支持的最高指令集
+    static SimdLevel detect();
+    static const char* levelName(SimdLevel level);
+
+    // 转换[rowStart, rowEnd)行，rowStart须为偶数；dst的宽高须与src相同且已分配缓冲
+    static void convertRows(const AVFrame* src, AVFrame* dst, int rowStart, int rowEnd, SimdLevel level);
+};
+
+#endif // YUVTORGB_H